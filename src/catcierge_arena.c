@@ -0,0 +1,250 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_arena.h"
+#include "catcierge_log.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_ALIGN_UP(n) (((n) + (ARENA_ALIGN - 1)) & ~((size_t)ARENA_ALIGN - 1))
+#define CHUNK_HEADER_SIZE ARENA_ALIGN_UP(sizeof(catcierge_arena_chunk_t))
+#define CHUNK_DATA(c) ((char *)(c) + CHUNK_HEADER_SIZE)
+
+int catcierge_arena_init(catcierge_arena_t *a, size_t chunk_size)
+{
+	assert(a);
+	memset(a, 0, sizeof(catcierge_arena_t));
+	a->chunk_size = chunk_size ? chunk_size : CATCIERGE_ARENA_DEFAULT_CHUNK_SIZE;
+
+	return 0;
+}
+
+static void catcierge_arena_free_chunks(catcierge_arena_chunk_t *c)
+{
+	catcierge_arena_chunk_t *next = NULL;
+
+	while (c)
+	{
+		next = c->next;
+		free(c);
+		c = next;
+	}
+}
+
+void catcierge_arena_destroy(catcierge_arena_t *a)
+{
+	assert(a);
+
+	catcierge_arena_free_chunks(a->chunks);
+	catcierge_arena_free_chunks(a->free_chunks);
+
+	a->chunks = NULL;
+	a->free_chunks = NULL;
+	a->last = NULL;
+}
+
+static catcierge_arena_chunk_t *catcierge_arena_new_chunk(catcierge_arena_t *a, size_t size)
+{
+	catcierge_arena_chunk_t **prev = &a->free_chunks;
+	catcierge_arena_chunk_t *c = NULL;
+	size_t chunk_size = a->chunk_size ? a->chunk_size : CATCIERGE_ARENA_DEFAULT_CHUNK_SIZE;
+
+	// Reuse a released chunk if one is big enough.
+	for (c = a->free_chunks; c; prev = &c->next, c = c->next)
+	{
+		if (c->size >= size)
+		{
+			*prev = c->next;
+			goto found;
+		}
+	}
+
+	if (size > chunk_size)
+	{
+		chunk_size = size;
+	}
+
+	if (!(c = malloc(CHUNK_HEADER_SIZE + chunk_size)))
+	{
+		CATERR("Out of memory\n"); return NULL;
+	}
+
+	c->size = chunk_size;
+
+found:
+	c->used = 0;
+	c->next = a->chunks;
+	a->chunks = c;
+
+	return c;
+}
+
+void *catcierge_arena_alloc(catcierge_arena_t *a, size_t size)
+{
+	char *p = NULL;
+	catcierge_arena_chunk_t *c = NULL;
+	assert(a);
+
+	size = ARENA_ALIGN_UP(size ? size : 1);
+	c = a->chunks;
+
+	if (!c || ((c->size - c->used) < size))
+	{
+		if (!(c = catcierge_arena_new_chunk(a, size)))
+		{
+			return NULL;
+		}
+	}
+
+	p = CHUNK_DATA(c) + c->used;
+	c->used += size;
+	a->last = p;
+
+	return p;
+}
+
+void *catcierge_arena_realloc(catcierge_arena_t *a, void *ptr,
+			size_t old_size, size_t new_size)
+{
+	char *p = NULL;
+	size_t offset = 0;
+	catcierge_arena_chunk_t *c = NULL;
+	assert(a);
+
+	if (!ptr)
+	{
+		return catcierge_arena_alloc(a, new_size);
+	}
+
+	if (new_size <= old_size)
+	{
+		return ptr;
+	}
+
+	// Nothing has been allocated after ptr, so just bump the end.
+	if (ptr == a->last)
+	{
+		c = a->chunks;
+		offset = (char *)ptr - CHUNK_DATA(c);
+
+		if ((offset + ARENA_ALIGN_UP(new_size)) <= c->size)
+		{
+			c->used = offset + ARENA_ALIGN_UP(new_size);
+			return ptr;
+		}
+	}
+
+	if (!(p = catcierge_arena_alloc(a, new_size)))
+	{
+		return NULL;
+	}
+
+	memcpy(p, ptr, old_size);
+
+	return p;
+}
+
+char *catcierge_arena_strndup(catcierge_arena_t *a, const char *str, size_t len)
+{
+	char *s = NULL;
+	const char *end = NULL;
+	assert(a);
+	assert(str);
+
+	if ((end = memchr(str, '\0', len)))
+	{
+		len = end - str;
+	}
+
+	if (!(s = catcierge_arena_alloc(a, len + 1)))
+	{
+		return NULL;
+	}
+
+	memcpy(s, str, len);
+	s[len] = '\0';
+
+	return s;
+}
+
+char *catcierge_arena_strdup(catcierge_arena_t *a, const char *str)
+{
+	assert(str);
+	return catcierge_arena_strndup(a, str, strlen(str));
+}
+
+catcierge_arena_mark_t catcierge_arena_mark(catcierge_arena_t *a)
+{
+	catcierge_arena_mark_t mark;
+	assert(a);
+
+	mark.chunk = a->chunks;
+	mark.used = a->chunks ? a->chunks->used : 0;
+
+	return mark;
+}
+
+void catcierge_arena_release(catcierge_arena_t *a, catcierge_arena_mark_t mark)
+{
+	catcierge_arena_chunk_t *c = NULL;
+	assert(a);
+
+	// Marks are released in the reverse order they were taken,
+	// so the chunks above the mark are all on top of it.
+	while (a->chunks && (a->chunks != mark.chunk))
+	{
+		c = a->chunks;
+		a->chunks = c->next;
+		c->next = a->free_chunks;
+		a->free_chunks = c;
+	}
+
+	if (a->chunks)
+	{
+		a->chunks->used = mark.used;
+	}
+
+	a->last = NULL;
+}
+
+void catcierge_arena_reset(catcierge_arena_t *a)
+{
+	catcierge_arena_mark_t mark;
+	assert(a);
+
+	memset(&mark, 0, sizeof(mark));
+	catcierge_arena_release(a, mark);
+}
+
+size_t catcierge_arena_capacity(catcierge_arena_t *a)
+{
+	size_t size = 0;
+	catcierge_arena_chunk_t *c = NULL;
+	assert(a);
+
+	for (c = a->chunks; c; c = c->next)
+		size += c->size;
+
+	for (c = a->free_chunks; c; c = c->next)
+		size += c->size;
+
+	return size;
+}
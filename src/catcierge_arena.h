@@ -0,0 +1,79 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_ARENA_H__
+#define __CATCIERGE_ARENA_H__
+
+//
+// Bump allocator for short lived allocations.
+//
+// Memory is handed out from large chunks and is never freed one
+// allocation at a time. Instead everything allocated after a mark is
+// released at once. Released chunks are kept for reuse, so once the
+// arena has grown to fit the largest workload it stops calling malloc.
+//
+
+#include <stddef.h>
+
+#define CATCIERGE_ARENA_DEFAULT_CHUNK_SIZE (16 * 1024)
+
+typedef struct catcierge_arena_chunk_s
+{
+	struct catcierge_arena_chunk_s *next;
+	size_t size;
+	size_t used;
+} catcierge_arena_chunk_t;
+
+typedef struct catcierge_arena_s
+{
+	catcierge_arena_chunk_t *chunks;		// The current chunk first.
+	catcierge_arena_chunk_t *free_chunks;	// Released chunks kept for reuse.
+	size_t chunk_size;
+	char *last;								// The last allocation can grow in place.
+} catcierge_arena_t;
+
+typedef struct catcierge_arena_mark_s
+{
+	catcierge_arena_chunk_t *chunk;
+	size_t used;
+} catcierge_arena_mark_t;
+
+int catcierge_arena_init(catcierge_arena_t *a, size_t chunk_size);
+void catcierge_arena_destroy(catcierge_arena_t *a);
+
+void *catcierge_arena_alloc(catcierge_arena_t *a, size_t size);
+
+// Grows ptr which was allocated with old_size. This is done in place if
+// it is the last allocation, otherwise the contents is copied.
+void *catcierge_arena_realloc(catcierge_arena_t *a, void *ptr,
+			size_t old_size, size_t new_size);
+
+char *catcierge_arena_strdup(catcierge_arena_t *a, const char *str);
+char *catcierge_arena_strndup(catcierge_arena_t *a, const char *str, size_t len);
+
+// Everything allocated after a mark is released together.
+catcierge_arena_mark_t catcierge_arena_mark(catcierge_arena_t *a);
+void catcierge_arena_release(catcierge_arena_t *a, catcierge_arena_mark_t mark);
+
+// Releases all allocations but keeps the memory.
+void catcierge_arena_reset(catcierge_arena_t *a);
+
+// Total size of the chunks owned by the arena.
+size_t catcierge_arena_capacity(catcierge_arena_t *a);
+
+#endif // __CATCIERGE_ARENA_H__
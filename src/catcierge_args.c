@@ -23,6 +23,7 @@
 #include "catcierge_args.h"
 #include "catcierge_output.h"
 #include "catcierge_log.h"
+#include "catcierge_clock.h"
 #ifdef RPI
 #include "catcierge_rpi_args.h"
 #endif
@@ -166,6 +167,17 @@ static int add_presentation_options(cargo_t cargo, catcierge_args_t *args)
 			"Turn off animations in the console.",
 			"b", &args->noanim);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<pres> --log_queue",
+			NULL,
+			"i", &args->log_queue);
+	ret |= cargo_set_option_description(cargo,
+			"--log_queue",
+			"Log lines are written to the console from a separate thread, "
+			"this is the number of lines that can wait for it before they "
+			"are dropped. 0 writes them directly instead. Default %d",
+			DEFAULT_LOG_QUEUE);
+
 	return ret;
 }
 
@@ -272,6 +284,44 @@ static int add_roi_options(cargo_t cargo, catcierge_args_t *args)
 	return ret;
 }
 
+static int add_idle_options(cargo_t cargo, catcierge_args_t *args)
+{
+	int ret = 0;
+
+	ret |= cargo_add_group(cargo, 0, "idle",
+			"Idle settings",
+			"Most of the day nothing is in front of the door. These settings "
+			"lower the frame rate after a while without any change in the "
+			"obstruction Region Of Interest, to save power and keep the CPU cool. "
+			"The full frame rate is used again as soon as anything changes.");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<idle> --idle_after",
+			"Number of seconds without any change while waiting before "
+			"dropping to --idle_fps. Default 0 (off).",
+			"d", &args->idle_after);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<idle> --idle_fps",
+			NULL,
+			"d", &args->idle_fps);
+	ret |= cargo_set_option_description(cargo,
+			"--idle_fps",
+			"Frame rate used when idle. Default %0.1f.", DEFAULT_IDLE_FPS);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<idle> --idle_threshold",
+			NULL,
+			"d", &args->idle_threshold);
+	ret |= cargo_set_option_description(cargo,
+			"--idle_threshold",
+			"How much the mean brightness (0-255) of the obstruction "
+			"Region Of Interest has to change between two frames to "
+			"count as a change. Default %0.1f.", DEFAULT_IDLE_THRESHOLD);
+
+	return ret;
+}
+
 static int add_matcher_options(cargo_t cargo, catcierge_args_t *args)
 {
 	//
@@ -302,12 +352,40 @@ static int add_matcher_options(cargo_t cargo, catcierge_args_t *args)
 			"i", &args->ok_matches_needed);
 	ret |= cargo_set_option_description(cargo,
 			"--ok_matches_needed",
-			"The number of matches out of %d matches "
+			"The number of matches out of --max_matches matches "
 			"that need to be OK for the match to be considered "
-			"an over all OK match.", MATCH_MAX_COUNT);
+			"an over all OK match. Default %d.", DEFAULT_OK_MATCHES_NEEDED);
 	ret |= cargo_add_validation(cargo, 0,
 			"--ok_matches_needed",
-			cargo_validate_int_range(0, MATCH_MAX_COUNT));
+			cargo_validate_int_range(0, MATCH_MAX_COUNT_LIMIT));
+
+	ret |= cargo_add_option(cargo, 0,
+			"<matcher> --max_matches", NULL,
+			"i", &args->max_matches);
+	ret |= cargo_set_option_description(cargo,
+			"--max_matches",
+			"The number of matches to perform before deciding "
+			"the lock status. Default %d.", DEFAULT_MAX_MATCHES);
+	ret |= cargo_add_validation(cargo, 0,
+			"--max_matches",
+			cargo_validate_int_range(1, MATCH_MAX_COUNT_LIMIT));
+
+	ret |= cargo_add_option(cargo, 0,
+			"<matcher> --early_decision",
+			"Stop matching as soon as the outcome of the match group "
+			"can't change, instead of always doing --max_matches matches. "
+			"For instance when --ok_matches_needed matches already are OK.",
+			"b", &args->early_decision);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<matcher> --early_decision_confidence", NULL,
+			"d", &args->early_decision_confidence);
+	ret |= cargo_set_option_description(cargo,
+			"--early_decision_confidence",
+			"Together with --early_decision, also lock out early when "
+			"the chance of reaching --ok_matches_needed (estimated from "
+			"the matches so far) is less than 1 minus this value. "
+			"For example 0.95. Default %0.2f (off).", 0.0);
 
 	ret |= cargo_add_option(cargo, 0,
 			"<matcher> --no_final_decision",
@@ -413,6 +491,38 @@ static int add_output_options(cargo_t cargo, catcierge_args_t *args)
 			"s", &args->template_output_path);
 	ret |= cargo_set_metavar(cargo, "--template_output_path", "PATH");
 
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --output_threads",
+			"Generate the templates and run the commands for events in the "
+			"background using this many threads to render the templates, "
+			"so that slow file writes never delay the state machine. "
+			"The output for each event is still written in order. "
+			"Default 0 (generate the output as soon as the event happens).",
+			"i", &args->output_threads);
+	ret |= cargo_set_metavar(cargo, "--output_threads", "COUNT");
+
+	#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --journal",
+			"Append a fixed size binary record for each match group to this "
+			"journal file, with the decision, scores, rects, directions and "
+			"image paths. A sparse time index is kept in PATH.idx. "
+			"Use catcierge_journal to query it.",
+			"s", &args->journal_path);
+	ret |= cargo_set_metavar(cargo, "--journal", "PATH");
+	#endif
+
+	#ifdef CATCIERGE_HAVE_DLFCN_H
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --plugin",
+			"Shared object to load as an event handler plugin, optionally "
+			"followed by a space and an argument for the plugin. "
+			"Plugins are called directly for the events they handle "
+			"instead of running a command. See catcierge_plugin.h.",
+			"[s]+", &args->plugins, &args->plugin_count);
+	ret |= cargo_set_metavar(cargo, "--plugin", "\"PATH [ARG]\" [\"PATH [ARG]\" ...]");
+	#endif
+
 	#ifdef WITH_ZMQ
 	ret |= cargo_add_option(cargo, 0,
 			"<output> --zmq",
@@ -447,6 +557,99 @@ static int add_output_options(cargo_t cargo, catcierge_args_t *args)
 			"The ZMQ transport to use. Default %s",
 			DEFAULT_ZMQ_TRANSPORT);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --zmq_cbor",
+			"Also publish every event as CBOR encoded match group data "
+			"on the topic 'cbor/<event>'. This is much cheaper for "
+			"subscribers to decode than the JSON templates.",
+			"b", &args->zmq_cbor);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --zmq_images",
+			"Publish the saved images of each match group on the topic "
+			"'images/match_group_done'. The message has an index frame "
+			"followed by one frame per PNG image. (--save must be turned on)",
+			"b", &args->zmq_images);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --zmq_hwm",
+			NULL,
+			"i", &args->zmq_hwm);
+	ret |= cargo_set_option_description(cargo,
+			"--zmq_hwm",
+			"The number of messages queued for each subscriber before "
+			"new messages to it are dropped (ZMQ_SNDHWM). Default %d",
+			DEFAULT_ZMQ_HWM);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --zmq_queue",
+			NULL,
+			"i", &args->zmq_queue);
+	ret |= cargo_set_option_description(cargo,
+			"--zmq_queue",
+			"Messages are published from a separate thread, this is the "
+			"number of messages that can wait for it before they are "
+			"dropped. Default %d",
+			DEFAULT_ZMQ_QUEUE);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --zmq_conflate",
+			"Only publish the newest of the waiting messages for topics "
+			"starting with any of these, such as \"cbor/state_change\".",
+			"[s]+", &args->zmq_conflate, &args->zmq_conflate_count);
+	ret |= cargo_set_metavar(cargo, "--zmq_conflate", "TOPIC [TOPIC ...]");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --preview",
+			"Publish a live JPEG preview of the camera on the topic "
+			"'preview' using a separate ZMQ socket. "
+			"Frames are only encoded while someone is subscribed.",
+			"b", &args->preview);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --preview_port",
+			NULL,
+			"i", &args->preview_port);
+	ret |= cargo_set_option_description(cargo,
+			"--preview_port",
+			"The TCP port that the preview publisher listens on. Default %d",
+			DEFAULT_PREVIEW_PORT);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --preview_fps",
+			NULL,
+			"d", &args->preview_fps);
+	ret |= cargo_set_option_description(cargo,
+			"--preview_fps",
+			"The maximum frame rate of the preview. Frames are dropped "
+			"if the encoding can't keep up. Default %0.1f",
+			DEFAULT_PREVIEW_FPS);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --preview_quality",
+			NULL,
+			"i", &args->preview_quality);
+	ret |= cargo_set_option_description(cargo,
+			"--preview_quality",
+			"The JPEG quality of the preview (0-100). Default %d",
+			DEFAULT_PREVIEW_QUALITY);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --control",
+			"Listen for commands on a ZMQ ROUTER socket. Send a REQ with "
+			"ping, state, lock, unlock, ignore, attention, stats, "
+			"history [N] or snapshot to get a JSON reply.",
+			"b", &args->control);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<output> --control_port",
+			NULL,
+			"i", &args->control_port);
+	ret |= cargo_set_option_description(cargo,
+			"--control_port",
+			"The TCP port that the control channel listens on. Default %d",
+			DEFAULT_CONTROL_PORT);
+
 	#endif // WITH_ZMQ
 
 	return ret;
@@ -472,6 +675,19 @@ int add_rfid_options(cargo_t cargo, catcierge_args_t *args)
 			"Path to the outter RFID reader.",
 			"s", &args->rfid_outer_path);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<rfid> --rfid",
+			"Named RFID readers, for doors with more than two antennas. "
+			"Given as NAME=PATH, in order from the inside of the door "
+			"to the outside. The direction of the cat is decided by which "
+			"reader detects it first. --rfid_in is placed first and "
+			"--rfid_out last.\n"
+			"Example: --rfid inner=/dev/ttyUSB0 mid=/dev/ttyUSB1 outer=/dev/ttyUSB2",
+			"[s]+", &args->rfid_readers, &args->rfid_reader_count);
+	ret |= cargo_set_metavar(cargo,
+			"--rfid",
+			"NAME=PATH [NAME=PATH ...]");
+
 	ret |= cargo_add_option(cargo, 0,
 			"<rfid> --rfid_lock",
 			"Lock if no RFID tag present or invalid RFID tag. Default OFF.",
@@ -494,6 +710,14 @@ int add_rfid_options(cargo_t cargo, catcierge_args_t *args)
 			"A comma separated list of allowed RFID tags. Example: %s",
 			EXAMPLE_RFID_STR);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<rfid> --rfid_allowed_file",
+			"File with allowed RFID tags, added to the ones in --rfid_allowed. "
+			"Tags are separated by whitespace or commas and # starts a comment. "
+			"The file is read again by the reload_rfid signal behavior "
+			"(see --sigusr1) and control command.",
+			"s", &args->rfid_allowed_file);
+
 	return ret;
 }
 #endif // WITH_RFID
@@ -518,6 +742,28 @@ static int add_command_options(cargo_t cargo, catcierge_args_t *args)
 			"Shows command output variable help.",
 			"b", &args->show_cmd_help);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<cmd> --cmd_max_running",
+			"The max number of commands that are allowed to run at the same "
+			"time. Commands for events beyond this wait for a running "
+			"command to finish.",
+			"i", &args->cmd_max_running);
+	ret |= cargo_set_metavar(cargo, "--cmd_max_running", "COUNT");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<cmd> --cmd_max_queued",
+			"The max number of commands waiting to run. Commands for events "
+			"beyond this are dropped.",
+			"i", &args->cmd_max_queued);
+	ret |= cargo_set_metavar(cargo, "--cmd_max_queued", "COUNT");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<cmd> --cmd_timeout",
+			"Kill commands that run for longer than this many seconds. "
+			"Default 0 (never).",
+			"d", &args->cmd_timeout);
+	ret |= cargo_set_metavar(cargo, "--cmd_timeout", "SECONDS");
+
 	ret |= cargo_add_group(cargo, CARGO_GROUP_HIDE, 
 			"cmd_help", "Advanced command settings", 
 			"These are commands that will be executed when certain events "
@@ -639,7 +885,7 @@ static int parse_base_time(cargo_t ctx, void *user, const char *optname,
 		goto fail;
 	}
 
-	gettimeofday(&base_time_now, NULL);
+	catcierge_clock_gettimeofday(&base_time_now);
 	args->base_time_diff = base_time_now.tv_sec - base_time_t;
 
 	return 0;
@@ -744,6 +990,7 @@ static int add_options(cargo_t cargo, catcierge_args_t *args)
 			"i", &args->camera_index);
 
 	ret |= add_roi_options(cargo, args);
+	ret |= add_idle_options(cargo, args);
 	ret |= add_matcher_options(cargo, args);
 	ret |= add_lockout_options(cargo, args);
 	#ifdef RPI
@@ -833,8 +1080,14 @@ void catcierge_args_init_vars(catcierge_args_t *args)
 	args->lockout_time = DEFAULT_LOCKOUT_TIME;
 	args->consecutive_lockout_delay = DEFAULT_CONSECUTIVE_LOCKOUT_DELAY;
 	args->ok_matches_needed = DEFAULT_OK_MATCHES_NEEDED;
+	args->max_matches = DEFAULT_MAX_MATCHES;
+	args->idle_fps = DEFAULT_IDLE_FPS;
+	args->idle_threshold = DEFAULT_IDLE_THRESHOLD;
 	args->output_path = strdup(".");
 	args->min_backlight = DEFAULT_MIN_BACKLIGHT;
+	args->cmd_max_running = DEFAULT_CMD_MAX_RUNNING;
+	args->cmd_max_queued = DEFAULT_CMD_MAX_QUEUED;
+	args->log_queue = DEFAULT_LOG_QUEUE;
 
 	#ifdef RPI
 	{
@@ -860,6 +1113,12 @@ void catcierge_args_init_vars(catcierge_args_t *args)
 	args->zmq_port = DEFAULT_ZMQ_PORT;
 	args->zmq_iface = strdup(DEFAULT_ZMQ_IFACE);
 	args->zmq_transport = strdup(DEFAULT_ZMQ_TRANSPORT);
+	args->zmq_hwm = DEFAULT_ZMQ_HWM;
+	args->zmq_queue = DEFAULT_ZMQ_QUEUE;
+	args->preview_port = DEFAULT_PREVIEW_PORT;
+	args->preview_fps = DEFAULT_PREVIEW_FPS;
+	args->preview_quality = DEFAULT_PREVIEW_QUALITY;
+	args->control_port = DEFAULT_CONTROL_PORT;
 	#endif
 }
 
@@ -874,10 +1133,12 @@ void catcierge_args_destroy_vars(catcierge_args_t *args)
 	catcierge_xfree(&args->steps_output_path);
 	catcierge_xfree(&args->obstruct_output_path);
 	catcierge_xfree(&args->template_output_path);
+	catcierge_xfree(&args->journal_path);
 
 	#ifdef WITH_ZMQ
 	catcierge_xfree(&args->zmq_iface);
 	catcierge_xfree(&args->zmq_transport);
+	catcierge_xfree_list(&args->zmq_conflate, &args->zmq_conflate_count);
 	#endif
 
 	for (i = 0; i < args->input_count; i++)
@@ -888,6 +1149,8 @@ void catcierge_args_destroy_vars(catcierge_args_t *args)
 	args->input_count = 0;
 	catcierge_xfree(&args->inputs);
 
+	catcierge_xfree_list(&args->plugins, &args->plugin_count);
+
 	catcierge_xfree(&args->log_path);
 
 	#define CATCIERGE_DEFINE_EVENT(ev_enum_name, ev_name, ev_description) 		\
@@ -916,6 +1179,8 @@ void catcierge_args_destroy_vars(catcierge_args_t *args)
 	catcierge_free_list(args->rfid_allowed, args->rfid_allowed_count);
 	args->rfid_allowed_count = 0;
 	args->rfid_allowed = NULL;
+	catcierge_xfree(&args->rfid_allowed_file);
+	catcierge_xfree_list(&args->rfid_readers, &args->rfid_reader_count);
 	#endif // WITH_RFID
 
 	catcierge_haar_matcher_args_destroy(&args->haar);
@@ -955,6 +1220,9 @@ int catcierge_args_init(catcierge_args_t *args, const char *progname)
 int catcierge_args_parse(catcierge_args_t *args, int argc, char **argv)
 {
 	int ret = 0;
+	#ifdef WITH_RFID
+	size_t i;
+	#endif
 	cargo_t cargo = args->cargo;
 	assert(args);
 
@@ -1036,6 +1304,102 @@ int catcierge_args_parse(catcierge_args_t *args, int argc, char **argv)
 		ret = -1; goto fail;
 	}
 
+	if (args->log_queue < 0)
+	{
+		CATERR("--log_queue can't be negative\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->ok_matches_needed > args->max_matches)
+	{
+		CATERR("--ok_matches_needed %d can't be larger than --max_matches %d\n",
+			args->ok_matches_needed, args->max_matches);
+		ret = -1; goto fail;
+	}
+
+	if ((args->idle_after > 0.0) && (args->idle_fps <= 0.0))
+	{
+		CATERR("--idle_fps must be larger than 0\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->output_threads < 0)
+	{
+		CATERR("--output_threads can't be negative\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->cmd_max_running < 1)
+	{
+		CATERR("--cmd_max_running must be at least 1\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->cmd_max_queued < 0)
+	{
+		CATERR("--cmd_max_queued can't be negative\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->cmd_timeout < 0.0)
+	{
+		CATERR("--cmd_timeout can't be negative\n");
+		ret = -1; goto fail;
+	}
+
+	#ifdef WITH_RFID
+	for (i = 0; i < args->rfid_reader_count; i++)
+	{
+		char *sep = strchr(args->rfid_readers[i], '=');
+
+		if (!sep || (sep == args->rfid_readers[i]) || !sep[1])
+		{
+			CATERR("Invalid RFID reader \"%s\", expected NAME=PATH\n",
+				args->rfid_readers[i]);
+			ret = -1; goto fail;
+		}
+	}
+	#endif // WITH_RFID
+
+	#ifdef WITH_ZMQ
+	if (args->zmq_images && !args->saveimg)
+	{
+		CATERR("--zmq_images needs --save\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->zmq_hwm < 0)
+	{
+		CATERR("--zmq_hwm can't be negative\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->zmq_queue <= 0)
+	{
+		CATERR("--zmq_queue must be larger than 0\n");
+		ret = -1; goto fail;
+	}
+
+	if (args->preview_fps <= 0.0)
+	{
+		CATERR("--preview_fps must be larger than 0\n");
+		ret = -1; goto fail;
+	}
+
+	if ((args->preview_quality < 0) || (args->preview_quality > 100))
+	{
+		CATERR("--preview_quality must be between 0 and 100\n");
+		ret = -1; goto fail;
+	}
+	#endif
+
+	if ((args->early_decision_confidence < 0.0)
+	 || (args->early_decision_confidence > 1.0))
+	{
+		CATERR("--early_decision_confidence must be between 0.0 and 1.0\n");
+		ret = -1; goto fail;
+	}
+
 	if (args->show_cmd_help)
 	{
 		print_cmd_help(cargo, args);
@@ -1066,15 +1430,20 @@ fail:
 
 void catcierge_print_settings(catcierge_args_t *args)
 {
-	#ifdef WITH_RFID
 	size_t i;
-	#endif
 
 	print_line(stdout, 80, "-");
 	printf("Settings:\n");
 	print_line(stdout, 80, "-");
 	printf("General:\n");
 	printf("       Startup delay: %0.1f seconds\n", args->startup_delay);
+	printf("          Idle after: %0.1f seconds %s\n", args->idle_after,
+							(args->idle_after <= 0.0) ? "(off)" : "");
+	if (args->idle_after > 0.0)
+	{
+	printf("            Idle FPS: %0.1f\n", args->idle_fps);
+	printf("      Idle threshold: %0.1f\n", args->idle_threshold);
+	}
 	printf("            Auto ROI: %d\n", args->auto_roi);
 	if (args->auto_roi)
 	{
@@ -1096,7 +1465,12 @@ void catcierge_print_settings(catcierge_args_t *args)
 	printf("            Log file: %s\n", args->log_path ? args->log_path : "-");
 	printf("            No color: %d\n", args->nocolor);
 	printf("        No animation: %d\n", args->noanim);
+	printf("           Log queue: %d\n", args->log_queue);
 	printf("   Ok matches needed: %d\n", args->ok_matches_needed);
+	printf("         Max matches: %d\n", args->max_matches);
+	printf("      Early decision: %d\n", args->early_decision);
+	if (args->early_decision && (args->early_decision_confidence > 0.0))
+	printf("  Early dec. confid.: %0.2f\n", args->early_decision_confidence);
 	printf("         Output path: %s\n", args->output_path);
 	if (args->match_output_path && strcmp(args->output_path, args->match_output_path))
 	printf("   Match output path: %s\n", args->match_output_path);
@@ -1106,11 +1480,32 @@ void catcierge_print_settings(catcierge_args_t *args)
 	printf("Obstruct output path: %s\n", args->obstruct_output_path);
 	if (args->template_output_path && strcmp(args->output_path, args->template_output_path))
 	printf("Template output path: %s\n", args->template_output_path);
+	printf("      Output threads: %d\n", args->output_threads);
+	#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+	printf("             Journal: %s\n", args->journal_path ? args->journal_path : "-");
+	#endif
+	for (i = 0; i < args->plugin_count; i++)
+	printf("              Plugin: %s\n", args->plugins[i]);
+	printf("    Max running cmds: %d\n", args->cmd_max_running);
+	printf("     Max queued cmds: %d\n", args->cmd_max_queued);
+	printf("         Cmd timeout: %0.2f\n", args->cmd_timeout);
 	#ifdef WITH_ZMQ
 	printf("       ZMQ publisher: %d\n", args->zmq);
 	printf("            ZMQ port: %d\n", args->zmq_port);
 	printf("       ZMQ interface: %s\n", args->zmq_iface);
 	printf("       ZMQ transport: %s\n", args->zmq_transport);
+	printf("            ZMQ CBOR: %d\n", args->zmq_cbor);
+	printf("          ZMQ images: %d\n", args->zmq_images);
+	printf("             ZMQ HWM: %d\n", args->zmq_hwm);
+	printf("           ZMQ queue: %d\n", args->zmq_queue);
+	for (i = 0; i < args->zmq_conflate_count; i++)
+	printf("        ZMQ conflate: %s\n", args->zmq_conflate[i]);
+	printf("             Preview: %d\n", args->preview);
+	printf("        Preview port: %d\n", args->preview_port);
+	printf("         Preview fps: %0.1f\n", args->preview_fps);
+	printf("     Preview quality: %d\n", args->preview_quality);
+	printf("     Control channel: %d\n", args->control);
+	printf("        Control port: %d\n", args->control_port);
 	#endif // WITH_ZMQ
 	printf("\n"); 
 	if (args->matcher_type == MATCHER_TEMPLATE)
@@ -1127,6 +1522,10 @@ void catcierge_print_settings(catcierge_args_t *args)
 	printf("RFID:\n");
 	printf("          Inner RFID: %s\n", args->rfid_inner_path ? args->rfid_inner_path : "-");
 	printf("          Outer RFID: %s\n", args->rfid_outer_path ? args->rfid_outer_path : "-");
+	for (i = 0; i < args->rfid_reader_count; i++)
+	{
+		printf("         RFID reader: %s\n", args->rfid_readers[i]);
+	}
 	printf("     Lock on no RFID: %d\n", args->lock_on_invalid_rfid);
 	printf("      RFID lock time: %.2f seconds\n", args->rfid_lock_time);
 	printf("        Allowed RFID: %s\n", (args->rfid_allowed_count <= 0) ? "-" : args->rfid_allowed[0]);
@@ -1134,6 +1533,7 @@ void catcierge_print_settings(catcierge_args_t *args)
 	{
 		printf("                 %s\n", args->rfid_allowed[i]);
 	}
+	printf("   Allowed RFID file: %s\n", args->rfid_allowed_file ? args->rfid_allowed_file : "-");
 	#endif // WITH_RFID
 	print_line(stdout, 80, "-");
 }
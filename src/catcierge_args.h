@@ -37,11 +37,23 @@
 #define DEFAULT_CONSECUTIVE_LOCKOUT_DELAY 3.0 // The time in seconds between lockouts that is considered consecutive.
 #define MAX_TEMP_CONFIG_VALUES 128
 #define DEFAULT_OK_MATCHES_NEEDED 2
+#define DEFAULT_MAX_MATCHES MATCH_MAX_COUNT
+#define DEFAULT_IDLE_FPS 2.0
+#define DEFAULT_IDLE_THRESHOLD 3.0
+#define DEFAULT_CMD_MAX_RUNNING 4
+#define DEFAULT_CMD_MAX_QUEUED 32
+#define DEFAULT_LOG_QUEUE 1024
 #define MAX_INPUT_TEMPLATES 32
 #ifdef WITH_ZMQ
 #define DEFAULT_ZMQ_PORT 5556
 #define DEFAULT_ZMQ_IFACE "*"
 #define DEFAULT_ZMQ_TRANSPORT "tcp"
+#define DEFAULT_ZMQ_HWM 1000
+#define DEFAULT_ZMQ_QUEUE 256
+#define DEFAULT_PREVIEW_PORT 5557
+#define DEFAULT_PREVIEW_FPS 2.0
+#define DEFAULT_PREVIEW_QUALITY 70
+#define DEFAULT_CONTROL_PORT 5558
 #endif // WITH_ZMQ
 
 typedef struct catcierge_args_s
@@ -72,6 +84,9 @@ typedef struct catcierge_args_s
 	char *obstruct_output_path;
 	char *template_output_path;
 	int ok_matches_needed;
+	int max_matches;
+	int early_decision;
+	double early_decision_confidence;
 	int save_steps;
 	int no_final_decision;
 
@@ -90,14 +105,23 @@ typedef struct catcierge_args_s
 	char **user_vars;
 	size_t user_var_count;
 
+	int cmd_max_running;
+	int cmd_max_queued;
+	double cmd_timeout;
+
 	char *config_path;
 	char *chuid;
 	int temp_config_count;
 	char *temp_config_values[MAX_TEMP_CONFIG_VALUES];
 	int nocolor;
 	int noanim;
+	int log_queue;
 	char **inputs;
 	size_t input_count;
+	char **plugins;
+	size_t plugin_count;
+	int output_threads;
+	char *journal_path;
 	CvRect roi;
 	int auto_roi;
 	int auto_roi_thr;
@@ -107,6 +131,10 @@ typedef struct catcierge_args_s
 	double startup_delay;
 	int no_default_config;
 
+	double idle_after;
+	double idle_fps;
+	double idle_threshold;
+
 	char *base_time;
 	long base_time_diff;
 
@@ -117,6 +145,9 @@ typedef struct catcierge_args_s
 	int lock_on_invalid_rfid;
 	char **rfid_allowed;
 	size_t rfid_allowed_count;
+	char *rfid_allowed_file;
+	char **rfid_readers;		// NAME=PATH, from the inside to the outside.
+	size_t rfid_reader_count;
 	#endif // WITH_RFID
 
 	int lockout_gpio_pin;
@@ -142,6 +173,18 @@ typedef struct catcierge_args_s
 	int zmq_port;
 	char *zmq_iface;
 	char *zmq_transport;
+	int zmq_cbor;
+	int zmq_images;
+	int zmq_hwm;
+	int zmq_queue;
+	char **zmq_conflate;
+	size_t zmq_conflate_count;
+	int preview;
+	int preview_port;
+	double preview_fps;
+	int preview_quality;
+	int control;
+	int control_port;
 	#endif // WITH_ZMQ
 } catcierge_args_t;
 
@@ -0,0 +1,391 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_bus.h"
+#include "catcierge_log.h"
+
+// The last bit is reserved for CATCIERGE_EVENT_ALL_BIT.
+typedef char catcierge_bus_event_count_check[(CATCIERGE_EVENT_COUNT < 31) ? 1 : -1];
+
+static const char *catcierge_event_names[] =
+{
+	#define CATCIERGE_DEFINE_EVENT(ev_enum_name, ev_name, ev_description) \
+		#ev_name,
+	#include "catcierge_events.h"
+};
+
+static const char *catcierge_subscriber_kind_names[] =
+{
+	"templates",
+	"zmq",
+	"commands",
+	"metrics",
+	"plugin",
+	"journal"
+};
+
+const char *catcierge_event_name(catcierge_event_t e)
+{
+	if ((e < 0) || (e >= CATCIERGE_EVENT_COUNT))
+	{
+		return "unknown";
+	}
+
+	return catcierge_event_names[e];
+}
+
+int catcierge_event_from_name(const char *name)
+{
+	int i;
+	assert(name);
+
+	for (i = 0; i < CATCIERGE_EVENT_COUNT; i++)
+	{
+		if (!strcmp(catcierge_event_names[i], name))
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+uint32_t catcierge_event_filter_mask(const char *filter)
+{
+	int e;
+	assert(filter);
+
+	if (!strcmp(filter, "all") || !strcmp(filter, "*"))
+	{
+		return CATCIERGE_EVENT_MASK_ALL;
+	}
+
+	if ((e = catcierge_event_from_name(filter)) < 0)
+	{
+		return 0;
+	}
+
+	return CATCIERGE_EVENT_BIT(e);
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+static void *catcierge_bus_subscriber_main(void *arg)
+{
+	catcierge_bus_subscriber_t *sub = (catcierge_bus_subscriber_t *)arg;
+	catcierge_event_data_t ev;
+
+	pthread_mutex_lock(&sub->lock);
+
+	while (1)
+	{
+		while (!sub->queue_count && !sub->stop)
+		{
+			pthread_cond_wait(&sub->cond, &sub->lock);
+		}
+
+		// The queue is drained before stopping.
+		if (!sub->queue_count)
+		{
+			break;
+		}
+
+		ev = sub->queue[sub->queue_head];
+		sub->queue_head = (sub->queue_head + 1) % sub->queue_size;
+		sub->queue_count--;
+		sub->busy = 1;
+		pthread_cond_broadcast(&sub->space_cond);
+		pthread_mutex_unlock(&sub->lock);
+
+		sub->handler(&ev, sub->user);
+
+		pthread_mutex_lock(&sub->lock);
+		sub->busy = 0;
+		sub->delivered++;
+		pthread_cond_broadcast(&sub->space_cond);
+	}
+
+	pthread_mutex_unlock(&sub->lock);
+
+	return NULL;
+}
+
+static void catcierge_bus_enqueue(catcierge_bus_subscriber_t *sub,
+		const catcierge_event_data_t *ev)
+{
+	pthread_mutex_lock(&sub->lock);
+
+	if (sub->queue_count == sub->queue_size)
+	{
+		switch (sub->policy)
+		{
+			case CATCIERGE_BUS_BLOCK:
+				while (sub->queue_count == sub->queue_size)
+				{
+					pthread_cond_wait(&sub->space_cond, &sub->lock);
+				}
+				break;
+			case CATCIERGE_BUS_DROP_NEWEST:
+				sub->dropped++;
+				pthread_mutex_unlock(&sub->lock);
+				return;
+			case CATCIERGE_BUS_DROP_OLDEST:
+				sub->queue_head = (sub->queue_head + 1) % sub->queue_size;
+				sub->queue_count--;
+				sub->dropped++;
+				break;
+		}
+	}
+
+	sub->queue[(sub->queue_head + sub->queue_count) % sub->queue_size] = *ev;
+	sub->queue_count++;
+	pthread_cond_signal(&sub->cond);
+
+	pthread_mutex_unlock(&sub->lock);
+}
+
+static int catcierge_bus_start_subscriber(catcierge_bus_subscriber_t *sub,
+		size_t queue_size, catcierge_bus_policy_t policy)
+{
+	if (!(sub->queue = calloc(queue_size, sizeof(catcierge_event_data_t))))
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	sub->queue_size = queue_size;
+	sub->policy = policy;
+
+	pthread_mutex_init(&sub->lock, NULL);
+	pthread_cond_init(&sub->cond, NULL);
+	pthread_cond_init(&sub->space_cond, NULL);
+
+	if (pthread_create(&sub->thread, NULL, catcierge_bus_subscriber_main, sub))
+	{
+		CATERR("Failed to create thread for event subscriber %s\n", sub->name);
+		pthread_mutex_destroy(&sub->lock);
+		pthread_cond_destroy(&sub->cond);
+		pthread_cond_destroy(&sub->space_cond);
+		free(sub->queue);
+		sub->queue = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void catcierge_bus_stop_subscriber(catcierge_bus_subscriber_t *sub)
+{
+	pthread_mutex_lock(&sub->lock);
+	sub->stop = 1;
+	pthread_cond_broadcast(&sub->cond);
+	pthread_mutex_unlock(&sub->lock);
+
+	pthread_join(sub->thread, NULL);
+
+	pthread_mutex_destroy(&sub->lock);
+	pthread_cond_destroy(&sub->cond);
+	pthread_cond_destroy(&sub->space_cond);
+	free(sub->queue);
+	sub->queue = NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int catcierge_bus_init(catcierge_bus_t *bus)
+{
+	assert(bus);
+	memset(bus, 0, sizeof(catcierge_bus_t));
+
+	return 0;
+}
+
+void catcierge_bus_destroy(catcierge_bus_t *bus)
+{
+	assert(bus);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	size_t i;
+
+	for (i = 0; i < bus->subscriber_count; i++)
+	{
+		if (bus->subscribers[i].queue)
+		{
+			catcierge_bus_stop_subscriber(&bus->subscribers[i]);
+		}
+	}
+	#endif
+
+	memset(bus, 0, sizeof(catcierge_bus_t));
+}
+
+int catcierge_bus_subscribe(catcierge_bus_t *bus, const char *name,
+		catcierge_subscriber_kind_t kind, uint32_t events,
+		catcierge_bus_handler_f handler, void *user,
+		size_t queue_size, catcierge_bus_policy_t policy)
+{
+	int id;
+	catcierge_bus_subscriber_t *sub = NULL;
+	assert(bus);
+	assert(name);
+	assert(handler);
+
+	if (bus->subscriber_count >= CATCIERGE_BUS_MAX_SUBSCRIBERS)
+	{
+		CATERR("Too many event subscribers, max %d\n", CATCIERGE_BUS_MAX_SUBSCRIBERS);
+		return -1;
+	}
+
+	id = (int)bus->subscriber_count;
+	sub = &bus->subscribers[id];
+	memset(sub, 0, sizeof(catcierge_bus_subscriber_t));
+
+	sub->name = name;
+	sub->kind = kind;
+	sub->handler = handler;
+	sub->user = user;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (queue_size && catcierge_bus_start_subscriber(sub, queue_size, policy))
+	{
+		return -1;
+	}
+	#endif
+
+	bus->subscriber_count++;
+
+	catcierge_bus_set_events(bus, id, events);
+
+	return id;
+}
+
+int catcierge_bus_set_events(catcierge_bus_t *bus, int id, uint32_t events)
+{
+	int e;
+	assert(bus);
+
+	if ((id < 0) || ((size_t)id >= bus->subscriber_count))
+	{
+		CATERR("Invalid event subscriber %d\n", id);
+		return -1;
+	}
+
+	bus->subscribers[id].events = events;
+
+	for (e = 0; e < CATCIERGE_EVENT_COUNT; e++)
+	{
+		if (events & CATCIERGE_EVENT_BIT(e))
+		{
+			bus->subscriptions[e] |= CATCIERGE_EVENT_BIT(id);
+		}
+		else
+		{
+			bus->subscriptions[e] &= ~CATCIERGE_EVENT_BIT(id);
+		}
+	}
+
+	return 0;
+}
+
+void catcierge_bus_publish(catcierge_bus_t *bus, const catcierge_event_data_t *ev)
+{
+	size_t i;
+	uint32_t subscribers;
+	catcierge_bus_subscriber_t *sub = NULL;
+	assert(bus);
+	assert(ev);
+	assert((ev->type >= 0) && (ev->type < CATCIERGE_EVENT_COUNT));
+
+	bus->published[ev->type]++;
+
+	for (i = 0, subscribers = bus->subscriptions[ev->type];
+		subscribers;
+		i++, subscribers >>= 1)
+	{
+		if (!(subscribers & 1))
+		{
+			continue;
+		}
+
+		sub = &bus->subscribers[i];
+
+		#ifdef CATCIERGE_HAVE_PTHREADS
+		if (sub->queue)
+		{
+			catcierge_bus_enqueue(sub, ev);
+			continue;
+		}
+		#endif
+
+		sub->handler(ev, sub->user);
+		sub->delivered++;
+	}
+}
+
+void catcierge_bus_flush(catcierge_bus_t *bus)
+{
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	size_t i;
+	catcierge_bus_subscriber_t *sub = NULL;
+	assert(bus);
+
+	for (i = 0; i < bus->subscriber_count; i++)
+	{
+		sub = &bus->subscribers[i];
+
+		if (!sub->queue)
+		{
+			continue;
+		}
+
+		pthread_mutex_lock(&sub->lock);
+
+		while (sub->queue_count || sub->busy)
+		{
+			pthread_cond_wait(&sub->space_cond, &sub->lock);
+		}
+
+		pthread_mutex_unlock(&sub->lock);
+	}
+	#endif
+}
+
+void catcierge_bus_print_stats(catcierge_bus_t *bus)
+{
+	size_t i;
+	catcierge_bus_subscriber_t *sub = NULL;
+	assert(bus);
+
+	CATLOG("Events published:\n");
+
+	for (i = 0; i < CATCIERGE_EVENT_COUNT; i++)
+	{
+		CATLOG("  %20s: %lu\n", catcierge_event_names[i], (unsigned long)bus->published[i]);
+	}
+
+	CATLOG("Event subscribers:\n");
+
+	for (i = 0; i < bus->subscriber_count; i++)
+	{
+		sub = &bus->subscribers[i];
+		CATLOG("  %s (%s): %lu delivered, %lu dropped\n",
+			sub->name, catcierge_subscriber_kind_names[sub->kind],
+			(unsigned long)sub->delivered, (unsigned long)sub->dropped);
+	}
+}
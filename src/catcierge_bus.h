@@ -0,0 +1,175 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_BUS_H__
+#define __CATCIERGE_BUS_H__
+
+//
+// Event bus that dispatches catcierge_event_t's to subscribers.
+//
+// Every subscriber registers for a set of events, and for each event
+// a bitmap of its subscribers is kept up to date, so publishing only
+// loops over the subscribers that want the event without any lookups.
+//
+// Subscribers are called on the publishing thread, unless they are
+// given a queue. A queued subscriber gets a thread of its own, and
+// what happens when it falls behind and the queue fills up is decided
+// by its back-pressure policy.
+//
+// Subscriptions are set up before events are published, the bus does
+// not lock the subscriber list itself.
+//
+
+#include <catcierge_config.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "catcierge_types.h"
+#include "catcierge_clock.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define CATCIERGE_BUS_MAX_SUBSCRIBERS 32
+
+#define CATCIERGE_EVENT_BIT(e) ((uint32_t)1 << (e))
+
+// Templates registered to "all" (or "*") have every bit set, including
+// this one which is used by the "all" pseudo event to generate them all.
+#define CATCIERGE_EVENT_ALL_BIT ((uint32_t)1 << 31)
+#define CATCIERGE_EVENT_MASK_ALL ((uint32_t)0xffffffff)
+
+typedef enum catcierge_subscriber_kind_e
+{
+	CATCIERGE_SUBSCRIBER_TEMPLATES,	// Output templates and the event commands.
+	CATCIERGE_SUBSCRIBER_ZMQ,
+	CATCIERGE_SUBSCRIBER_COMMANDS,
+	CATCIERGE_SUBSCRIBER_METRICS,
+	CATCIERGE_SUBSCRIBER_PLUGIN,
+	CATCIERGE_SUBSCRIBER_JOURNAL
+} catcierge_subscriber_kind_t;
+
+typedef enum catcierge_bus_policy_e
+{
+	CATCIERGE_BUS_BLOCK,		// Wait for room in the queue.
+	CATCIERGE_BUS_DROP_NEWEST,	// Drop the event being published.
+	CATCIERGE_BUS_DROP_OLDEST	// Drop the oldest queued event.
+} catcierge_bus_policy_t;
+
+// The payload is copied when queued, so it only holds values
+// and static strings.
+typedef struct catcierge_event_data_s
+{
+	catcierge_event_t type;
+	struct timeval tv;
+	int execute;			// Should the event commands be run?
+
+	union
+	{
+		struct
+		{
+			const char *state;
+			const char *prev_state;
+		} state_change;
+
+		struct
+		{
+			int idx;
+			int success;
+			double result;
+		} match;
+
+		struct
+		{
+			int success;
+			int success_count;
+			match_direction_t direction;
+		} match_group;
+	} u;
+} catcierge_event_data_t;
+
+typedef void (*catcierge_bus_handler_f)(const catcierge_event_data_t *ev, void *user);
+
+typedef struct catcierge_bus_subscriber_s
+{
+	const char *name;
+	catcierge_subscriber_kind_t kind;
+	catcierge_bus_handler_f handler;
+	void *user;
+	uint32_t events;				// CATCIERGE_EVENT_BIT's of the subscribed events.
+
+	size_t delivered;
+	size_t dropped;
+
+	// Only used by queued subscribers.
+	catcierge_event_data_t *queue;
+	size_t queue_size;
+	size_t queue_head;
+	size_t queue_count;
+	catcierge_bus_policy_t policy;
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// An event was queued, or the bus is stopping.
+	pthread_cond_t space_cond;		// An event was taken from the queue.
+	int busy;						// The handler is running.
+	int stop;
+	#endif
+} catcierge_bus_subscriber_t;
+
+typedef struct catcierge_bus_s
+{
+	catcierge_bus_subscriber_t subscribers[CATCIERGE_BUS_MAX_SUBSCRIBERS];
+	size_t subscriber_count;
+
+	// Bitmap of the subscribers for each event.
+	uint32_t subscriptions[CATCIERGE_EVENT_COUNT];
+	size_t published[CATCIERGE_EVENT_COUNT];
+} catcierge_bus_t;
+
+int catcierge_bus_init(catcierge_bus_t *bus);
+
+// Queued events are delivered before the subscriber threads are joined.
+void catcierge_bus_destroy(catcierge_bus_t *bus);
+
+// Returns the subscriber id or -1. With a queue_size of 0 the handler
+// is called directly by catcierge_bus_publish. Without thread support
+// all subscribers are called directly.
+int catcierge_bus_subscribe(catcierge_bus_t *bus, const char *name,
+		catcierge_subscriber_kind_t kind, uint32_t events,
+		catcierge_bus_handler_f handler, void *user,
+		size_t queue_size, catcierge_bus_policy_t policy);
+
+int catcierge_bus_set_events(catcierge_bus_t *bus, int id, uint32_t events);
+
+void catcierge_bus_publish(catcierge_bus_t *bus, const catcierge_event_data_t *ev);
+
+// Blocks until the queued subscribers have handled everything published so far.
+void catcierge_bus_flush(catcierge_bus_t *bus);
+
+void catcierge_bus_print_stats(catcierge_bus_t *bus);
+
+const char *catcierge_event_name(catcierge_event_t e);
+
+// Returns -1 for unknown event names.
+int catcierge_event_from_name(const char *name);
+
+// The events matched by a template event filter, "all" and "*" match everything.
+uint32_t catcierge_event_filter_mask(const char *filter);
+
+#endif // __CATCIERGE_BUS_H__
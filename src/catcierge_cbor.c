@@ -0,0 +1,263 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_cbor.h"
+#include "catcierge_log.h"
+
+#define CBOR_UINT	0
+#define CBOR_NEGINT	1
+#define CBOR_BYTES	2
+#define CBOR_TEXT	3
+#define CBOR_ARRAY	4
+#define CBOR_MAP	5
+#define CBOR_SIMPLE	7
+
+#define CBOR_FALSE		20
+#define CBOR_TRUE		21
+#define CBOR_NULL		22
+#define CBOR_FLOAT32	26
+#define CBOR_FLOAT64	27
+
+void catcierge_cbor_init(catcierge_cbor_t *c)
+{
+	assert(c);
+	c->buf = c->inline_buf;
+	c->size = sizeof(c->inline_buf);
+	c->len = 0;
+	c->failed = 0;
+}
+
+void catcierge_cbor_destroy(catcierge_cbor_t *c)
+{
+	assert(c);
+
+	if (c->buf != c->inline_buf)
+	{
+		free(c->buf);
+	}
+
+	catcierge_cbor_init(c);
+}
+
+void catcierge_cbor_reset(catcierge_cbor_t *c)
+{
+	assert(c);
+	c->len = 0;
+	c->failed = 0;
+}
+
+static uint8_t *catcierge_cbor_reserve(catcierge_cbor_t *c, size_t len)
+{
+	uint8_t *buf = NULL;
+	size_t size = c->size;
+
+	if (c->failed)
+	{
+		return NULL;
+	}
+
+	if ((c->len + len) > c->size)
+	{
+		while ((c->len + len) > size)
+			size *= 2;
+
+		if (c->buf == c->inline_buf)
+		{
+			if ((buf = malloc(size)))
+				memcpy(buf, c->buf, c->len);
+		}
+		else
+		{
+			buf = realloc(c->buf, size);
+		}
+
+		if (!buf)
+		{
+			CATERR("Out of memory\n");
+			c->failed = 1;
+			return NULL;
+		}
+
+		c->buf = buf;
+		c->size = size;
+	}
+
+	buf = c->buf + c->len;
+	c->len += len;
+
+	return buf;
+}
+
+static void catcierge_cbor_head(catcierge_cbor_t *c, int major, uint64_t val)
+{
+	uint8_t *p = NULL;
+	int i;
+	int n;
+	int info;
+
+	if (val < 24)
+	{
+		n = 0; info = (int)val;
+	}
+	else if (val <= 0xff)
+	{
+		n = 1; info = 24;
+	}
+	else if (val <= 0xffff)
+	{
+		n = 2; info = 25;
+	}
+	else if (val <= 0xffffffff)
+	{
+		n = 4; info = 26;
+	}
+	else
+	{
+		n = 8; info = 27;
+	}
+
+	if (!(p = catcierge_cbor_reserve(c, 1 + n)))
+	{
+		return;
+	}
+
+	*p++ = (uint8_t)((major << 5) | info);
+
+	// Big endian.
+	for (i = n - 1; i >= 0; i--)
+	{
+		*p++ = (uint8_t)(val >> (i * 8));
+	}
+}
+
+static void catcierge_cbor_raw(catcierge_cbor_t *c, const void *data, size_t len)
+{
+	uint8_t *p = NULL;
+
+	if (len && (p = catcierge_cbor_reserve(c, len)))
+	{
+		memcpy(p, data, len);
+	}
+}
+
+void catcierge_cbor_uint(catcierge_cbor_t *c, uint64_t val)
+{
+	assert(c);
+	catcierge_cbor_head(c, CBOR_UINT, val);
+}
+
+void catcierge_cbor_int(catcierge_cbor_t *c, int64_t val)
+{
+	assert(c);
+
+	if (val < 0)
+	{
+		// -1 - n, written without overflowing for INT64_MIN.
+		catcierge_cbor_head(c, CBOR_NEGINT, (uint64_t)(-(val + 1)));
+	}
+	else
+	{
+		catcierge_cbor_head(c, CBOR_UINT, (uint64_t)val);
+	}
+}
+
+void catcierge_cbor_double(catcierge_cbor_t *c, double val)
+{
+	uint8_t *p = NULL;
+	float f = (float)val;
+	uint32_t u32;
+	uint64_t u64;
+	int i;
+	assert(c);
+
+	if (((double)f == val) || (val != val))
+	{
+		memcpy(&u32, &f, sizeof(u32));
+
+		if ((p = catcierge_cbor_reserve(c, 5)))
+		{
+			*p++ = (CBOR_SIMPLE << 5) | CBOR_FLOAT32;
+
+			for (i = 3; i >= 0; i--)
+				*p++ = (uint8_t)(u32 >> (i * 8));
+		}
+
+		return;
+	}
+
+	memcpy(&u64, &val, sizeof(u64));
+
+	if ((p = catcierge_cbor_reserve(c, 9)))
+	{
+		*p++ = (CBOR_SIMPLE << 5) | CBOR_FLOAT64;
+
+		for (i = 7; i >= 0; i--)
+			*p++ = (uint8_t)(u64 >> (i * 8));
+	}
+}
+
+void catcierge_cbor_bool(catcierge_cbor_t *c, int val)
+{
+	assert(c);
+	catcierge_cbor_head(c, CBOR_SIMPLE, val ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void catcierge_cbor_null(catcierge_cbor_t *c)
+{
+	assert(c);
+	catcierge_cbor_head(c, CBOR_SIMPLE, CBOR_NULL);
+}
+
+void catcierge_cbor_text(catcierge_cbor_t *c, const char *s)
+{
+	size_t len;
+	assert(c);
+
+	if (!s)
+	{
+		catcierge_cbor_null(c);
+		return;
+	}
+
+	len = strlen(s);
+	catcierge_cbor_head(c, CBOR_TEXT, len);
+	catcierge_cbor_raw(c, s, len);
+}
+
+void catcierge_cbor_bytes(catcierge_cbor_t *c, const void *data, size_t len)
+{
+	assert(c);
+	catcierge_cbor_head(c, CBOR_BYTES, len);
+	catcierge_cbor_raw(c, data, len);
+}
+
+void catcierge_cbor_array(catcierge_cbor_t *c, size_t count)
+{
+	assert(c);
+	catcierge_cbor_head(c, CBOR_ARRAY, count);
+}
+
+void catcierge_cbor_map(catcierge_cbor_t *c, size_t count)
+{
+	assert(c);
+	catcierge_cbor_head(c, CBOR_MAP, count);
+}
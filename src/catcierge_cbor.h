@@ -0,0 +1,68 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_CBOR_H__
+#define __CATCIERGE_CBOR_H__
+
+//
+// Minimal CBOR (RFC 7049) encoder.
+//
+// Only what is needed to serialize events is supported: integers,
+// floats, booleans, null, strings, byte strings and definite length
+// arrays and maps. Maps are written as a count followed by that many
+// key and value pairs.
+//
+// Errors are sticky, if the buffer fails to grow the encoder stops
+// writing and sets failed, so it only needs to be checked at the end.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CATCIERGE_CBOR_INLINE_SIZE 1024
+
+typedef struct catcierge_cbor_s
+{
+	uint8_t *buf;
+	size_t len;
+	size_t size;
+	int failed;
+	uint8_t inline_buf[CATCIERGE_CBOR_INLINE_SIZE]; // Used until it runs out.
+} catcierge_cbor_t;
+
+void catcierge_cbor_init(catcierge_cbor_t *c);
+void catcierge_cbor_destroy(catcierge_cbor_t *c);
+void catcierge_cbor_reset(catcierge_cbor_t *c);
+
+void catcierge_cbor_uint(catcierge_cbor_t *c, uint64_t val);
+void catcierge_cbor_int(catcierge_cbor_t *c, int64_t val);
+
+// Written as a single precision float if that doesn't lose precision.
+void catcierge_cbor_double(catcierge_cbor_t *c, double val);
+
+void catcierge_cbor_bool(catcierge_cbor_t *c, int val);
+void catcierge_cbor_null(catcierge_cbor_t *c);
+
+// A NULL string is written as null.
+void catcierge_cbor_text(catcierge_cbor_t *c, const char *s);
+void catcierge_cbor_bytes(catcierge_cbor_t *c, const void *data, size_t len);
+
+void catcierge_cbor_array(catcierge_cbor_t *c, size_t count);
+void catcierge_cbor_map(catcierge_cbor_t *c, size_t count);
+
+#endif // __CATCIERGE_CBOR_H__
@@ -0,0 +1,181 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <time.h>
+#include <errno.h>
+#include "catcierge_platform.h"
+#include "catcierge_clock.h"
+
+static catcierge_clock_f monotonic_clock = NULL;
+static void *monotonic_clock_user = NULL;
+static catcierge_clock_f realtime_clock = NULL;
+static void *realtime_clock_user = NULL;
+
+typedef struct catcierge_virtual_clock_s
+{
+	int active;
+	double monotonic;
+	double realtime;
+} catcierge_virtual_clock_t;
+
+static catcierge_virtual_clock_t virtual_clock;
+
+static double catcierge_clock_system_monotonic()
+{
+	#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (!freq.QuadPart)
+	{
+		QueryPerformanceFrequency(&freq);
+	}
+
+	QueryPerformanceCounter(&count);
+
+	return (double)count.QuadPart / (double)freq.QuadPart;
+	#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+	#endif
+}
+
+double catcierge_clock_monotonic()
+{
+	if (monotonic_clock)
+	{
+		return monotonic_clock(monotonic_clock_user);
+	}
+
+	return catcierge_clock_system_monotonic();
+}
+
+void catcierge_clock_set_monotonic(catcierge_clock_f clock, void *user)
+{
+	monotonic_clock = clock;
+	monotonic_clock_user = user;
+}
+
+void catcierge_clock_sleep(double seconds)
+{
+	#ifndef _WIN32
+	struct timespec ts;
+	#endif
+
+	if (seconds <= 0.0)
+		return;
+
+	if (virtual_clock.active)
+	{
+		catcierge_clock_virtual_advance(seconds);
+		return;
+	}
+
+	#ifdef _WIN32
+	Sleep((DWORD)(seconds * 1000.0));
+	#else
+	ts.tv_sec = (time_t)seconds;
+	ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1000000000.0);
+
+	// Sleep the rest if interrupted by a signal.
+	while (nanosleep(&ts, &ts) && (errno == EINTR));
+	#endif
+}
+
+void catcierge_clock_gettimeofday(struct timeval *tv)
+{
+	double now;
+
+	if (!realtime_clock)
+	{
+		gettimeofday(tv, NULL);
+		return;
+	}
+
+	now = realtime_clock(realtime_clock_user);
+	tv->tv_sec = (time_t)now;
+	tv->tv_usec = (long)((now - (double)tv->tv_sec) * 1000000.0);
+}
+
+time_t catcierge_clock_time()
+{
+	struct timeval tv;
+	catcierge_clock_gettimeofday(&tv);
+
+	return (time_t)tv.tv_sec;
+}
+
+double catcierge_clock_realtime()
+{
+	struct timeval tv;
+	catcierge_clock_gettimeofday(&tv);
+
+	return (double)tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+void catcierge_clock_set_realtime(catcierge_clock_f clock, void *user)
+{
+	realtime_clock = clock;
+	realtime_clock_user = user;
+}
+
+static double catcierge_clock_virtual_monotonic(void *user)
+{
+	return ((catcierge_virtual_clock_t *)user)->monotonic;
+}
+
+static double catcierge_clock_virtual_realtime(void *user)
+{
+	return ((catcierge_virtual_clock_t *)user)->realtime;
+}
+
+void catcierge_clock_virtual_start(double realtime)
+{
+	// Start where the real clocks are, so that nothing
+	// already running sees time go backwards.
+	virtual_clock.monotonic = catcierge_clock_monotonic();
+	virtual_clock.realtime = (realtime > 0.0) ? realtime : catcierge_clock_realtime();
+	virtual_clock.active = 1;
+
+	catcierge_clock_set_monotonic(catcierge_clock_virtual_monotonic, &virtual_clock);
+	catcierge_clock_set_realtime(catcierge_clock_virtual_realtime, &virtual_clock);
+}
+
+void catcierge_clock_virtual_advance(double seconds)
+{
+	if (!virtual_clock.active || (seconds <= 0.0))
+		return;
+
+	virtual_clock.monotonic += seconds;
+	virtual_clock.realtime += seconds;
+}
+
+void catcierge_clock_virtual_stop()
+{
+	virtual_clock.active = 0;
+	catcierge_clock_set_monotonic(NULL, NULL);
+	catcierge_clock_set_realtime(NULL, NULL);
+}
+
+int catcierge_clock_is_virtual()
+{
+	return virtual_clock.active;
+}
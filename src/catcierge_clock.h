@@ -0,0 +1,66 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_CLOCK_H__
+#define __CATCIERGE_CLOCK_H__
+
+#include <time.h>
+
+#ifdef _WIN32
+#include "win32/gettimeofday.h"
+#else
+#include <sys/time.h>
+#endif
+
+// Returns seconds.
+typedef double (*catcierge_clock_f)(void *user);
+
+// Seconds since some unspecified point in time. Unlike gettimeofday
+// this never jumps when the wall clock is changed (NTP on a Raspberry Pi
+// without a real time clock for instance).
+double catcierge_clock_monotonic();
+
+// Replace the monotonic clock source, for tests.
+// Pass NULL to go back to the system clock.
+void catcierge_clock_set_monotonic(catcierge_clock_f clock, void *user);
+
+// Sleeps with sub-second precision. When the virtual
+// clock is running this only advances it.
+void catcierge_clock_sleep(double seconds);
+
+// Wall clock time. Use these instead of gettimeofday and time(NULL)
+// so that the time can be controlled by catcierge_clock_set_realtime
+// or the virtual clock.
+void catcierge_clock_gettimeofday(struct timeval *tv);
+time_t catcierge_clock_time();
+
+// Seconds since the epoch.
+double catcierge_clock_realtime();
+void catcierge_clock_set_realtime(catcierge_clock_f clock, void *user);
+
+//
+// Virtual clock. Replaces both the monotonic and wall clock with
+// a clock that only moves when catcierge_clock_virtual_advance is called.
+// This lets the state machine be simulated much faster than real time.
+//
+void catcierge_clock_virtual_start(double realtime);
+void catcierge_clock_virtual_advance(double seconds);
+void catcierge_clock_virtual_stop();
+int catcierge_clock_is_virtual();
+
+#endif // __CATCIERGE_CLOCK_H__
@@ -0,0 +1,503 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "catcierge_config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "catcierge_control.h"
+#include "catcierge_sigusr.h"
+#include "catcierge_encoded_image.h"
+#include "catcierge_bus.h"
+#include "catcierge_clock.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+
+#if (ZMQ_VERSION >= ZMQ_MAKE_VERSION (4, 0, 0))
+
+typedef struct catcierge_json_s
+{
+	char *buf;
+	size_t len;
+	size_t size;
+	int failed;
+} catcierge_json_t;
+
+static void catcierge_json_printf(catcierge_json_t *j, const char *fmt, ...)
+{
+	int n;
+	char *tmp = NULL;
+	va_list args;
+
+	while (!j->failed)
+	{
+		va_start(args, fmt);
+		n = vsnprintf(j->buf + j->len, j->size - j->len, fmt, args);
+		va_end(args);
+
+		if (n < 0)
+		{
+			j->failed = 1;
+			break;
+		}
+
+		if ((size_t)n < (j->size - j->len))
+		{
+			j->len += n;
+			break;
+		}
+
+		if (!(tmp = realloc(j->buf, j->size * 2 + n)))
+		{
+			CATERR("Out of memory\n");
+			j->failed = 1;
+			break;
+		}
+
+		j->buf = tmp;
+		j->size = j->size * 2 + n;
+	}
+}
+
+static void catcierge_json_string(catcierge_json_t *j, const char *s)
+{
+	catcierge_json_printf(j, "\"");
+
+	for (; s && *s; s++)
+	{
+		switch (*s)
+		{
+			case '"': catcierge_json_printf(j, "\\\""); break;
+			case '\\': catcierge_json_printf(j, "\\\\"); break;
+			case '\n': catcierge_json_printf(j, "\\n"); break;
+			case '\r': catcierge_json_printf(j, "\\r"); break;
+			case '\t': catcierge_json_printf(j, "\\t"); break;
+			default:
+			{
+				if ((unsigned char)*s < 0x20)
+					catcierge_json_printf(j, "\\u%04x", (unsigned char)*s);
+				else
+					catcierge_json_printf(j, "%c", *s);
+			}
+		}
+	}
+
+	catcierge_json_printf(j, "\"");
+}
+
+static double catcierge_tv_to_double(const struct timeval *tv)
+{
+	return (double)tv->tv_sec + (tv->tv_usec / 1000000.0);
+}
+
+static void catcierge_control_on_match_group_done(const catcierge_event_data_t *ev, void *user)
+{
+	catcierge_control_t *ctrl = (catcierge_control_t *)user;
+	match_group_t *mg = &ctrl->grb->match_group;
+	catcierge_control_history_t *h = &ctrl->history[ctrl->history_head];
+
+	// Called directly on the FSM thread, so the match group is intact.
+	snprintf(h->id, sizeof(h->id), "%x%x%x%x%x",
+		mg->sha.Message_Digest[0],
+		mg->sha.Message_Digest[1],
+		mg->sha.Message_Digest[2],
+		mg->sha.Message_Digest[3],
+		mg->sha.Message_Digest[4]);
+	h->start_tv = mg->start_tv;
+	h->end_tv = mg->end_tv;
+	h->success = mg->success;
+	h->success_count = mg->success_count;
+	h->match_count = mg->match_count;
+	h->direction = mg->direction;
+	snprintf(h->description, sizeof(h->description), "%s", mg->description);
+
+	ctrl->history_head = (ctrl->history_head + 1) % CATCIERGE_CONTROL_HISTORY;
+
+	if (ctrl->history_count < CATCIERGE_CONTROL_HISTORY)
+		ctrl->history_count++;
+
+	ctrl->match_group_total++;
+}
+
+static void catcierge_control_history(catcierge_control_t *ctrl,
+		catcierge_json_t *j, const char *arg)
+{
+	size_t i;
+	size_t idx;
+	size_t n = ctrl->history_count;
+	catcierge_control_history_t *h = NULL;
+
+	if (arg && (atoi(arg) >= 0) && ((size_t)atoi(arg) < n))
+	{
+		n = (size_t)atoi(arg);
+	}
+
+	catcierge_json_printf(j, ",\"total\":%lu,\"match_groups\":[",
+		(unsigned long)ctrl->match_group_total);
+
+	for (i = 0; i < n; i++)
+	{
+		// Newest first.
+		idx = (ctrl->history_head + CATCIERGE_CONTROL_HISTORY - 1 - i) % CATCIERGE_CONTROL_HISTORY;
+		h = &ctrl->history[idx];
+
+		catcierge_json_printf(j, "%s{\"id\":\"%s\",\"start\":%.3f,\"end\":%.3f,"
+			"\"success\":%s,\"success_count\":%d,\"match_count\":%lu,\"direction\":",
+			i ? "," : "", h->id,
+			catcierge_tv_to_double(&h->start_tv),
+			catcierge_tv_to_double(&h->end_tv),
+			h->success ? "true" : "false",
+			h->success_count,
+			(unsigned long)h->match_count);
+		catcierge_json_string(j, catcierge_get_direction_str(h->direction));
+		catcierge_json_printf(j, ",\"description\":");
+		catcierge_json_string(j, h->description);
+		catcierge_json_printf(j, "}");
+	}
+
+	catcierge_json_printf(j, "]");
+}
+
+static void catcierge_control_stats(catcierge_control_t *ctrl, catcierge_json_t *j)
+{
+	size_t i;
+	catcierge_bus_t *bus = &ctrl->grb->bus;
+
+	catcierge_json_printf(j, ",\"uptime\":%.3f,\"match_groups\":%lu,"
+		"\"commands\":%lu,\"events\":{",
+		catcierge_clock_monotonic() - ctrl->start_time,
+		(unsigned long)ctrl->match_group_total,
+		(unsigned long)ctrl->commands);
+
+	for (i = 0; i < CATCIERGE_EVENT_COUNT; i++)
+	{
+		catcierge_json_printf(j, "%s\"%s\":%lu", i ? "," : "",
+			catcierge_event_name((catcierge_event_t)i),
+			(unsigned long)bus->published[i]);
+	}
+
+	catcierge_json_printf(j, "}");
+}
+
+static void catcierge_control_reply(catcierge_control_t *ctrl, zmsg_t **envelope,
+		catcierge_json_t *j)
+{
+	if (j->failed)
+	{
+		zmsg_destroy(envelope);
+		return;
+	}
+
+	zmsg_addstr(*envelope, j->buf);
+
+	if (zmsg_send(envelope, ctrl->router))
+	{
+		CATERR("Failed to send control reply\n");
+		zmsg_destroy(envelope);
+	}
+}
+
+static void catcierge_control_state(catcierge_control_t *ctrl, catcierge_json_t *j)
+{
+	catcierge_json_printf(j, ",\"state\":");
+	catcierge_json_string(j, catcierge_get_state_string(ctrl->grb->state));
+}
+
+static void catcierge_control_handle(catcierge_control_t *ctrl, zmsg_t *msg)
+{
+	char *cmd = NULL;
+	char *arg = NULL;
+	zframe_t *frame = NULL;
+	catcierge_json_t j;
+	const char *error = NULL;
+
+	memset(&j, 0, sizeof(j));
+
+	if (!(j.buf = malloc(j.size = 1024)))
+	{
+		CATERR("Out of memory\n");
+		zmsg_destroy(&msg);
+		return;
+	}
+
+	// The rest of the message is the envelope we reply with.
+	if (!(frame = zmsg_last(msg)) || (zmsg_size(msg) < 2))
+	{
+		CATERR("Invalid control message\n");
+		frame = NULL;
+		zmsg_destroy(&msg);
+		goto done;
+	}
+
+	zmsg_remove(msg, frame);
+
+	if (!(cmd = zframe_strdup(frame)))
+	{
+		zmsg_destroy(&msg);
+		goto done;
+	}
+
+	zframe_destroy(&frame);
+	ctrl->commands++;
+
+	if ((arg = strchr(cmd, ' ')))
+	{
+		*arg++ = '\0';
+	}
+
+	catcierge_json_printf(&j, "{\"ok\":true,\"command\":");
+	catcierge_json_string(&j, cmd);
+
+	if (!strcmp(cmd, "ping"))
+	{
+		// Only the reply.
+	}
+	else if (!strcmp(cmd, "state"))
+	{
+		catcierge_control_state(ctrl, &j);
+	}
+	else if (!strcmp(cmd, "lock")
+		  || !strcmp(cmd, "unlock")
+		  || !strcmp(cmd, "ignore")
+		  || !strcmp(cmd, "attention"))
+	{
+		CATLOG("Control: %s\n", cmd);
+		catcierge_handle_sigusr(ctrl->grb, cmd);
+		catcierge_control_state(ctrl, &j);
+	}
+	#ifdef WITH_RFID
+	else if (!strcmp(cmd, "reload_rfid"))
+	{
+		CATLOG("Control: %s\n", cmd);
+
+		if (catcierge_reload_rfid_allowed(ctrl->grb))
+		{
+			error = "Failed to reload the allowed RFID tags";
+		}
+		else
+		{
+			catcierge_json_printf(&j, ",\"allowed\":%lu",
+				(unsigned long)ctrl->grb->rfid_allowed.count);
+		}
+	}
+	#endif // WITH_RFID
+	else if (!strcmp(cmd, "stats"))
+	{
+		catcierge_control_stats(ctrl, &j);
+	}
+	else if (!strcmp(cmd, "history"))
+	{
+		catcierge_control_history(ctrl, &j, arg);
+	}
+	else if (!strcmp(cmd, "snapshot"))
+	{
+		if (ctrl->snapshot_count >= CATCIERGE_CONTROL_MAX_SNAPSHOTS)
+		{
+			error = "Too many snapshot requests";
+		}
+		else
+		{
+			// Answered by catcierge_control_frame.
+			ctrl->snapshots[ctrl->snapshot_count++] = msg;
+			goto done;
+		}
+	}
+	else
+	{
+		error = "Unknown command";
+	}
+
+	if (error)
+	{
+		ctrl->errors++;
+		j.len = 0;
+		catcierge_json_printf(&j, "{\"ok\":false,\"command\":");
+		catcierge_json_string(&j, cmd);
+		catcierge_json_printf(&j, ",\"error\":");
+		catcierge_json_string(&j, error);
+	}
+
+	catcierge_json_printf(&j, "}");
+	catcierge_control_reply(ctrl, &msg, &j);
+
+done:
+	zframe_destroy(&frame);
+	free(cmd);
+	free(j.buf);
+}
+
+int catcierge_control_init(catcierge_control_t *ctrl, catcierge_grb_t *grb,
+		const char *endpoint)
+{
+	assert(ctrl);
+	assert(grb);
+	assert(endpoint);
+	memset(ctrl, 0, sizeof(catcierge_control_t));
+
+	ctrl->grb = grb;
+	ctrl->start_time = catcierge_clock_monotonic();
+
+	if (!(ctrl->router = zsock_new_router(endpoint)))
+	{
+		CATERR("Failed to create control socket on %s\n", endpoint);
+		return -1;
+	}
+
+	if (catcierge_bus_subscribe(&grb->bus, "control", CATCIERGE_SUBSCRIBER_ZMQ,
+		CATCIERGE_EVENT_BIT(CATCIERGE_MATCH_GROUP_DONE),
+		catcierge_control_on_match_group_done, ctrl, 0, CATCIERGE_BUS_DROP_NEWEST) < 0)
+	{
+		CATERR("Failed to subscribe the control channel to events\n");
+		catcierge_control_destroy(ctrl);
+		return -1;
+	}
+
+	CATLOG("Control channel listening on %s\n", endpoint);
+
+	return 0;
+}
+
+void catcierge_control_destroy(catcierge_control_t *ctrl)
+{
+	size_t i;
+	assert(ctrl);
+
+	for (i = 0; i < ctrl->snapshot_count; i++)
+	{
+		zmsg_destroy(&ctrl->snapshots[i]);
+	}
+
+	ctrl->snapshot_count = 0;
+
+	if (ctrl->router)
+	{
+		zsock_destroy((zsock_t **)&ctrl->router);
+	}
+}
+
+int catcierge_control_fd(catcierge_control_t *ctrl)
+{
+	assert(ctrl);
+	assert(ctrl->router);
+	return zsock_fd(ctrl->router);
+}
+
+void catcierge_control_service(catcierge_control_t *ctrl)
+{
+	zmsg_t *msg = NULL;
+	assert(ctrl);
+
+	if (!ctrl->router)
+		return;
+
+	// The fd is edge triggered, so everything must be read.
+	while (zsock_events(ctrl->router) & ZMQ_POLLIN)
+	{
+		if (!(msg = zmsg_recv(ctrl->router)))
+			break;
+
+		catcierge_control_handle(ctrl, msg);
+	}
+}
+
+void catcierge_control_frame(catcierge_control_t *ctrl, IplImage *img)
+{
+	size_t i;
+	char json[128];
+	int params[] = { CV_IMWRITE_JPEG_QUALITY, CATCIERGE_CONTROL_SNAPSHOT_QUALITY, 0 };
+	catcierge_encoded_image_t *e = NULL;
+	assert(ctrl);
+
+	if (!ctrl->snapshot_count || !img)
+		return;
+
+	if (!(e = catcierge_encoded_image_create(img, ".jpg", params)))
+	{
+		snprintf(json, sizeof(json),
+			"{\"ok\":false,\"command\":\"snapshot\",\"error\":\"Failed to encode image\"}");
+	}
+	else
+	{
+		snprintf(json, sizeof(json),
+			"{\"ok\":true,\"command\":\"snapshot\",\"width\":%d,\"height\":%d,\"size\":%lu}",
+			img->width, img->height, (unsigned long)e->size);
+	}
+
+	for (i = 0; i < ctrl->snapshot_count; i++)
+	{
+		zmsg_addstr(ctrl->snapshots[i], json);
+
+		if (!e)
+		{
+			zmsg_send(&ctrl->snapshots[i], ctrl->router);
+		}
+		else if (zmsg_sendm(&ctrl->snapshots[i], ctrl->router)
+			  || catcierge_encoded_image_send(e, zsock_resolve(ctrl->router), 0))
+		{
+			CATERR("Failed to send snapshot\n");
+		}
+
+		zmsg_destroy(&ctrl->snapshots[i]);
+	}
+
+	ctrl->snapshot_count = 0;
+	catcierge_encoded_image_unref(&e);
+
+	// Sending can swallow the fd notification for new commands.
+	catcierge_control_service(ctrl);
+}
+
+#else // ZMQ_VERSION < 4.0.0
+
+int catcierge_control_init(catcierge_control_t *ctrl, catcierge_grb_t *grb,
+		const char *endpoint)
+{
+	assert(ctrl);
+	memset(ctrl, 0, sizeof(catcierge_control_t));
+	CATERR("The control channel needs CZMQ 3.0 or later\n");
+	return -1;
+}
+
+void catcierge_control_destroy(catcierge_control_t *ctrl)
+{
+}
+
+int catcierge_control_fd(catcierge_control_t *ctrl)
+{
+	return -1;
+}
+
+void catcierge_control_service(catcierge_control_t *ctrl)
+{
+}
+
+void catcierge_control_frame(catcierge_control_t *ctrl, IplImage *img)
+{
+}
+
+#endif // ZMQ_VERSION < 4.0.0
+
+void catcierge_control_print_stats(catcierge_control_t *ctrl)
+{
+	assert(ctrl);
+
+	CATLOG("Control: %lu commands, %lu errors\n",
+		(unsigned long)ctrl->commands, (unsigned long)ctrl->errors);
+}
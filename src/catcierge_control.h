@@ -0,0 +1,101 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_CONTROL_H__
+#define __CATCIERGE_CONTROL_H__
+
+//
+// Control and query channel over a ZMQ ROUTER socket (--control).
+//
+// Clients (REQ or DEALER) send a single text frame with a command and
+// get a JSON reply back:
+//
+//   ping                   Check that catcierge is alive.
+//   state                  The current state.
+//   lock, unlock,
+//   ignore, attention      Same as the --sigusr1/--sigusr2 behaviors.
+//   reload_rfid            Reload the allowed RFID tags (--rfid_allowed_file).
+//   stats                  Uptime and the number of published events.
+//   history [N]            The last N match groups, newest first.
+//   snapshot               The next camera frame, sent as a JPEG
+//                          frame after the reply.
+//
+// The commands are run by the main loop, never from a signal handler.
+//
+
+#include <catcierge_config.h>
+#include <czmq.h>
+#include "catcierge_fsm.h"
+
+#define CATCIERGE_CONTROL_HISTORY 32
+#define CATCIERGE_CONTROL_MAX_SNAPSHOTS 8
+#define CATCIERGE_CONTROL_SNAPSHOT_QUALITY 90
+
+typedef struct catcierge_control_history_s
+{
+	char id[41];					// SHA1 of the match group.
+	struct timeval start_tv;
+	struct timeval end_tv;
+	int success;
+	int success_count;
+	size_t match_count;
+	match_direction_t direction;
+	char description[128];
+} catcierge_control_history_t;
+
+typedef struct catcierge_control_s
+{
+	catcierge_grb_t *grb;
+	void *router;
+
+	// Ring buffer of the last match groups.
+	catcierge_control_history_t history[CATCIERGE_CONTROL_HISTORY];
+	size_t history_head;			// Where the next one is written.
+	size_t history_count;
+	size_t match_group_total;
+
+	// Envelopes of snapshot requests waiting for the next frame.
+	zmsg_t *snapshots[CATCIERGE_CONTROL_MAX_SNAPSHOTS];
+	size_t snapshot_count;
+
+	double start_time;
+
+	// Statistics.
+	size_t commands;
+	size_t errors;
+} catcierge_control_t;
+
+// The control channel subscribes to the event bus of grb,
+// so this must be done after catcierge_grabber_init.
+int catcierge_control_init(catcierge_control_t *ctrl, catcierge_grb_t *grb,
+		const char *endpoint);
+void catcierge_control_destroy(catcierge_control_t *ctrl);
+
+// The fd to poll for incoming commands. Like all ZMQ fds it only
+// signals that catcierge_control_service should be called.
+int catcierge_control_fd(catcierge_control_t *ctrl);
+
+// Runs all pending commands without blocking.
+void catcierge_control_service(catcierge_control_t *ctrl);
+
+// Called by the main loop for every frame, to answer snapshot requests.
+void catcierge_control_frame(catcierge_control_t *ctrl, IplImage *img);
+
+void catcierge_control_print_stats(catcierge_control_t *ctrl);
+
+#endif // __CATCIERGE_CONTROL_H__
@@ -0,0 +1,180 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "catcierge_config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "catcierge_encoded_image.h"
+#include "catcierge_platform.h"
+#include "catcierge_log.h"
+
+#ifdef WITH_ZMQ
+#include <czmq.h>
+#endif
+
+catcierge_encoded_image_t *catcierge_encoded_image_create(IplImage *img,
+		const char *ext, const int *params)
+{
+	catcierge_encoded_image_t *e = NULL;
+	assert(img);
+	assert(ext);
+
+	if (!(e = calloc(1, sizeof(catcierge_encoded_image_t))))
+	{
+		CATERR("Out of memory\n"); return NULL;
+	}
+
+	if (!(e->mat = cvEncodeImage(ext, img, params)))
+	{
+		CATERR("Failed to encode %s image\n", ext);
+		free(e);
+		return NULL;
+	}
+
+	e->data = e->mat->data.ptr;
+	e->size = (size_t)e->mat->rows * e->mat->cols * CV_ELEM_SIZE(e->mat->type);
+	e->refcount = 1;
+
+	return e;
+}
+
+catcierge_encoded_image_t *catcierge_encoded_image_ref(catcierge_encoded_image_t *e)
+{
+	if (e)
+	{
+		catcierge_atomic_inc(&e->refcount);
+	}
+
+	return e;
+}
+
+void catcierge_encoded_image_unref(catcierge_encoded_image_t **e)
+{
+	if (!e || !*e)
+		return;
+
+	if (catcierge_atomic_dec(&(*e)->refcount) == 0)
+	{
+		cvReleaseMat(&(*e)->mat);
+		free(*e);
+	}
+
+	*e = NULL;
+}
+
+int catcierge_encoded_image_save(catcierge_encoded_image_t *e, const char *path)
+{
+	int ret = 0;
+	FILE *f = NULL;
+	assert(e);
+	assert(path);
+
+	if (!(f = fopen(path, "wb")))
+	{
+		CATERR("Failed to open \"%s\" for writing\n", path);
+		return -1;
+	}
+
+	if (fwrite(e->data, 1, e->size, f) != e->size)
+	{
+		CATERR("Failed to write image \"%s\"\n", path);
+		ret = -1;
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+#ifdef WITH_ZMQ
+// Called by ZMQ when it is done sending a frame.
+static void catcierge_encoded_image_free_frame(void *data, void *hint)
+{
+	catcierge_encoded_image_t *e = (catcierge_encoded_image_t *)hint;
+	catcierge_encoded_image_unref(&e);
+}
+
+int catcierge_encoded_image_send(catcierge_encoded_image_t *e, void *sock, int more)
+{
+	zmq_msg_t msg;
+	assert(e);
+	assert(sock);
+
+	catcierge_encoded_image_ref(e);
+
+	if (zmq_msg_init_data(&msg, (void *)e->data, e->size,
+		catcierge_encoded_image_free_frame, e))
+	{
+		catcierge_encoded_image_unref(&e);
+		return -1;
+	}
+
+	if (zmq_msg_send(&msg, sock, more ? ZMQ_SNDMORE : 0) < 0)
+	{
+		zmq_msg_close(&msg);
+		return -1;
+	}
+
+	return 0;
+}
+#endif // WITH_ZMQ
+
+void catcierge_encoded_images_ref(match_group_t *mg)
+{
+	size_t i;
+	size_t j;
+	assert(mg);
+
+	catcierge_encoded_image_ref(mg->obstruct_encoded);
+
+	if (!mg->matches)
+		return;
+
+	for (i = 0; i < mg->max_count; i++)
+	{
+		catcierge_encoded_image_ref(mg->matches[i].encoded);
+
+		for (j = 0; j < MAX_STEPS; j++)
+		{
+			catcierge_encoded_image_ref(mg->matches[i].result.steps[j].encoded);
+		}
+	}
+}
+
+void catcierge_encoded_images_release(match_group_t *mg)
+{
+	size_t i;
+	size_t j;
+	assert(mg);
+
+	catcierge_encoded_image_unref(&mg->obstruct_encoded);
+
+	if (!mg->matches)
+		return;
+
+	for (i = 0; i < mg->max_count; i++)
+	{
+		catcierge_encoded_image_unref(&mg->matches[i].encoded);
+
+		for (j = 0; j < MAX_STEPS; j++)
+		{
+			catcierge_encoded_image_unref(&mg->matches[i].result.steps[j].encoded);
+		}
+	}
+}
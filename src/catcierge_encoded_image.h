@@ -0,0 +1,65 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_ENCODED_IMAGE_H__
+#define __CATCIERGE_ENCODED_IMAGE_H__
+
+//
+// A compressed image shared by everything that outputs it.
+//
+// Images are encoded once when they are saved, the same buffer is
+// then written to disk and published over ZMQ without being copied.
+// The buffer is freed when the last reference is released, which
+// can happen on another thread (ZMQ frees sent frames on its I/O thread).
+//
+
+#include <stddef.h>
+#include "catcierge_types.h"
+
+typedef struct catcierge_encoded_image_s
+{
+	CvMat *mat;					// Result of cvEncodeImage.
+	const unsigned char *data;
+	size_t size;
+	volatile long refcount;
+} catcierge_encoded_image_t;
+
+// The format is given by the extension, such as ".png". The params are
+// passed on to cvEncodeImage and can be NULL. Returns an image with a
+// single reference.
+catcierge_encoded_image_t *catcierge_encoded_image_create(IplImage *img,
+		const char *ext, const int *params);
+
+catcierge_encoded_image_t *catcierge_encoded_image_ref(catcierge_encoded_image_t *e);
+
+// Releases a reference and sets the pointer to NULL.
+void catcierge_encoded_image_unref(catcierge_encoded_image_t **e);
+
+int catcierge_encoded_image_save(catcierge_encoded_image_t *e, const char *path);
+
+#ifdef WITH_ZMQ
+// Sends the image as a ZMQ frame without copying it. The frame holds a
+// reference until ZMQ is done with it. sock is a raw libzmq socket.
+int catcierge_encoded_image_send(catcierge_encoded_image_t *e, void *sock, int more);
+#endif
+
+// Adds or releases a reference for every encoded image in a match group.
+void catcierge_encoded_images_ref(match_group_t *mg);
+void catcierge_encoded_images_release(match_group_t *mg);
+
+#endif // __CATCIERGE_ENCODED_IMAGE_H__
@@ -0,0 +1,386 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "catcierge_exec.h"
+#include "catcierge_clock.h"
+#include "catcierge_log.h"
+
+extern char **environ;
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#define EXEC_LOCK(e) pthread_mutex_lock(&(e)->lock)
+#define EXEC_UNLOCK(e) pthread_mutex_unlock(&(e)->lock)
+#else
+#define EXEC_LOCK(e)
+#define EXEC_UNLOCK(e)
+#endif
+
+int catcierge_exec_init(catcierge_exec_t *e,
+		size_t max_running, size_t max_queued, double timeout)
+{
+	assert(e);
+	memset(e, 0, sizeof(catcierge_exec_t));
+
+	e->max_running = max_running ? max_running : CATCIERGE_EXEC_DEFAULT_MAX_RUNNING;
+	e->max_queued = max_queued;
+	e->timeout = timeout;
+
+	if (!(e->running = calloc(e->max_running, sizeof(catcierge_exec_proc_t))))
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_init(&e->lock, NULL);
+	#endif
+
+	return 0;
+}
+
+static int catcierge_exec_spawn(catcierge_exec_t *e, char *command)
+{
+	int err;
+	pid_t pid;
+	sigset_t mask;
+	catcierge_exec_proc_t *p = NULL;
+	posix_spawnattr_t attr;
+	char *argv[4];
+
+	argv[0] = "/bin/sh";
+	argv[1] = "-c";
+	argv[2] = command;
+	argv[3] = NULL;
+
+	// The main loop blocks the signals it reads from a signalfd,
+	// the children should get them as usual.
+	posix_spawnattr_init(&attr);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	err = posix_spawn(&pid, argv[0], NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+
+	if (err)
+	{
+		CATERR("Failed to run \"%s\": %d, %s\n", command, err, strerror(err));
+		e->stats.spawn_errors++;
+		free(command);
+		return -1;
+	}
+
+	p = &e->running[e->running_count++];
+	p->pid = pid;
+	p->command = command;
+	p->start = catcierge_clock_monotonic();
+	p->terminated = 0;
+
+	e->stats.started++;
+
+	if (e->running_count > e->stats.max_running)
+	{
+		e->stats.max_running = e->running_count;
+	}
+
+	CATLOG("Called program \"%s\" (pid %d)\n", command, (int)pid);
+
+	return 0;
+}
+
+int catcierge_exec_run(catcierge_exec_t *e, const char *command)
+{
+	int ret = 0;
+	char *cmd = NULL;
+	catcierge_exec_cmd_t *c = NULL;
+	assert(e);
+	assert(command);
+
+	if (!(cmd = strdup(command)))
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	EXEC_LOCK(e);
+
+	if (e->running_count < e->max_running)
+	{
+		ret = catcierge_exec_spawn(e, cmd);
+		goto done;
+	}
+
+	if (e->queued_count >= e->max_queued)
+	{
+		CATERR("Too many commands running, dropping \"%s\"\n", cmd);
+		e->stats.dropped++;
+		free(cmd);
+		ret = -1; goto done;
+	}
+
+	if (!(c = calloc(1, sizeof(catcierge_exec_cmd_t))))
+	{
+		CATERR("Out of memory\n");
+		free(cmd);
+		ret = -1; goto done;
+	}
+
+	c->command = cmd;
+
+	if (e->tail)
+		e->tail->next = c;
+	else
+		e->head = c;
+
+	e->tail = c;
+	e->queued_count++;
+
+done:
+	EXEC_UNLOCK(e);
+	return ret;
+}
+
+static void catcierge_exec_remove(catcierge_exec_t *e, size_t i)
+{
+	free(e->running[i].command);
+
+	// Keep the running commands packed at the start.
+	e->running[i] = e->running[--e->running_count];
+	memset(&e->running[e->running_count], 0, sizeof(catcierge_exec_proc_t));
+}
+
+static void catcierge_exec_finished(catcierge_exec_t *e, size_t i, int status)
+{
+	catcierge_exec_proc_t *p = &e->running[i];
+	double elapsed = catcierge_clock_monotonic() - p->start;
+
+	e->stats.total_time += elapsed;
+
+	if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+	{
+		CATLOG("Program \"%s\" (pid %d) finished in %0.2f seconds\n",
+			p->command, (int)p->pid, elapsed);
+		e->stats.succeeded++;
+	}
+	else
+	{
+		if (WIFEXITED(status))
+		{
+			CATERR("Program \"%s\" (pid %d) exited with status %d after %0.2f seconds\n",
+				p->command, (int)p->pid, WEXITSTATUS(status), elapsed);
+		}
+		else if (WIFSIGNALED(status))
+		{
+			CATERR("Program \"%s\" (pid %d) was killed by signal %d after %0.2f seconds\n",
+				p->command, (int)p->pid, WTERMSIG(status), elapsed);
+		}
+
+		e->stats.failed++;
+	}
+
+	catcierge_exec_remove(e, i);
+}
+
+static void catcierge_exec_lost(catcierge_exec_t *e, size_t i, int err)
+{
+	catcierge_exec_proc_t *p = &e->running[i];
+
+	CATERR("Program \"%s\" (pid %d) exit status unknown, waitpid failed %d, %s\n",
+		p->command, (int)p->pid, err, strerror(err));
+
+	e->stats.lost++;
+	catcierge_exec_remove(e, i);
+}
+
+static void catcierge_exec_check_timeout(catcierge_exec_t *e, catcierge_exec_proc_t *p)
+{
+	double elapsed;
+
+	if (e->timeout <= 0.0)
+	{
+		return;
+	}
+
+	elapsed = catcierge_clock_monotonic() - p->start;
+
+	if (!p->terminated && (elapsed >= e->timeout))
+	{
+		CATERR("Program \"%s\" (pid %d) timed out after %0.2f seconds\n",
+			p->command, (int)p->pid, elapsed);
+		kill(p->pid, SIGTERM);
+		p->terminated = 1;
+		e->stats.timed_out++;
+	}
+	else if (p->terminated && (elapsed >= (e->timeout + CATCIERGE_EXEC_KILL_DELAY)))
+	{
+		kill(p->pid, SIGKILL);
+	}
+}
+
+size_t catcierge_exec_service(catcierge_exec_t *e)
+{
+	size_t i;
+	size_t count;
+	int status;
+	pid_t pid;
+	catcierge_exec_cmd_t *c = NULL;
+	assert(e);
+
+	EXEC_LOCK(e);
+
+	for (i = 0; i < e->running_count; )
+	{
+		// Only our own children are waited for, so that
+		// nothing else that is forked gets reaped here.
+		pid = waitpid(e->running[i].pid, &status, WNOHANG);
+
+		if ((pid < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+
+		if (pid == 0)
+		{
+			catcierge_exec_check_timeout(e, &e->running[i]);
+			i++;
+			continue;
+		}
+
+		if (pid < 0)
+		{
+			// Most likely someone else reaped it (ECHILD).
+			catcierge_exec_lost(e, i, errno);
+			continue;
+		}
+
+		catcierge_exec_finished(e, i, status);
+	}
+
+	while (e->head && (e->running_count < e->max_running))
+	{
+		c = e->head;
+		e->head = c->next;
+
+		if (!e->head)
+		{
+			e->tail = NULL;
+		}
+
+		e->queued_count--;
+		catcierge_exec_spawn(e, c->command);
+		free(c);
+	}
+
+	count = e->running_count + e->queued_count;
+
+	EXEC_UNLOCK(e);
+
+	return count;
+}
+
+void catcierge_exec_destroy(catcierge_exec_t *e)
+{
+	size_t i;
+	double start;
+	catcierge_exec_cmd_t *c = NULL;
+	assert(e);
+
+	if (!e->running)
+	{
+		return;
+	}
+
+	// Queued commands are never started.
+	while (e->head)
+	{
+		c = e->head;
+		e->head = c->next;
+		free(c->command);
+		free(c);
+	}
+
+	e->tail = NULL;
+	e->queued_count = 0;
+
+	start = catcierge_clock_monotonic();
+
+	while (catcierge_exec_service(e) > 0)
+	{
+		// Without a timeout the commands are left running like before.
+		if (e->timeout <= 0.0)
+		{
+			CATLOG("Leaving %lu commands running\n", (unsigned long)e->running_count);
+			break;
+		}
+
+		if ((catcierge_clock_monotonic() - start) >= (e->timeout + CATCIERGE_EXEC_KILL_DELAY))
+		{
+			for (i = 0; i < e->running_count; i++)
+			{
+				kill(e->running[i].pid, SIGKILL);
+			}
+		}
+
+		catcierge_clock_sleep(0.01);
+	}
+
+	for (i = 0; i < e->running_count; i++)
+	{
+		free(e->running[i].command);
+	}
+
+	free(e->running);
+	e->running = NULL;
+	e->running_count = 0;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_destroy(&e->lock);
+	#endif
+}
+
+void catcierge_exec_print_stats(catcierge_exec_t *e)
+{
+	size_t finished;
+	catcierge_exec_stats_t *s = NULL;
+	assert(e);
+
+	s = &e->stats;
+	finished = s->succeeded + s->failed;
+
+	CATLOG("Commands: %lu started, %lu succeeded, %lu failed, %lu timed out, "
+		"%lu lost, %lu dropped, %lu failed to start\n",
+		(unsigned long)s->started, (unsigned long)s->succeeded,
+		(unsigned long)s->failed, (unsigned long)s->timed_out,
+		(unsigned long)s->lost, (unsigned long)s->dropped,
+		(unsigned long)s->spawn_errors);
+
+	CATLOG("Commands: At most %lu running at once, %0.2f seconds on average\n",
+		(unsigned long)s->max_running, finished ? (s->total_time / finished) : 0.0);
+}
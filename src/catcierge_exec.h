@@ -0,0 +1,109 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_EXEC_H__
+#define __CATCIERGE_EXEC_H__
+
+//
+// Runs the event commands as child processes.
+//
+// Commands are started with posix_spawn, so the grabber with all its
+// image buffers is never forked. At most max_running commands run at
+// once, the rest wait in a bounded queue and are dropped when it is
+// full, so a burst of events can't start an unbounded number of
+// processes. Children are reaped and the ones running for longer than
+// the timeout are killed by catcierge_exec_service, which should be
+// called on SIGCHLD and regularly from the main loop.
+//
+
+#include <catcierge_config.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define CATCIERGE_EXEC_DEFAULT_MAX_RUNNING 4
+#define CATCIERGE_EXEC_DEFAULT_MAX_QUEUED 32
+#define CATCIERGE_EXEC_KILL_DELAY 2.0 // Seconds after SIGTERM before SIGKILL.
+
+typedef struct catcierge_exec_proc_s
+{
+	pid_t pid;
+	char *command;
+	double start;
+	int terminated;		// SIGTERM was sent on timeout.
+} catcierge_exec_proc_t;
+
+typedef struct catcierge_exec_cmd_s
+{
+	char *command;
+	struct catcierge_exec_cmd_s *next;
+} catcierge_exec_cmd_t;
+
+typedef struct catcierge_exec_stats_s
+{
+	size_t started;
+	size_t succeeded;
+	size_t failed;		// Non-zero exit status or killed by a signal.
+	size_t timed_out;
+	size_t lost;		// Reaped by someone else, the exit status is unknown.
+	size_t dropped;		// The queue was full.
+	size_t spawn_errors;
+	size_t max_running;	// The most commands running at once.
+	double total_time;	// Run time of all finished commands.
+} catcierge_exec_stats_t;
+
+typedef struct catcierge_exec_s
+{
+	size_t max_running;
+	size_t max_queued;
+	double timeout;					// 0 for no timeout.
+
+	catcierge_exec_proc_t *running;	// max_running slots.
+	size_t running_count;
+
+	catcierge_exec_cmd_t *head;		// Commands waiting for a free slot.
+	catcierge_exec_cmd_t *tail;
+	size_t queued_count;
+
+	catcierge_exec_stats_t stats;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_t lock;			// Commands are run from the output threads.
+	#endif
+} catcierge_exec_t;
+
+int catcierge_exec_init(catcierge_exec_t *e,
+		size_t max_running, size_t max_queued, double timeout);
+
+// Waits for the running commands, at most the timeout, and kills the rest.
+// Without a timeout the running commands are left running.
+void catcierge_exec_destroy(catcierge_exec_t *e);
+
+// Starts the command with /bin/sh -c, or queues it if too many are running.
+int catcierge_exec_run(catcierge_exec_t *e, const char *command);
+
+// Reaps finished children, kills timed out ones and starts queued commands.
+// Returns the number of commands still running or queued.
+size_t catcierge_exec_service(catcierge_exec_t *e);
+
+void catcierge_exec_print_stats(catcierge_exec_t *e);
+
+#endif // __CATCIERGE_EXEC_H__
@@ -19,9 +19,11 @@
 #include "catcierge_config.h"
 #include "catcierge_args.h"
 #include "catcierge_log.h"
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
 
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
@@ -30,6 +32,7 @@
 #include "catcierge_template_matcher.h"
 #include "catcierge_haar_matcher.h"
 #include "catcierge_timer.h"
+#include "catcierge_clock.h"
 
 #ifdef RPI
 #include "RaspiCamCV.h"
@@ -51,29 +54,120 @@
 
 #ifdef WITH_ZMQ
 #include <czmq.h>
+#include "catcierge_publisher.h"
+#endif
+
+#if defined(WITH_ZMQ) && defined(CATCIERGE_HAVE_PTHREADS)
+#include "catcierge_preview.h"
 #endif
 
 #include "catcierge_fsm.h"
 #include "catcierge_output.h"
+#include "catcierge_encoded_image.h"
+
+static char **catcierge_get_event_commands(catcierge_args_t *args,
+		catcierge_event_t e, size_t *count)
+{
+	switch (e)
+	{
+		#define CATCIERGE_DEFINE_EVENT(ev_enum_name, ev_name, ev_description)	\
+			case ev_enum_name:												\
+				*count = args->ev_name ## _cmd_count;						\
+				return args->ev_name ## _cmd;
+		#include "catcierge_events.h"
+		default: break;
+	}
+
+	*count = 0;
+	return NULL;
+}
+
+static void catcierge_output_event_handler(const catcierge_event_data_t *ev, void *user)
+{
+	catcierge_grb_t *grb = (catcierge_grb_t *)user;
+	char **cmd = NULL;
+	size_t count = 0;
+
+	if (ev->execute)
+	{
+		cmd = catcierge_get_event_commands(&grb->args, ev->type, &count);
+	}
+
+	catcierge_output_execute_event(grb, ev->type, cmd, count);
+}
+
+int catcierge_update_event_subscriptions(catcierge_grb_t *grb)
+{
+	int e;
+	size_t count;
+	uint32_t events;
+	assert(grb);
+
+	events = grb->output.event_mask;
+
+	// Every event is published with --zmq_cbor.
+	if (grb->output.publish_cbor)
+	{
+		events = CATCIERGE_EVENT_MASK_ALL;
+	}
+
+	if (grb->output.publish_images)
+	{
+		events |= CATCIERGE_EVENT_BIT(CATCIERGE_MATCH_GROUP_DONE);
+	}
+
+	for (e = 0; e < CATCIERGE_EVENT_COUNT; e++)
+	{
+		catcierge_get_event_commands(&grb->args, (catcierge_event_t)e, &count);
+
+		if (count > 0)
+		{
+			events |= CATCIERGE_EVENT_BIT(e);
+		}
+	}
+
+	return catcierge_bus_set_events(&grb->bus, grb->output_subscriber, events);
+}
 
 void catcierge_trigger_event(catcierge_grb_t *grb, catcierge_event_t e, int execute)
 {
-	catcierge_args_t *args = &grb->args;
+	catcierge_event_data_t ev;
+	match_group_t *mg = &grb->match_group;
+	match_state_t *m = NULL;
 
 	// We use this wrapper function and pass a catcierge_event_t so that if
 	// one specifies an event type that is not defined in "catcierge_events.h"
 	// it will fail at compilation time.
 
-	#define CATCIERGE_DEFINE_EVENT(ev_enum_name, ev_name, ev_description)	\
-		if (e == ev_enum_name)												\
-		{																	\
-			char **cmd = NULL;												\
-			size_t count = args->ev_name ## _cmd_count;						\
-			if (execute) cmd = args->ev_name ## _cmd;						\
-			catcierge_output_execute_list(grb, #ev_name, cmd, count);		\
-			return;															\
-		}
-	#include "catcierge_events.h"
+	memset(&ev, 0, sizeof(ev));
+	ev.type = e;
+	ev.execute = execute;
+	catcierge_clock_gettimeofday(&ev.tv);
+
+	switch (e)
+	{
+		case CATCIERGE_STATE_CHANGE:
+			ev.u.state_change.state = catcierge_get_state_string(grb->state);
+			ev.u.state_change.prev_state = catcierge_get_state_string(grb->prev_state);
+			break;
+		case CATCIERGE_MATCH_DONE:
+			if (mg->matches && (mg->match_count > 0))
+			{
+				m = &mg->matches[mg->match_count - 1];
+				ev.u.match.idx = (int)mg->match_count - 1;
+				ev.u.match.success = m->result.success;
+				ev.u.match.result = m->result.result;
+			}
+			break;
+		case CATCIERGE_MATCH_GROUP_DONE:
+			ev.u.match_group.success = mg->success;
+			ev.u.match_group.success_count = mg->success_count;
+			ev.u.match_group.direction = mg->direction;
+			break;
+		default: break;
+	}
+
+	catcierge_bus_publish(&grb->bus, &ev);
 }
 
 void catcierge_run_state(catcierge_grb_t *grb)
@@ -122,50 +216,61 @@ void catcierge_set_state(catcierge_grb_t *grb, catcierge_state_func_t new_state)
 	grb->prev_state = grb->state;
 	grb->state = new_state;
 
+	// Only idle while waiting, and start counting
+	// from scratch every time we get back to waiting.
+	catcierge_set_idle(grb, 0);
+	catcierge_timer_reset(&grb->idle_timer);
+
 	catcierge_trigger_event(grb, CATCIERGE_STATE_CHANGE, 1);
 }
 
 #ifdef WITH_RFID
-static int match_allowed_rfid(catcierge_grb_t *grb, const char *rfid_tag)
+static rfid_match_t *rfid_first_triggered(catcierge_grb_t *grb, size_t *idx)
 {
-	int i;
-	catcierge_args_t *args;
-	assert(grb);
-	args = &grb->args;
+	size_t i;
+	rfid_match_t *first = NULL;
 
-	for (i = 0; i < args->rfid_allowed_count; i++)
+	for (i = 0; i < grb->rfid_count; i++)
 	{
-		if (!strcmp(rfid_tag, args->rfid_allowed[i]))
+		rfid_match_t *m = &grb->rfid_matches[i];
+
+		if (m->triggered && (!first || timercmp(&m->time, &first->time, <)))
 		{
-			return 1;
+			first = m;
+			*idx = i;
 		}
 	}
 
-	return 0;
+	return first;
 }
 
-static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid_match_t *other, 
-						match_direction_t dir, const char *dir_str, catcierge_rfid_t *rfid, 
+static void rfid_set_direction(catcierge_grb_t *grb, size_t idx, catcierge_rfid_t *rfid,
 						int complete, const char *data, size_t data_len)
 {
-	catcierge_args_t *args;
+	size_t first_idx = 0;
+	rfid_match_t *current = NULL;
+	rfid_match_t *first = NULL;
 	assert(grb);
-	args = &grb->args;
 
-	CATLOG("%s RFID: %s%s\n", rfid->name, data, !complete ? " (incomplete)": "");
+	current = &grb->rfid_matches[idx];
+
+	CATLOG("%s RFID: %s%s (received %.0f ms ago)\n", rfid->name, data,
+		!complete ? " (incomplete)": "",
+		(catcierge_clock_realtime() - (rfid->time.tv_sec + rfid->time.tv_usec / 1000000.0)) * 1000.0);
 
 	CATLOG("   Old data %s (%d bytes) New data %s (%d bytes)\n",
-		other->complete ? "COMPLETE" : "INCOMPLETE",
-		(int)other->data_len,
+		current->complete ? "COMPLETE" : "INCOMPLETE",
+		(int)current->data_len,
 		complete ? "COMPLETE" : "INCOMPLETE",
 		(int)data_len);
 
 	// Update the match if we get a complete tag.
-	if (complete && (data_len > other->data_len))
+	if (complete && (data_len > current->data_len))
 	{
 		strncpy(current->data, data, sizeof(current->data) - 1);
 		current->data_len = data_len;
 		current->complete = complete;
+		current->is_allowed = catcierge_rfid_allowed_contains(&grb->rfid_allowed, current->data);
 	}
 
 	// If we have already triggered this reader
@@ -177,68 +282,175 @@ static void rfid_set_direction(catcierge_grb_t *grb, rfid_match_t *current, rfid
 		return;
 	}
 
-	// The other reader triggered first so we know the direction.
+	// Another reader triggered first so we know the direction,
+	// the cat is moving from that reader towards this one.
 	// TODO: It could be wise to time this out after a while...
-	if (other->triggered)
+	if ((first = rfid_first_triggered(grb, &first_idx)))
 	{
-		grb->rfid_direction = dir;
-		CATLOG("%s RFID: Direction %s\n", rfid->name, dir_str);
+		grb->rfid_direction = (idx < first_idx) ? MATCH_DIR_IN : MATCH_DIR_OUT;
+		CATLOG("%s RFID: Direction %s (first seen by %s)\n", rfid->name,
+			(grb->rfid_direction == MATCH_DIR_IN) ? "IN" : "OUT",
+			grb->rfids[first_idx].name);
 	}
 
 	current->triggered = 1;
 	current->complete = complete;
 	strncpy(current->data, data, sizeof(current->data) - 1);
 	current->data_len = data_len;
-	current->is_allowed = match_allowed_rfid(grb, current->data);
+	current->time = rfid->time;
+	current->is_allowed = catcierge_rfid_allowed_contains(&grb->rfid_allowed, current->data);
 
 	// TODO: Do we have all RFID vars for this?
 	catcierge_trigger_event(grb, CATCIERGE_RFID_DETECT, 1);
 }
 
-static void rfid_inner_read_cb(catcierge_rfid_t *rfid, int complete, const char *data, size_t data_len, void *user)
+static void rfid_read_cb(catcierge_rfid_t *rfid, int complete, const char *data, size_t data_len, void *user)
 {
 	catcierge_grb_t *grb = user;
 
-	// The inner RFID reader has detected a tag, we now pass that
-	// match on to the code that decides which direction the cat
-	// is going.
-	rfid_set_direction(grb, &grb->rfid_in_match, &grb->rfid_out_match,
-			MATCH_DIR_IN, "IN", rfid, complete, data, data_len);
+	// A reader has detected a tag, we now pass that match on to
+	// the code that decides which direction the cat is going.
+	rfid_set_direction(grb, (size_t)(rfid - grb->rfids), rfid, complete, data, data_len);
 }
 
-static void rfid_outer_read_cb(catcierge_rfid_t *rfid, int complete, const char *data, size_t data_len, void *user)
+int catcierge_reload_rfid_allowed(catcierge_grb_t *grb)
 {
-	catcierge_grb_t *grb = user;
-	rfid_set_direction(grb, &grb->rfid_out_match, &grb->rfid_in_match,
-			MATCH_DIR_OUT, "OUT", rfid, complete, data, data_len);
+	size_t i;
+	catcierge_args_t *args;
+	assert(grb);
+	args = &grb->args;
+
+	if (catcierge_rfid_allowed_load(&grb->rfid_allowed,
+		args->rfid_allowed, args->rfid_allowed_count, args->rfid_allowed_file))
+	{
+		CATERR("Failed to load the allowed RFID tags, keeping the old ones\n");
+		return -1;
+	}
+
+	// Tags that have already been read are checked again.
+	for (i = 0; i < grb->rfid_count; i++)
+	{
+		rfid_match_t *m = &grb->rfid_matches[i];
+		m->is_allowed = m->triggered
+			&& catcierge_rfid_allowed_contains(&grb->rfid_allowed, m->data);
+	}
+
+	CATLOG("Loaded %lu allowed RFID tags\n", (unsigned long)grb->rfid_allowed.count);
+
+	return 0;
 }
 
-void catcierge_init_rfid_readers(catcierge_grb_t *grb)
+static void rfid_setup_reader(catcierge_grb_t *grb, const char *name,
+						int name_len, const char *path)
 {
+	char buf[256];
+
+	snprintf(buf, sizeof(buf), "%.*s", name_len, name);
+	catcierge_rfid_init(buf, &grb->rfids[grb->rfid_count], path, rfid_read_cb, grb);
+	grb->rfid_count++;
+}
+
+int catcierge_create_rfid_readers(catcierge_grb_t *grb)
+{
+	size_t i;
+	size_t count;
 	catcierge_args_t *args;
 	assert(grb);
 
 	args = &grb->args;
 
 	catcierge_rfid_ctx_init(&grb->rfid_ctx);
+	catcierge_rfid_allowed_init(&grb->rfid_allowed);
 
+	if (catcierge_reload_rfid_allowed(grb))
+	{
+		return -1;
+	}
+
+	count = args->rfid_reader_count
+		+ (args->rfid_inner_path ? 1 : 0)
+		+ (args->rfid_outer_path ? 1 : 0);
+
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	if (!(grb->rfids = calloc(count, sizeof(catcierge_rfid_t)))
+	 || !(grb->rfid_matches = calloc(count, sizeof(rfid_match_t))))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	// Ordered from the inside to the outside.
 	if (args->rfid_inner_path)
 	{
-		memset(&grb->rfid_in_match, 0, sizeof(grb->rfid_in_match));
-		catcierge_rfid_init("Inner", &grb->rfid_in, args->rfid_inner_path, rfid_inner_read_cb, grb);
-		catcierge_rfid_ctx_set_inner(&grb->rfid_ctx, &grb->rfid_in);
-		catcierge_rfid_open(&grb->rfid_in);
+		rfid_setup_reader(grb, "Inner", 5, args->rfid_inner_path);
+	}
+
+	for (i = 0; i < args->rfid_reader_count; i++)
+	{
+		const char *reader = args->rfid_readers[i];
+		const char *sep = strchr(reader, '=');
+		assert(sep);
+		rfid_setup_reader(grb, reader, (int)(sep - reader), sep + 1);
 	}
 
 	if (args->rfid_outer_path)
 	{
-		memset(&grb->rfid_out_match, 0, sizeof(grb->rfid_out_match));
-		catcierge_rfid_init("Outer", &grb->rfid_out, args->rfid_outer_path, rfid_outer_read_cb, grb);
-		catcierge_rfid_ctx_set_outer(&grb->rfid_ctx, &grb->rfid_out);
-		catcierge_rfid_open(&grb->rfid_out);
+		rfid_setup_reader(grb, "Outer", 5, args->rfid_outer_path);
 	}
-	
-	CATLOG("Initialized RFID readers\n");
+
+	for (i = 0; i < grb->rfid_count; i++)
+	{
+		if (catcierge_rfid_ctx_add(&grb->rfid_ctx, &grb->rfids[i]))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int catcierge_init_rfid_readers(catcierge_grb_t *grb)
+{
+	size_t i;
+	assert(grb);
+
+	if (catcierge_create_rfid_readers(grb))
+	{
+		return -1;
+	}
+
+	for (i = 0; i < grb->rfid_count; i++)
+	{
+		catcierge_rfid_open(&grb->rfids[i]);
+	}
+
+	CATLOG("Initialized %lu RFID readers\n", (unsigned long)grb->rfid_count);
+
+	return 0;
+}
+
+void catcierge_destroy_rfid_readers(catcierge_grb_t *grb)
+{
+	size_t i;
+	assert(grb);
+
+	// Stops the reader thread before the ports are closed.
+	catcierge_rfid_ctx_destroy(&grb->rfid_ctx);
+
+	for (i = 0; i < grb->rfid_count; i++)
+	{
+		catcierge_rfid_destroy(&grb->rfids[i]);
+	}
+
+	catcierge_xfree(&grb->rfids);
+	catcierge_xfree(&grb->rfid_matches);
+	grb->rfid_count = 0;
+
+	catcierge_rfid_allowed_destroy(&grb->rfid_allowed);
 }
 #endif // WITH_RFID
 
@@ -307,11 +519,10 @@ static void catcierge_path_reset(catcierge_path_t *path)
 	path->dir[0] = '\0';
 }
 
-static void catcierge_cleanup_match_steps(catcierge_grb_t *grb, match_result_t *result)
+static void catcierge_cleanup_match_steps(match_result_t *result)
 {
 	int j;
 	match_step_t *step = NULL;
-	assert(grb);
 	assert(result);
 
 	for (j = 0; j < MAX_MATCH_RECTS; j++)
@@ -331,19 +542,77 @@ static void catcierge_cleanup_match_steps(catcierge_grb_t *grb, match_result_t *
 	result->step_img_count = 0;
 }
 
-static void catcierge_cleanup_imgs(catcierge_grb_t *grb)
+static void catcierge_match_group_cleanup_imgs(match_group_t *mg)
 {
-	int i;
-	assert(grb);
+	size_t i;
+	assert(mg);
+
+	catcierge_encoded_images_release(mg);
 
-	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	for (i = 0; i < mg->max_count; i++)
 	{
-		if (grb->match_group.matches[i].img)
+		if (mg->matches[i].img)
 		{
-			cvReleaseImage(&grb->match_group.matches[i].img);
+			cvReleaseImage(&mg->matches[i].img);
 		}
 
-		catcierge_cleanup_match_steps(grb, &grb->match_group.matches[i].result);
+		catcierge_cleanup_match_steps(&mg->matches[i].result);
+	}
+}
+
+int catcierge_match_group_init(match_group_t *mg, size_t max_count)
+{
+	assert(mg);
+	assert(max_count > 0);
+
+	if (!(mg->matches = calloc(max_count, sizeof(match_state_t))))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	mg->max_count = max_count;
+	mg->match_count = 0;
+
+	return 0;
+}
+
+int catcierge_match_group_resize(match_group_t *mg, size_t max_count)
+{
+	assert(mg);
+
+	if (mg->matches && (mg->max_count == max_count))
+	{
+		return 0;
+	}
+
+	catcierge_match_group_destroy(mg);
+
+	return catcierge_match_group_init(mg, max_count);
+}
+
+void catcierge_match_group_destroy(match_group_t *mg)
+{
+	assert(mg);
+
+	if (mg->matches)
+	{
+		catcierge_match_group_cleanup_imgs(mg);
+		free(mg->matches);
+		mg->matches = NULL;
+	}
+
+	mg->max_count = 0;
+	mg->match_count = 0;
+}
+
+static void catcierge_cleanup_imgs(catcierge_grb_t *grb)
+{
+	assert(grb);
+
+	if (grb->match_group.matches)
+	{
+		catcierge_match_group_cleanup_imgs(&grb->match_group);
 	}
 
 	if (grb->match_group.obstruct_img)
@@ -429,6 +698,14 @@ void catcierge_destroy_camera(catcierge_grb_t *grb)
 	}
 }
 
+void catcierge_destroy_output(catcierge_grb_t *grb)
+{
+	// With --output_threads the queued events are still generated when the
+	// output is destroyed, and they can refer to the matcher settings.
+	catcierge_output_destroy(&grb->output);
+	catcierge_matcher_destroy(&grb->matcher);
+}
+
 int catcierge_drop_root_privileges(const char *user)
 {
 	#ifdef CATCIERGE_ENABLE_DROP_ROOT_PRIVILEGES
@@ -516,10 +793,77 @@ fail:
 }
 #endif // RPI
 
+static void catcierge_set_camera_fps(catcierge_grb_t *grb, double fps)
+{
+	assert(grb);
+
+	#ifdef RPI
+	if (!grb->args.non_rpi_cam)
+	{
+		if (grb->rpi_capture)
+		{
+			raspiCamCvSetCaptureProperty(grb->rpi_capture, CV_CAP_PROP_FPS, fps);
+		}
+	}
+	else
+	#endif // RPI
+	{
+		if (grb->capture)
+		{
+			cvSetCaptureProperty(grb->capture, CV_CAP_PROP_FPS, fps);
+		}
+	}
+}
+
+static double catcierge_get_camera_fps(catcierge_grb_t *grb)
+{
+	assert(grb);
+
+	#ifdef RPI
+	if (!grb->args.non_rpi_cam)
+	{
+		return grb->args.rpi_settings.framerate;
+	}
+	else
+	#endif // RPI
+	{
+		// Returns 0 if the backend doesn't support it.
+		return grb->capture ? cvGetCaptureProperty(grb->capture, CV_CAP_PROP_FPS) : 0.0;
+	}
+}
+
+// Only called by whoever grabs the frames, so that the frame
+// rate never changes in the middle of capturing a frame.
+static void catcierge_update_camera_fps(catcierge_grb_t *grb)
+{
+	int idle = (int)catcierge_atomic_load(&grb->camera_idle);
+
+	if (idle == grb->camera_idle_applied)
+		return;
+
+	if (idle)
+	{
+		// If the camera can't change its frame rate we still
+		// skip frames, see catcierge_get_frame_interval.
+		if ((grb->camera_fps = catcierge_get_camera_fps(grb)) > 0.0)
+		{
+			catcierge_set_camera_fps(grb, grb->args.idle_fps);
+		}
+	}
+	else if (grb->camera_fps > 0.0)
+	{
+		catcierge_set_camera_fps(grb, grb->camera_fps);
+	}
+
+	grb->camera_idle_applied = idle;
+}
+
 IplImage *catcierge_get_frame(catcierge_grb_t *grb)
 {
 	assert(grb);
 
+	catcierge_update_camera_fps(grb);
+
 	#ifdef RPI
 	if (!grb->args.non_rpi_cam)
 	{
@@ -532,6 +876,101 @@ IplImage *catcierge_get_frame(catcierge_grb_t *grb)
 	}
 }
 
+void catcierge_set_idle(catcierge_grb_t *grb, int idle)
+{
+	catcierge_args_t *args;
+	assert(grb);
+	args = &grb->args;
+
+	if (grb->idle == idle)
+		return;
+
+	if (idle)
+	{
+		CATLOG("Nothing has changed for %0.1f seconds, going idle at %0.1f fps\n",
+			catcierge_timer_get(&grb->idle_timer), args->idle_fps);
+	}
+	else
+	{
+		CATLOG("Leaving idle, back to full frame rate\n");
+	}
+
+	// This can run on another thread than the one capturing frames
+	// (signals, --control), so the camera is changed before the next grab.
+	catcierge_atomic_store(&grb->camera_idle, (long)idle);
+	grb->idle = idle;
+	catcierge_timer_reset(&grb->idle_timer);
+}
+
+double catcierge_get_frame_interval(catcierge_grb_t *grb)
+{
+	assert(grb);
+
+	if (!grb->idle || (grb->args.idle_fps <= 0.0))
+		return 0.0;
+
+	return (1.0 / grb->args.idle_fps);
+}
+
+static double catcierge_get_roi_mean(catcierge_grb_t *grb)
+{
+	int i;
+	double mean = 0.0;
+	CvScalar avg;
+	IplImage *img = grb->img;
+	CvRect orig_roi = cvGetImageROI(img);
+	CvRect *roi = &grb->args.roi;
+
+	if ((roi->width != 0) && (roi->height != 0))
+	{
+		cvSetImageROI(img, *roi);
+	}
+
+	avg = cvAvg(img, NULL);
+	cvSetImageROI(img, orig_roi);
+
+	for (i = 0; i < img->nChannels; i++)
+	{
+		mean += avg.val[i];
+	}
+
+	return (mean / img->nChannels);
+}
+
+static void catcierge_update_idle(catcierge_grb_t *grb, int frame_obstructed)
+{
+	double mean;
+	catcierge_args_t *args = &grb->args;
+	assert(grb);
+
+	if (args->idle_after <= 0.0)
+		return;
+
+	// Cheap change detection, so that we wake up as soon
+	// as something moves in front of the backlight.
+	mean = catcierge_get_roi_mean(grb);
+
+	if (frame_obstructed
+	 || (fabs(mean - grb->idle_prev_mean) > args->idle_threshold))
+	{
+		catcierge_set_idle(grb, 0);
+		catcierge_timer_reset(&grb->idle_timer);
+	}
+
+	grb->idle_prev_mean = mean;
+
+	if (!catcierge_timer_isactive(&grb->idle_timer))
+	{
+		catcierge_timer_set(&grb->idle_timer, args->idle_after);
+		catcierge_timer_start(&grb->idle_timer);
+	}
+
+	if (!grb->idle && catcierge_timer_has_timed_out(&grb->idle_timer))
+	{
+		catcierge_set_idle(grb, 1);
+	}
+}
+
 static int catcierge_calculate_match_id(IplImage *img, match_state_t *m)
 {
 	assert(img);
@@ -580,7 +1019,7 @@ static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
  	match_state_t *m = NULL;
 	assert(grb);
 	assert(img);
-	assert(grb->match_group.match_count <= MATCH_MAX_COUNT);
+	assert(grb->match_group.match_count <= grb->match_group.max_count);
 	args = &grb->args;
 
 	m = &grb->match_group.matches[grb->match_group.match_count - 1];
@@ -588,8 +1027,8 @@ static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
 
 	// Get time of match and format.
 	m->img = NULL;
-	m->time = time(NULL); // TODO: Get rid of this and use tv.tv_sec instead, same thing.
-	gettimeofday(&m->tv, NULL);
+	catcierge_clock_gettimeofday(&m->tv);
+	m->time = m->tv.tv_sec;
 	get_time_str_fmt(m->time, &m->tv, m->time_str,
 		sizeof(m->time_str), FILENAME_TIME_FORMAT);
 
@@ -698,12 +1137,31 @@ static void catcierge_process_match_result(catcierge_grb_t *grb, IplImage *img)
 	}
 }
 
+// The image is encoded once, and the same data is kept for publishing.
+static int catcierge_save_image(IplImage *img, catcierge_path_t *path,
+		catcierge_encoded_image_t **encoded)
+{
+	const char *ext = strrchr(path->filename, '.');
+
+	catcierge_encoded_image_unref(encoded);
+	catcierge_make_path(path->dir);
+
+	if (!(*encoded = catcierge_encoded_image_create(img, ext ? ext : ".png", NULL))
+	 || catcierge_encoded_image_save(*encoded, path->full))
+	{
+		CATERR("Failed to save image %s\n", path->full);
+		return -1;
+	}
+
+	return 0;
+}
+
 static void catcierge_save_images(catcierge_grb_t *grb, match_direction_t direction)
 {
 	match_group_t *mg = &grb->match_group;
 	match_state_t *m;
 	match_result_t *res;
-	int i;
+	size_t i;
 	size_t j;
 	catcierge_args_t *args;
 	match_step_t *step = NULL;
@@ -713,22 +1171,25 @@ static void catcierge_save_images(catcierge_grb_t *grb, match_direction_t direct
 	if (args->save_obstruct_img)
 	{
 		CATLOG("Saving obstruct image: %s\n", mg->obstruct_path.full);
-		catcierge_make_path(mg->obstruct_path.dir);
-		cvSaveImage(mg->obstruct_path.full, mg->obstruct_img, 0);
+
+		if (mg->obstruct_img)
+		{
+			catcierge_save_image(mg->obstruct_img, &mg->obstruct_path, &mg->obstruct_encoded);
+		}
+
 		// TODO: Save obstruct step images as well?
 		// TODO: Add execute event for this?
 
 		cvReleaseImage(&mg->obstruct_img);
 	}
 
-	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	for (i = 0; i < mg->match_count; i++)
 	{
 		m = &grb->match_group.matches[i];
 		res = &m->result;
 
 		CATLOG("Saving image %s\n", m->path.full);
-		catcierge_make_path(m->path.dir);
-		cvSaveImage(m->path.full, m->img, 0);
+		catcierge_save_image(m->img, &m->path, &m->encoded);
 
 		if (args->save_steps)
 		{
@@ -739,8 +1200,7 @@ static void catcierge_save_images(catcierge_grb_t *grb, match_direction_t direct
 
 				if (step->img)
 				{
-					catcierge_make_path(step->path.dir);
-					cvSaveImage(step->path.full, step->img, NULL);
+					catcierge_save_image(step->img, &step->path, &step->encoded);
 				}
 			}
 		}
@@ -818,35 +1278,28 @@ static void catcierge_should_we_rfid_lockout(catcierge_grb_t *grb)
 	if (!args->lock_on_invalid_rfid)
 		return;
 
-	if (!grb->checked_rfid_lock 
-		&& (args->rfid_inner_path || args->rfid_outer_path))
+	if (!grb->checked_rfid_lock && (grb->rfid_count > 0))
 	{
 		// Have we waited long enough since the camera match was
 		// complete (The cat must have moved far enough for both
 		// readers to have a chance to detect it).
 		if (catcierge_timer_get(&grb->rematch_timer) >= args->rfid_lock_time)
 		{
-			int do_rfid_lockout = 0;
+			size_t i;
+			size_t first_idx;
+			int do_rfid_lockout = 1;
 
-			if (!grb->rfid_out_match.triggered && !grb->rfid_in_match.triggered)
+			// Only require one of the readers to have a correct read.
+			for (i = 0; i < grb->rfid_count; i++)
 			{
-				CATERR("Unknown RFID direction!\n");
-				grb->rfid_direction = MATCH_DIR_UNKNOWN;
+				if (grb->rfid_matches[i].is_allowed)
+					do_rfid_lockout = 0;
 			}
 
-			if (args->rfid_inner_path && args->rfid_outer_path)
-			{
-				// Only require one of the readers to have a correct read.
-				do_rfid_lockout = !(grb->rfid_in_match.is_allowed 
-								|| grb->rfid_out_match.is_allowed);
-			}
-			else if (args->rfid_inner_path)
-			{
-				do_rfid_lockout = !grb->rfid_in_match.is_allowed;
-			}
-			else if (args->rfid_outer_path)
+			if (!rfid_first_triggered(grb, &first_idx))
 			{
-				do_rfid_lockout = !grb->rfid_out_match.is_allowed;
+				CATERR("Unknown RFID direction!\n");
+				grb->rfid_direction = MATCH_DIR_UNKNOWN;
 			}
 
 			if (do_rfid_lockout)
@@ -866,8 +1319,11 @@ static void catcierge_should_we_rfid_lockout(catcierge_grb_t *grb)
 				CATLOG("RFID OK!\n");
 			}
 
-			if (args->rfid_inner_path) CATLOG("  %s RFID: %s\n", grb->rfid_in.name, grb->rfid_in_match.triggered ? grb->rfid_in_match.data : "No tag data");
-			if (args->rfid_outer_path) CATLOG("  %s RFID: %s\n", grb->rfid_out.name, grb->rfid_out_match.triggered ? grb->rfid_out_match.data : "No tag data");
+			for (i = 0; i < grb->rfid_count; i++)
+			{
+				CATLOG("  %s RFID: %s\n", grb->rfids[i].name,
+					grb->rfid_matches[i].triggered ? grb->rfid_matches[i].data : "No tag data");
+			}
 
 			// TODO: Do we have all RFID vars for this?
 			catcierge_trigger_event(grb, CATCIERGE_RFID_MATCH, 1);
@@ -891,6 +1347,13 @@ static void catcierge_show_image(catcierge_grb_t *grb)
 	if (!grb->img)
 		return;
 
+	#if defined(WITH_ZMQ) && defined(CATCIERGE_HAVE_PTHREADS)
+	if (grb->preview)
+	{
+		catcierge_preview_push(grb->preview, grb->img);
+	}
+	#endif
+
 	// Show the video feed.
 	if (args->show)
 	{
@@ -898,7 +1361,7 @@ static void catcierge_show_image(catcierge_grb_t *grb)
 
 		// Only try to show the match rectangles when we're in match mode.
 		if ((grb->match_group.match_count > 0)
-			&& (grb->match_group.match_count <= MATCH_MAX_COUNT))
+			&& (grb->match_group.match_count <= grb->match_group.max_count))
 		{
 			size_t i;
 			CvScalar match_color;
@@ -944,13 +1407,13 @@ double catcierge_do_match(catcierge_grb_t *grb)
 	match_result_t *result;
 	match_state_t *match;
 	assert(grb);
-	assert(mg->match_count <= MATCH_MAX_COUNT);
+	assert(mg->match_count <= mg->max_count);
 	args = &grb->args;
 
 	// Clear match structs before doing a new one.
 	match = &mg->matches[mg->match_count - 1];
 	result = &match->result;
-	catcierge_cleanup_match_steps(grb, result);
+	catcierge_cleanup_match_steps(result);
 	memset(result, 0, sizeof(match_result_t));
 
 	if ((match_res = grb->matcher->match(grb->matcher, grb->img, result, args->save_steps)) < 0.0)
@@ -963,7 +1426,8 @@ double catcierge_do_match(catcierge_grb_t *grb)
 
 static match_direction_t catcierge_guess_overall_direction(catcierge_grb_t *grb)
 {
-	int i;
+	size_t i;
+	match_group_t *mg = &grb->match_group;
 	match_direction_t direction = MATCH_DIR_UNKNOWN;
 	assert(grb);
 
@@ -973,7 +1437,7 @@ static match_direction_t catcierge_guess_overall_direction(catcierge_grb_t *grb)
 		// (It is very uncommon for 2 successful matches to give different
 		// direction with the template matcher, so we can be pretty sure
 		// this is correct).
-		for (i = 0; i < MATCH_MAX_COUNT; i++)
+		for (i = 0; i < mg->match_count; i++)
 		{
 			if (grb->match_group.matches[i].result.success)
 			{
@@ -988,7 +1452,7 @@ static match_direction_t catcierge_guess_overall_direction(catcierge_grb_t *grb)
 		int out_count = 0;
 		int unknown_count = 0;
 
-		for (i = 0; i < MATCH_MAX_COUNT; i++)
+		for (i = 0; i < mg->match_count; i++)
 		{
 			switch (grb->match_group.matches[i].result.direction)
 			{
@@ -1019,8 +1483,8 @@ void catcierge_match_group_start(match_group_t *mg, IplImage *img)
 {
 	assert(mg);
 
-	gettimeofday(&mg->start_tv, NULL);
-	mg->start_time = time(NULL);
+	catcierge_clock_gettimeofday(&mg->start_tv);
+	mg->start_time = mg->start_tv.tv_sec;
 
 	memset(&mg->end_tv, 0, sizeof(mg->end_tv));
 	mg->end_time = 0;
@@ -1029,6 +1493,7 @@ void catcierge_match_group_start(match_group_t *mg, IplImage *img)
 	catcierge_path_reset(&mg->obstruct_path);
 	mg->match_count = 0;
 	mg->final_decision = 0;
+	mg->early_decision = 0;
 
 	// We base the matchgroup id on the obstruct image + timestamp.
 	catcierge_calculate_matchgroup_id(mg, img);
@@ -1052,8 +1517,151 @@ void catcierge_match_group_end(match_group_t *mg)
 {
 	assert(mg);
 
-	gettimeofday(&mg->end_tv, NULL);
-	mg->end_time = time(NULL);
+	catcierge_clock_gettimeofday(&mg->end_tv);
+	mg->end_time = mg->end_tv.tv_sec;
+}
+
+// The probability that at least needed of the remaining matches succeed,
+// using the success rate so far (with a uniform prior) as the estimate.
+static double catcierge_match_group_success_probability(int success_count,
+				int match_count, int remaining, int needed)
+{
+	int j;
+	double p = (success_count + 1.0) / (match_count + 2.0);
+	double binom = 1.0;
+	double prob = 0.0;
+
+	needed -= success_count;
+
+	if (needed <= 0)
+		return 1.0;
+
+	if (needed > remaining)
+		return 0.0;
+
+	for (j = 0; j <= remaining; j++)
+	{
+		if (j >= needed)
+		{
+			prob += binom * pow(p, j) * pow(1.0 - p, remaining - j);
+		}
+
+		// C(remaining, j + 1)
+		binom = binom * (remaining - j) / (j + 1);
+	}
+
+	return prob;
+}
+
+// Can the remaining matches still make the overall direction "out",
+// which always counts as a success?
+static int catcierge_match_group_can_go_out(catcierge_grb_t *grb, int remaining)
+{
+	size_t i;
+	int in_count = 0;
+	int out_count = 0;
+	int unknown_count = 0;
+	int success_count = 0;
+	match_group_t *mg = &grb->match_group;
+
+	for (i = 0; i < mg->match_count; i++)
+	{
+		success_count += !!mg->matches[i].result.success;
+
+		switch (mg->matches[i].result.direction)
+		{
+			case MATCH_DIR_IN: in_count++; break;
+			case MATCH_DIR_OUT: out_count++; break;
+			case MATCH_DIR_UNKNOWN: unknown_count++; break;
+		}
+	}
+
+	if (grb->args.matcher_type == MATCHER_TEMPLATE)
+	{
+		// The template matcher takes the direction of the successful
+		// matches, which practically never disagree. So once we have
+		// one the direction is settled.
+		if (success_count > 0)
+			return (catcierge_guess_overall_direction(grb) == MATCH_DIR_OUT);
+
+		return (remaining > 0);
+	}
+
+	// Best case for "out" is that all remaining matches are "out".
+	out_count += remaining;
+
+	if ((in_count > out_count) && (in_count > unknown_count))
+		return 0;
+
+	return (out_count > unknown_count);
+}
+
+// Checks if the match group outcome is settled before
+// all --max_matches matches have been made (--early_decision).
+static int catcierge_match_group_is_decided(catcierge_grb_t *grb)
+{
+	size_t i;
+	int success_count = 0;
+	int remaining;
+	double prob;
+	match_group_t *mg = &grb->match_group;
+	catcierge_args_t *args = &grb->args;
+	assert(grb);
+
+	if (!args->early_decision)
+		return 0;
+
+	for (i = 0; i < mg->match_count; i++)
+	{
+		success_count += !!mg->matches[i].result.success;
+	}
+
+	remaining = (int)(mg->max_count - mg->match_count);
+
+	if (success_count >= args->ok_matches_needed)
+	{
+		// More matches can't take away successes. But let the matcher
+		// veto on a copy, so that we keep matching if it would.
+		if (!args->no_final_decision)
+		{
+			match_group_t tmp = *mg;
+			tmp.success = 1;
+			tmp.final_decision = 0;
+
+			if (!grb->matcher->decide(grb->matcher, &tmp))
+				return 0;
+		}
+
+		mg->early_decision = 1;
+	}
+	else if (!catcierge_match_group_can_go_out(grb, remaining))
+	{
+		if ((success_count + remaining) < args->ok_matches_needed)
+		{
+			// Not enough matches left to reach --ok_matches_needed.
+			mg->early_decision = 1;
+		}
+		else if (args->early_decision_confidence > 0.0)
+		{
+			prob = catcierge_match_group_success_probability(success_count,
+					(int)mg->match_count, remaining, args->ok_matches_needed);
+
+			if (prob <= (1.0 - args->early_decision_confidence))
+			{
+				CATLOG("Only %0.1f%% chance of reaching %d ok matches\n",
+					prob * 100.0, args->ok_matches_needed);
+				mg->early_decision = 1;
+			}
+		}
+	}
+
+	if (mg->early_decision)
+	{
+		CATLOG("Early decision after %d of %d matches\n",
+			(int)mg->match_count, (int)mg->max_count);
+	}
+
+	return mg->early_decision;
 }
 
 void catcierge_decide_lock_status(catcierge_grb_t *grb)
@@ -1061,12 +1669,12 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 	match_group_t *mg = &grb->match_group;
 	catcierge_args_t *args = &grb->args;
 	assert(grb);
-	int i;
+	size_t i;
 
 	mg->success = 0;
 	mg->success_count = 0;
 
-	for (i = 0; i < MATCH_MAX_COUNT; i++)
+	for (i = 0; i < mg->match_count; i++)
 	{
 		mg->success_count += !!mg->matches[i].result.success;
 	}
@@ -1091,7 +1699,7 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 		{
 			snprintf(mg->description, sizeof(mg->description) - 1,
 				"Lockout %d of %d matches failed",
-				(MATCH_MAX_COUNT - mg->success_count), MATCH_MAX_COUNT);
+				((int)mg->match_count - mg->success_count), (int)mg->match_count);
 		}
 
 		// Let the matcher veto if the match group was successful.
@@ -1112,7 +1720,7 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 		snprintf(mg->description, sizeof(mg->description) - 1, "Everything OK!");
 
 		CATLOG("Everything OK! (%d out of %d matches succeeded)"
-				" Door kept open...\n", mg->success_count, MATCH_MAX_COUNT);
+				" Door kept open...\n", mg->success_count, (int)mg->match_count);
 
 		if (grb->consecutive_lockout_count > 0)
 		{
@@ -1137,7 +1745,7 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 	else
 	{
 		CATLOG("Lockout! %d out of %d matches failed (for %d seconds).\n",
-				(MATCH_MAX_COUNT - mg->success_count), MATCH_MAX_COUNT,
+				((int)mg->match_count - mg->success_count), (int)mg->match_count,
 				args->lockout_time);
 
 		// Only do the lockout if something isn't wrong.
@@ -1162,7 +1770,10 @@ void catcierge_decide_lock_status(catcierge_grb_t *grb)
 
 	catcierge_trigger_event(grb, CATCIERGE_MATCH_GROUP_DONE, 1);
 
-	assert(mg->match_count <= MATCH_MAX_COUNT);
+	// Output generated in the background keeps its own references.
+	catcierge_encoded_images_release(mg);
+
+	assert(mg->match_count <= mg->max_count);
 }
 
 void catcierge_save_obstruct_image(catcierge_grb_t *grb)
@@ -1181,8 +1792,8 @@ void catcierge_save_obstruct_image(catcierge_grb_t *grb)
 
 		mg->obstruct_img = cvCloneImage(grb->img);
 
-		mg->obstruct_time = time(NULL);
-		gettimeofday(&mg->obstruct_tv, NULL);
+		catcierge_clock_gettimeofday(&mg->obstruct_tv);
+		mg->obstruct_time = mg->obstruct_tv.tv_sec;
 		get_time_str_fmt(mg->obstruct_time, &mg->obstruct_tv, time_str,
 			sizeof(time_str), FILENAME_TIME_FORMAT);
 
@@ -1228,11 +1839,20 @@ void catcierge_fsm_start(catcierge_grb_t *grb)
 
 void catcierge_zmq_destroy(catcierge_grb_t *grb)
 {
+	// Sends what is still queued, so this must be done first.
+	if (grb->zmq_publisher)
+	{
+		catcierge_publisher_print_stats(grb->zmq_publisher);
+		catcierge_publisher_destroy(grb->zmq_publisher);
+		free(grb->zmq_publisher);
+		grb->zmq_publisher = NULL;
+	}
+
 	#if (ZMQ_VERSION >= ZMQ_MAKE_VERSION (4, 0, 0))
 
 	if (grb->zmq_pub)
 	{
-		zsock_destroy(grb->zmq_pub);
+		zsock_destroy((zsock_t **)&grb->zmq_pub);
 		grb->zmq_pub = NULL;
 	}
 
@@ -1270,11 +1890,21 @@ int catcierge_zmq_init(catcierge_grb_t *grb)
 		snprintf(endpoint, sizeof(endpoint) - 1, "%s://%s:%d",
 			args->zmq_transport, args->zmq_iface, args->zmq_port);
 
-		if (!(grb->zmq_pub = zsock_new_pub(endpoint)))
+		if (!(grb->zmq_pub = zsock_new(ZMQ_PUB)))
 		{
 			CATERR("Failed to create ZMQ publisher socket\n");
 			goto fail;
 		}
+
+		// Must be set before binding. Messages to subscribers that
+		// have this many messages queued are dropped by ZMQ.
+		zsock_set_sndhwm(grb->zmq_pub, args->zmq_hwm);
+
+		if (zsock_bind(grb->zmq_pub, "%s", endpoint) < 0)
+		{
+			CATERR("Failed to bind to ZMQ publisher to %s\n", endpoint);
+			goto fail;
+		}
 	}
 	#else // ZMQ_VERSION < 4.0.0
 	{
@@ -1290,6 +1920,8 @@ int catcierge_zmq_init(catcierge_grb_t *grb)
 			goto fail;
 		}
 
+		zsocket_set_sndhwm(grb->zmq_pub, args->zmq_hwm);
+
 		if (zsocket_bind(grb->zmq_pub, "%s://%s:%d",
 			args->zmq_transport, args->zmq_iface, args->zmq_port) < 0)
 		{
@@ -1300,6 +1932,16 @@ int catcierge_zmq_init(catcierge_grb_t *grb)
 	}
 	#endif // ZMQ_VERSION < 4.0.0
 
+	if (!(grb->zmq_publisher = calloc(1, sizeof(catcierge_publisher_t)))
+	 || catcierge_publisher_init(grb->zmq_publisher, grb->zmq_pub,
+			args->zmq_queue, args->zmq_conflate, args->zmq_conflate_count))
+	{
+		CATERR("Failed to start ZMQ publisher\n");
+		free(grb->zmq_publisher);
+		grb->zmq_publisher = NULL;
+		goto fail;
+	}
+
 	CATLOG("ZMQ publish to %s://%s:%d\n",
 			args->zmq_transport, args->zmq_iface, args->zmq_port);
 
@@ -1496,7 +2138,8 @@ int catcierge_state_matching(catcierge_grb_t *grb)
 
 	catcierge_show_image(grb);
 
-	if (mg->match_count < MATCH_MAX_COUNT)
+	if ((mg->match_count < mg->max_count)
+		&& !catcierge_match_group_is_decided(grb))
 	{
 		// Continue until we have enough matches for a decision.
 		return 0;
@@ -1559,10 +2202,17 @@ int catcierge_state_waiting(catcierge_grb_t *grb)
 		CATERR("Failed to perform check for obstructed frame\n"); return -1;
 	}
 
+	catcierge_update_idle(grb, frame_obstructed);
+
 	if (frame_obstructed)
 	{
 		CATLOG("Something in frame! Start matching...\n");
 
+		if (catcierge_match_group_resize(mg, (size_t)args->max_matches))
+		{
+			CATERR("Failed to allocate match group\n"); return -1;
+		}
+
 		catcierge_match_group_start(mg, grb->img);
 
 		// Save the obstruct image.
@@ -1635,6 +2285,22 @@ int catcierge_grabber_init(catcierge_grb_t *grb)
 	assert(grb);
 
 	memset(grb, 0, sizeof(catcierge_grb_t));
+
+	if (catcierge_match_group_init(&grb->match_group, MATCH_MAX_COUNT))
+	{
+		return -1;
+	}
+
+	catcierge_bus_init(&grb->bus);
+
+	// Subscribed to everything until catcierge_update_event_subscriptions.
+	if ((grb->output_subscriber = catcierge_bus_subscribe(&grb->bus, "output",
+		CATCIERGE_SUBSCRIBER_TEMPLATES, CATCIERGE_EVENT_MASK_ALL,
+		catcierge_output_event_handler, grb, 0, CATCIERGE_BUS_BLOCK)) < 0)
+	{
+		return -1;
+	}
+
 	#if 0
 	if (catcierge_args_init(&grb->args))
 	{
@@ -1650,5 +2316,10 @@ void catcierge_grabber_destroy(catcierge_grb_t *grb)
 	// Always make sure we unlock.
 	catcierge_do_unlock(grb);
 	catcierge_cleanup_imgs(grb);
+	catcierge_match_group_destroy(&grb->match_group);
+	catcierge_bus_destroy(&grb->bus);
+	#ifdef WITH_RFID
+	catcierge_destroy_rfid_readers(grb);
+	#endif
 	cvDestroyAllWindows();
 }
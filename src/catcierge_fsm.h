@@ -30,6 +30,7 @@
 #include "catcierge_args.h"
 #include "catcierge_types.h"
 #include "catcierge_output_types.h"
+#include "catcierge_bus.h"
 
 #ifdef RPI
 #include "RaspiCamCV.h"
@@ -43,6 +44,7 @@
 // TODO: Move this to catcierge_types.h instead
 #ifdef WITH_RFID
 #include "catcierge_rfid.h"
+#include "catcierge_rfid_allowed.h"
 
 typedef struct rfid_match_s
 {
@@ -51,6 +53,7 @@ typedef struct rfid_match_s
 	size_t data_len;		// Length of the current data.
 	int complete;			// Is the data complete?
 	const char *time_str;	// Time of match.
+	struct timeval time;	// When the reader received the tag.
 	int is_allowed;			// Is the RFID in the allowed list?
 } rfid_match_t;
 #endif // WITH_RFID
@@ -58,7 +61,6 @@ typedef struct rfid_match_s
 #define CATLOGFPS(fmt, ...) CATLOG(fmt, ##__VA_ARGS__)
 #define CATERRFPS(fmt, ...) CATLOG(fmt, ##__VA_ARGS__)
 
-#define MATCH_MAX_COUNT 4 // The number of matches to perform before deciding the lock state.
 
 #define FILENAME_TIME_FORMAT "%Y-%m-%d_%H_%M_%S.%f"
 
@@ -94,20 +96,29 @@ typedef struct catcierge_grb_s
 	catcierge_timer_t frame_timer;
 	catcierge_timer_t startup_timer;
 
+	// Adaptive capture rate (--idle_after).
+	catcierge_timer_t idle_timer;	// Time without any change while waiting.
+	int idle;						// Are we running at --idle_fps?
+	double idle_prev_mean;			// Mean brightness of the obstruction ROI in the last frame.
+	volatile long camera_idle;		// Frame rate the camera should use, set by catcierge_set_idle.
+	int camera_idle_applied;		// Frame rate the camera uses, only touched by catcierge_get_frame.
+	double camera_fps;				// Camera frame rate to go back to after being idle.
+
 	catcierge_output_t output;
 
+	catcierge_bus_t bus;		// All events are published here.
+	int output_subscriber;		// Generates the templates and runs the commands for events.
+
 	#ifdef WITH_RFID
 	char *rfid_inner_path;
 	char *rfid_outer_path;
-	catcierge_rfid_t rfid_in;
-	catcierge_rfid_t rfid_out;
+	catcierge_rfid_t *rfids;			// The readers, from the inside of the door to the outside.
+	size_t rfid_count;
 	catcierge_rfid_context_t rfid_ctx;
 
 	match_direction_t rfid_direction;	// Direction that is determined based on which RFID reader gets triggered first.
-	rfid_match_t rfid_in_match;			// Match struct for the inner RFID reader.
-	rfid_match_t rfid_out_match;		// Match struct for the outer RFID reader.
-	char **rfid_allowed;				// The list of allowed RFID chips.
-	size_t rfid_allowed_count;
+	rfid_match_t *rfid_matches;			// Match struct for each RFID reader.
+	catcierge_rfid_allowed_t rfid_allowed;	// The allowed RFID chips.
 	int lock_on_invalid_rfid;			// Should we lock when no or an invalid RFID tag is found?
 	double rfid_lock_time;				// The time after a camera match has been made until we check the RFID readers. (In seconds).
 	int checked_rfid_lock;				// Did we check if we should do an RFID lock during this match timeout?
@@ -119,6 +130,8 @@ typedef struct catcierge_grb_s
 	zctx_t *zmq_ctx;
 	#endif
 	void *zmq_pub;	// ZMQ publisher.
+	struct catcierge_publisher_s *zmq_publisher; // Sends on zmq_pub from an I/O thread.
+	struct catcierge_preview_s *preview; // Live preview (--preview).
 	#endif // WITH_ZMQ
 } catcierge_grb_t;
 
@@ -126,22 +139,38 @@ const char *catcierge_get_state_string(catcierge_state_func_t state);
 void catcierge_do_lockout(catcierge_grb_t *grb);
 void catcierge_do_unlock(catcierge_grb_t *grb);
 IplImage *catcierge_get_frame(catcierge_grb_t *grb);
+void catcierge_set_idle(catcierge_grb_t *grb, int idle);
+double catcierge_get_frame_interval(catcierge_grb_t *grb);
 void catcierge_run_state(catcierge_grb_t *grb);
 void catcierge_print_spinner(catcierge_grb_t *grb);
 void catcierge_destroy_camera(catcierge_grb_t *grb);
+// Destroys the output before the matcher it uses.
+void catcierge_destroy_output(catcierge_grb_t *grb);
 #ifdef RPI
 int catcierge_setup_gpio(catcierge_grb_t *grb);
 #endif
 int catcierge_grabber_init(catcierge_grb_t *grb);
 void catcierge_grabber_destroy(catcierge_grb_t *grb);
+int catcierge_match_group_init(match_group_t *mg, size_t max_count);
+int catcierge_match_group_resize(match_group_t *mg, size_t max_count);
+void catcierge_match_group_destroy(match_group_t *mg);
 #ifdef WITH_RFID
-void catcierge_init_rfid_readers(catcierge_grb_t *grb);
+// Sets up the readers and the allowed tags without opening the readers.
+int catcierge_create_rfid_readers(catcierge_grb_t *grb);
+int catcierge_init_rfid_readers(catcierge_grb_t *grb);
+void catcierge_destroy_rfid_readers(catcierge_grb_t *grb);
+int catcierge_reload_rfid_allowed(catcierge_grb_t *grb);
 #endif
 int catcierge_setup_camera(catcierge_grb_t *grb);
 void catcierge_set_state(catcierge_grb_t *grb, catcierge_state_func_t new_state);
 void catcierge_run_state(catcierge_grb_t *grb);
 int catcierge_drop_root_privileges(const char *user);
 void catcierge_fsm_start(catcierge_grb_t *grb);
+void catcierge_trigger_event(catcierge_grb_t *grb, catcierge_event_t e, int execute);
+
+// Only dispatches the events with templates or commands to the output,
+// done once the templates are loaded and the commands are parsed.
+int catcierge_update_event_subscriptions(catcierge_grb_t *grb);
 
 int catcierge_state_waiting(catcierge_grb_t *grb);
 int catcierge_state_keepopen(catcierge_grb_t *grb);
@@ -28,6 +28,7 @@
 #include "catcierge_output.h"
 #include "test/catcierge_test_common.h"
 #include "catcierge_strftime.h"
+#include "catcierge_clock.h"
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
 
@@ -36,6 +37,11 @@
 #endif
 
 #define MAX_IMG_PATHS 4
+#define DEFAULT_FSM_TESTER_FPS 30.0
+#define DEFAULT_FSM_TESTER_MAX_IDLE 10.0
+
+// Give up on a scenario if the state machine doesn't return to waiting.
+#define FSM_TESTER_MAX_SCENARIO_TIME (60.0 * 60.0)
 
 typedef struct fsm_tester_ctx_s
 {
@@ -44,9 +50,24 @@ typedef struct fsm_tester_ctx_s
 	double delay;
 	int keep_running;
 	int keep_obstructing;
+	int virtual_time;
+	int scenarios;
+	int seed;
+	double fps;
+	double max_idle;
 } fsm_tester_ctx_t;
 
+typedef struct fsm_tester_stats_s
+{
+	int scenarios;
+	int lockouts;
+	int keepopens;
+	int frames;
+	double virtual_start;
+} fsm_tester_stats_t;
+
 fsm_tester_ctx_t ctx;
+fsm_tester_stats_t stats;
 catcierge_grb_t grb;
 
 static IplImage *load_image(catcierge_grb_t *grb, const char *path)
@@ -62,6 +83,132 @@ static IplImage *load_image(catcierge_grb_t *grb, const char *path)
 	return img;
 }
 
+static void run_frame(IplImage *img)
+{
+	catcierge_state_func_t prev_state = grb.state;
+
+	// In virtual time each frame takes exactly 1/fps seconds.
+	if (ctx.virtual_time)
+	{
+		catcierge_clock_virtual_advance(1.0 / ctx.fps);
+	}
+
+	grb.img = img;
+	catcierge_run_state(&grb);
+	stats.frames++;
+
+	if (grb.state != prev_state)
+	{
+		if (grb.state == catcierge_state_lockout) stats.lockouts++;
+		if (grb.state == catcierge_state_keepopen) stats.keepopens++;
+	}
+}
+
+static void run_frames(IplImage *img, double seconds)
+{
+	double start = catcierge_clock_monotonic();
+
+	while (grb.running && ((catcierge_clock_monotonic() - start) < seconds))
+	{
+		run_frame(img);
+	}
+}
+
+static double random_duration()
+{
+	return ctx.max_idle * ((double)rand() / RAND_MAX);
+}
+
+static int run_scenarios(IplImage *clear_img)
+{
+	int ret = 0;
+	size_t i;
+	size_t j;
+	double start;
+	clock_t cpu_start = clock();
+	double cpu_time;
+	double virtual_time;
+	IplImage *imgs[MAX_IMG_PATHS];
+
+	memset(imgs, 0, sizeof(imgs));
+
+	// Load the images once, instead of once per frame.
+	for (i = 0; i < ctx.img_count; i++)
+	{
+		if (!(imgs[i] = load_image(&grb, ctx.img_paths[i])))
+		{
+			ret = -1; goto fail;
+		}
+	}
+
+	srand(ctx.seed);
+	stats.virtual_start = catcierge_clock_monotonic();
+
+	printf("Running %d scenarios in virtual time at %0.1f fps (seed %d)\n",
+		ctx.scenarios, ctx.fps, ctx.seed);
+
+	for (i = 0; grb.running && (i < (size_t)ctx.scenarios); i++)
+	{
+		// Nothing in front of the door for a while.
+		run_frames(clear_img, random_duration());
+
+		// Obstruct the frame and pass the match images.
+		run_frame(imgs[0]);
+
+		for (j = 0; grb.running && (grb.state == catcierge_state_matching); j++)
+		{
+			run_frame(imgs[j % ctx.img_count]);
+		}
+
+		// The cat either lingers in front of the door or leaves.
+		run_frames((rand() % 2) ? imgs[0] : clear_img, random_duration());
+
+		// Let any lockout or keep open finish.
+		start = catcierge_clock_monotonic();
+
+		while (grb.running && (grb.state != catcierge_state_waiting))
+		{
+			if ((catcierge_clock_monotonic() - start) > FSM_TESTER_MAX_SCENARIO_TIME)
+			{
+				fprintf(stderr, "Scenario %d: State machine stuck in %s\n",
+					(int)i, catcierge_get_state_string(grb.state));
+				ret = -1; goto fail;
+			}
+
+			run_frame(clear_img);
+		}
+
+		stats.scenarios++;
+	}
+
+fail:
+	cpu_time = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+	virtual_time = catcierge_clock_monotonic() - stats.virtual_start;
+
+	printf("\nScenarios: %d\n", stats.scenarios);
+	printf("   Frames: %d\n", stats.frames);
+	printf(" Lockouts: %d\n", stats.lockouts);
+	printf("Keep open: %d\n", stats.keepopens);
+	printf("  Virtual: %0.1f seconds\n", virtual_time);
+	printf("      CPU: %0.2f seconds (%0.0f scenarios/sec)\n",
+		cpu_time, (cpu_time > 0.0) ? (stats.scenarios / cpu_time) : 0.0);
+
+	if (!grb.running)
+	{
+		printf("State machine stopped running (consecutive lockout limit?)\n");
+	}
+
+	for (i = 0; i < ctx.img_count; i++)
+	{
+		if (imgs[i])
+			cvReleaseImage(&imgs[i]);
+	}
+
+	grb.img = NULL;
+
+	return ret;
+}
+
 static int add_fsm_tester_args(catcierge_args_t *args)
 {
 	int ret = 0;
@@ -99,6 +246,42 @@ static int add_fsm_tester_args(catcierge_args_t *args)
 			"To clear the frame do Ctrl+C (and to terminate do it again).",
 			"b", &ctx.keep_obstructing);
 
+	ret |= cargo_add_option(cargo, 0,
+			"<fsm> --virtual_time",
+			"Run the state machine in virtual time. Time only moves forward "
+			"1/fps seconds per frame, so --delay and lockout times pass "
+			"instantly.",
+			"b", &ctx.virtual_time);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<fsm> --scenarios",
+			"Simulate this many random obstruct/match/lockout sequences "
+			"in virtual time using the given images, and print statistics. "
+			"Implies --virtual_time.",
+			"i", &ctx.scenarios);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<fsm> --fps",
+			NULL,
+			"d", &ctx.fps);
+	ret |= cargo_set_option_description(cargo, "--fps",
+			"Frame rate used for virtual time. Default %0.1f.",
+			DEFAULT_FSM_TESTER_FPS);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<fsm> --max_idle",
+			NULL,
+			"d", &ctx.max_idle);
+	ret |= cargo_set_option_description(cargo, "--max_idle",
+			"Max number of seconds the frame is clear or obstructed "
+			"between each step in a scenario. Default %0.1f.",
+			DEFAULT_FSM_TESTER_MAX_IDLE);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<fsm> --seed",
+			"Random seed for --scenarios, so that a run can be repeated.",
+			"i", &ctx.seed);
+
 	// This option is defined in the catcierge lib instead, since it
 	// uses variables internal to that. But we still group it with these settings.
 	#ifndef _WIN32
@@ -133,6 +316,8 @@ int main(int argc, char **argv)
 	catcierge_args_t *args = &grb.args;
 
 	memset(&ctx, 0, sizeof(ctx));
+	ctx.fps = DEFAULT_FSM_TESTER_FPS;
+	ctx.max_idle = DEFAULT_FSM_TESTER_MAX_IDLE;
 	catcierge_grabber_init(&grb);
 
 	if (catcierge_args_init(args, argv[0]))
@@ -172,6 +357,23 @@ int main(int argc, char **argv)
 		catcierge_strftime_set_base_diff(args->base_time_diff);
 	}
 
+	if (ctx.scenarios > 0)
+	{
+		ctx.virtual_time = 1;
+	}
+
+	if (ctx.virtual_time)
+	{
+		if (ctx.fps <= 0.0)
+		{
+			fprintf(stderr, "--fps must be larger than 0\n");
+			ret = -1; goto fail;
+		}
+
+		printf("Using virtual time\n");
+		catcierge_clock_virtual_start(0.0);
+	}
+
 	if (catcierge_matcher_init(&grb.matcher, catcierge_get_matcher_args(args)))
 	{
 		fprintf(stderr, "\n\nFailed to %s init matcher\n\n", grb.matcher->name);
@@ -208,6 +410,12 @@ int main(int argc, char **argv)
 		ret = -1; goto fail;
 	}
 
+	if (ctx.scenarios > 0)
+	{
+		ret = run_scenarios(clear_img);
+		goto fail;
+	}
+
 	// For delayed start we create a clear image that will
 	// be fed to the state machine until we're ready to obstruct the frame.
 	if (ctx.delay > 0.0)
@@ -218,11 +426,9 @@ int main(int argc, char **argv)
 		catcierge_timer_reset(&t);
 		catcierge_timer_set(&t, ctx.delay);
 		catcierge_timer_start(&t);
-		grb.img = clear_img;
-
 		while (!catcierge_timer_has_timed_out(&t))
 		{
-			catcierge_run_state(&grb);
+			run_frame(clear_img);
 		}
 
 		grb.img = NULL;
@@ -234,7 +440,7 @@ int main(int argc, char **argv)
 		ret = -1; goto fail;
 	}
 
-	catcierge_run_state(&grb);
+	run_frame(grb.img);
 	cvReleaseImage(&grb.img);
 	grb.img = NULL;
 
@@ -246,7 +452,7 @@ int main(int argc, char **argv)
 			ret = -1; goto fail;
 		}
 
-		catcierge_run_state(&grb);
+		run_frame(grb.img);
 
 		cvReleaseImage(&grb.img);
 		grb.img = NULL;
@@ -272,20 +478,26 @@ int main(int argc, char **argv)
 			// to press ctrl+c before the clear image is used.
 			if ((grb.img != clear_img) && !ctx.keep_obstructing)
 			{
+				cvReleaseImage(&grb.img);
 				grb.img = clear_img;
 			}
 
-			catcierge_run_state(&grb);
+			run_frame(grb.img);
 		}
 	}
 
 fail:
 	cvReleaseImage(&clear_img);
+
+	if (ctx.virtual_time)
+	{
+		catcierge_clock_virtual_stop();
+	}
+
+	catcierge_destroy_output(&grb);
 	#ifdef WITH_ZMQ
 	catcierge_zmq_destroy(&grb);
 	#endif
-	catcierge_matcher_destroy(&grb.matcher);
-	catcierge_output_destroy(&grb.output);
 	catcierge_grabber_destroy(&grb);
 	catcierge_args_destroy(&grb.args);
 
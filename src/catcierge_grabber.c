@@ -24,22 +24,79 @@
 #include "catcierge_output.h"
 #include "catcierge_matcher.h"
 #include "catcierge_sigusr.h"
+#include "catcierge_clock.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #ifndef _WIN32
 #include <fcntl.h>
+#include "catcierge_exec.h"
 #endif // _WIN32
 
+#ifdef CATCIERGE_HAVE_EPOLL
+#include <pthread.h>
+#include <sys/epoll.h>
+#include "catcierge_reactor.h"
+#endif
+
 #ifdef WITH_ZMQ
 #include <czmq.h>
 #endif
 
+#if defined(WITH_ZMQ) && defined(CATCIERGE_HAVE_PTHREADS)
+#include "catcierge_preview.h"
+#endif
+
+#ifdef WITH_ZMQ
+#include "catcierge_control.h"
+#endif
+
+#ifdef CATCIERGE_HAVE_DLFCN_H
+#include "catcierge_plugins.h"
+#endif
+
+#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+#include "catcierge_match_journal.h"
+#endif
+
 #include <opencv2/core/version.hpp>
 
 catcierge_grb_t grb;
 
+#ifdef CATCIERGE_HAVE_DLFCN_H
+static catcierge_plugins_t plugins;
+#endif
+
+#if defined(WITH_ZMQ) && defined(CATCIERGE_HAVE_PTHREADS)
+static catcierge_preview_t preview;
+#endif
+
+#ifdef WITH_ZMQ
+static catcierge_control_t control;
+#endif
+
+#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+static catcierge_journal_t journal;
+
+// Called directly when the match group is done, since
+// the match group is reused as soon as it returns.
+static void journal_event_handler(const catcierge_event_data_t *ev, void *user)
+{
+	catcierge_journal_record_t r;
+
+	catcierge_journal_record_init(&r, &grb.match_group);
+	catcierge_journal_append(&journal, &r);
+}
+#endif
+
+#ifndef _WIN32
+// Set by sig_handler and handled by the main loop.
+static volatile sig_atomic_t sigusr1_received;
+static volatile sig_atomic_t sigusr2_received;
+#endif
+
 #ifndef _WIN32
+static catcierge_exec_t exec;
 int pid_fd;
 #define PID_PATH "/var/run/catcierge.pid"
 
@@ -118,8 +175,6 @@ int create_pid_file(const char *prog_name, const char *pid_path, int flags)
 
 static void sig_handler(int signo)
 {
-	catcierge_args_t *args = &grb.args;
-
 	switch (signo)
 	{
 		case SIGINT:
@@ -145,20 +200,39 @@ static void sig_handler(int signo)
 		#ifndef _WIN32
 		case SIGUSR1:
 		{
-			CATLOG("Received SIGUSR1\n");
-			catcierge_handle_sigusr(&grb, args->sigusr1_str);
+			sigusr1_received = 1;
 			break;
 		}
 		case SIGUSR2:
 		{
-			CATLOG("Received SIGUSR2\n");
-			catcierge_handle_sigusr(&grb, args->sigusr2_str);
+			sigusr2_received = 1;
 			break;
 		}
 		#endif // _WIN32
 	}
 }
 
+#ifndef _WIN32
+static void handle_sigusr_received()
+{
+	catcierge_args_t *args = &grb.args;
+
+	if (sigusr1_received)
+	{
+		sigusr1_received = 0;
+		CATLOG("Received SIGUSR1\n");
+		catcierge_handle_sigusr(&grb, args->sigusr1_str);
+	}
+
+	if (sigusr2_received)
+	{
+		sigusr2_received = 0;
+		CATLOG("Received SIGUSR2\n");
+		catcierge_handle_sigusr(&grb, args->sigusr2_str);
+	}
+}
+#endif // _WIN32
+
 void setup_sig_handlers()
 {
 	if (signal(SIGINT, sig_handler) == SIG_ERR)
@@ -179,6 +253,316 @@ void setup_sig_handlers()
 	#endif // _WIN32
 }
 
+#ifdef CATCIERGE_HAVE_EPOLL
+
+// Seconds without a frame before we complain about the camera.
+#define CATCIERGE_FRAME_WATCHDOG_TIMEOUT 5.0
+
+//
+// The camera has no file descriptor we can wait on, so frames are
+// captured on a separate thread that wakes the main loop using an eventfd.
+// The capture thread waits for the main loop to finish with a frame before
+// capturing the next one, since the capture APIs reuse the same image.
+//
+typedef struct catcierge_capture_thread_s
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int frame_fd;
+	int consumed;
+	int quit;
+	IplImage *img;
+} catcierge_capture_thread_t;
+
+static catcierge_reactor_t reactor;
+static catcierge_timer_wheel_t wheel;
+static catcierge_wheel_timer_t watchdog_timer;
+static catcierge_wheel_timer_t next_frame_timer;
+static catcierge_wheel_timer_t exec_timer;
+static catcierge_capture_thread_t capture;
+static catcierge_timer_t last_frame_timer;
+
+static void *capture_thread_main(void *arg)
+{
+	IplImage *img;
+	catcierge_capture_thread_t *c = (catcierge_capture_thread_t *)arg;
+
+	pthread_mutex_lock(&c->lock);
+
+	while (!c->quit)
+	{
+		while (!c->consumed && !c->quit)
+		{
+			pthread_cond_wait(&c->cond, &c->lock);
+		}
+
+		if (c->quit)
+			break;
+
+		c->consumed = 0;
+		pthread_mutex_unlock(&c->lock);
+
+		// Blocks until the camera delivers a frame.
+		img = catcierge_get_frame(&grb);
+
+		pthread_mutex_lock(&c->lock);
+		c->img = img;
+		catcierge_reactor_notify(c->frame_fd);
+	}
+
+	pthread_mutex_unlock(&c->lock);
+
+	return NULL;
+}
+
+static void request_next_frame(catcierge_capture_thread_t *c)
+{
+	// Let the capture thread get the next frame.
+	pthread_mutex_lock(&c->lock);
+	c->consumed = 1;
+	pthread_cond_signal(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void on_next_frame(catcierge_timer_wheel_t *w, catcierge_wheel_timer_t *t, void *user)
+{
+	request_next_frame((catcierge_capture_thread_t *)user);
+}
+
+static void on_frame(catcierge_reactor_t *r, int fd, uint32_t events, void *user)
+{
+	double interval;
+	catcierge_capture_thread_t *c = (catcierge_capture_thread_t *)user;
+
+	pthread_mutex_lock(&c->lock);
+	grb.img = c->img;
+	pthread_mutex_unlock(&c->lock);
+
+	catcierge_timer_reset(&last_frame_timer);
+	catcierge_timer_start(&last_frame_timer);
+
+	if (!catcierge_timer_isactive(&grb.frame_timer))
+	{
+		catcierge_timer_start(&grb.frame_timer);
+	}
+
+	// Any tag that arrived before the frame should be seen by the FSM first.
+	#ifdef WITH_RFID
+	if ((grb.rfid_count > 0) && catcierge_rfid_ctx_service(&grb.rfid_ctx))
+	{
+		CATERRFPS("Failed to service RFID readers\n");
+	}
+	#endif // WITH_RFID
+
+	catcierge_run_state(&grb);
+	catcierge_print_spinner(&grb);
+
+	#ifdef WITH_ZMQ
+	catcierge_control_frame(&control, grb.img);
+	#endif
+
+	if (!grb.running)
+	{
+		catcierge_reactor_stop(r);
+		return;
+	}
+
+	// While idle we hold off the capture thread instead of
+	// processing every frame (--idle_after).
+	if ((interval = catcierge_get_frame_interval(&grb)) > 0.0)
+	{
+		catcierge_timer_wheel_add(&wheel, &next_frame_timer, interval, 0.0);
+		return;
+	}
+
+	request_next_frame(c);
+}
+
+static void on_watchdog(catcierge_timer_wheel_t *w, catcierge_wheel_timer_t *t, void *user)
+{
+	// Frames come slower while idle.
+	if (catcierge_timer_get(&last_frame_timer) >
+		(CATCIERGE_FRAME_WATCHDOG_TIMEOUT + catcierge_get_frame_interval(&grb)))
+	{
+		CATERR("No frame from the camera for %.0f seconds\n",
+			catcierge_timer_get(&last_frame_timer));
+	}
+}
+
+static void on_exec_timer(catcierge_timer_wheel_t *w, catcierge_wheel_timer_t *t, void *user)
+{
+	// Kills commands that have timed out (--cmd_timeout) and
+	// starts queued ones in case a SIGCHLD was missed.
+	catcierge_exec_service(&exec);
+}
+
+#ifdef WITH_RFID
+static int rfid_event_fd = -1;
+
+static void on_rfid_tag(catcierge_rfid_context_t *ctx, void *user)
+{
+	// Runs on the RFID thread, wake up the main loop.
+	catcierge_reactor_notify(rfid_event_fd);
+}
+
+static void on_rfid(catcierge_reactor_t *r, int fd, uint32_t events, void *user)
+{
+	if (catcierge_rfid_ctx_service(&grb.rfid_ctx))
+	{
+		CATERRFPS("Failed to service RFID readers\n");
+	}
+}
+#endif // WITH_RFID
+
+#ifdef WITH_ZMQ
+static void on_control(catcierge_reactor_t *r, int fd, uint32_t events, void *user)
+{
+	catcierge_control_service((catcierge_control_t *)user);
+}
+#endif
+
+static void on_signal(catcierge_reactor_t *r, int signo, void *user)
+{
+	catcierge_args_t *args = &grb.args;
+
+	// Unlike sig_handler this runs from the main loop,
+	// so it is safe to do real work here.
+	switch (signo)
+	{
+		case SIGINT:
+		{
+			CATLOG("Received SIGINT, stopping...\n");
+			grb.running = 0;
+			catcierge_reactor_stop(r);
+			break;
+		}
+		case SIGUSR1:
+		{
+			CATLOG("Received SIGUSR1\n");
+			catcierge_handle_sigusr(&grb, args->sigusr1_str);
+			break;
+		}
+		case SIGUSR2:
+		{
+			CATLOG("Received SIGUSR2\n");
+			catcierge_handle_sigusr(&grb, args->sigusr2_str);
+			break;
+		}
+		case SIGCHLD:
+		{
+			catcierge_exec_service(&exec);
+			break;
+		}
+	}
+}
+
+static int run_reactor_loop()
+{
+	int ret = 0;
+	int started_thread = 0;
+	int signals[] = { SIGINT, SIGUSR1, SIGUSR2, SIGCHLD };
+
+	if (catcierge_reactor_init(&reactor))
+	{
+		return -1;
+	}
+
+	catcierge_timer_wheel_init(&wheel);
+	catcierge_reactor_set_timer_wheel(&reactor, &wheel);
+
+	memset(&capture, 0, sizeof(capture));
+	pthread_mutex_init(&capture.lock, NULL);
+	pthread_cond_init(&capture.cond, NULL);
+	catcierge_timer_reset(&last_frame_timer);
+	catcierge_timer_set(&last_frame_timer, CATCIERGE_FRAME_WATCHDOG_TIMEOUT);
+	catcierge_timer_start(&last_frame_timer);
+
+	// Must be done before starting the capture thread
+	// so that it inherits the blocked signals.
+	if (catcierge_reactor_add_signals(&reactor, signals,
+		sizeof(signals) / sizeof(signals[0]), on_signal, NULL))
+	{
+		goto fail;
+	}
+
+	if ((capture.frame_fd = catcierge_reactor_add_event(&reactor, on_frame, &capture)) < 0)
+	{
+		goto fail;
+	}
+
+	catcierge_wheel_timer_init(&watchdog_timer, on_watchdog, NULL);
+	catcierge_wheel_timer_init(&next_frame_timer, on_next_frame, &capture);
+	catcierge_wheel_timer_init(&exec_timer, on_exec_timer, NULL);
+	catcierge_timer_wheel_add(&wheel, &watchdog_timer,
+		CATCIERGE_FRAME_WATCHDOG_TIMEOUT, CATCIERGE_FRAME_WATCHDOG_TIMEOUT);
+	catcierge_timer_wheel_add(&wheel, &exec_timer, 1.0, 1.0);
+
+	#ifdef WITH_RFID
+	// Started after the signals are blocked, like the capture thread.
+	if (grb.rfid_count > 0)
+	{
+		if ((rfid_event_fd = catcierge_reactor_add_event(&reactor, on_rfid, NULL)) < 0)
+		{
+			goto fail;
+		}
+
+		catcierge_rfid_ctx_set_notify(&grb.rfid_ctx, on_rfid_tag, NULL);
+
+		if (catcierge_rfid_ctx_start(&grb.rfid_ctx))
+		{
+			CATERR("Failed to start RFID thread, polling the readers instead\n");
+		}
+	}
+	#endif // WITH_RFID
+
+	#ifdef WITH_ZMQ
+	if (control.router)
+	{
+		catcierge_reactor_add_fd(&reactor, catcierge_control_fd(&control),
+			EPOLLIN, on_control, &control);
+	}
+	#endif
+
+	// Get the first frame right away.
+	capture.consumed = 1;
+
+	if (pthread_create(&capture.thread, NULL, capture_thread_main, &capture))
+	{
+		CATERR("Failed to start capture thread\n");
+		goto fail;
+	}
+
+	started_thread = 1;
+
+	ret = catcierge_reactor_run(&reactor);
+
+fail:
+	if (started_thread)
+	{
+		pthread_mutex_lock(&capture.lock);
+		capture.quit = 1;
+		pthread_cond_signal(&capture.cond);
+		pthread_mutex_unlock(&capture.lock);
+		pthread_join(capture.thread, NULL);
+	}
+
+	// The RFID thread notifies the reactor.
+	#ifdef WITH_RFID
+	catcierge_rfid_ctx_stop(&grb.rfid_ctx);
+	catcierge_rfid_ctx_set_notify(&grb.rfid_ctx, NULL, NULL);
+	#endif
+
+	// This also unblocks the signals so sig_handler takes over again.
+	catcierge_reactor_destroy(&reactor);
+	catcierge_timer_wheel_destroy(&wheel);
+	pthread_cond_destroy(&capture.cond);
+	pthread_mutex_destroy(&capture.lock);
+
+	return (started_thread ? ret : -1);
+}
+#endif // CATCIERGE_HAVE_EPOLL
+
 int main(int argc, char **argv)
 {
 	catcierge_args_t *args = &grb.args;
@@ -228,6 +612,13 @@ int main(int argc, char **argv)
 
 	catcierge_print_settings(args);
 
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if ((args->log_queue > 0) && catcierge_log_async_start(args->log_queue))
+	{
+		CATERR("Failed to start log thread, logging directly instead\n");
+	}
+	#endif
+
 	setup_sig_handlers();
 
 	if (args->log_path)
@@ -272,10 +663,74 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	if (catcierge_update_event_subscriptions(&grb))
+	{
+		return -1;
+	}
+
+	#ifndef _WIN32
+	if (catcierge_exec_init(&exec, args->cmd_max_running,
+			args->cmd_max_queued, args->cmd_timeout))
+	{
+		CATERR("Failed to init command executor\n");
+		return -1;
+	}
+
+	grb.output.exec = &exec;
+	#endif // !_WIN32
+
 	CATLOG("Initialized output templates\n");
 
+	#ifdef CATCIERGE_HAVE_DLFCN_H
+	catcierge_plugins_init(&plugins);
+
+	if (args->plugin_count > 0)
+	{
+		size_t i;
+		CATLOG("Loading plugins:\n");
+
+		for (i = 0; i < args->plugin_count; i++)
+		{
+			if (catcierge_plugins_load(&plugins, args->plugins[i]))
+			{
+				return -1;
+			}
+		}
+
+		if (catcierge_plugins_start(&plugins, &grb))
+		{
+			CATERR("Failed to start plugins\n");
+			return -1;
+		}
+	}
+	#endif // CATCIERGE_HAVE_DLFCN_H
+
+	#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+	if (args->journal_path)
+	{
+		if (catcierge_journal_open(&journal, args->journal_path))
+		{
+			return -1;
+		}
+
+		if (catcierge_bus_subscribe(&grb.bus, "journal", CATCIERGE_SUBSCRIBER_JOURNAL,
+			CATCIERGE_EVENT_BIT(CATCIERGE_MATCH_GROUP_DONE),
+			journal_event_handler, NULL, 0, CATCIERGE_BUS_BLOCK) < 0)
+		{
+			return -1;
+		}
+
+		CATLOG("Appending match groups to the journal %s (%lu records)\n",
+			args->journal_path, (unsigned long)journal.count);
+	}
+	#endif // CATCIERGE_HAVE_SYS_MMAN_H
+
 	#ifdef WITH_RFID
-	catcierge_init_rfid_readers(&grb);
+	if (catcierge_init_rfid_readers(&grb))
+	{
+		CATERR("Failed to setup RFID readers\n");
+		return -1;
+	}
 	#endif
 
 	if (catcierge_setup_camera(&grb))
@@ -286,49 +741,157 @@ int main(int argc, char **argv)
 
 	#ifdef WITH_ZMQ
 	catcierge_zmq_init(&grb);
-	#endif
+
+	if (args->preview)
+	{
+		#ifdef CATCIERGE_HAVE_PTHREADS
+		char endpoint[1024];
+
+		snprintf(endpoint, sizeof(endpoint) - 1, "%s://%s:%d",
+			args->zmq_transport, args->zmq_iface, args->preview_port);
+
+		if (catcierge_preview_init(&preview, endpoint,
+				args->preview_fps, args->preview_quality))
+		{
+			CATERR("Failed to start preview\n");
+		}
+		else
+		{
+			grb.preview = &preview;
+		}
+		#else
+		CATERR("--preview is not supported without pthreads\n");
+		#endif
+	}
+
+	if (args->control)
+	{
+		char endpoint[1024];
+
+		snprintf(endpoint, sizeof(endpoint) - 1, "%s://%s:%d",
+			args->zmq_transport, args->zmq_iface, args->control_port);
+
+		if (catcierge_control_init(&control, &grb, endpoint))
+		{
+			CATERR("Failed to start control channel\n");
+		}
+	}
+	#endif // WITH_ZMQ
 
 	CATLOG("Starting detection!\n");
 	// TODO: Create a catcierge_grb_start(grb) function that does this instead.
 	catcierge_fsm_start(&grb);
 
 	// Run the program state machine.
+	#ifdef CATCIERGE_HAVE_EPOLL
+	if (run_reactor_loop())
+	{
+		CATERR("Event loop failed\n");
+	}
+	#else
+	#ifdef WITH_RFID
+	if ((grb.rfid_count > 0) && catcierge_rfid_ctx_start(&grb.rfid_ctx))
+	{
+		CATLOG("Polling the RFID readers once per frame\n");
+	}
+	#endif // WITH_RFID
+
 	do
 	{
+		double frame_start = catcierge_clock_monotonic();
+
 		if (!catcierge_timer_isactive(&grb.frame_timer))
 		{
 			catcierge_timer_start(&grb.frame_timer);
 		}
 
-		// Always feed the RFID readers.
+		// Always feed the RFID readers the tags they have received.
 		#ifdef WITH_RFID
-		if ((args->rfid_inner_path || args->rfid_outer_path) 
-			&& catcierge_rfid_ctx_service(&grb.rfid_ctx))
+		if ((grb.rfid_count > 0) && catcierge_rfid_ctx_service(&grb.rfid_ctx))
 		{
 			CATERRFPS("Failed to service RFID readers\n");
 		}
 		#endif // WITH_RFID
 
+		#ifndef _WIN32
+		catcierge_exec_service(&exec);
+		handle_sigusr_received();
+		#endif
+
+		#ifdef WITH_ZMQ
+		catcierge_control_service(&control);
+		#endif
+
 		grb.img = catcierge_get_frame(&grb);
 
 		catcierge_run_state(&grb);
 		catcierge_print_spinner(&grb);
+
+		#ifdef WITH_ZMQ
+		catcierge_control_frame(&control, grb.img);
+		#endif
+
+		// Skip frames while idle (--idle_after).
+		catcierge_clock_sleep(catcierge_get_frame_interval(&grb)
+			- (catcierge_clock_monotonic() - frame_start));
 	} while (
 		grb.running
 		#ifdef WITH_ZMQ
 		&& !zctx_interrupted
 		#endif
 		);
+	#endif // CATCIERGE_HAVE_EPOLL
 
-	catcierge_matcher_destroy(&grb.matcher);
-	catcierge_output_destroy(&grb.output);
+	catcierge_bus_print_stats(&grb.bus);
+	catcierge_destroy_output(&grb);
 	catcierge_destroy_camera(&grb);
+	#if defined(WITH_ZMQ) && defined(CATCIERGE_HAVE_PTHREADS)
+	if (grb.preview)
+	{
+		catcierge_preview_print_stats(grb.preview);
+		catcierge_preview_destroy(grb.preview);
+		grb.preview = NULL;
+	}
+	#endif
 	#ifdef WITH_ZMQ
+	if (control.router)
+	{
+		catcierge_control_print_stats(&control);
+	}
+	catcierge_control_destroy(&control);
 	catcierge_zmq_destroy(&grb);
 	#endif
 	catcierge_grabber_destroy(&grb);
+
+	#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+	if (args->journal_path)
+	{
+		CATLOG("Journal: %lu match groups appended, %lu failed\n",
+			(unsigned long)journal.appended, (unsigned long)journal.failed);
+		catcierge_journal_close(&journal);
+	}
+	#endif
+
+	#ifdef CATCIERGE_HAVE_DLFCN_H
+	catcierge_plugins_print_stats(&plugins);
+	catcierge_plugins_destroy(&plugins);
+	#endif
+
+	#ifndef _WIN32
+	grb.output.exec = NULL;
+	catcierge_exec_print_stats(&exec);
+	catcierge_exec_destroy(&exec);
+	#endif
+
 	catcierge_args_destroy(&grb.args);
 
+	if (catcierge_log_async_dropped() > 0)
+	{
+		CATERR("Dropped %lu log lines\n", catcierge_log_async_dropped());
+	}
+
+	catcierge_log_async_stop();
+
 	if (grb.log_file)
 	{
 		fclose(grb.log_file);
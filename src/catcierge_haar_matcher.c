@@ -858,66 +858,44 @@ const char *catcierge_haar_matcher_prey_method_str(catcierge_haar_prey_method_t
 	}
 }
 
-const char *catcierge_haar_matcher_translate(catcierge_matcher_t *octx, const char *var,
-	char *buf, size_t bufsize)
+const char *catcierge_haar_matcher_translate(catcierge_matcher_t *octx,
+	const catcierge_output_var_ref_t *var, char *buf, size_t bufsize)
 {
 	catcierge_haar_matcher_t *ctx = (catcierge_haar_matcher_t *)octx;
 	assert(ctx);
-
-	if (!strcmp(var, "cascade"))
-	{
-		return ctx->args->cascade;
-	}
-
-	if (!strcmp(var, "in_direction"))
-	{
-		return catcierge_get_left_right_str(ctx->args->in_direction);
-	}
-
-	if (!strcmp(var, "min_size"))
-	{
-		snprintf(buf, bufsize - 1, "%dx%d",
-			ctx->args->min_width,
-			ctx->args->min_height);
-		return buf;
-	}
-
-	if (!strcmp(var, "min_size_width"))
-	{
-		snprintf(buf, bufsize - 1, "%d", ctx->args->min_width);
-		return buf;
-	}
-
-	if (!strcmp(var, "min_size_height"))
-	{
-		snprintf(buf, bufsize - 1, "%d", ctx->args->min_height);
-		return buf;
+	assert(var);
+
+	switch (var->id)
+	{
+		case CATCIERGE_VAR_HAAR_CASCADE:
+			return ctx->args->cascade;
+		case CATCIERGE_VAR_HAAR_IN_DIRECTION:
+			return catcierge_get_left_right_str(ctx->args->in_direction);
+		case CATCIERGE_VAR_HAAR_MIN_SIZE:
+			snprintf(buf, bufsize - 1, "%dx%d",
+				ctx->args->min_width,
+				ctx->args->min_height);
+			return buf;
+		case CATCIERGE_VAR_HAAR_MIN_SIZE_WIDTH:
+			snprintf(buf, bufsize - 1, "%d", ctx->args->min_width);
+			return buf;
+		case CATCIERGE_VAR_HAAR_MIN_SIZE_HEIGHT:
+			snprintf(buf, bufsize - 1, "%d", ctx->args->min_height);
+			return buf;
+		case CATCIERGE_VAR_HAAR_NO_MATCH_IS_FAIL:
+			snprintf(buf, bufsize - 1, "%d", ctx->args->no_match_is_fail);
+			return buf;
+		case CATCIERGE_VAR_HAAR_EQ_HISTOGRAM:
+			snprintf(buf, bufsize - 1, "%d", ctx->args->eq_histogram);
+			return buf;
+		case CATCIERGE_VAR_HAAR_PREY_METHOD:
+			return catcierge_haar_matcher_prey_method_str(ctx->args->prey_method);
+		case CATCIERGE_VAR_HAAR_PREY_STEPS:
+			snprintf(buf, bufsize - 1, "%d", ctx->args->prey_steps);
+			return buf;
+		default:
+			return NULL;
 	}
-
-	if (!strcmp(var, "no_match_is_fail"))
-	{
-		snprintf(buf, bufsize - 1, "%d", ctx->args->no_match_is_fail);
-		return buf;
-	}
-
-	if (!strcmp(var, "eq_histogram"))
-	{
-		snprintf(buf, bufsize - 1, "%d", ctx->args->eq_histogram);
-		return buf;
-	}
-
-	if (!strcmp(var, "prey_method"))
-	{
-		return catcierge_haar_matcher_prey_method_str(ctx->args->prey_method);
-	}
-
-	if (!strcmp(var, "prey_steps"))
-	{
-		snprintf(buf, bufsize - 1, "%d", ctx->args->prey_steps);
-		return buf;
-	}
-
-	return NULL;
 }
 
 void catcierge_haar_matcher_print_settings(catcierge_haar_matcher_args_t *args)
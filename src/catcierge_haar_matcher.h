@@ -24,6 +24,7 @@
 #include "catcierge_haar_wrapper.h"
 #include "catcierge_types.h"
 #include "catcierge_matcher.h"
+#include "catcierge_output_types.h"
 #include "cargo.h"
 
 #define HAAR_FAIL 0.0
@@ -83,8 +84,8 @@ int catcierge_haar_matcher_args_destroy(catcierge_haar_matcher_args_t *args);
 int catcierge_haar_matcher_parse_args(catcierge_haar_matcher_args_t *args, const char *key, char **values, size_t value_count);
 void catcierge_haar_matcher_args_init(catcierge_haar_matcher_args_t * args);
 void catcierge_haar_matcher_print_settings(catcierge_haar_matcher_args_t *args);
-const char *catcierge_haar_matcher_translate(catcierge_matcher_t *octx, const char *var,
-	char *buf, size_t bufsize);
+const char *catcierge_haar_matcher_translate(catcierge_matcher_t *octx,
+	const catcierge_output_var_ref_t *var, char *buf, size_t bufsize);
 void catcierge_haar_output_print_usage();
 
 #endif // __CATCIERGE_HAAR_MATCHER_H__
@@ -0,0 +1,431 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#define _GNU_SOURCE // For strptime.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "catcierge_config.h"
+#include "catcierge_match_journal.h"
+#include "catcierge_util.h"
+#include "cargo.h"
+
+typedef struct journal_ctx_s
+{
+	char *journal_path;
+	char *from;
+	char *to;
+	int csv;
+	int matches;
+	int stats;
+	int count;
+} journal_ctx_t;
+
+typedef struct journal_stats_s
+{
+	size_t count;
+	size_t success;
+	size_t fail;
+	size_t in;
+	size_t out;
+	size_t unknown;
+	size_t truncated;
+	size_t match_count;
+	double result_sum;
+} journal_stats_t;
+
+journal_ctx_t ctx;
+journal_stats_t stats;
+
+static int add_journal_args(cargo_t cargo)
+{
+	int ret = 0;
+
+	ret |= cargo_add_group(cargo, 0,
+			"journal", "Journal query settings",
+			"Lists the match groups in a journal written by catcierge_grabber "
+			"--journal. Times are local and given as YYYY-mm-ddTHH:MM:SS, "
+			"YYYY-mm-dd or @SECONDS since the epoch.\n");
+
+	ret |= cargo_add_option(cargo, CARGO_OPT_REQUIRED,
+			"<journal> --journal",
+			"The journal file to read.",
+			"s", &ctx.journal_path);
+	ret |= cargo_set_metavar(cargo, "--journal", "PATH");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<journal> --from",
+			"Only match groups that started at or after this time.",
+			"s", &ctx.from);
+	ret |= cargo_set_metavar(cargo, "--from", "TIME");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<journal> --to",
+			"Only match groups that started before this time.",
+			"s", &ctx.to);
+	ret |= cargo_set_metavar(cargo, "--to", "TIME");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<journal> --csv",
+			"Print CSV with a header instead of text.",
+			"b", &ctx.csv);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<journal> --matches",
+			"Print each match in the match groups. With --csv there is "
+			"one row per match instead of one per match group.",
+			"b", &ctx.matches);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<journal> --stats",
+			"Only print a summary of the match groups in the range.",
+			"b", &ctx.stats);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<journal> --count",
+			"Stop after this many match groups.",
+			"i", &ctx.count);
+
+	return ret;
+}
+
+static int parse_time(const char *str, int64_t *usec)
+{
+	struct tm tm;
+	time_t t;
+	char *end = NULL;
+	const char *formats[] =
+	{
+		"%Y-%m-%dT%H:%M:%S",
+		"%Y-%m-%d %H:%M:%S",
+		"%Y-%m-%d"
+	};
+	size_t i;
+
+	if (str[0] == '@')
+	{
+		*usec = (int64_t)(strtod(str + 1, &end) * 1000000.0);
+		return (*end || (end == (str + 1))) ? -1 : 0;
+	}
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+	{
+		memset(&tm, 0, sizeof(tm));
+
+		if ((end = strptime(str, formats[i], &tm)) && !*end)
+		{
+			tm.tm_isdst = -1;
+
+			if ((t = mktime(&tm)) == -1)
+			{
+				return -1;
+			}
+
+			*usec = (int64_t)t * 1000000;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static const char *format_time(int64_t usec, char *buf, size_t size)
+{
+	time_t t = (time_t)(usec / 1000000);
+	struct tm tm;
+
+	if (!localtime_r(&t, &tm) || !strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm))
+	{
+		snprintf(buf, size, "%lld", (long long)usec);
+		return buf;
+	}
+
+	snprintf(buf + strlen(buf), size - strlen(buf), ".%06d", (int)(usec % 1000000));
+
+	return buf;
+}
+
+static const char *format_id(const catcierge_journal_record_t *r, char *buf, size_t size)
+{
+	// Same as %match_group_id% in the templates.
+	snprintf(buf, size, "%x%x%x%x%x",
+		r->id[0], r->id[1], r->id[2], r->id[3], r->id[4]);
+	return buf;
+}
+
+static void print_csv_string(const char *s)
+{
+	putchar('"');
+
+	for (; *s; s++)
+	{
+		if (*s == '"')
+			putchar('"');
+		putchar(*s);
+	}
+
+	putchar('"');
+}
+
+static void print_match_path(const catcierge_journal_record_t *r,
+		const catcierge_journal_match_t *m)
+{
+	// Images saved somewhere else than the first one have the full path.
+	if (m->path[0] && !strchr(m->path, '/') && !strchr(m->path, '\\'))
+	{
+		printf("%s%s", r->dir, catcierge_path_sep());
+	}
+}
+
+static int print_csv_record(const catcierge_journal_record_t *r)
+{
+	size_t i;
+	size_t count = r->match_count;
+	const catcierge_journal_match_t *m = NULL;
+	char start[64];
+	char end[64];
+	char id[64];
+
+	format_time(r->start_usec, start, sizeof(start));
+	format_time(r->end_usec, end, sizeof(end));
+	format_id(r, id, sizeof(id));
+
+	if (!ctx.matches)
+	{
+		printf("%s,%s,%s,%d,%d,%d,%s,%d,%d,",
+			start, end, id,
+			r->success, r->final_decision, r->early_decision,
+			catcierge_get_direction_str((match_direction_t)r->direction),
+			r->match_count, r->success_count);
+		print_csv_string(r->description);
+		printf(",%d\n", (r->flags & CATCIERGE_JOURNAL_TRUNCATED) ? 1 : 0);
+		return 0;
+	}
+
+	if (count > CATCIERGE_JOURNAL_MAX_MATCHES)
+		count = CATCIERGE_JOURNAL_MAX_MATCHES;
+
+	for (i = 0; i < count; i++)
+	{
+		m = &r->matches[i];
+		format_time(m->time_usec, start, sizeof(start));
+
+		printf("%s,%d,%s,%f,%d,%s,%d,%d,",
+			id, (int)(i + 1), start, m->result, m->success,
+			catcierge_get_direction_str((match_direction_t)m->direction),
+			m->rect_count, m->step_count);
+
+		if (m->rect_count > 0)
+		{
+			printf("%d %d %d %d", m->rects[0].x, m->rects[0].y,
+				m->rects[0].width, m->rects[0].height);
+		}
+
+		printf(",\"");
+		print_match_path(r, m);
+		printf("%s\"\n", m->path);
+	}
+
+	return 0;
+}
+
+static int print_text_record(const catcierge_journal_record_t *r)
+{
+	size_t i;
+	size_t k;
+	size_t count = r->match_count;
+	const catcierge_journal_match_t *m = NULL;
+	char start[64];
+	char id[64];
+
+	printf("%s %s %-4s %-7s %d/%d %s%s\n",
+		format_time(r->start_usec, start, sizeof(start)),
+		format_id(r, id, sizeof(id)),
+		r->success ? "OK" : "FAIL",
+		catcierge_get_direction_str((match_direction_t)r->direction),
+		r->success_count, r->match_count,
+		r->description,
+		(r->flags & CATCIERGE_JOURNAL_TRUNCATED) ? " (truncated)" : "");
+
+	if (!ctx.matches)
+	{
+		return 0;
+	}
+
+	if (count > CATCIERGE_JOURNAL_MAX_MATCHES)
+		count = CATCIERGE_JOURNAL_MAX_MATCHES;
+
+	for (i = 0; i < count; i++)
+	{
+		m = &r->matches[i];
+
+		printf("  %d: %s %-4s %-7s %f",
+			(int)(i + 1),
+			format_time(m->time_usec, start, sizeof(start)),
+			m->success ? "OK" : "FAIL",
+			catcierge_get_direction_str((match_direction_t)m->direction),
+			m->result);
+
+		for (k = 0; k < m->rect_count; k++)
+		{
+			printf(" (%d,%d %dx%d)", m->rects[k].x, m->rects[k].y,
+				m->rects[k].width, m->rects[k].height);
+		}
+
+		if (m->path[0])
+		{
+			printf(" ");
+			print_match_path(r, m);
+			printf("%s", m->path);
+		}
+
+		printf("\n");
+	}
+
+	return 0;
+}
+
+static int record_callback(const catcierge_journal_record_t *r, void *user)
+{
+	size_t i;
+	size_t count = r->match_count;
+
+	stats.count++;
+
+	if (ctx.stats)
+	{
+		if (r->success) stats.success++; else stats.fail++;
+
+		switch ((match_direction_t)r->direction)
+		{
+			case MATCH_DIR_IN: stats.in++; break;
+			case MATCH_DIR_OUT: stats.out++; break;
+			default: stats.unknown++; break;
+		}
+
+		if (r->flags & CATCIERGE_JOURNAL_TRUNCATED)
+			stats.truncated++;
+
+		if (count > CATCIERGE_JOURNAL_MAX_MATCHES)
+			count = CATCIERGE_JOURNAL_MAX_MATCHES;
+
+		for (i = 0; i < count; i++)
+		{
+			stats.result_sum += r->matches[i].result;
+			stats.match_count++;
+		}
+	}
+	else if (ctx.csv)
+	{
+		print_csv_record(r);
+	}
+	else
+	{
+		print_text_record(r);
+	}
+
+	return ((ctx.count > 0) && (stats.count >= (size_t)ctx.count)) ? 1 : 0;
+}
+
+static void print_stats()
+{
+	printf("Match groups: %lu\n", (unsigned long)stats.count);
+	printf("     Success: %lu\n", (unsigned long)stats.success);
+	printf("        Fail: %lu\n", (unsigned long)stats.fail);
+	printf("          In: %lu\n", (unsigned long)stats.in);
+	printf("         Out: %lu\n", (unsigned long)stats.out);
+	printf("     Unknown: %lu\n", (unsigned long)stats.unknown);
+	printf("   Truncated: %lu\n", (unsigned long)stats.truncated);
+	printf("     Matches: %lu\n", (unsigned long)stats.match_count);
+	printf(" Mean result: %f\n", stats.match_count
+		? (stats.result_sum / stats.match_count) : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+	cargo_t cargo;
+	catcierge_journal_reader_t rd;
+	int64_t from_usec = INT64_MIN;
+	int64_t to_usec = INT64_MAX;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&stats, 0, sizeof(stats));
+	memset(&rd, 0, sizeof(rd));
+
+	if (cargo_init(&cargo, 0, "%s", argv[0]))
+	{
+		fprintf(stderr, "Failed to init command line parsing\n");
+		return -1;
+	}
+
+	if (add_journal_args(cargo))
+	{
+		fprintf(stderr, "Failed to add journal args\n");
+		ret = -1; goto fail;
+	}
+
+	if (cargo_parse(cargo, 0, 1, argc, argv))
+	{
+		ret = -1; goto fail;
+	}
+
+	if (ctx.from && parse_time(ctx.from, &from_usec))
+	{
+		fprintf(stderr, "Invalid --from time \"%s\"\n", ctx.from);
+		ret = -1; goto fail;
+	}
+
+	if (ctx.to && parse_time(ctx.to, &to_usec))
+	{
+		fprintf(stderr, "Invalid --to time \"%s\"\n", ctx.to);
+		ret = -1; goto fail;
+	}
+
+	if (catcierge_journal_reader_open(&rd, ctx.journal_path))
+	{
+		ret = -1; goto fail;
+	}
+
+	if (ctx.csv && !ctx.stats)
+	{
+		if (ctx.matches)
+			printf("id,match,time,result,success,direction,rect_count,step_count,rect,path\n");
+		else
+			printf("start,end,id,success,final_decision,early_decision,direction,"
+				"match_count,success_count,description,truncated\n");
+	}
+
+	catcierge_journal_query(&rd, from_usec, to_usec, record_callback, NULL);
+
+	if (ctx.stats)
+	{
+		print_stats();
+	}
+
+fail:
+	catcierge_journal_reader_close(&rd);
+	free(ctx.journal_path);
+	free(ctx.from);
+	free(ctx.to);
+	cargo_destroy(&cargo);
+
+	return ret;
+}
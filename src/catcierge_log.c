@@ -24,13 +24,54 @@
 #endif
 
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
+#include <catcierge_config.h>
 #include "catcierge_log.h"
 #include "catcierge_platform.h"
 #include "catcierge_strftime.h"
+#include "catcierge_clock.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#include <sched.h>
+#include "catcierge_queue.h"
+#endif
 
 int catcierge_nocolor = 0;
 
+#ifdef CATCIERGE_HAVE_PTHREADS
+typedef struct catcierge_log_record_s
+{
+	FILE *fd;
+	enum catcierge_color_e color;
+	int has_time;
+	struct timeval tv;
+	char msg[CATCIERGE_LOG_MAX_LINE];
+} catcierge_log_record_t;
+
+typedef struct catcierge_log_async_s
+{
+	volatile size_t started;
+	volatile long pushing;			// Callers between checking started and queueing.
+	int stop;
+	int atexit_added;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// A line was queued, or stopping.
+	pthread_mutex_t write_lock;		// Held while writing, keeps the lines in order.
+	volatile size_t sleeping;		// The writer thread is waiting on cond.
+	catcierge_queue_t queue;		// Lines waiting to be written.
+	catcierge_queue_t free;			// Records not in use.
+	catcierge_log_record_t *records;
+	volatile long dropped;
+	time_t time_sec;				// The date part of the timestamp only
+	char time_str[64];				// changes once per second.
+} catcierge_log_async_t;
+
+static catcierge_log_async_t log_async;
+#endif // CATCIERGE_HAVE_PTHREADS
+
 char *get_time_str_fmt(time_t t, struct timeval *tv, char *time_str, size_t len, const char *fmt)
 {
 	struct tm tm;
@@ -52,9 +93,9 @@ char *get_time_str_fmt(time_t t, struct timeval *tv, char *time_str, size_t len,
 char *get_time_str(char *time_str, size_t len)
 {
 	struct timeval tv;
-	gettimeofday(&tv, NULL);
+	catcierge_clock_gettimeofday(&tv);
 
-	return get_time_str_fmt(time(NULL), &tv, time_str, len, NULL);
+	return get_time_str_fmt(tv.tv_sec, &tv, time_str, len, NULL);
 }
 
 void log_vprintf(FILE *target, enum catcierge_color_e print_color, const char *fmt, va_list args)
@@ -129,10 +170,305 @@ void log_vprintf(FILE *target, enum catcierge_color_e print_color, const char *f
 	#endif
 }
 
+static void log_printf_sync(FILE *fd, enum catcierge_color_e print_color, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	log_vprintf(fd, print_color, fmt, args);
+	va_end(args);
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+static void log_async_write_time(FILE *fd, struct timeval tv)
+{
+	if (tv.tv_sec != log_async.time_sec)
+	{
+		get_time_str_fmt(tv.tv_sec, &tv, log_async.time_str,
+			sizeof(log_async.time_str), "%Y-%m-%d %H:%M:%S");
+		log_async.time_sec = tv.tv_sec;
+	}
+
+	log_printf_sync(fd, COLOR_NORMAL, "[");
+	log_printf_sync(fd, COLOR_BRIGHT, "%s.%06ld", log_async.time_str, (long)tv.tv_usec);
+	log_printf_sync(fd, COLOR_NORMAL, "]  ");
+}
+
+// Must be called with the write lock held.
+static size_t log_async_write_queued()
+{
+	size_t count = 0;
+	catcierge_log_record_t *r = NULL;
+
+	while ((r = catcierge_queue_pop(&log_async.queue)))
+	{
+		if (r->has_time)
+		{
+			log_async_write_time(r->fd, r->tv);
+		}
+
+		log_printf_sync(r->fd, r->color, "%s", r->msg);
+		catcierge_queue_push(&log_async.free, r);
+		count++;
+	}
+
+	return count;
+}
+
+static size_t log_async_drain()
+{
+	size_t count = 0;
+
+	pthread_mutex_lock(&log_async.write_lock);
+
+	if ((count = log_async_write_queued()) > 0)
+	{
+		fflush(stdout);
+		fflush(stderr);
+	}
+
+	pthread_mutex_unlock(&log_async.write_lock);
+
+	return count;
+}
+
+static void *log_async_thread(void *arg)
+{
+	int stop = 0;
+
+	while (1)
+	{
+		if (log_async_drain() > 0)
+			continue;
+
+		if (stop)
+			break;
+
+		pthread_mutex_lock(&log_async.lock);
+
+		// Pairs with the fence in log_async_push, either we
+		// see the new line or the producer sees that we are sleeping.
+		catcierge_atomic_store(&log_async.sleeping, 1);
+		catcierge_atomic_fence();
+
+		while (!log_async.stop && !catcierge_queue_count(&log_async.queue))
+		{
+			pthread_cond_wait(&log_async.cond, &log_async.lock);
+		}
+
+		catcierge_atomic_store(&log_async.sleeping, 0);
+		stop = log_async.stop;
+		pthread_mutex_unlock(&log_async.lock);
+	}
+
+	return NULL;
+}
+
+// Returns -1 if the line should be written directly instead.
+static int log_async_push(FILE *fd, enum catcierge_color_e print_color,
+		int has_time, const char *fmt, va_list args)
+{
+	int len;
+	va_list copy;
+	catcierge_log_record_t *r = NULL;
+
+	if ((fd != stdout) && (fd != stderr))
+	{
+		return -1;
+	}
+
+	catcierge_atomic_inc(&log_async.pushing);
+
+	if (!catcierge_atomic_load(&log_async.started))
+	{
+		catcierge_atomic_dec(&log_async.pushing);
+		return -1;
+	}
+
+	if (!(r = catcierge_queue_pop(&log_async.free)))
+	{
+		catcierge_atomic_inc(&log_async.dropped);
+		catcierge_atomic_dec(&log_async.pushing);
+		return 0;
+	}
+
+	r->fd = fd;
+	r->color = print_color;
+	r->has_time = has_time;
+
+	if (has_time)
+	{
+		catcierge_clock_gettimeofday(&r->tv);
+	}
+
+	va_copy(copy, args);
+	len = vsnprintf(r->msg, sizeof(r->msg), fmt, args);
+
+	if (len >= (int)sizeof(r->msg))
+	{
+		// Too long for a record, so it is written directly
+		// instead, after the lines that are already waiting.
+		pthread_mutex_lock(&log_async.write_lock);
+		log_async_write_queued();
+
+		if (has_time)
+		{
+			log_async_write_time(fd, r->tv);
+		}
+
+		log_vprintf(fd, print_color, fmt, copy);
+		fflush(fd);
+		pthread_mutex_unlock(&log_async.write_lock);
+
+		va_end(copy);
+		catcierge_queue_push(&log_async.free, r);
+		catcierge_atomic_dec(&log_async.pushing);
+		return 0;
+	}
+
+	va_end(copy);
+
+	// There are as many records as there is room in the queue.
+	catcierge_queue_push(&log_async.queue, r);
+	catcierge_atomic_dec(&log_async.pushing);
+	catcierge_atomic_fence();
+
+	if (catcierge_atomic_load(&log_async.sleeping))
+	{
+		pthread_mutex_lock(&log_async.lock);
+		pthread_cond_signal(&log_async.cond);
+		pthread_mutex_unlock(&log_async.lock);
+	}
+
+	return 0;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int catcierge_log_async_start(size_t records)
+{
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	size_t i;
+
+	if (log_async.started)
+	{
+		return 0;
+	}
+
+	if (catcierge_queue_init(&log_async.queue, records)
+	 || catcierge_queue_init(&log_async.free, records))
+	{
+		goto fail;
+	}
+
+	// Use all of the rounded up queue size.
+	records = catcierge_queue_size(&log_async.queue);
+
+	if (!(log_async.records = calloc(records, sizeof(catcierge_log_record_t))))
+	{
+		fprintf(stderr, "Out of memory\n");
+		goto fail;
+	}
+
+	for (i = 0; i < records; i++)
+	{
+		catcierge_queue_push(&log_async.free, &log_async.records[i]);
+	}
+
+	log_async.stop = 0;
+	log_async.time_sec = 0;
+	pthread_mutex_init(&log_async.lock, NULL);
+	pthread_mutex_init(&log_async.write_lock, NULL);
+	pthread_cond_init(&log_async.cond, NULL);
+
+	if (pthread_create(&log_async.thread, NULL, log_async_thread, NULL))
+	{
+		fprintf(stderr, "Failed to start log thread\n");
+		pthread_cond_destroy(&log_async.cond);
+		pthread_mutex_destroy(&log_async.write_lock);
+		pthread_mutex_destroy(&log_async.lock);
+		goto fail;
+	}
+
+	if (!log_async.atexit_added)
+	{
+		atexit(catcierge_log_async_stop);
+		log_async.atexit_added = 1;
+	}
+
+	catcierge_atomic_store(&log_async.started, 1);
+
+	return 0;
+
+fail:
+	catcierge_queue_destroy(&log_async.queue);
+	catcierge_queue_destroy(&log_async.free);
+	free(log_async.records);
+	log_async.records = NULL;
+	#endif // CATCIERGE_HAVE_PTHREADS
+	return -1;
+}
+
+void catcierge_log_async_stop()
+{
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (!log_async.started)
+	{
+		return;
+	}
+
+	catcierge_atomic_store(&log_async.started, 0);
+	catcierge_atomic_fence();
+
+	// Let anyone already queueing a line finish.
+	while (catcierge_atomic_load(&log_async.pushing))
+	{
+		sched_yield();
+	}
+
+	pthread_mutex_lock(&log_async.lock);
+	log_async.stop = 1;
+	pthread_cond_signal(&log_async.cond);
+	pthread_mutex_unlock(&log_async.lock);
+
+	pthread_join(log_async.thread, NULL);
+
+	// Anything queued while the thread was stopping.
+	log_async_drain();
+
+	pthread_cond_destroy(&log_async.cond);
+	pthread_mutex_destroy(&log_async.write_lock);
+	pthread_mutex_destroy(&log_async.lock);
+	catcierge_queue_destroy(&log_async.queue);
+	catcierge_queue_destroy(&log_async.free);
+	free(log_async.records);
+	log_async.records = NULL;
+	#endif // CATCIERGE_HAVE_PTHREADS
+}
+
+unsigned long catcierge_log_async_dropped()
+{
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	return (unsigned long)catcierge_atomic_load(&log_async.dropped);
+	#else
+	return 0;
+	#endif
+}
+
 void log_printf(FILE *fd, enum catcierge_color_e print_color, const char *fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (!log_async_push(fd, print_color, 0, fmt, args))
+	{
+		va_end(args);
+		return;
+	}
+
+	va_end(args);
+	va_start(args, fmt);
+	#endif
+
 	log_vprintf(fd, print_color, fmt, args);
 	va_end(args);
 }
@@ -141,13 +477,26 @@ void log_printc(FILE *fd, enum catcierge_color_e print_color, const char *fmt, .
 {
 	va_list ap;
 	char time_str[256];
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	va_start(ap, fmt);
+
+	if (!log_async_push(fd, print_color, 1, fmt, ap))
+	{
+		va_end(ap);
+		return;
+	}
+
+	va_end(ap);
+	#endif
+
 	get_time_str(time_str, sizeof(time_str));
 
 	if ((fd == stdout) || (fd == stderr))
 	{
-		log_printf(fd, COLOR_NORMAL, "[");
-		log_printf(fd, COLOR_BRIGHT, "%s", time_str);
-		log_printf(fd, COLOR_NORMAL, "]  ");
+		log_printf_sync(fd, COLOR_NORMAL, "[");
+		log_printf_sync(fd, COLOR_BRIGHT, "%s", time_str);
+		log_printf_sync(fd, COLOR_NORMAL, "]  ");
 
 		va_start(ap, fmt);
 		log_vprintf(fd, print_color, fmt, ap);
@@ -31,6 +31,29 @@ char *get_time_str(char *time_str, size_t len);
 void log_printc(FILE *fd, enum catcierge_color_e print_color, const char *fmt, ...);
 void log_printf(FILE *fd, enum catcierge_color_e print_color, const char *fmt, ...);
 
+//
+// Asynchronous logging.
+//
+// Once started, lines logged to stdout and stderr are formatted into a
+// preallocated record and handed over through a lock-free queue to a
+// background thread that writes them. A slow terminal or SD card then
+// never holds up the caller. The thread writes everything that is
+// waiting before flushing, and only formats the date once per second.
+//
+// If all records are in use the line is dropped and counted, instead
+// of blocking. Other files, and lines longer than CATCIERGE_LOG_MAX_LINE,
+// are still written directly.
+//
+#define CATCIERGE_LOG_MAX_LINE 512
+
+int catcierge_log_async_start(size_t records);
+
+// Writes any waiting lines and stops the thread.
+// This is also done at exit.
+void catcierge_log_async_stop();
+
+unsigned long catcierge_log_async_dropped();
+
 #define log_print(fd, fmt, ...) log_printc(fd, COLOR_NORMAL, fmt, ##__VA_ARGS__)
 #define CATLOG(fmt, ...) log_printc(stdout, COLOR_NORMAL, fmt, ##__VA_ARGS__)
 #define CATERR(fmt, ...) log_printc(stderr, COLOR_RED, fmt, ##__VA_ARGS__)
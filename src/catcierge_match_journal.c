@@ -0,0 +1,636 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "catcierge_match_journal.h"
+#include "catcierge_log.h"
+
+// Changing any of these breaks existing journals.
+typedef char catcierge_journal_header_size_check[(sizeof(catcierge_journal_header_t) == 64) ? 1 : -1];
+typedef char catcierge_journal_match_size_check[(sizeof(catcierge_journal_match_t) == 128) ? 1 : -1];
+typedef char catcierge_journal_record_size_check[(sizeof(catcierge_journal_record_t) == 1280) ? 1 : -1];
+typedef char catcierge_journal_index_size_check[(sizeof(catcierge_journal_index_header_t) == 32) ? 1 : -1];
+
+#define JOURNAL_HEADER_SIZE sizeof(catcierge_journal_header_t)
+#define JOURNAL_RECORD_SIZE sizeof(catcierge_journal_record_t)
+#define INDEX_HEADER_SIZE sizeof(catcierge_journal_index_header_t)
+#define INDEX_ENTRY_SIZE sizeof(catcierge_journal_index_entry_t)
+#define RECORD_OFFSET(n) ((off_t)(JOURNAL_HEADER_SIZE + (n) * JOURNAL_RECORD_SIZE))
+#define INDEX_OFFSET(n) ((off_t)(INDEX_HEADER_SIZE + (n) * INDEX_ENTRY_SIZE))
+
+int64_t catcierge_journal_tv_to_usec(const struct timeval *tv)
+{
+	assert(tv);
+	return ((int64_t)tv->tv_sec * 1000000) + tv->tv_usec;
+}
+
+static int catcierge_journal_write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	ssize_t n;
+
+	while (len > 0)
+	{
+		if ((n = write(fd, p, len)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int catcierge_journal_read_all(int fd, void *buf, size_t len, off_t offset)
+{
+	char *p = (char *)buf;
+	ssize_t n;
+
+	while (len > 0)
+	{
+		if ((n = pread(fd, p, len, offset)) <= 0)
+		{
+			if ((n < 0) && (errno == EINTR))
+				continue;
+
+			return -1;
+		}
+
+		p += n;
+		len -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+static void catcierge_journal_header_init(catcierge_journal_header_t *h)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, CATCIERGE_JOURNAL_MAGIC, sizeof(CATCIERGE_JOURNAL_MAGIC));
+	h->version = CATCIERGE_JOURNAL_VERSION;
+	h->endian = CATCIERGE_JOURNAL_ENDIAN;
+	h->header_size = JOURNAL_HEADER_SIZE;
+	h->record_size = JOURNAL_RECORD_SIZE;
+	h->index_interval = CATCIERGE_JOURNAL_INDEX_INTERVAL;
+}
+
+static int catcierge_journal_header_check(const catcierge_journal_header_t *h, const char *path)
+{
+	if (memcmp(h->magic, CATCIERGE_JOURNAL_MAGIC, sizeof(CATCIERGE_JOURNAL_MAGIC)))
+	{
+		CATERR("%s is not a match journal\n", path);
+		return -1;
+	}
+
+	if (h->endian != CATCIERGE_JOURNAL_ENDIAN)
+	{
+		CATERR("%s was written on a machine with a different byte order\n", path);
+		return -1;
+	}
+
+	if ((h->version != CATCIERGE_JOURNAL_VERSION)
+		|| (h->header_size != JOURNAL_HEADER_SIZE)
+		|| (h->record_size != JOURNAL_RECORD_SIZE)
+		|| (h->index_interval != CATCIERGE_JOURNAL_INDEX_INTERVAL))
+	{
+		CATERR("%s is an unsupported journal version %u\n", path, h->version);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void catcierge_journal_index_header_init(catcierge_journal_index_header_t *h)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, CATCIERGE_JOURNAL_INDEX_MAGIC, sizeof(CATCIERGE_JOURNAL_INDEX_MAGIC));
+	h->version = CATCIERGE_JOURNAL_VERSION;
+	h->interval = CATCIERGE_JOURNAL_INDEX_INTERVAL;
+}
+
+static int catcierge_journal_index_header_check(const catcierge_journal_index_header_t *h)
+{
+	return (memcmp(h->magic, CATCIERGE_JOURNAL_INDEX_MAGIC, sizeof(CATCIERGE_JOURNAL_INDEX_MAGIC))
+		|| (h->version != CATCIERGE_JOURNAL_VERSION)
+		|| (h->interval != CATCIERGE_JOURNAL_INDEX_INTERVAL)) ? -1 : 0;
+}
+
+static int catcierge_journal_add_index_entry(catcierge_journal_t *j,
+		int64_t start_usec, uint64_t record)
+{
+	catcierge_journal_index_entry_t e;
+
+	memset(&e, 0, sizeof(e));
+	e.start_usec = start_usec;
+	e.record = record;
+
+	return catcierge_journal_write_all(j->index_fd, &e, sizeof(e));
+}
+
+// Makes the index match the records in the journal.
+static int catcierge_journal_open_index(catcierge_journal_t *j, const char *path)
+{
+	char index_path[4096];
+	struct stat st;
+	catcierge_journal_index_header_t h;
+	catcierge_journal_record_t r;
+	uint64_t entries = 0;
+	uint64_t expected = 0;
+
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+
+	if ((j->index_fd = open(index_path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0)
+	{
+		CATERR("Failed to open journal index %s: %s\n", index_path, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(j->index_fd, &st))
+	{
+		CATERR("Failed to stat %s: %s\n", index_path, strerror(errno));
+		return -1;
+	}
+
+	if ((st.st_size < (off_t)INDEX_HEADER_SIZE)
+		|| catcierge_journal_read_all(j->index_fd, &h, sizeof(h), 0)
+		|| catcierge_journal_index_header_check(&h))
+	{
+		if (st.st_size > 0)
+		{
+			CATLOG("Rebuilding the journal index %s\n", index_path);
+		}
+
+		catcierge_journal_index_header_init(&h);
+
+		if (ftruncate(j->index_fd, 0)
+			|| catcierge_journal_write_all(j->index_fd, &h, sizeof(h)))
+		{
+			CATERR("Failed to write %s: %s\n", index_path, strerror(errno));
+			return -1;
+		}
+	}
+	else
+	{
+		entries = (st.st_size - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+	}
+
+	expected = (j->count + CATCIERGE_JOURNAL_INDEX_INTERVAL - 1) / CATCIERGE_JOURNAL_INDEX_INTERVAL;
+
+	// Entries for records that were cut off, or a half written entry.
+	if ((entries > expected) || (st.st_size != INDEX_OFFSET(entries)))
+	{
+		if (entries > expected)
+			entries = expected;
+
+		if (ftruncate(j->index_fd, INDEX_OFFSET(entries)))
+		{
+			CATERR("Failed to truncate %s: %s\n", index_path, strerror(errno));
+			return -1;
+		}
+	}
+
+	for (; entries < expected; entries++)
+	{
+		uint64_t record = entries * CATCIERGE_JOURNAL_INDEX_INTERVAL;
+
+		if (catcierge_journal_read_all(j->fd, &r, sizeof(r), RECORD_OFFSET(record))
+			|| catcierge_journal_add_index_entry(j, r.start_usec, record))
+		{
+			CATERR("Failed to rebuild %s: %s\n", index_path, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int catcierge_journal_open(catcierge_journal_t *j, const char *path)
+{
+	struct stat st;
+	catcierge_journal_header_t h;
+	off_t size;
+	assert(j);
+	assert(path);
+
+	memset(j, 0, sizeof(catcierge_journal_t));
+	j->index_fd = -1;
+
+	if ((j->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0)
+	{
+		CATERR("Failed to open journal %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(j->fd, &st))
+	{
+		CATERR("Failed to stat %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+
+	if (st.st_size == 0)
+	{
+		catcierge_journal_header_init(&h);
+
+		if (catcierge_journal_write_all(j->fd, &h, sizeof(h)))
+		{
+			CATERR("Failed to write %s: %s\n", path, strerror(errno));
+			goto fail;
+		}
+
+		st.st_size = sizeof(h);
+	}
+	else if ((st.st_size < (off_t)sizeof(h))
+			|| catcierge_journal_read_all(j->fd, &h, sizeof(h), 0))
+	{
+		CATERR("%s is not a match journal\n", path);
+		goto fail;
+	}
+	else if (catcierge_journal_header_check(&h, path))
+	{
+		goto fail;
+	}
+
+	j->count = (st.st_size - JOURNAL_HEADER_SIZE) / JOURNAL_RECORD_SIZE;
+	size = RECORD_OFFSET(j->count);
+
+	if (st.st_size != size)
+	{
+		CATLOG("Removing a partially written record at the end of %s\n", path);
+
+		if (ftruncate(j->fd, size))
+		{
+			CATERR("Failed to truncate %s: %s\n", path, strerror(errno));
+			goto fail;
+		}
+	}
+
+	if (catcierge_journal_open_index(j, path))
+	{
+		goto fail;
+	}
+
+	return 0;
+fail:
+	catcierge_journal_close(j);
+	return -1;
+}
+
+void catcierge_journal_close(catcierge_journal_t *j)
+{
+	assert(j);
+
+	if (j->fd >= 0)
+	{
+		close(j->fd);
+		j->fd = -1;
+	}
+
+	if (j->index_fd >= 0)
+	{
+		close(j->index_fd);
+		j->index_fd = -1;
+	}
+}
+
+static void catcierge_journal_strcpy(char *dst, size_t size,
+		const char *src, uint32_t *flags)
+{
+	size_t len = strlen(src);
+
+	if (len >= size)
+	{
+		len = size - 1;
+		*flags |= CATCIERGE_JOURNAL_TRUNCATED;
+	}
+
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+void catcierge_journal_record_init(catcierge_journal_record_t *r, const match_group_t *mg)
+{
+	size_t i;
+	size_t k;
+	size_t count;
+	assert(r);
+	assert(mg);
+
+	memset(r, 0, sizeof(catcierge_journal_record_t));
+	r->magic = CATCIERGE_JOURNAL_RECORD_MAGIC;
+	r->start_usec = catcierge_journal_tv_to_usec(&mg->start_tv);
+	r->end_usec = catcierge_journal_tv_to_usec(&mg->end_tv);
+
+	for (i = 0; i < 5; i++)
+	{
+		r->id[i] = mg->sha.Message_Digest[i];
+	}
+
+	r->success = (int8_t)mg->success;
+	r->final_decision = (int8_t)mg->final_decision;
+	r->early_decision = (int8_t)mg->early_decision;
+	r->direction = (int8_t)mg->direction;
+	r->match_count = (uint8_t)mg->match_count;
+	r->success_count = (uint8_t)mg->success_count;
+	catcierge_journal_strcpy(r->description, sizeof(r->description),
+		mg->description, &r->flags);
+
+	if (mg->match_count == 0)
+	{
+		return;
+	}
+
+	// The images of a match group normally end up in the same place.
+	catcierge_journal_strcpy(r->dir, sizeof(r->dir),
+		mg->matches[0].path.dir, &r->flags);
+
+	count = mg->match_count;
+
+	if (count > CATCIERGE_JOURNAL_MAX_MATCHES)
+	{
+		count = CATCIERGE_JOURNAL_MAX_MATCHES;
+		r->flags |= CATCIERGE_JOURNAL_TRUNCATED;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		const match_state_t *m = &mg->matches[i];
+		catcierge_journal_match_t *jm = &r->matches[i];
+
+		jm->time_usec = catcierge_journal_tv_to_usec(&m->tv);
+		jm->result = m->result.result;
+		jm->success = (int8_t)m->result.success;
+		jm->direction = (int8_t)m->result.direction;
+		jm->step_count = (uint8_t)m->result.step_img_count;
+		jm->rect_count = (uint8_t)m->result.rect_count;
+
+		if (jm->rect_count > CATCIERGE_JOURNAL_MAX_RECTS)
+		{
+			jm->rect_count = CATCIERGE_JOURNAL_MAX_RECTS;
+			r->flags |= CATCIERGE_JOURNAL_TRUNCATED;
+		}
+
+		for (k = 0; k < jm->rect_count; k++)
+		{
+			jm->rects[k].x = (int16_t)m->result.match_rects[k].x;
+			jm->rects[k].y = (int16_t)m->result.match_rects[k].y;
+			jm->rects[k].width = (int16_t)m->result.match_rects[k].width;
+			jm->rects[k].height = (int16_t)m->result.match_rects[k].height;
+		}
+
+		catcierge_journal_strcpy(jm->path, sizeof(jm->path),
+			strcmp(m->path.dir, r->dir) ? m->path.full : m->path.filename,
+			&r->flags);
+	}
+}
+
+int catcierge_journal_append(catcierge_journal_t *j, const catcierge_journal_record_t *r)
+{
+	assert(j);
+	assert(r);
+
+	if (j->fd < 0)
+	{
+		return -1;
+	}
+
+	if (catcierge_journal_write_all(j->fd, r, sizeof(*r)))
+	{
+		CATERR("Failed to append to the match journal: %s\n", strerror(errno));
+
+		// Don't leave half a record behind for the next one to be appended to.
+		if (ftruncate(j->fd, RECORD_OFFSET(j->count)))
+		{
+			CATERR("Failed to truncate the match journal: %s\n", strerror(errno));
+		}
+
+		j->failed++;
+		return -1;
+	}
+
+	// The index is rebuilt from the journal on the next
+	// open if this fails, so that is not fatal.
+	if ((j->count % CATCIERGE_JOURNAL_INDEX_INTERVAL) == 0)
+	{
+		if (catcierge_journal_add_index_entry(j, r->start_usec, j->count))
+		{
+			CATERR("Failed to update the match journal index: %s\n", strerror(errno));
+		}
+	}
+
+	j->count++;
+	j->appended++;
+
+	return 0;
+}
+
+static void *catcierge_journal_map(const char *path, size_t *size, int quiet)
+{
+	int fd;
+	struct stat st;
+	void *map = NULL;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		if (!quiet)
+			CATERR("Failed to open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || (st.st_size == 0))
+	{
+		if (!quiet)
+			CATERR("%s is empty\n", path);
+		goto fail;
+	}
+
+	if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		if (!quiet)
+			CATERR("Failed to map %s: %s\n", path, strerror(errno));
+		map = NULL;
+		goto fail;
+	}
+
+	*size = st.st_size;
+fail:
+	// The mapping stays valid after the file is closed.
+	close(fd);
+	return map;
+}
+
+int catcierge_journal_reader_open(catcierge_journal_reader_t *rd, const char *path)
+{
+	char index_path[4096];
+	const catcierge_journal_header_t *h = NULL;
+	const catcierge_journal_index_header_t *ih = NULL;
+	size_t max_index_count;
+	assert(rd);
+	assert(path);
+
+	memset(rd, 0, sizeof(catcierge_journal_reader_t));
+
+	if (!(rd->map = catcierge_journal_map(path, &rd->map_size, 0)))
+	{
+		return -1;
+	}
+
+	h = (const catcierge_journal_header_t *)rd->map;
+
+	if (rd->map_size < sizeof(*h))
+	{
+		CATERR("%s is not a match journal\n", path);
+		goto fail;
+	}
+
+	if (catcierge_journal_header_check(h, path))
+	{
+		goto fail;
+	}
+
+	// A record being appended right now is left out.
+	rd->records = (const catcierge_journal_record_t *)((const char *)rd->map + JOURNAL_HEADER_SIZE);
+	rd->count = (rd->map_size - JOURNAL_HEADER_SIZE) / JOURNAL_RECORD_SIZE;
+
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+
+	if ((rd->index_map = catcierge_journal_map(index_path, &rd->index_map_size, 1)))
+	{
+		ih = (const catcierge_journal_index_header_t *)rd->index_map;
+
+		if ((rd->index_map_size < sizeof(*ih))
+			|| catcierge_journal_index_header_check(ih))
+		{
+			CATLOG("Ignoring the invalid journal index %s\n", index_path);
+		}
+		else
+		{
+			rd->index = (const catcierge_journal_index_entry_t *)((const char *)rd->index_map + INDEX_HEADER_SIZE);
+			rd->index_count = (rd->index_map_size - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+
+			max_index_count = (rd->count + CATCIERGE_JOURNAL_INDEX_INTERVAL - 1)
+							/ CATCIERGE_JOURNAL_INDEX_INTERVAL;
+
+			if (rd->index_count > max_index_count)
+				rd->index_count = max_index_count;
+		}
+	}
+
+	return 0;
+fail:
+	catcierge_journal_reader_close(rd);
+	return -1;
+}
+
+void catcierge_journal_reader_close(catcierge_journal_reader_t *rd)
+{
+	assert(rd);
+
+	if (rd->map)
+	{
+		munmap(rd->map, rd->map_size);
+	}
+
+	if (rd->index_map)
+	{
+		munmap(rd->index_map, rd->index_map_size);
+	}
+
+	memset(rd, 0, sizeof(catcierge_journal_reader_t));
+}
+
+size_t catcierge_journal_find(const catcierge_journal_reader_t *rd, int64_t usec)
+{
+	size_t lo = 0;
+	size_t hi = 0;
+	size_t mid;
+	assert(rd);
+
+	// The first index entry that started at or after the time.
+	hi = rd->index_count;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if (rd->index[mid].start_usec < usec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	// The record is between that entry and the one before it. Past the
+	// last entry it is somewhere in the records the index does not cover.
+	hi = (lo < rd->index_count) ? (size_t)rd->index[lo].record : rd->count;
+	lo = (lo > 0) ? (size_t)rd->index[lo - 1].record : 0;
+
+	if (hi > rd->count)
+		hi = rd->count;
+
+	if (lo > hi)
+		lo = hi;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if (rd->records[mid].start_usec < usec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+int catcierge_journal_query(const catcierge_journal_reader_t *rd,
+		int64_t from_usec, int64_t to_usec,
+		catcierge_journal_query_f func, void *user)
+{
+	int ret = 0;
+	size_t i;
+	assert(rd);
+	assert(func);
+
+	for (i = catcierge_journal_find(rd, from_usec);
+		(i < rd->count) && (rd->records[i].start_usec < to_usec);
+		i++)
+	{
+		if ((ret = func(&rd->records[i], user)))
+		{
+			break;
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,175 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_MATCH_JOURNAL_H__
+#define __CATCIERGE_MATCH_JOURNAL_H__
+
+//
+// Append-only journal of the match groups.
+//
+// Every match group is written as a fixed size record, so record N is
+// always found at the same offset and the file can be mapped and used
+// as an array. The records are appended in the order the match groups
+// end, which means they are sorted by time as long as the clock is
+// not set back.
+//
+// Next to the journal a sparse index "<journal>.idx" holds the start
+// time of every CATCIERGE_JOURNAL_INDEX_INTERVAL:th record. Searching
+// the small index first means a time range query only touches a few
+// pages of a journal with hundreds of thousands of records, instead of
+// faulting in pages all over the file for a plain binary search.
+//
+// A record cut short by a crash is removed when the journal is opened
+// for writing, and index entries missing after that are rebuilt.
+//
+
+#include <catcierge_config.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "catcierge_types.h"
+
+#define CATCIERGE_JOURNAL_MAGIC "CATJRNL"
+#define CATCIERGE_JOURNAL_INDEX_MAGIC "CATJIDX"
+#define CATCIERGE_JOURNAL_VERSION 1
+#define CATCIERGE_JOURNAL_ENDIAN 0x01020304
+#define CATCIERGE_JOURNAL_RECORD_MAGIC 0x4a435243 // "CRCJ" on disk on little endian.
+
+#define CATCIERGE_JOURNAL_INDEX_INTERVAL 64
+#define CATCIERGE_JOURNAL_MAX_MATCHES 8
+#define CATCIERGE_JOURNAL_MAX_RECTS 4
+
+// Record flags.
+#define CATCIERGE_JOURNAL_TRUNCATED (1 << 0)	// A string or list did not fit.
+
+// All structs are padded explicitly, so the layout is the same
+// for every compiler. The sizes are checked at compile time.
+typedef struct catcierge_journal_header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t index_interval;
+	uint32_t reserved[9];
+} catcierge_journal_header_t;
+
+typedef struct catcierge_journal_rect_s
+{
+	int16_t x;
+	int16_t y;
+	int16_t width;
+	int16_t height;
+} catcierge_journal_rect_t;
+
+typedef struct catcierge_journal_match_s
+{
+	int64_t time_usec;
+	double result;
+	int8_t success;
+	int8_t direction;		// match_direction_t
+	uint8_t rect_count;
+	uint8_t step_count;
+	uint32_t reserved;
+	catcierge_journal_rect_t rects[CATCIERGE_JOURNAL_MAX_RECTS];
+	char path[72];			// Relative to the record dir, unless the image was saved elsewhere.
+} catcierge_journal_match_t;
+
+typedef struct catcierge_journal_record_s
+{
+	uint32_t magic;
+	uint32_t flags;
+	int64_t start_usec;
+	int64_t end_usec;
+	uint32_t id[5];			// The match group SHA1.
+	int8_t success;
+	int8_t final_decision;
+	int8_t early_decision;
+	int8_t direction;		// match_direction_t
+	uint8_t match_count;	// Can be more than CATCIERGE_JOURNAL_MAX_MATCHES.
+	uint8_t success_count;
+	uint8_t reserved[6];
+	char description[72];
+	char dir[128];			// Where the match images were saved.
+	catcierge_journal_match_t matches[CATCIERGE_JOURNAL_MAX_MATCHES];
+} catcierge_journal_record_t;
+
+typedef struct catcierge_journal_index_entry_s
+{
+	int64_t start_usec;
+	uint64_t record;
+} catcierge_journal_index_entry_t;
+
+typedef struct catcierge_journal_index_header_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t interval;
+	uint32_t reserved[4];
+} catcierge_journal_index_header_t;
+
+typedef struct catcierge_journal_s
+{
+	int fd;
+	int index_fd;
+	uint64_t count;			// Records in the journal.
+	size_t appended;
+	size_t failed;
+} catcierge_journal_t;
+
+typedef struct catcierge_journal_reader_s
+{
+	void *map;
+	size_t map_size;
+	void *index_map;
+	size_t index_map_size;
+	const catcierge_journal_record_t *records;
+	size_t count;
+	const catcierge_journal_index_entry_t *index;
+	size_t index_count;
+} catcierge_journal_reader_t;
+
+// Opens or creates the journal and its index for appending.
+int catcierge_journal_open(catcierge_journal_t *j, const char *path);
+void catcierge_journal_close(catcierge_journal_t *j);
+
+// Fills in a record for a match group that has ended.
+void catcierge_journal_record_init(catcierge_journal_record_t *r, const match_group_t *mg);
+
+int catcierge_journal_append(catcierge_journal_t *j, const catcierge_journal_record_t *r);
+
+// Maps a journal read only. A missing or outdated index
+// is not an error, the records it lacks are searched directly.
+int catcierge_journal_reader_open(catcierge_journal_reader_t *rd, const char *path);
+void catcierge_journal_reader_close(catcierge_journal_reader_t *rd);
+
+// Index of the first record that started at or after the given time,
+// or the record count if there is none.
+size_t catcierge_journal_find(const catcierge_journal_reader_t *rd, int64_t usec);
+
+// Calls func for each record that started in [from_usec, to_usec).
+// Stops and returns what func returned if it is not 0.
+typedef int (*catcierge_journal_query_f)(const catcierge_journal_record_t *r, void *user);
+
+int catcierge_journal_query(const catcierge_journal_reader_t *rd,
+		int64_t from_usec, int64_t to_usec,
+		catcierge_journal_query_f func, void *user);
+
+int64_t catcierge_journal_tv_to_usec(const struct timeval *tv);
+
+#endif // __CATCIERGE_MATCH_JOURNAL_H__
@@ -28,14 +28,15 @@
 #define DEFAULT_MIN_BACKLIGHT 10000
 
 struct catcierge_matcher_s;
+struct catcierge_output_var_ref_s;
 
 typedef double (*catcierge_match_func_t)(void *ctx,
 		IplImage *img, match_result_t *result, int save_steps);
 
 typedef int (*catcierge_decide_func_t)(void *ctx, match_group_t *mg);
 
-typedef const char *(*catcierge_matcher_translate_func_t)(struct catcierge_matcher_s *octx, const char *var,
-														  char *buf, size_t bufsize);
+typedef const char *(*catcierge_matcher_translate_func_t)(struct catcierge_matcher_s *octx,
+		const struct catcierge_output_var_ref_s *var, char *buf, size_t bufsize);
 
 typedef int (*catcierge_is_obstruct_func_t)(struct catcierge_matcher_s *ctx, const IplImage *img);
 
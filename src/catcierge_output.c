@@ -23,6 +23,7 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #ifdef CATCIERGE_HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -32,6 +33,9 @@
 #ifdef CATCIERGE_HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 #include "catcierge_log.h"
 #include "catcierge_util.h"
@@ -40,9 +44,20 @@
 #include "catcierge_output_types.h"
 #include "catcierge_fsm.h"
 #include "catcierge_strftime.h"
+#include "catcierge_clock.h"
+#include "catcierge_bus.h"
+#include "catcierge_cbor.h"
+#include "catcierge_encoded_image.h"
+#ifndef _WIN32
+#include "catcierge_exec.h"
+#endif
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include "catcierge_workers.h"
+#endif
 
 #ifdef WITH_ZMQ
 #include <czmq.h>
+#include "catcierge_publisher.h"
 #endif
 
 // TODO: Enable generating relative paths to a given path at the head of a template.
@@ -55,6 +70,8 @@ catcierge_output_var_t vars[] =
 	{ "matchtime", "Value of --matchtime."},
 	{ "ok_matches_needed", "Value of --ok_matches_needed" },
 	{ "no_final_decision", "Value of --no_final_decision" },
+	{ "max_matches", "Value of --max_matches" },
+	{ "early_decision", "Value of --early_decision" },
 	{ "lockout_method", "Value of --lockout_method." },
 	{ "lockout_time", "Value of --lockout_time." },
 	{ "lockout_error", "Value of --lockout_error." },
@@ -71,6 +88,7 @@ catcierge_output_var_t vars[] =
 	{ "match_group_success_str", "Match group success status, as a string 'success' or 'fail'."},
 	{ "match_group_success_count", "Match group success count."},
 	{ "match_group_final_decision", "Did the match group veto the final decision?"},
+	{ "match_group_early_decision", "Was the match group decided before all matches were made?"},
 	{ "match_group_desc", "Match group description."},
 	{ "match_group_direction", "The match group direction (based on all match directions)."},
 	{ "match_group_count", "Match group count o matches so far."},
@@ -157,6 +175,45 @@ fail:
 	return NULL;
 }
 
+#ifdef CATCIERGE_HAVE_PTHREADS
+static void catcierge_output_stop_workers(catcierge_output_t *ctx)
+{
+	// The events still queued are generated before the threads are joined.
+	if (ctx->events)
+	{
+		catcierge_workers_destroy(ctx->events);
+		catcierge_xfree(&ctx->events);
+	}
+
+	if (ctx->renderers)
+	{
+		catcierge_workers_destroy(ctx->renderers);
+		catcierge_xfree(&ctx->renderers);
+	}
+}
+
+static int catcierge_output_start_workers(catcierge_output_t *ctx, size_t count)
+{
+	if (!(ctx->events = calloc(1, sizeof(catcierge_workers_t)))
+	 || !(ctx->renderers = calloc(1, sizeof(catcierge_workers_t))))
+	{
+		CATERR("Out of memory\n"); goto fail;
+	}
+
+	// A single thread so the events are generated in the order they happened.
+	if (catcierge_workers_init(ctx->events, 1)
+	 || catcierge_workers_init(ctx->renderers, count))
+	{
+		goto fail;
+	}
+
+	return 0;
+fail:
+	catcierge_output_stop_workers(ctx);
+	return -1;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
 int catcierge_output_init(catcierge_grb_t *grb, catcierge_output_t *ctx)
 {
 	size_t i;
@@ -167,6 +224,20 @@ int catcierge_output_init(catcierge_grb_t *grb, catcierge_output_t *ctx)
 	ctx->template_max_count = 10;
 	ctx->template_idx = -1;
 
+	catcierge_arena_init(&ctx->event_arena, 0);
+	catcierge_arena_init(&ctx->arena, 0);
+	catcierge_arena_init(&ctx->sink_arena, 0);
+
+	#ifdef WITH_ZMQ
+	ctx->publish_cbor = (args->zmq && args->zmq_cbor);
+	ctx->publish_images = (args->zmq && args->zmq_images);
+	#endif
+
+	if (catcierge_output_vars_init())
+	{
+		return -1;
+	}
+
 	if (!(ctx->templates = calloc(ctx->template_max_count,
 		sizeof(catcierge_output_template_t))))
 	{
@@ -196,6 +267,15 @@ int catcierge_output_init(catcierge_grb_t *grb, catcierge_output_t *ctx)
 		}
 	}
 
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if ((args->output_threads > 0)
+	 && catcierge_output_start_workers(ctx, args->output_threads))
+	{
+		CATERR("Failed to start %d output threads\n", args->output_threads);
+		goto fail;
+	}
+	#endif
+
 	return 0;
 fail:
 	return -1;
@@ -224,6 +304,9 @@ void catcierge_output_free_template(catcierge_output_template_t *t)
 	catcierge_xfree(&t->name);
 	catcierge_xfree(&t->generated_path);
 
+	catcierge_output_program_destroy(&t->prog);
+	catcierge_output_program_destroy(&t->filename_prog);
+
 	catcierge_output_free_template_settings(&t->settings);
 }
 
@@ -234,6 +317,10 @@ void catcierge_output_destroy(catcierge_output_t *ctx)
 	catcierge_output_invar_t *tmp = NULL;
 	assert(ctx);
 
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	catcierge_output_stop_workers(ctx);
+	#endif
+
 	if (ctx->templates)
 	{
 		size_t i;
@@ -249,6 +336,7 @@ void catcierge_output_destroy(catcierge_output_t *ctx)
 	}
 
 	ctx->template_count = 0;
+	ctx->event_mask = 0;
 	ctx->template_max_count = 0;
 
 	HASH_ITER(hh, ctx->vars, var_it, tmp)
@@ -257,10 +345,38 @@ void catcierge_output_destroy(catcierge_output_t *ctx)
 		catcierge_xfree(&var_it->value);
 		catcierge_xfree(&var_it);
 	}
+
+	catcierge_output_snapshot_end(ctx);
+	catcierge_arena_destroy(&ctx->event_arena);
+	catcierge_arena_destroy(&ctx->arena);
+	catcierge_arena_destroy(&ctx->sink_arena);
+}
+
+void catcierge_output_snapshot_begin(catcierge_output_t *ctx)
+{
+	assert(ctx);
+	catcierge_output_snapshot_end(ctx);
+	ctx->snapshot = 1;
+}
+
+void catcierge_output_snapshot_end(catcierge_output_t *ctx)
+{
+	assert(ctx);
+
+	// The cached values all live in the event arena.
+	if (ctx->cache_count)
+	{
+		memset(ctx->cache, 0, sizeof(ctx->cache));
+		ctx->cache_count = 0;
+	}
+
+	catcierge_arena_reset(&ctx->event_arena);
+	ctx->snapshot = 0;
 }
 
 int catcierge_output_read_event_setting(catcierge_output_settings_t *settings, const char *events)
 {
+	size_t i;
 	assert(settings);
 
 	CATLOG("    Event filters: %s\n", events);
@@ -272,6 +388,14 @@ int catcierge_output_read_event_setting(catcierge_output_settings_t *settings, c
 		return -1;
 	}
 
+	// Events are matched against the mask, not the names.
+	settings->event_mask = 0;
+
+	for (i = 0; i < settings->event_filter_count; i++)
+	{
+		settings->event_mask |= catcierge_event_filter_mask(settings->event_filter[i]);
+	}
+
 	return 0;
 }
 
@@ -595,6 +719,19 @@ int catcierge_output_add_template(catcierge_output_t *ctx,
 		goto out_of_memory;
 	}
 
+	// Parse the template once here instead of every time it is generated.
+	if (catcierge_output_compile(&t->prog, t->tmpl))
+	{
+		CATERR("Failed to compile template \"%s\"\n", t->name);
+		goto fail;
+	}
+
+	if (catcierge_output_compile(&t->filename_prog, t->settings.filename))
+	{
+		CATERR("Failed to compile template filename \"%s\"\n", t->settings.filename);
+		goto fail;
+	}
+
 	for (i = 0; i < t->settings.required_var_count; i++)
 	{
 		HASH_FIND_STR(ctx->vars, t->settings.required_vars[i], it);
@@ -607,6 +744,7 @@ int catcierge_output_add_template(catcierge_output_t *ctx,
 		}
 	}
 
+	ctx->event_mask |= t->settings.event_mask;
 	ctx->template_count++;
 
 	CATLOG(" %s (%s)\n", t->name, t->settings.filename);
@@ -636,20 +774,17 @@ static char *catcierge_replace_time_format_char(char *fmt)
 	return fmt;
 }
 
-static char *catcierge_get_time_var_format(const char *var,
+static char *catcierge_get_time_var_format(const char *suffix,
 	char *buf, size_t bufsize, const char *default_fmt, time_t t, struct timeval *tv)
 {
 	int ret;
 	char *fmt = NULL;
-	const char *var_fmt = var + 4;
-	assert(!strncmp(var, "time", 4));
+	struct tm tm;
 
-	if (*var_fmt == ':')
+	// time:<fmt>
+	if (*suffix == ':')
 	{
-		char *s = NULL;
-		var_fmt++;
-
-		if (!(fmt = strdup(var_fmt)))
+		if (!(fmt = strdup(suffix + 1)))
 		{
 			CATERR("Out of memory!\n"); return NULL;
 		}
@@ -664,7 +799,8 @@ static char *catcierge_get_time_var_format(const char *var,
 		}
 	}
 
-	ret = catcierge_strftime(buf, bufsize - 1, fmt, localtime(&t), tv);
+	localtime_r(&t, &tm);
+	ret = catcierge_strftime(buf, bufsize - 1, fmt, &tm, tv);
 
 	if (!ret)
 	{
@@ -748,8 +884,52 @@ static char *catcierge_get_short_id(const char *subvar, char *buf, size_t bufsiz
 	return buf;
 }
 
+static char *catcierge_output_generate_scratch(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, const char *template_str);
+
+//
+// With --output_threads no template is written until all of them are
+// rendered, so a template path is resolved through its directory.
+//
+static char *catcierge_get_output_abs_path(const char *path, char *buf, size_t bufsize)
+{
+	size_t len;
+	char dir[4096];
+	char *filename = NULL;
+
+	if (catcierge_get_abs_path(path, buf, bufsize))
+	{
+		return buf;
+	}
+
+	snprintf(dir, sizeof(dir), "%s", path);
+
+	if (!(filename = strrchr(dir, catcierge_path_sep()[0])))
+	{
+		return NULL;
+	}
+
+	*filename++ = '\0';
+
+	if (!catcierge_get_abs_path(*dir ? dir : catcierge_path_sep(), buf, bufsize))
+	{
+		return NULL;
+	}
+
+	len = strlen(buf);
+
+	if (snprintf(buf + len, bufsize - len, "%s%s",
+		(len && (buf[len - 1] == catcierge_path_sep()[0])) ? "" : catcierge_path_sep(),
+		filename) >= (int)(bufsize - len))
+	{
+		return NULL;
+	}
+
+	return buf;
+}
+
 static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
-								catcierge_path_t *path,
+								const catcierge_path_t *path,
 								char *buf, size_t bufsize)
 {
 	// Example:
@@ -767,16 +947,18 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 	int is_dir = 0;
 	int is_abs = 0;
 	int is_rel = 0;
-	char *the_path = NULL;
-	char *rel_to_path = NULL;
+	char *ret = NULL;
+	const char *the_path = NULL;
+	const char *rel_to_path = NULL;
+	char full[sizeof(path->full)];
 	catcierge_output_t *ctx = NULL;
 	catcierge_output_template_t *template = NULL;
-	size_t count = 0;
-	char **path_ops_list = NULL;
+	catcierge_arena_mark_t mark;
 	assert(path);
 	assert(grb);
 
 	ctx = &grb->output;
+	mark = catcierge_arena_mark(&ctx->arena);
 
 	// If we are generating this based on a template
 	// we want the settings from the template so we
@@ -786,20 +968,26 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 		template = &ctx->templates[ctx->template_idx];
 	}
 
-	if (!(*path->full))
+	// The path is only read, since templates for the
+	// same event can be generated on several threads.
+	if (*path->full)
+	{
+		snprintf(full, sizeof(full), "%s", path->full);
+	}
+	else
 	{
-		char *dir_end = path->dir + strlen(path->dir) - 1;
+		const char *dir_end = path->dir + strlen(path->dir) - 1;
 
 		if (*path->filename)
 		{
-			snprintf(path->full, sizeof(path->full) - 1, "%s%s%s",
+			snprintf(full, sizeof(full), "%s%s%s",
 				*path->dir ? path->dir : "",
 				((*dir_end == '/') || (*dir_end == catcierge_path_sep()[0])) ? "" : "/",
 				path->filename);
 		}
 		else
 		{
-			snprintf(path->full, sizeof(path->full) - 1, "%s",
+			snprintf(full, sizeof(full), "%s",
 				*path->dir ? path->dir : "");
 		}
 	}
@@ -807,32 +995,44 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 	// Get any path operations if any.
 	if (path_ops)
 	{
-		size_t i = 0;
-		char *c = NULL;
+		char *ops = NULL;
+		char *op = NULL;
+		char *next = NULL;
 
 		path_ops++; // Skip the | char.
 
+		if (!(ops = catcierge_arena_strdup(&ctx->arena, path_ops)))
+		{
+			goto fail;
+		}
+
 		// First we parse each path operation.
 		// We wait with performing the actual action until later.
-		path_ops_list = catcierge_parse_list(path_ops, &count, 1);
-
-		for (i = 0; i < count; i++)
+		for (op = ops; op; op = next)
 		{
-			if (!strcmp(path_ops_list[i], "dir"))
+			if ((next = strchr(op, ',')))
+			{
+				*next++ = '\0';
+			}
+
+			op = catcierge_skip_whitespace_alt(op);
+			catcierge_end_trim_whitespace(op);
+
+			if (!strcmp(op, "dir"))
 			{
 				is_dir = 1;
 			}
-			else if (!strcmp(path_ops_list[i], "abs"))
+			else if (!strcmp(op, "abs"))
 			{
 				is_abs = 1;
 			}
-			else if (!strncmp(path_ops_list[i], "rel", 3))
+			else if (!strncmp(op, "rel", 3))
 			{
 				//
 				// Parse/evaluate the path we should calculate the relative path.
 				//
 
-				char *s = path_ops_list[i];
+				char *s = op;
 				char *start = NULL;
 
 				if (rel_to_path)
@@ -843,7 +1043,7 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 
 				s += sizeof("rel") - 1;
 
-				if (!(s = strchr(s, '('))) return NULL;
+				if (!(s = strchr(s, '('))) goto fail;
 				s++;
 				start = s;
 
@@ -862,23 +1062,16 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 				}
 
 				*s = 0;
-
-				if (!(rel_to_path = strdup(start)))
-				{
-					CATERR("Out of memory\n");
-					goto fail;
-				}
+				rel_to_path = start;
 			}
 		}
-
-		catcierge_xfree_list(&path_ops_list, &count);
 	}
 
 	//
 	// Perform actions in a consistent order that makes sense
 	// instead of the one given by the user. Dir, absolute and finally relative.
 	//
-	the_path = !(*path->full) ? path->dir : path->full;
+	the_path = !(*full) ? path->dir : full;
 
 	if (is_dir) the_path = path->dir;
 	if (is_abs)
@@ -897,11 +1090,7 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 	// root path if set for the current template.
 	if (!rel_to_path && template && template->settings.rootpath)
 	{
-		if (!(rel_to_path = strdup(template->settings.rootpath)))
-		{
-			CATERR("Out of memory\n");
-			goto fail;
-		}
+		rel_to_path = template->settings.rootpath;
 	}
 
 	if (rel_to_path && !ctx->no_relative_path)
@@ -913,7 +1102,7 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 		// Generate the full relative path.
 		ctx->no_relative_path = 1;
 
-		if (!(full_rel_to_path = catcierge_output_generate(&grb->output, grb, rel_to_path)))
+		if (!(full_rel_to_path = catcierge_output_generate_scratch(ctx, grb, rel_to_path)))
 		{
 			ctx->no_relative_path = 0;
 			goto fail;
@@ -923,32 +1112,34 @@ static char *catcierge_get_path(catcierge_grb_t *grb, const char *var,
 
 		// TODO: Check return values
 		// The relativeness must be based on absolute paths.
-		the_path = catcierge_get_abs_path(the_path, buf, bufsize);
+		the_path = catcierge_get_output_abs_path(the_path, buf, bufsize);
 		catcierge_get_abs_path(full_rel_to_path,
 							abs_rel_to_path, sizeof(abs_rel_to_path));
 
-		// Relative path (the_path is allocated).
-		the_path = catcierge_relative_path(abs_rel_to_path, the_path);
-		free(full_rel_to_path);
+		// Relative path (tmp_path is allocated).
+		if (!(tmp_path = catcierge_relative_path(abs_rel_to_path, the_path)))
+		{
+			goto fail;
+		}
+
+		snprintf(buf, bufsize - 1, "%s", tmp_path);
+		free(tmp_path);
 	}
 	else
 	{
-		if (!(the_path = catcierge_output_generate(&grb->output, grb, the_path)))
+		if (!(the_path = catcierge_output_generate_scratch(ctx, grb, the_path)))
 		{
 			goto fail;
 		}
-	}
 
-	snprintf(buf, bufsize - 1, "%s", the_path);
-
-	catcierge_xfree(&rel_to_path);
-	catcierge_xfree(&the_path);
+		snprintf(buf, bufsize - 1, "%s", the_path);
+	}
 
-	return buf;
+	ret = buf;
 
 fail:
-	catcierge_xfree_list(&path_ops_list, &count);
-	return NULL;
+	catcierge_arena_release(&ctx->arena, mark);
+	return ret;
 }
 
 #define DIR_ONLY 1
@@ -963,18 +1154,14 @@ char *catcierge_create_and_get_path(catcierge_grb_t *grb, const char *var,
 	char *dir = NULL;
 	char *dir_end = NULL;
 	char *filename = NULL;
-	char *path_copy = NULL;
+	char path_copy[4096];
 	catcierge_path_t path;
 
 	if (!path_val)
 		return NULL;
 
 	memset(&path, 0, sizeof(path));
-
-	if (!(path_copy = strdup(path_val)))
-	{
-		return NULL;
-	}
+	snprintf(path_copy, sizeof(path_copy), "%s", path_val);
 
 	if (!dir_only)
 	{
@@ -1000,578 +1187,966 @@ char *catcierge_create_and_get_path(catcierge_grb_t *grb, const char *var,
 		snprintf(path.filename, sizeof(path.filename), "%s", filename);
 	}
 
-	free(path_copy);
-
 	return catcierge_get_path(grb, var, &path, buf, bufsize);
 }
 
-static char *catcierge_output_realloc_if_needed(char *str, size_t new_size, size_t *max_size)
+//
+// Everything allocated while rendering comes from the arena in the output
+// context, and is released at once when the final output has been copied
+// out or written. So once the arena has grown large enough rendering does
+// not have to call malloc at all.
+//
+
+typedef struct catcierge_output_buf_s
+{
+	catcierge_output_sink_t sink;
+	catcierge_arena_t *arena;
+	char *str;
+	size_t len;
+	size_t max_len;
+} catcierge_output_buf_t;
+
+static int catcierge_output_buf_append(catcierge_output_buf_t *buf,
+		const char *str, size_t len)
 {
-	assert(max_size);
+	char *tmp = NULL;
+	size_t max_len = buf->max_len;
 
-	while (new_size >= *max_size)
+	while ((buf->len + len + 1) > max_len)
 	{
-		//CATLOG("Realloc needed! %lu >= %u\n", new_size, *max_size);
-		(*max_size) *= 2;
+		max_len *= 2;
+	}
 
-		if (!(str = realloc(str, *max_size)))
+	if (max_len != buf->max_len)
+	{
+		if (!(tmp = catcierge_arena_realloc(buf->arena, buf->str, buf->max_len, max_len)))
 		{
-			CATERR("Out of memory\n"); return NULL;
+			return -1;
 		}
+
+		buf->str = tmp;
+		buf->max_len = max_len;
 	}
 
-	return str;
+	memcpy(&buf->str[buf->len], str, len);
+	buf->len += len;
+	buf->str[buf->len] = '\0';
+
+	return 0;
 }
 
-const char *_catcierge_output_translate(catcierge_grb_t *grb,
-	char *buf, size_t bufsize, const char *var)
+static int catcierge_output_buf_write(catcierge_output_sink_t *sink,
+		const char *str, size_t len, int literal)
 {
-	const char *matcher_val;
-	match_group_t *mg = &grb->match_group;
+	catcierge_output_buf_t *buf = (catcierge_output_buf_t *)sink;
+	sink->len += len;
+	return catcierge_output_buf_append(buf, str, len);
+}
 
-	if (!strncmp(var, "template_path", 13))
-	{
-		char *template_path = catcierge_get_template_path(grb, var);
-		return catcierge_create_and_get_path(grb, var,
-					template_path, 0, buf, bufsize);
-	}
+static int catcierge_output_buf_init(catcierge_output_buf_t *buf,
+		catcierge_arena_t *arena, size_t max_len)
+{
+	memset(buf, 0, sizeof(*buf));
+	buf->sink.write = catcierge_output_buf_write;
+	buf->arena = arena;
+	buf->max_len = max_len ? max_len : 64;
 
-	// Current time.
-	if (!strncmp(var, "time", 4))
+	if (!(buf->str = catcierge_arena_alloc(arena, buf->max_len)))
 	{
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		return catcierge_get_time_var_format(var, buf, bufsize,
-			"%Y-%m-%d %H:%M:%S.%f", time(NULL), &tv);
+		return -1;
 	}
 
-	if (!strcmp(var, "state"))
-	{
-		return catcierge_get_state_string(grb->state);
-	}
+	*buf->str = '\0';
 
-	if (!strcmp(var, "prev_state"))
-	{
-		return catcierge_get_state_string(grb->prev_state);
-	}
+	return 0;
+}
 
-	if (!strcmp(var, "git_commit") || !strcmp(var, "git_hash"))
-	{
-		return CATCIERGE_GIT_HASH;
-	}
+//
+// Templates that are written to a file or published are kept as a list of
+// pieces instead. The literal text is referenced straight from the compiled
+// template and only variable values are copied, into a separate arena.
+// When the output goes to a file the pieces are written with writev as soon
+// as the list is full and the copies are released, so even large templates
+// are written without building the whole output.
+//
 
-	if (!strcmp(var, "git_commit_short") || !strcmp(var, "git_hash_short"))
-	{
-		return CATCIERGE_GIT_HASH_SHORT;
-	}
+#define CATCIERGE_OUTPUT_SEGMENT_COUNT 64
 
-	if (!strcmp(var, "git_tainted"))
-	{
-		snprintf(buf, bufsize - 1, "%d", CATCIERGE_GIT_TAINTED);
-		return buf;
-	}
+typedef struct catcierge_output_segment_s
+{
+	const char *str;
+	size_t len;
+} catcierge_output_segment_t;
+
+typedef struct catcierge_output_segments_s
+{
+	catcierge_output_sink_t sink;
+	catcierge_arena_t *arena;
+	catcierge_output_segment_t *segs;
+	size_t count;
+	size_t max_count;
+	FILE *f;						// Stream the pieces to this file if set.
+	catcierge_arena_mark_t mark;	// Released after the pieces have been written.
+} catcierge_output_segments_t;
+
+static int catcierge_output_segments_write_file(FILE *f,
+		catcierge_output_segment_t *segs, size_t count)
+{
+	#ifdef _WIN32
+	size_t i;
 
-	if (!strcmp(var, "version"))
+	for (i = 0; i < count; i++)
 	{
-		return CATCIERGE_VERSION_STR;
+		if (fwrite(segs[i].str, 1, segs[i].len, f) != segs[i].len)
+		{
+			return -1;
+		}
 	}
+	#else
+	size_t i = 0;
+	size_t n = 0;
+	ssize_t written = 0;
+	struct iovec iov[CATCIERGE_OUTPUT_SEGMENT_COUNT];
 
-	if (!strcmp(var, "cwd"))
+	while (i < count)
 	{
-		if (!getcwd(buf, bufsize - 1))
+		for (n = 0; (n < CATCIERGE_OUTPUT_SEGMENT_COUNT) && ((i + n) < count); n++)
 		{
-			CATERR("Failed to get cwd\n"); return NULL;
+			iov[n].iov_base = (void *)segs[i + n].str;
+			iov[n].iov_len = segs[i + n].len;
 		}
 
-		return buf;
-	}
+		if ((written = writev(fileno(f), iov, n)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
 
-	#define CHECK_OUTPUT_PATH_VAR(name, _output) \
-		if (!strcmp(name, #_output)) \
-		{ \
-			return catcierge_create_and_get_path(grb, var, \
-						grb->args._output, DIR_ONLY, buf, bufsize); \
+			return -1;
 		}
 
-	CHECK_OUTPUT_PATH_VAR(var, output_path);
-	CHECK_OUTPUT_PATH_VAR(var, match_output_path);
-	CHECK_OUTPUT_PATH_VAR(var, steps_output_path);
-	CHECK_OUTPUT_PATH_VAR(var, obstruct_output_path);
-	CHECK_OUTPUT_PATH_VAR(var, template_output_path);
+		// Skip what was written, a short write continues in the middle of a piece.
+		while ((n > 0) && ((size_t)written >= segs[i].len))
+		{
+			written -= segs[i].len;
+			i++; n--;
+		}
 
-	if (!strcmp(var, "matcher"))
-	{
-		return grb->matcher->short_name;
+		if (written > 0)
+		{
+			segs[i].str += written;
+			segs[i].len -= written;
+		}
 	}
+	#endif // _WIN32
 
-	if (grb->matcher && (matcher_val = grb->matcher->translate(grb->matcher, var, buf, bufsize)))
-	{
-		return matcher_val;
-	}
+	return 0;
+}
 
-	if (!strcmp(var, "ok_matches_needed"))
+static int catcierge_output_segments_flush(catcierge_output_segments_t *segs)
+{
+	if (!segs->f || !segs->count)
 	{
-		snprintf(buf, bufsize - 1, "%d", grb->args.ok_matches_needed);
-		return buf;
+		return 0;
 	}
 
-	if (!strcmp(var, "no_final_decision"))
+	if (catcierge_output_segments_write_file(segs->f, segs->segs, segs->count))
 	{
-		snprintf(buf, bufsize - 1, "%d", grb->args.no_final_decision);
-		return buf;
+		CATERR("Failed to write template output: %s\n", strerror(errno));
+		return -1;
 	}
 
-	if (!strcmp(var, "matchtime"))
-	{
-		snprintf(buf, bufsize - 1, "%d", grb->args.match_time);
-		return buf;
-	}
+	segs->count = 0;
+	catcierge_arena_release(segs->arena, segs->mark);
 
-	if (!strcmp(var, "lockout_method"))
-	{
-		snprintf(buf, bufsize - 1, "%d", (int)grb->args.lockout_method);
-		return buf;
-	}
+	return 0;
+}
 
-	if (!strcmp(var, "lockout_error"))
-	{
-		snprintf(buf, bufsize - 1, "%d", grb->args.max_consecutive_lockout_count);
-		return buf;
-	}
+static int catcierge_output_segments_write(catcierge_output_sink_t *sink,
+		const char *str, size_t len, int literal)
+{
+	char *tmp = NULL;
+	catcierge_output_segments_t *segs = (catcierge_output_segments_t *)sink;
+	catcierge_output_segment_t *last = segs->count ? &segs->segs[segs->count - 1] : NULL;
 
-	if (!strcmp(var, "lockout_error_delay"))
+	if (!len)
 	{
-		snprintf(buf, bufsize - 1, "%0.2f", grb->args.consecutive_lockout_delay);
-		return buf;
+		return 0;
 	}
 
-	if (!strcmp(var, "lockout_time"))
-	{
-		snprintf(buf, bufsize - 1, "%d", grb->args.lockout_time);
-		return buf;
-	}
+	sink->len += len;
 
-	if (!strncmp(var, "match_group_id", 14))
+	// Variable values that follow each other are joined
+	// into one piece, if it can be grown in place.
+	if (!literal && last && (last->str == segs->arena->last))
 	{
-		const char *subvar = var + 14;
-		return catcierge_get_short_id(subvar, buf, bufsize, &mg->sha);
-	}
+		if (!(tmp = catcierge_arena_realloc(segs->arena,
+			(char *)last->str, last->len, last->len + len)))
+		{
+			return -1;
+		}
 
-	if (!strncmp(var, "match_group_start_time", 22))
-	{
-		var += strlen("match_group_start_");
-		return catcierge_get_time_var_format(var, buf, bufsize,
-					"%Y-%m-%d %H:%M:%S.%f", mg->start_time, &mg->start_tv);
+		memcpy(tmp + last->len, str, len);
+		last->str = tmp;
+		last->len += len;
+		return 0;
 	}
 
-	if (!strncmp(var, "match_group_end_time", 20))
+	if (segs->count >= segs->max_count)
 	{
-		var += strlen("match_group_end_");
-		return catcierge_get_time_var_format(var, buf, bufsize,
-					"%Y-%m-%d %H:%M:%S.%f", mg->end_time, &mg->end_tv);
-	}
+		if (segs->f)
+		{
+			if (catcierge_output_segments_flush(segs))
+				return -1;
+		}
+		else
+		{
+			if (!(tmp = catcierge_arena_realloc(segs->arena, (char *)segs->segs,
+				segs->max_count * sizeof(catcierge_output_segment_t),
+				2 * segs->max_count * sizeof(catcierge_output_segment_t))))
+			{
+				return -1;
+			}
 
-	if (!strcmp(var, "match_group_success")
-	 || !strcmp(var, "match_success"))
-	{
-		snprintf(buf, bufsize - 1, "%d", grb->match_group.success);
-		return buf;
+			segs->segs = (catcierge_output_segment_t *)tmp;
+			segs->max_count *= 2;
+		}
 	}
 
-	if (!strcmp(var, "match_group_success_count"))
+	if (!literal)
 	{
-		snprintf(buf, bufsize - 1, "%d", grb->match_group.success_count);
-		return buf;
-	}
+		if (!(tmp = catcierge_arena_alloc(segs->arena, len)))
+		{
+			return -1;
+		}
 
-	if (!strcmp(var, "match_group_final_decision"))
-	{
-		snprintf(buf, bufsize - 1, "%d", grb->match_group.final_decision);
-		return buf;
+		memcpy(tmp, str, len);
+		str = tmp;
 	}
 
-	if (!strcmp(var, "match_group_direction"))
-	{
-		return catcierge_get_direction_str(grb->match_group.direction);
-	}
+	segs->segs[segs->count].str = str;
+	segs->segs[segs->count].len = len;
+	segs->count++;
 
-	if (!strcmp(var, "match_group_description")
-	 || !strcmp(var, "match_group_desc"))
-	{
-		return grb->match_group.description;
-	}
+	return 0;
+}
 
-	if (!strcmp(var, "match_group_count")
-	 || !strcmp(var, "match_count"))
-	{
-		snprintf(buf, bufsize - 1, "%d", (int)grb->match_group.match_count);
-		return buf;
-	}
+static int catcierge_output_segments_init(catcierge_output_segments_t *segs,
+		catcierge_arena_t *arena, FILE *f)
+{
+	memset(segs, 0, sizeof(*segs));
+	segs->sink.write = catcierge_output_segments_write;
+	segs->arena = arena;
+	segs->f = f;
+	segs->max_count = CATCIERGE_OUTPUT_SEGMENT_COUNT;
 
-	if (!strcmp(var, "match_group_max_count"))
+	if (!(segs->segs = catcierge_arena_alloc(arena,
+		segs->max_count * sizeof(catcierge_output_segment_t))))
 	{
-		snprintf(buf, bufsize - 1, "%d", MATCH_MAX_COUNT);
-		return buf;
+		return -1;
 	}
 
-	if (!strcmp(var, "obstruct_filename"))
-	{
-		return mg->obstruct_path.filename;
-	}
+	segs->mark = catcierge_arena_mark(arena);
 
-	if (!strncmp(var, "obstruct_path", 13))
-	{
-		return catcierge_get_path(grb, var, &mg->obstruct_path, buf, bufsize);
-	}
+	return 0;
+}
 
-	if (!strncmp(var, "obstruct_time", strlen("obstruct_time")))
+// Copies all the pieces into str which must fit sink.len bytes.
+static void catcierge_output_segments_copy(catcierge_output_segments_t *segs, char *str)
+{
+	size_t i;
+
+	for (i = 0; i < segs->count; i++)
 	{
-		const char *subvar = var + strlen("obstruct_");
-		return catcierge_get_time_var_format(subvar, buf, bufsize,
-					"%Y-%m-%d %H:%M:%S.%f", mg->obstruct_time, &mg->obstruct_tv);
+		memcpy(str, segs->segs[i].str, segs->segs[i].len);
+		str += segs->segs[i].len;
 	}
+}
 
-	if (!strncmp(var, "match", 5))
-	{
-		int idx = -1;
-		match_state_t *m = NULL;
-		const char *subvar = NULL;
+//
+// Variable names are resolved into IDs through a perfect hash table that
+// is generated from catcierge_output_vars.h the first time it is needed.
+// Indices such as the ones in match3_step2_path are replaced by # in
+// the name that is looked up, and are stored separately.
+//
 
-		if (!strncmp(var, "matchcur", 8))
-		{
-			idx = grb->match_group.match_count;
-			subvar = var + strlen("matchcur_");
-			idx--;
-		}
-		else
-		{
-			subvar = var + strlen("match#_");
+#define CATCIERGE_DEFINE_VAR(var_id, var_name, var_flags) \
+	{ var_id, var_name, var_flags },
 
-			if (sscanf(var, "match%d_", &idx) == EOF)
-			{
-				CATERR("Output: Failed to parse %s\n", var); return NULL;
-			}
+static const struct catcierge_output_var_def_s
+{
+	catcierge_output_var_id_t id;
+	const char *name;
+	int flags;
+} var_defs[] =
+{
+	#include "catcierge_output_vars.h"
+};
 
-			idx--; // Convert to 0-based index.
-		}
+#define VAR_DEF_COUNT (sizeof(var_defs) / sizeof(var_defs[0]))
+#define VAR_HASH_SIZE 1024
+#define VAR_HASH_MAX_SEED 100000
+#define VAR_NAME_MAX 64
 
-		// TODO: fix better error messages.
-		if ((idx < 0) || (idx >= MATCH_MAX_COUNT))
-		{
-			CATERR("Output: %s out of range. (%lu > %lu)\n", var, idx, grb->match_group.match_count); return NULL;
-		}
+// Index + 1 into var_defs, 0 means an empty slot.
+static unsigned char var_hash[VAR_HASH_SIZE];
+static uint32_t var_hash_seed;
+static int var_hash_built;
 
-		m = &grb->match_group.matches[idx];
+static uint32_t catcierge_output_var_hash(const char *name, uint32_t seed)
+{
+	// FNV-1a.
+	uint32_t h = 2166136261u ^ seed;
 
-		if ((size_t)idx > grb->match_group.match_count)
-		{
-			CATERR("Output: %s out of range. (%lu > %lu)\n", var, idx, grb->match_group.match_count);
-			return "";
-		}
+	while (*name)
+	{
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
 
-		if (!strncmp(subvar, "path", 4))
-		{
-			return catcierge_get_path(grb, var, &m->path, buf, bufsize);
-		}
-		else if (!strcmp(subvar, "filename"))
-		{
-			return m->path.filename;
-		}
-		else if (!strncmp(subvar, "idx", 3))
-		{
-			snprintf(buf, bufsize - 1, "%d", idx + 1);
-			return buf;
-		}
-		else if (!strncmp(subvar, "id", 2))
-		{
-			const char *subsubvar = subvar + 2;
-			return catcierge_get_short_id(subsubvar, buf, bufsize, &m->sha);
-		}
-		else if (!strcmp(subvar, "success"))
-		{
-			snprintf(buf, bufsize - 1, "%d", m->result.success);
-			return buf;
-		}
-		else if (!strcmp(subvar, "success_str"))
-		{
-			snprintf(buf, bufsize - 1, "%s", m->result.success ? "success": "fail");
-			return buf;
-		}
-		else if (!strcmp(subvar, "direction"))
-		{
-			return catcierge_get_direction_str(m->result.direction);
-		}
-		else if (!strncmp(subvar, "desc", 4))
-		{
-			return m->result.description;
-		}
-		else if (!strcmp(subvar, "result"))
-		{
-			snprintf(buf, bufsize - 1, "%f", m->result.result);
-			return buf;
-		}
-		else if (!strncmp(subvar, "time", 4))
-		{
-			return catcierge_get_time_var_format(subvar, buf, bufsize,
-					"%Y-%m-%d %H:%M:%S.%f", m->time, &m->tv);
-		}
-		else if (!strcmp(subvar, "step_count"))
-		{
-			snprintf(buf, bufsize - 1, "%d", (int)m->result.step_img_count);
-			return buf;
-		}
-		else if (!strncmp(subvar, "step", 4))
-		{
-			// Match step images / descriptions.
-			int stepidx = -1;
-			match_step_t *step = NULL;
+	return h & (VAR_HASH_SIZE - 1);
+}
+
+int catcierge_output_vars_init()
+{
+	size_t i;
+	uint32_t seed;
+	uint32_t h;
 
-			const char *stepvar = subvar + strlen("step#_");
+	if (var_hash_built)
+		return 0;
 
-			if (sscanf(subvar, "step%d_", &stepidx) == EOF)
-			{
-				CATERR("Failed to parse step#_\n");
-				return NULL;
-			}
+	assert(VAR_DEF_COUNT < 255);
 
-			// "step##_" instead of just "step#_"
-			if (stepidx >= 10)
-				stepvar++;
+	// Look for a seed that gives each name a slot of its own.
+	for (seed = 0; seed < VAR_HASH_MAX_SEED; seed++)
+	{
+		memset(var_hash, 0, sizeof(var_hash));
 
-			stepidx--; // Convert to 0-based index.
+		for (i = 0; i < VAR_DEF_COUNT; i++)
+		{
+			h = catcierge_output_var_hash(var_defs[i].name, seed);
 
-			if ((stepidx < 0) || (stepidx >= MAX_STEPS))
-			{
-				CATERR("Step index out of range %d\n", stepidx);
-				return NULL;
-			}
+			if (var_hash[h])
+				break;
 
-			step = &m->result.steps[stepidx];
+			var_hash[h] = (unsigned char)(i + 1);
+		}
 
-			if (!strcmp(stepvar, "path"))
-			{
-				return catcierge_get_path(grb, var, &step->path, buf, bufsize);
-			}
-			else if (!strcmp(stepvar, "filename"))
-			{
-				return step->path.filename;
-			}
-			else if (!strcmp(stepvar, "name"))
-			{
-				return step->name ? step->name : "";
-			}
-			else if (!strncmp(stepvar, "desc", 4))
-			{
-				return step->description ? step->description : "";
-			}
-			else if (!strcmp(stepvar, "active"))
-			{
-				snprintf(buf, bufsize - 1, "%d", step->img != NULL);
-				return buf;
-			}
+		if (i == VAR_DEF_COUNT)
+		{
+			var_hash_seed = seed;
+			var_hash_built = 1;
+			return 0;
 		}
 	}
 
-	// Look for user defined variables.
-	{
-		catcierge_output_invar_t *it = NULL;
-		HASH_FIND_STR(grb->output.vars, var, it);
+	CATERR("Failed to build output variable hash table\n");
+	return -1;
+}
+
+static const struct catcierge_output_var_def_s *catcierge_output_var_lookup(const char *name)
+{
+	size_t i;
+	unsigned char slot;
 
-		if (it)
+	if (!var_hash_built && catcierge_output_vars_init())
+	{
+		// Should never happen, but still works.
+		for (i = 0; i < VAR_DEF_COUNT; i++)
 		{
-			snprintf(buf, bufsize - 1, "%s", it->value);
-			return buf;
+			if (!strcmp(var_defs[i].name, name))
+				return &var_defs[i];
 		}
+
+		return NULL;
 	}
 
-	return NULL;
+	slot = var_hash[catcierge_output_var_hash(name, var_hash_seed)];
+
+	if (!slot || strcmp(var_defs[slot - 1].name, name))
+	{
+		return NULL;
+	}
+
+	return &var_defs[slot - 1];
 }
 
-char *catcierge_translate_inner_vars(catcierge_grb_t *grb, const char *var)
+int catcierge_output_var_parse(catcierge_output_var_ref_t *ref, const char *name)
 {
-	char *it = NULL;
-	char *output = NULL;
-	const char *innervar = NULL;
+	char key[VAR_NAME_MAX];
+	const char *s = name;
 	char *end = NULL;
-	size_t orig_len = 0;
-	size_t out_len = 0;
-	size_t reslen = 0;
 	size_t len = 0;
-	char buf[4096];
-	char *tmpvar = NULL;
+	int nums[2];
+	int num_count = 0;
+	const struct catcierge_output_var_def_s *def = NULL;
+	assert(ref);
+	assert(name);
 
-	orig_len = strlen(var);
-	out_len = (2 * orig_len + 1);
-
-	if (!(output = malloc(out_len)))
-	{
-		CATERR("Out of memory\n"); return NULL;
-	}
+	memset(ref, 0, sizeof(*ref));
+	ref->name = name;
+	ref->idx = -1;
+	ref->step_idx = -1;
 
-	if (!(tmpvar = strdup(var)))
+	// The current match is the same as match#_ with a variable index.
+	if (!strncmp(s, "matchcur_", 9))
 	{
-		CATERR("Out of memory\n"); goto fail;
+		strcpy(key, "match#");
+		len = strlen(key);
+		s += strlen("matchcur");
+		ref->current = 1;
+		nums[num_count++] = 0;
 	}
 
-	it = tmpvar;
-
-	while (*it)
+	// The name ends where any arguments or path operations begin.
+	while (*s && (*s != ':') && (*s != '|'))
 	{
-		if (*it == '$')
+		if (len >= (sizeof(key) - 1))
 		{
-			const char *res = NULL;
-			char *innervartmp = NULL;
-			it++;
-
-			innervar = it;
+			return -1;
+		}
 
-			while (*it && (*it != '$'))
+		if ((*s >= '0') && (*s <= '9'))
+		{
+			if (num_count >= 2)
 			{
-				it++;
+				return -1;
 			}
 
-			// Either we found it or the end of string.
-			if (*it != '$')
-			{
-				*it = '\0';
-				CATERR("Inner variable \"$...$\" not terminated inside of \"%s\"\n", var);
-				goto fail;
-			}
+			nums[num_count++] = (int)strtol(s, &end, 10);
+			key[len++] = '#';
+			s = end;
+			continue;
+		}
 
-			if (!(innervartmp = strndup(innervar, (it - innervar))))
-			{
-				CATERR("Out of memory\n");
-				goto fail;
-			}
+		key[len++] = *s++;
+	}
 
-			it++;
+	key[len] = '\0';
 
-			if (!(res = _catcierge_output_translate(grb, buf, sizeof(buf), innervartmp)))
-			{
-				CATERR("Unknown template inner variable \"%s\"\n", innervartmp);
-				catcierge_xfree(&innervartmp);
-				goto fail;
-			}
+	if (!(def = catcierge_output_var_lookup(key)))
+	{
+		return -1;
+	}
 
-			catcierge_xfree(&innervartmp);
-			reslen = strlen(res);
+	if (*s && !(def->flags & CATCIERGE_VAR_SUFFIX))
+	{
+		return -1;
+	}
 
-			if (!(output = catcierge_output_realloc_if_needed(output, (len + reslen + 1), &out_len)))
-			{
-				CATERR("Out of memory\n");
-				goto fail;
-			}
+	ref->id = def->id;
+	ref->flags = def->flags;
+	ref->suffix = s;
 
-			while (*res)
-			{
-				output[len] = *res++;
-				len++;
-			}
-		}
-		else
-		{
-			if (!(output = catcierge_output_realloc_if_needed(output, (len + 1), &out_len)))
-			{
-				goto fail;
-			}
+	if (num_count > 0) ref->idx = nums[0] - 1; // Convert to 0-based index.
+	if (num_count > 1) ref->step_idx = nums[1] - 1;
 
-			output[len] = *it++;
-			len++;
-		}
-	}
+	return 0;
+}
 
-	catcierge_xfree(&tmpvar);
-	output[len] = '\0';
+static match_state_t *catcierge_output_get_match(catcierge_grb_t *grb,
+		const catcierge_output_var_ref_t *ref, int *idx)
+{
+	match_group_t *mg = &grb->match_group;
 
-	return output;
-fail:
-	catcierge_xfree(&tmpvar);
-	catcierge_xfree(&output);
-	return NULL;
+	*idx = ref->current ? ((int)mg->match_count - 1) : ref->idx;
+
+	// TODO: fix better error messages.
+	if ((*idx < 0) || ((size_t)*idx >= mg->max_count))
+	{
+		CATERR("Output: %s out of range. (%d > %d)\n",
+			ref->name, *idx, (int)mg->match_count);
+		return NULL;
+	}
+
+	return &mg->matches[*idx];
 }
 
-const char *catcierge_output_translate(catcierge_grb_t *grb,
-	char *buf, size_t bufsize, const char *var)
+static const char *catcierge_output_translate_step(catcierge_grb_t *grb,
+		const catcierge_output_var_ref_t *ref, match_state_t *m,
+		char *buf, size_t bufsize)
 {
-	const char *ret = NULL;
-	char *varexp = NULL;
+	match_step_t *step = NULL;
 
-	// Expand variables inside of other variables.
-	if (!(varexp = catcierge_translate_inner_vars(grb, var)))
+	if ((ref->step_idx < 0) || (ref->step_idx >= MAX_STEPS))
 	{
-		CATERR("Invalid inner variable '%s'\n", var);
+		CATERR("Step index out of range %d\n", ref->step_idx);
 		return NULL;
 	}
 
-	ret = _catcierge_output_translate(grb, buf, bufsize, varexp);
-	catcierge_xfree(&varexp);
-	return ret;
+	step = &m->result.steps[ref->step_idx];
+
+	switch (ref->id)
+	{
+		case CATCIERGE_VAR_STEPN_PATH:
+			return catcierge_get_path(grb, ref->name, &step->path, buf, bufsize);
+		case CATCIERGE_VAR_STEPN_FILENAME:
+			return step->path.filename;
+		case CATCIERGE_VAR_STEPN_NAME:
+			return step->name ? step->name : "";
+		case CATCIERGE_VAR_STEPN_DESC:
+		case CATCIERGE_VAR_STEPN_DESCRIPTION:
+			return step->description ? step->description : "";
+		case CATCIERGE_VAR_STEPN_ACTIVE:
+			snprintf(buf, bufsize - 1, "%d", step->img != NULL);
+			return buf;
+		default:
+			return NULL;
+	}
 }
 
-char **catcierge_output_parse_for_loop_expr(catcierge_grb_t *grb,
-		const char *forexpr, char **for_expr_var_ret, size_t *for_expr_vals_count,
-		size_t *linenum)
+static const char *catcierge_output_translate_match(catcierge_grb_t *grb,
+		const catcierge_output_var_ref_t *ref, char *buf, size_t bufsize)
 {
-	size_t i;
-	char valbuf[128];
-	char range_strs[2][128];
-	char for_expr_var[128];
-	char for_expr_valstr[1024];
-	char **for_expr_vals = NULL;
+	int idx;
+	match_state_t *m = NULL;
 
-	if (sscanf(forexpr, " %127s in %1023s ", for_expr_var, for_expr_valstr) != 2)
+	if (!(m = catcierge_output_get_match(grb, ref, &idx)))
 	{
-		CATERR("Failed to parse for expression '%s' on line %d\n", forexpr, *linenum);
 		return NULL;
 	}
 
-	if (sscanf(for_expr_valstr, " %[^ \t.] .. %127s", range_strs[0], range_strs[1]) == 2)
+	if ((size_t)idx > grb->match_group.match_count)
 	{
-		long range[2];
-		long j;
-		const char *res = NULL;
-		const char *varval = NULL;
-		char *end = NULL;
-		char buf[4096];
+		CATERR("Output: %s out of range. (%d > %d)\n",
+			ref->name, idx, (int)grb->match_group.match_count);
+		return "";
+	}
 
-		for (i = 0; i < 2; i++)
-		{
-			res = range_strs[i];
+	switch (ref->id)
+	{
+		case CATCIERGE_VAR_MATCHN_PATH:
+			return catcierge_get_path(grb, ref->name, &m->path, buf, bufsize);
+		case CATCIERGE_VAR_MATCHN_FILENAME:
+			return m->path.filename;
+		case CATCIERGE_VAR_MATCHN_IDX:
+			snprintf(buf, bufsize - 1, "%d", idx + 1);
+			return buf;
+		case CATCIERGE_VAR_MATCHN_ID:
+			return catcierge_get_short_id(ref->suffix, buf, bufsize, &m->sha);
+		case CATCIERGE_VAR_MATCHN_SUCCESS:
+			snprintf(buf, bufsize - 1, "%d", m->result.success);
+			return buf;
+		case CATCIERGE_VAR_MATCHN_SUCCESS_STR:
+			snprintf(buf, bufsize - 1, "%s", m->result.success ? "success": "fail");
+			return buf;
+		case CATCIERGE_VAR_MATCHN_DIRECTION:
+			return catcierge_get_direction_str(m->result.direction);
+		case CATCIERGE_VAR_MATCHN_DESC:
+		case CATCIERGE_VAR_MATCHN_DESCRIPTION:
+			return m->result.description;
+		case CATCIERGE_VAR_MATCHN_RESULT:
+			snprintf(buf, bufsize - 1, "%f", m->result.result);
+			return buf;
+		case CATCIERGE_VAR_MATCHN_TIME:
+			return catcierge_get_time_var_format(ref->suffix, buf, bufsize,
+					"%Y-%m-%d %H:%M:%S.%f", m->time, &m->tv);
+		case CATCIERGE_VAR_MATCHN_STEP_COUNT:
+			snprintf(buf, bufsize - 1, "%d", (int)m->result.step_img_count);
+			return buf;
+		default:
+			return catcierge_output_translate_step(grb, ref, m, buf, bufsize);
+	}
+}
 
-			if ((varval = catcierge_output_translate(grb, buf, sizeof(buf), res)))
+static const char *catcierge_output_translate_builtin(catcierge_grb_t *grb,
+	const catcierge_output_var_ref_t *ref, char *buf, size_t bufsize)
+{
+	struct timeval tv;
+	match_group_t *mg = &grb->match_group;
+	catcierge_args_t *args = &grb->args;
+
+	#define OUTPUT_PATH_VAR(_output) \
+		return catcierge_create_and_get_path(grb, ref->name, \
+					args->_output, DIR_ONLY, buf, bufsize)
+
+	#define INT_VAR(_val) \
+		snprintf(buf, bufsize - 1, "%d", (int)(_val)); \
+		return buf
+
+	switch (ref->id)
+	{
+		case CATCIERGE_VAR_TEMPLATE_PATH:
+			return catcierge_create_and_get_path(grb, ref->name,
+					catcierge_get_template_path(grb, ref->name), 0, buf, bufsize);
+		case CATCIERGE_VAR_TIME:
+			// Current time, or when the event happened if
+			// it is generated in the background.
+			if (grb->output.event_tv.tv_sec)
+				tv = grb->output.event_tv;
+			else
+				catcierge_clock_gettimeofday(&tv);
+			return catcierge_get_time_var_format(ref->suffix, buf, bufsize,
+				"%Y-%m-%d %H:%M:%S.%f", tv.tv_sec, &tv);
+		case CATCIERGE_VAR_STATE: return catcierge_get_state_string(grb->state);
+		case CATCIERGE_VAR_PREV_STATE: return catcierge_get_state_string(grb->prev_state);
+		case CATCIERGE_VAR_GIT_COMMIT:
+		case CATCIERGE_VAR_GIT_HASH: return CATCIERGE_GIT_HASH;
+		case CATCIERGE_VAR_GIT_COMMIT_SHORT:
+		case CATCIERGE_VAR_GIT_HASH_SHORT: return CATCIERGE_GIT_HASH_SHORT;
+		case CATCIERGE_VAR_GIT_TAINTED: INT_VAR(CATCIERGE_GIT_TAINTED);
+		case CATCIERGE_VAR_VERSION: return CATCIERGE_VERSION_STR;
+		case CATCIERGE_VAR_CWD:
+			if (!getcwd(buf, bufsize - 1))
 			{
-				res = varval;
+				CATERR("Failed to get cwd\n"); return NULL;
 			}
-
-			range[i] = strtol(res, &end, 10);
-			if (end == res)
+			return buf;
+		case CATCIERGE_VAR_OUTPUT_PATH: OUTPUT_PATH_VAR(output_path);
+		case CATCIERGE_VAR_MATCH_OUTPUT_PATH: OUTPUT_PATH_VAR(match_output_path);
+		case CATCIERGE_VAR_STEPS_OUTPUT_PATH: OUTPUT_PATH_VAR(steps_output_path);
+		case CATCIERGE_VAR_OBSTRUCT_OUTPUT_PATH: OUTPUT_PATH_VAR(obstruct_output_path);
+		case CATCIERGE_VAR_TEMPLATE_OUTPUT_PATH: OUTPUT_PATH_VAR(template_output_path);
+		case CATCIERGE_VAR_MATCHER: return grb->matcher->short_name;
+		case CATCIERGE_VAR_OK_MATCHES_NEEDED: INT_VAR(args->ok_matches_needed);
+		case CATCIERGE_VAR_NO_FINAL_DECISION: INT_VAR(args->no_final_decision);
+		case CATCIERGE_VAR_MAX_MATCHES: INT_VAR(args->max_matches);
+		case CATCIERGE_VAR_EARLY_DECISION: INT_VAR(args->early_decision);
+		case CATCIERGE_VAR_MATCHTIME: INT_VAR(args->match_time);
+		case CATCIERGE_VAR_LOCKOUT_METHOD: INT_VAR(args->lockout_method);
+		case CATCIERGE_VAR_LOCKOUT_ERROR: INT_VAR(args->max_consecutive_lockout_count);
+		case CATCIERGE_VAR_LOCKOUT_ERROR_DELAY:
+			snprintf(buf, bufsize - 1, "%0.2f", args->consecutive_lockout_delay);
+			return buf;
+		case CATCIERGE_VAR_LOCKOUT_TIME: INT_VAR(args->lockout_time);
+		case CATCIERGE_VAR_MATCH_GROUP_ID:
+			return catcierge_get_short_id(ref->suffix, buf, bufsize, &mg->sha);
+		case CATCIERGE_VAR_MATCH_GROUP_START_TIME:
+			return catcierge_get_time_var_format(ref->suffix, buf, bufsize,
+					"%Y-%m-%d %H:%M:%S.%f", mg->start_time, &mg->start_tv);
+		case CATCIERGE_VAR_MATCH_GROUP_END_TIME:
+			return catcierge_get_time_var_format(ref->suffix, buf, bufsize,
+					"%Y-%m-%d %H:%M:%S.%f", mg->end_time, &mg->end_tv);
+		case CATCIERGE_VAR_MATCH_GROUP_SUCCESS:
+		case CATCIERGE_VAR_MATCH_SUCCESS: INT_VAR(mg->success);
+		case CATCIERGE_VAR_MATCH_GROUP_SUCCESS_COUNT: INT_VAR(mg->success_count);
+		case CATCIERGE_VAR_MATCH_GROUP_FINAL_DECISION: INT_VAR(mg->final_decision);
+		case CATCIERGE_VAR_MATCH_GROUP_EARLY_DECISION: INT_VAR(mg->early_decision);
+		case CATCIERGE_VAR_MATCH_GROUP_DIRECTION: return catcierge_get_direction_str(mg->direction);
+		case CATCIERGE_VAR_MATCH_GROUP_DESCRIPTION:
+		case CATCIERGE_VAR_MATCH_GROUP_DESC: return mg->description;
+		case CATCIERGE_VAR_MATCH_GROUP_COUNT:
+		case CATCIERGE_VAR_MATCH_COUNT: INT_VAR(mg->match_count);
+		case CATCIERGE_VAR_MATCH_GROUP_MAX_COUNT: INT_VAR(mg->max_count);
+		case CATCIERGE_VAR_OBSTRUCT_FILENAME: return mg->obstruct_path.filename;
+		case CATCIERGE_VAR_OBSTRUCT_PATH:
+			return catcierge_get_path(grb, ref->name, &mg->obstruct_path, buf, bufsize);
+		case CATCIERGE_VAR_OBSTRUCT_TIME:
+			return catcierge_get_time_var_format(ref->suffix, buf, bufsize,
+					"%Y-%m-%d %H:%M:%S.%f", mg->obstruct_time, &mg->obstruct_tv);
+		case CATCIERGE_VAR_MATCHN_PATH:
+		case CATCIERGE_VAR_MATCHN_FILENAME:
+		case CATCIERGE_VAR_MATCHN_IDX:
+		case CATCIERGE_VAR_MATCHN_ID:
+		case CATCIERGE_VAR_MATCHN_SUCCESS:
+		case CATCIERGE_VAR_MATCHN_SUCCESS_STR:
+		case CATCIERGE_VAR_MATCHN_DIRECTION:
+		case CATCIERGE_VAR_MATCHN_DESC:
+		case CATCIERGE_VAR_MATCHN_DESCRIPTION:
+		case CATCIERGE_VAR_MATCHN_RESULT:
+		case CATCIERGE_VAR_MATCHN_TIME:
+		case CATCIERGE_VAR_MATCHN_STEP_COUNT:
+		case CATCIERGE_VAR_STEPN_PATH:
+		case CATCIERGE_VAR_STEPN_FILENAME:
+		case CATCIERGE_VAR_STEPN_NAME:
+		case CATCIERGE_VAR_STEPN_DESC:
+		case CATCIERGE_VAR_STEPN_DESCRIPTION:
+		case CATCIERGE_VAR_STEPN_ACTIVE:
+			return catcierge_output_translate_match(grb, ref, buf, bufsize);
+		default:
+			// Settings for the matcher in use.
+			if (grb->matcher)
 			{
-				CATERR("Failed to parse '%s' as an integer in '%s'\n", res, forexpr);
-				return NULL;
+				return grb->matcher->translate(grb->matcher, ref, buf, bufsize);
 			}
-		}
-
-		if (range[0] > range[1])
-		{
-			CATERR("Reversed range not allowed %d > %d for '%s'\n",
-					range[0], range[1], for_expr_valstr);
 			return NULL;
-		}
+	}
 
-		*for_expr_vals_count = range[1] - range[0] + 1;
+	#undef OUTPUT_PATH_VAR
+	#undef INT_VAR
+}
 
-		if (!(for_expr_vals = calloc(*for_expr_vals_count, sizeof(char *))))
+static int catcierge_output_cache_key(catcierge_output_t *ctx,
+	const catcierge_output_var_ref_t *ref, char *key, size_t keysize)
+{
+	const char *rootpath = NULL;
+
+	if (ref->flags & CATCIERGE_VAR_VOLATILE)
+	{
+		return -1;
+	}
+
+	if (ref->flags & CATCIERGE_VAR_PATH)
+	{
+		// A path relative to another path can refer to loop variables.
+		if (strstr(ref->suffix, "rel"))
 		{
-			CATERR("Out of memory\n"); return NULL;
+			return -1;
+		}
+
+		// Otherwise it is relative to the rootpath of the template.
+		if (!ctx->no_relative_path && (ctx->template_idx >= 0))
+		{
+			rootpath = ctx->templates[ctx->template_idx].settings.rootpath;
+		}
+	}
+
+	if (snprintf(key, keysize, "%s\n%s", ref->name,
+		rootpath ? rootpath : "") >= (int)keysize)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static const char *catcierge_output_translate_cached(catcierge_grb_t *grb,
+	const catcierge_output_var_ref_t *ref, char *buf, size_t bufsize)
+{
+	char key[4096];
+	uint32_t slot = 0;
+	const char *res = NULL;
+	catcierge_output_t *ctx = &grb->output;
+	catcierge_output_cached_var_t *it = NULL;
+
+	if (!ctx->snapshot || catcierge_output_cache_key(ctx, ref, key, sizeof(key)))
+	{
+		return catcierge_output_translate_builtin(grb, ref, buf, bufsize);
+	}
+
+	slot = catcierge_output_var_hash(key, 0) % CATCIERGE_OUTPUT_CACHE_SIZE;
+
+	for (it = ctx->cache[slot]; it; it = it->next)
+	{
+		if (!strcmp(it->key, key))
+		{
+			return it->value;
+		}
+	}
+
+	if (!(res = catcierge_output_translate_builtin(grb, ref, buf, bufsize)))
+	{
+		return NULL;
+	}
+
+	// Failing to cache the value is not an error.
+	if (!(it = catcierge_arena_alloc(&ctx->event_arena, sizeof(*it)))
+	 || !(it->key = catcierge_arena_strdup(&ctx->event_arena, key))
+	 || !(it->value = catcierge_arena_strdup(&ctx->event_arena, res)))
+	{
+		return res;
+	}
+
+	it->next = ctx->cache[slot];
+	ctx->cache[slot] = it;
+	ctx->cache_count++;
+
+	return it->value;
+}
+
+const char *catcierge_output_translate_ref(catcierge_grb_t *grb,
+	char *buf, size_t bufsize, const catcierge_output_var_ref_t *ref)
+{
+	const char *res = NULL;
+	catcierge_output_invar_t *it = NULL;
+	catcierge_output_loop_var_t *loop_var = NULL;
+	assert(grb);
+	assert(ref);
+
+	if ((ref->id != CATCIERGE_VAR_UNKNOWN)
+	 && (res = catcierge_output_translate_cached(grb, ref, buf, bufsize)))
+	{
+		return res;
+	}
+
+	for (loop_var = grb->output.loop_vars; loop_var; loop_var = loop_var->next)
+	{
+		if (!strcmp(loop_var->name, ref->name))
+		{
+			return loop_var->value;
+		}
+	}
+
+	// Look for user defined variables.
+	HASH_FIND_STR(grb->output.vars, ref->name, it);
+
+	if (it)
+	{
+		snprintf(buf, bufsize - 1, "%s", it->value);
+		return buf;
+	}
+
+	return NULL;
+}
+
+const char *_catcierge_output_translate(catcierge_grb_t *grb,
+	char *buf, size_t bufsize, const char *var)
+{
+	catcierge_output_var_ref_t ref;
+
+	// Unknown names are left as CATCIERGE_VAR_UNKNOWN
+	// and looked up among the user variables.
+	catcierge_output_var_parse(&ref, var);
+
+	return catcierge_output_translate_ref(grb, buf, bufsize, &ref);
+}
+
+// The result is allocated in the output arena.
+char *catcierge_translate_inner_vars(catcierge_grb_t *grb, const char *var)
+{
+	const char *it = var;
+	const char *start = NULL;
+	const char *res = NULL;
+	char *innervar = NULL;
+	char tmp[4096];
+	catcierge_output_buf_t buf;
+
+	if (catcierge_output_buf_init(&buf, &grb->output.arena, 2 * strlen(var) + 1))
+	{
+		return NULL;
+	}
+
+	while (*it)
+	{
+		start = it;
+
+		if (*it != '$')
+		{
+			while (*it && (*it != '$'))
+			{
+				it++;
+			}
+
+			if (catcierge_output_buf_append(&buf, start, (it - start)))
+			{
+				return NULL;
+			}
+
+			continue;
+		}
+
+		start = ++it;
+
+		while (*it && (*it != '$'))
+		{
+			it++;
+		}
+
+		// Either we found it or the end of string.
+		if (*it != '$')
+		{
+			CATERR("Inner variable \"$...$\" not terminated inside of \"%s\"\n", var);
+			return NULL;
+		}
+
+		if (!(innervar = catcierge_arena_strndup(buf.arena, start, (it - start))))
+		{
+			return NULL;
+		}
+
+		it++;
+
+		if (!(res = _catcierge_output_translate(grb, tmp, sizeof(tmp), innervar)))
+		{
+			CATERR("Unknown template inner variable \"%s\"\n", innervar);
+			return NULL;
+		}
+
+		if (catcierge_output_buf_append(&buf, res, strlen(res)))
+		{
+			return NULL;
+		}
+	}
+
+	return buf.str;
+}
+
+const char *catcierge_output_translate(catcierge_grb_t *grb,
+	char *buf, size_t bufsize, const char *var)
+{
+	const char *ret = NULL;
+	char *varexp = NULL;
+	catcierge_arena_mark_t mark = catcierge_arena_mark(&grb->output.arena);
+
+	// Expand variables inside of other variables.
+	if (!(varexp = catcierge_translate_inner_vars(grb, var)))
+	{
+		CATERR("Invalid inner variable '%s'\n", var);
+		goto fail;
+	}
+
+	ret = _catcierge_output_translate(grb, buf, bufsize, varexp);
+
+fail:
+	catcierge_arena_release(&grb->output.arena, mark);
+	return ret;
+}
+
+// The values are allocated in the output arena.
+char **catcierge_output_parse_for_loop_expr(catcierge_grb_t *grb,
+		const char *forexpr, char **for_expr_var_ret, size_t *for_expr_vals_count,
+		size_t *linenum)
+{
+	size_t i;
+	char valbuf[128];
+	catcierge_arena_t *arena = &grb->output.arena;
+	char range_strs[2][128];
+	char for_expr_var[128];
+	char for_expr_valstr[1024];
+	char **for_expr_vals = NULL;
+
+	if (sscanf(forexpr, " %127s in %1023s ", for_expr_var, for_expr_valstr) != 2)
+	{
+		CATERR("Failed to parse for expression '%s' on line %d\n", forexpr, *linenum);
+		return NULL;
+	}
+
+	if (sscanf(for_expr_valstr, " %[^ \t.] .. %127s", range_strs[0], range_strs[1]) == 2)
+	{
+		long range[2];
+		long j;
+		const char *res = NULL;
+		const char *varval = NULL;
+		char *end = NULL;
+		char buf[4096];
+
+		for (i = 0; i < 2; i++)
+		{
+			res = range_strs[i];
+
+			if ((varval = catcierge_output_translate(grb, buf, sizeof(buf), res)))
+			{
+				res = varval;
+			}
+
+			range[i] = strtol(res, &end, 10);
+			if (end == res)
+			{
+				CATERR("Failed to parse '%s' as an integer in '%s'\n", res, forexpr);
+				return NULL;
+			}
+		}
+
+		if (range[0] > range[1])
+		{
+			CATERR("Reversed range not allowed %d > %d for '%s'\n",
+					range[0], range[1], for_expr_valstr);
+			return NULL;
+		}
+
+		*for_expr_vals_count = range[1] - range[0] + 1;
+
+		if (!(for_expr_vals = catcierge_arena_alloc(arena, *for_expr_vals_count * sizeof(char *))))
+		{
+			return NULL;
 		}
 
 		for (i = 0, j = range[0]; i < *for_expr_vals_count; i++, j++)
 		{
 			snprintf(valbuf, sizeof(valbuf) - 1, "%ld", j);
 
-			if (!(for_expr_vals[i] = strdup(valbuf)))
+			if (!(for_expr_vals[i] = catcierge_arena_strdup(arena, valbuf)))
 			{
-				catcierge_xfree_list(&for_expr_vals, for_expr_vals_count);
 				return NULL;
 			}
 		}
@@ -1579,6 +2154,8 @@ char **catcierge_output_parse_for_loop_expr(catcierge_grb_t *grb,
 	else if (*for_expr_valstr == '[')
 	{
 		char *range_str_end = NULL;
+		char *s = NULL;
+		char *next = NULL;
 
 		if (!(range_str_end = strchr(&for_expr_valstr[1], ']')))
 		{
@@ -1588,11 +2165,30 @@ char **catcierge_output_parse_for_loop_expr(catcierge_grb_t *grb,
 		*range_str_end = '\0';
 
 		// Split comma delimeted list into strings.
-		if (catcierge_split(&for_expr_valstr[1], ',', &for_expr_vals, for_expr_vals_count))
+		*for_expr_vals_count = 1;
+
+		for (s = &for_expr_valstr[1]; (s = strchr(s, ',')); s++)
+		{
+			(*for_expr_vals_count)++;
+		}
+
+		if (!(for_expr_vals = catcierge_arena_alloc(arena, *for_expr_vals_count * sizeof(char *))))
 		{
-			CATERR("Failed to parse argument list in loop: '%s'\n", forexpr);
 			return NULL;
 		}
+
+		for (i = 0, s = &for_expr_valstr[1]; i < *for_expr_vals_count; i++, s = next)
+		{
+			if ((next = strchr(s, ',')))
+			{
+				*next++ = '\0';
+			}
+
+			if (!(for_expr_vals[i] = catcierge_arena_strdup(arena, s)))
+			{
+				return NULL;
+			}
+		}
 	}
 	else
 	{
@@ -1600,744 +2196,1486 @@ char **catcierge_output_parse_for_loop_expr(catcierge_grb_t *grb,
 		return NULL;
 	}
 
-	if (for_expr_vals)
+	if (!(*for_expr_var_ret = catcierge_arena_strdup(arena, for_expr_var)))
+	{
+		return NULL;
+	}
+
+	return for_expr_vals;
+}
+
+//
+// Templates are compiled once into a list of nodes (literal text, variables,
+// loops and conditionals), so generating them only has to walk the list
+// instead of re-scanning and copying the template text for every event
+// and every loop iteration.
+//
+
+static int catcierge_output_program_grow(catcierge_output_program_t *prog)
+{
+	catcierge_output_node_t *nodes = NULL;
+	size_t max_count = prog->max_count ? (2 * prog->max_count) : 8;
+
+	if (prog->arena)
+	{
+		nodes = catcierge_arena_realloc(prog->arena, prog->nodes,
+			prog->max_count * sizeof(catcierge_output_node_t),
+			max_count * sizeof(catcierge_output_node_t));
+	}
+	else
+	{
+		nodes = realloc(prog->nodes, max_count * sizeof(catcierge_output_node_t));
+	}
+
+	if (!nodes)
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	prog->nodes = nodes;
+	prog->max_count = max_count;
+
+	return 0;
+}
+
+static catcierge_output_node_t *catcierge_output_program_add(
+		catcierge_output_program_t *prog, catcierge_output_node_type_t type,
+		const char *str, size_t len, size_t linenum)
+{
+	catcierge_output_node_t *node = NULL;
+
+	if ((prog->count >= prog->max_count) && catcierge_output_program_grow(prog))
+	{
+		return NULL;
+	}
+
+	node = &prog->nodes[prog->count];
+	memset(node, 0, sizeof(*node));
+	node->body.arena = prog->arena;
+
+	if (prog->arena)
+	{
+		node->str = catcierge_arena_strndup(prog->arena, str, len);
+	}
+	else
+	{
+		node->str = strndup(str, len);
+	}
+
+	if (!node->str)
+	{
+		CATERR("Out of memory\n"); return NULL;
+	}
+
+	node->type = type;
+	node->len = len;
+	node->linenum = linenum;
+	node->inner_vars = (memchr(str, '$', len) != NULL);
+	prog->count++;
+
+	return node;
+}
+
+static int catcierge_output_program_add_text(catcierge_output_program_t *prog,
+		const char *str, size_t len, size_t linenum)
+{
+	catcierge_output_node_t *node = NULL;
+	char *text = NULL;
+
+	if (len == 0)
+		return 0;
+
+	// Merge with the previous literal, this happens for %%.
+	if (prog->count && (prog->nodes[prog->count - 1].type == CATCIERGE_OUTPUT_NODE_TEXT))
+	{
+		node = &prog->nodes[prog->count - 1];
+
+		if (prog->arena)
+		{
+			text = catcierge_arena_realloc(prog->arena, node->str, node->len + 1, node->len + len + 1);
+		}
+		else
+		{
+			text = realloc(node->str, node->len + len + 1);
+		}
+
+		if (!text)
+		{
+			CATERR("Out of memory\n"); return -1;
+		}
+
+		memcpy(&text[node->len], str, len);
+		node->len += len;
+		text[node->len] = '\0';
+		node->str = text;
+
+		return 0;
+	}
+
+	if (!(node = catcierge_output_program_add(prog,
+			CATCIERGE_OUTPUT_NODE_TEXT, str, len, linenum)))
+	{
+		return -1;
+	}
+
+	node->inner_vars = 0;
+
+	return 0;
+}
+
+void catcierge_output_program_destroy(catcierge_output_program_t *prog)
+{
+	size_t i;
+	assert(prog);
+
+	// Released together with the arena.
+	if (prog->arena)
+	{
+		memset(prog, 0, sizeof(*prog));
+		return;
+	}
+
+	for (i = 0; i < prog->count; i++)
+	{
+		catcierge_xfree(&prog->nodes[i].str);
+		catcierge_output_program_destroy(&prog->nodes[i].body);
+	}
+
+	catcierge_xfree(&prog->nodes);
+	prog->count = 0;
+	prog->max_count = 0;
+}
+
+static int catcierge_output_compile_body(catcierge_output_program_t *prog,
+		const char **template_str, size_t *linenum,
+		const char *end_tag, const char *start_expr, size_t start_linenum)
+{
+	const char *it = *template_str;
+	const char *text = it;
+	const char *var = NULL;
+	size_t var_len = 0;
+	catcierge_output_node_t *node = NULL;
+
+	while (*it)
+	{
+		if (*it == '\n')
+		{
+			(*linenum)++;
+		}
+
+		if (*it != '%')
+		{
+			it++;
+			continue;
+		}
+
+		if (catcierge_output_program_add_text(prog, text, (it - text), *linenum))
+		{
+			return -1;
+		}
+
+		it++;
+
+		// %% means a literal %
+		if (*it == '%')
+		{
+			if (catcierge_output_program_add_text(prog, it, 1, *linenum))
+			{
+				return -1;
+			}
+
+			text = ++it;
+			continue;
+		}
+
+		// Save position at beginning of var name.
+		var = it;
+
+		// Look for the ending %
+		while (*it && (*it != '%') && (*it != '\n'))
+		{
+			it++;
+		}
+
+		// Either we found it or the end of string.
+		if (*it != '%')
+		{
+			CATERR("Variable \"%.*s\" not terminated in output template line %d\n",
+				(int)(it - var), var, (int)*linenum);
+			return -1;
+		}
+
+		var_len = it - var;
+		it++; // Skip ending %
+
+		if (end_tag && (var_len == strlen(end_tag)) && !strncmp(var, end_tag, var_len))
+		{
+			// Found end of body.
+			*template_str = it;
+			return 0;
+		}
+
+		if (!strncmp(var, "for", 3))
+		{
+			if (!(node = catcierge_output_program_add(prog,
+					CATCIERGE_OUTPUT_NODE_FOR, var, var_len, *linenum)))
+			{
+				return -1;
+			}
+
+			if (*it != '\n')
+			{
+				CATERR("Expected newline after '%s', line %d\n", node->str, (int)*linenum);
+				return -1;
+			}
+
+			it++; // Skip newline after for loop expression.
+			(*linenum)++;
+
+			if (catcierge_output_compile_body(&node->body, &it, linenum,
+					"endfor", node->str, node->linenum))
+			{
+				return -1;
+			}
+
+			if (*it != '\n')
+			{
+				CATERR("Expected newline after 'endfor' got '%c', line %d\n",
+					*it, (int)*linenum);
+				return -1;
+			}
+
+			it++;
+			(*linenum)++;
+		}
+		else if (!strncmp(var, "if", 2))
+		{
+			if (!(node = catcierge_output_program_add(prog,
+					CATCIERGE_OUTPUT_NODE_IF, var, var_len, *linenum)))
+			{
+				return -1;
+			}
+
+			if (catcierge_output_compile_body(&node->body, &it, linenum,
+					"endif", node->str, node->linenum))
+			{
+				return -1;
+			}
+		}
+		else
+		{
+			if (!(node = catcierge_output_program_add(prog,
+					CATCIERGE_OUTPUT_NODE_VAR, var, var_len, *linenum)))
+			{
+				return -1;
+			}
+
+			// Names with inner variables are only known when rendering.
+			if (!node->inner_vars)
+			{
+				catcierge_output_var_parse(&node->ref, node->str);
+			}
+		}
+
+		text = it;
+	}
+
+	if (end_tag)
+	{
+		CATERR("Missing closing '%s' for '%s' at line %d\n",
+				end_tag, start_expr, (int)start_linenum);
+		return -1;
+	}
+
+	if (catcierge_output_program_add_text(prog, text, (it - text), *linenum))
+	{
+		return -1;
+	}
+
+	*template_str = it;
+
+	return 0;
+}
+
+static int catcierge_output_compile_in(catcierge_output_program_t *prog,
+		catcierge_arena_t *arena, const char *template_str)
+{
+	size_t linenum = 0;
+	assert(prog);
+	assert(template_str);
+
+	memset(prog, 0, sizeof(*prog));
+	prog->arena = arena;
+
+	if (catcierge_output_compile_body(prog, &template_str, &linenum, NULL, NULL, 0))
+	{
+		catcierge_output_program_destroy(prog);
+		return -1;
+	}
+
+	return 0;
+}
+
+int catcierge_output_compile(catcierge_output_program_t *prog, const char *template_str)
+{
+	return catcierge_output_compile_in(prog, NULL, template_str);
+}
+
+static int catcierge_output_eval_if(catcierge_grb_t *grb,
+		const char *ifexpr, size_t linenum, int *if_val)
+{
+	const char *res = NULL;
+	const char *varval = NULL;
+	char valstrs[2][128];
+	char *end = NULL;
+	long vals[2];
+	char operator[128];
+	int i;
+	char buf[1024];
+
+	if (sscanf(ifexpr, "%127s %127s %127s", valstrs[0], operator, valstrs[1]) != 3)
+	{
+		CATERR("Failed to parse if expression '%s' on line %d\n", ifexpr, (int)linenum);
+		return -1;
+	}
+
+	// TODO: Add string support.
+
+	for (i = 0; i < 2; i++)
+	{
+		res = valstrs[i];
+
+		if ((varval = catcierge_output_translate(grb, buf, sizeof(buf), res)))
+		{
+			res = varval;
+		}
+
+		vals[i] = strtol(res, &end, 10);
+		if (end == res)
+		{
+			CATERR("Failed to parse '%s' as an integer\n", res);
+			return -1;
+		}
+	}
+
+	*if_val = 0;
+
+	if (!strcmp(operator, "==")) *if_val = (vals[0] == vals[1]);
+	else if (!strcmp(operator, ">=")) *if_val = (vals[0] >= vals[1]);
+	else if (!strcmp(operator, "<=")) *if_val = (vals[0] <= vals[1]);
+	else if (!strcmp(operator, "!=")) *if_val = (vals[0] != vals[1]);
+	else if (!strcmp(operator, ">")) *if_val = (vals[0] > vals[1]);
+	else if (!strcmp(operator, "<")) *if_val = (vals[0] < vals[1]);
+
+	return 0;
+}
+
+static int catcierge_output_render_program(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_program_t *prog,
+		catcierge_output_sink_t *sink);
+
+static int catcierge_output_render_for(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_node_t *node,
+		catcierge_output_sink_t *sink)
+{
+	int ret = 0;
+	size_t i;
+	size_t linenum = node->linenum;
+	char *expr = NULL;
+	char *for_expr_var = NULL;
+	char **for_expr_vals = NULL;
+	size_t for_expr_vals_count = 0;
+	catcierge_output_invar_t *var_it = NULL;
+	catcierge_output_loop_var_t *it = NULL;
+	catcierge_output_loop_var_t loop_var;
+
+	// The loop range can refer to other variables: 1..$match_count$
+	if (node->inner_vars)
+	{
+		if (!(expr = catcierge_translate_inner_vars(grb, node->str)))
+		{
+			return -1;
+		}
+	}
+
+	if (!(for_expr_vals = catcierge_output_parse_for_loop_expr(grb,
+			(expr ? expr : node->str) + strlen("for"),
+			&for_expr_var, &for_expr_vals_count, &linenum)))
+	{
+		return -1;
+	}
+
+	HASH_FIND_STR(ctx->vars, for_expr_var, var_it);
+
+	for (it = ctx->loop_vars; it && !var_it; it = it->next)
+	{
+		if (!strcmp(it->name, for_expr_var))
+			break;
+	}
+
+	if (var_it || it)
+	{
+		CATERR("Variable '%s' already defined\n", for_expr_var);
+		return -1;
+	}
+
+	// The loop variable is only visible inside of the loop.
+	memset(&loop_var, 0, sizeof(loop_var));
+	loop_var.name = for_expr_var;
+	loop_var.next = ctx->loop_vars;
+	ctx->loop_vars = &loop_var;
+
+	for (i = 0; i < for_expr_vals_count; i++)
+	{
+		loop_var.value = for_expr_vals[i];
+
+		if (catcierge_output_render_program(ctx, grb, &node->body, sink))
+		{
+			CATERR("Failed to generate loop at iteration %d\n", (int)i);
+			ret = -1; break;
+		}
+	}
+
+	ctx->loop_vars = loop_var.next;
+
+	return ret;
+}
+
+static int catcierge_output_render_if(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_node_t *node,
+		catcierge_output_sink_t *sink)
+{
+	int if_val = 0;
+	char *expr = NULL;
+
+	if (node->inner_vars)
+	{
+		if (!(expr = catcierge_translate_inner_vars(grb, node->str)))
+		{
+			return -1;
+		}
+	}
+
+	if (catcierge_output_eval_if(grb, (expr ? expr : node->str) + strlen("if"),
+			node->linenum, &if_val))
+	{
+		return -1;
+	}
+
+	if (if_val)
+	{
+		return catcierge_output_render_program(ctx, grb, &node->body, sink);
+	}
+
+	return 0;
+}
+
+static int catcierge_output_render_var(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_node_t *node,
+		catcierge_output_sink_t *sink)
+{
+	const char *res = NULL;
+	char tmp[4096];
+
+	// Only variables such as %match$i$_path% need to be expanded
+	// before they can be looked up.
+	if (node->inner_vars)
+	{
+		res = catcierge_output_translate(grb, tmp, sizeof(tmp), node->str);
+	}
+	else
+	{
+		res = catcierge_output_translate_ref(grb, tmp, sizeof(tmp), &node->ref);
+	}
+
+	if (!res)
+	{
+		if (ctx->recursion_error)
+		{
+			CATERR(" %*s\"%s\"\n", (CATCIERGE_OUTPUT_MAX_RECURSION - ctx->recursion), "", node->str);
+		}
+		else
+		{
+			CATERR("Unknown template variable \"%s\"\n", node->str);
+		}
+
+		return -1;
+	}
+
+	return sink->write(sink, res, strlen(res), 0);
+}
+
+static int catcierge_output_render_program(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_program_t *prog,
+		catcierge_output_sink_t *sink)
+{
+	int ret = 0;
+	size_t i;
+	catcierge_output_node_t *node = NULL;
+
+	if (ctx->recursion >= CATCIERGE_OUTPUT_MAX_RECURSION)
+	{
+		CATERR("Max output template recursion level reached (%d)!\n",
+			CATCIERGE_OUTPUT_MAX_RECURSION);
+		ctx->recursion_error = 1;
+		return -1;
+	}
+
+	for (i = 0; (i < prog->count) && !ret; i++)
+	{
+		node = &prog->nodes[i];
+
+		if (node->type == CATCIERGE_OUTPUT_NODE_TEXT)
+		{
+			ret = sink->write(sink, node->str, node->len, 1);
+			continue;
+		}
+
+		// Some variables can nest other variables, make sure
+		// we don't end up in an infinite recursion.
+		ctx->recursion++;
+
+		switch (node->type)
+		{
+			case CATCIERGE_OUTPUT_NODE_VAR: ret = catcierge_output_render_var(ctx, grb, node, sink); break;
+			case CATCIERGE_OUTPUT_NODE_FOR: ret = catcierge_output_render_for(ctx, grb, node, sink); break;
+			case CATCIERGE_OUTPUT_NODE_IF: ret = catcierge_output_render_if(ctx, grb, node, sink); break;
+			default: break;
+		}
+
+		ctx->recursion--;
+	}
+
+	return ret;
+}
+
+int catcierge_output_render_to(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_program_t *prog,
+		catcierge_output_sink_t *sink)
+{
+	int ret = 0;
+	assert(ctx);
+	assert(grb);
+	assert(prog);
+	assert(sink);
+
+	ret = catcierge_output_render_program(ctx, grb, prog, sink);
+
+	// The whole chain of failed variables has been logged.
+	if (ctx->recursion == 0)
+	{
+		ctx->recursion_error = 0;
+	}
+
+	return ret;
+}
+
+// The output is allocated in the arena.
+static char *catcierge_output_render_scratch(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_program_t *prog)
+{
+	catcierge_output_buf_t buf;
+
+	if (catcierge_output_buf_init(&buf, &ctx->arena, 256))
+	{
+		return NULL;
+	}
+
+	if (catcierge_output_render_to(ctx, grb, prog, &buf.sink))
+	{
+		return NULL;
+	}
+
+	return buf.str;
+}
+
+static char *catcierge_output_generate_scratch(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, const char *template_str)
+{
+	catcierge_output_program_t prog;
+
+	// Paths and commands are only generated once per event,
+	// so they are not worth keeping compiled.
+	if (catcierge_output_compile_in(&prog, &ctx->arena, template_str))
+	{
+		return NULL;
+	}
+
+	return catcierge_output_render_scratch(ctx, grb, &prog);
+}
+
+char *catcierge_output_render(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, catcierge_output_program_t *prog)
+{
+	char *output = NULL;
+	char *ret = NULL;
+	catcierge_arena_mark_t mark;
+	assert(ctx);
+	assert(grb);
+	assert(prog);
+
+	mark = catcierge_arena_mark(&ctx->arena);
+
+	if ((output = catcierge_output_render_scratch(ctx, grb, prog))
+	 && !(ret = strdup(output)))
+	{
+		CATERR("Out of memory\n");
+	}
+
+	catcierge_arena_release(&ctx->arena, mark);
+
+	return ret;
+}
+
+char *catcierge_output_generate(catcierge_output_t *ctx,
+		catcierge_grb_t *grb, const char *template_str)
+{
+	char *output = NULL;
+	char *ret = NULL;
+	catcierge_arena_mark_t mark;
+	assert(ctx);
+	assert(grb);
+
+	if (!template_str)
+		return NULL;
+
+	mark = catcierge_arena_mark(&ctx->arena);
+
+	if ((output = catcierge_output_generate_scratch(ctx, grb, template_str))
+	 && !(ret = strdup(output)))
+	{
+		CATERR("Out of memory\n");
+	}
+
+	catcierge_arena_release(&ctx->arena, mark);
+
+	return ret;
+}
+
+int catcierge_output_validate(catcierge_output_t *ctx,
+	catcierge_grb_t *grb, const char *template_str)
+{
+	int is_valid = 0;
+	catcierge_arena_mark_t mark;
+	assert(ctx);
+
+	if (!template_str)
+		return 0;
+
+	mark = catcierge_arena_mark(&ctx->arena);
+	is_valid = (catcierge_output_generate_scratch(ctx, grb, template_str) != NULL);
+	catcierge_arena_release(&ctx->arena, mark);
+
+	return is_valid;
+}
+
+static char *catcierge_replace_whitespace(char *path, char *extra_chars)
+{
+	char *p = path;
+	char *e = NULL;
+
+	while (*p)
+	{
+		if ((*p == ' ') || (*p == '\t') || (*p == '\n'))
+		{
+			*p = '_';
+		}
+
+		if (extra_chars)
+		{
+			e = extra_chars;
+			while (*e)
+			{
+				if (*p == *e)
+				{
+					*p = '_';
+				}
+
+				e++;
+			}
+		}
+
+		p++;
+	}
+
+	return 0;
+}
+
+static void catcierge_output_free_generated_paths(catcierge_output_t *ctx)
+{
+	size_t i;
+	catcierge_output_template_t *t = NULL;
+	assert(ctx);
+
+	for (i = 0; i < ctx->template_count; i++)
+	{
+		t = &ctx->templates[i];
+
+		if (t->generated_path)
+		{
+			free(t->generated_path);
+			t->generated_path = NULL;
+		}
+	}
+}
+
+int catcierge_output_template_registered_to_event(catcierge_output_template_t *t, uint32_t event_bit)
+{
+	assert(t);
+	return !!(t->settings.event_mask & event_bit);
+}
+
+// Event names map to the same bits as the catcierge_event_t's,
+// "all" (or "*") generates the templates registered to all events.
+static uint32_t catcierge_output_event_bit(const char *event)
+{
+	int e;
+	assert(event);
+
+	if ((e = catcierge_event_from_name(event)) >= 0)
 	{
-		*for_expr_var_ret = strdup(for_expr_var);
+		return CATCIERGE_EVENT_BIT(e);
 	}
 
-	return for_expr_vals;
+	return catcierge_event_filter_mask(event) & CATCIERGE_EVENT_ALL_BIT;
 }
 
-char *catcierge_parse_body(const char *forexpr, char **template_str,
-									size_t start_linenum, size_t *linenum,
-									const char* start_tag, const char *end_tag,
-									int newline_after_tag)
+static int catcierge_output_default_template_path(catcierge_args_t *args)
 {
-	char *start = *template_str;
-	char *end = NULL;
-	char *var = NULL;
-	char *body = NULL;
-	char *it = NULL;
-	int inner_body = 0;
-
-	if (newline_after_tag)
+	if (!args->template_output_path && args->output_path)
 	{
-		if (*start != '\n')
+		if (!(args->template_output_path = strdup(args->output_path)))
 		{
-			CATERR("Expected newline after '%s', line %d\n", forexpr, start_linenum);
-			goto fail;
+			CATERR("Out of memory");
+			return -1;
 		}
-
-		start++; // Skip newline after for loop expression.
 	}
-	it = start;
-	end = NULL;
-
-	while (*it)
-	{
-		if (*it == '\n')
-		{
-			(*linenum)++;
-		}
-
-		if (*it == '%')
-		{
-			it++;
-
-			// %% means a literal %
-			if (*it && (*it == '%'))
-			{
-				it++;
-				continue;
-			}
-
-			// Save position at beginning of var name.
-			var = it;
-
-			// Look for the ending %
-			while (*it && (*it != '%') && (*it != '\n'))
-			{
-				it++;
-			}
-
-			// Either we found it or the end of string.
-			if (*it != '%')
-			{
-				*it = '\0';
-				CATERR("Variable \"%s\" not terminated. Line %d\n",
-						var, (int)*linenum);
-				goto fail;
-			}
 
-			if (!(var = strndup(var, (it - var))))
-			{
-				CATERR("Out of memory\n"); goto fail;
-			}
+	return 0;
+}
 
-			it++; // Skip ending %
+static int catcierge_output_generate_template_path(catcierge_output_t *ctx,
+	catcierge_grb_t *grb, catcierge_output_template_t *t)
+{
+	int ret = 0;
+	char *path = NULL;
+	char full_path[4096];
+	char *gen_output_path = NULL;
+	catcierge_args_t *args = &grb->args;
+	catcierge_arena_mark_t mark;
 
-			if (!strncmp(var, start_tag, strlen(start_tag)))
-			{
-				inner_body++;
-			}
-			else if (!strcmp(var, end_tag))
-			{
-				if (inner_body == 0)
-				{
-					// Found end of body.
-					end = it - (strlen(end_tag) + 2 + 1);
-					catcierge_xfree(&var);
-
-					if (newline_after_tag)
-					{
-						if (*it != '\n')
-						{
-							CATERR("Expected newline after '%s' got '%c', line %d\n",
-									end_tag, *it, *linenum);
-							goto fail;
-						}
-						it++;
-					}
-
-					break;
-				}
-				else
-				{
-					inner_body--;
-				}
-			}
+	mark = catcierge_arena_mark(&ctx->arena);
 
-			catcierge_xfree(&var);
-		}
-		else
-		{
-			it++;
-		}
+	// Generate the output path.
+	if (!(gen_output_path = catcierge_output_generate_scratch(ctx,
+			grb, args->template_output_path)))
+	{
+		CATERR("Failed to generate output path from: \"%s\"\n", args->template_output_path);
+		ret = -1; goto fail;
 	}
 
-	if (end == NULL)
+	if (catcierge_make_path(gen_output_path))
 	{
-		CATERR("Missing closing '%s' for '%s' at line %d\n",
-				end_tag, forexpr, start_linenum);
-		goto fail;
+		CATERR("Failed to create directory %s\n", gen_output_path);
 	}
 
-	// Copy the body.
-	if (!(body = strndup(start, (end - start) + 1)))
+	// Generate the filename.
+	if (!(path = catcierge_output_render_scratch(ctx, grb, &t->filename_prog)))
 	{
-		goto fail;
+		CATERR("Failed to generate output path for template \"%s\"\n", t->settings.filename);
+		ret = -1; goto fail;
 	}
 
-	// Pass our iterator back to the caller (after the for loop).
-	*template_str = it;
+	// Replace whitespace with underscore.
+	catcierge_replace_whitespace(path, ":");
 
-fail:
+	// Assemble the full output path.
+	snprintf(full_path, sizeof(full_path), "%s%s%s",
+		gen_output_path, catcierge_path_sep(), path);
+
+	// We make a copy so that we can use the generated
+	// path as a variable in the templates contents, or
+	// when passed to catcierge_execute. 
+	if (!(t->generated_path = strdup(full_path)))
+	{
+		CATERR("Out of memory!\n"); ret = -1; goto fail;
+	}
 
-	return body;
+fail:
+	catcierge_arena_release(&ctx->arena, mark);
+	return ret;
 }
 
-char *catcierge_parse_for_loop(catcierge_grb_t *grb, char **template_str,
-		const char *forexpr, size_t *linenum)
+static int catcierge_output_publishes_template(catcierge_grb_t *grb,
+	catcierge_output_template_t *t)
 {
-	char *it = NULL;
-	char *for_expr_var = NULL;
-	char **for_expr_vals = NULL;
-	size_t for_expr_vals_count = 0;
-	char *for_body = NULL;
-	size_t start_linenum = *linenum;
-	catcierge_output_t *ctx = &grb->output;
-	assert(grb);
+	#ifdef WITH_ZMQ
+	return (grb->args.zmq && grb->zmq_publisher && !t->settings.nozmq);
+	#else
+	return 0;
+	#endif
+}
 
-	forexpr += sizeof("for");
+static FILE *catcierge_output_open_template(catcierge_output_template_t *t)
+{
+	FILE *f = NULL;
 
-	// Parse the for loop expression.
-	if (!(for_expr_vals = catcierge_output_parse_for_loop_expr(grb, forexpr,
-							&for_expr_var, &for_expr_vals_count, linenum)))
+	if (!t->generated_path)
 	{
+		CATERR("No output path for template \"%s\"\n", t->settings.filename);
 		return NULL;
 	}
 
-	// Find end of the for loop body.
-	if (!(for_body = catcierge_parse_body(forexpr, template_str,
-						start_linenum, linenum, "for", "endfor", 1)))
+	CATLOG("Generate template: %s\n", t->generated_path);
+
+	if (!(f = fopen(t->generated_path, "w")))
 	{
-		goto fail;
+		CATERR("Failed to open template output file \"%s\" for writing\n", t->generated_path);
 	}
 
-	// Now generate based on the loop body.
-	{
-		char *res = NULL;
-		char *resit = NULL;
-		size_t reslen = 0;
-		char *output = NULL;
-		size_t orig_len = 0;
-		size_t out_len = 0;
-		size_t len = 0;
-		catcierge_output_invar_t *var_it = NULL;
-		size_t i;
+	return f;
+}
 
-		orig_len = strlen(for_body);
-		out_len = (2 * orig_len + 1) * for_expr_vals_count;
+// Publishes and saves output that has been rendered into a list of pieces.
+static int catcierge_output_write_template(catcierge_grb_t *grb,
+	catcierge_output_template_t *t, catcierge_output_segments_t *segs)
+{
+	int ret = 0;
+	FILE *f = NULL;
+	#ifdef WITH_ZMQ
+	zframe_t *frame = NULL;
 
-		if (!(output = malloc(out_len)))
-		{
-			CATERR("Out of memory\n"); goto fail;
-		}
+	if (catcierge_output_publishes_template(grb, t))
+	{
+		CATLOG("ZMQ Publish topic %s, %d bytes\n", t->settings.topic, (int)segs->sink.len);
 
-		if (!(var_it = catcierge_output_add_user_variable(&grb->output, for_expr_var, NULL)))
+		// The message must be in one piece, so this is the only copy made.
+		if (!(frame = zframe_new(NULL, segs->sink.len)))
 		{
-			CATERR("Failed to add variable '%s'\n", for_expr_var);
-			catcierge_xfree(&output);
-			goto fail_gen;
+			CATERR("Out of memory\n"); return -1;
 		}
 
-		for (i = 0; i < for_expr_vals_count; i++)
-		{
-			// Set loop var value.
-			catcierge_xfree(&var_it->value);
-
-			if (!(var_it->value = strdup(for_expr_vals[i])))
-			{
-				CATERR("Out of memory\n");
-				catcierge_xfree(&output);
-				goto fail_gen;
-			}
-
-			if (!(res = catcierge_output_generate(&grb->output, grb, for_body)))
-			{	
-				CATERR("Failed to generate loop at iteration %d\n", i);
-				catcierge_xfree(&output);
-				goto fail_gen;
-			}
-
-			reslen = strlen(res);
-
-			if (!(output = catcierge_output_realloc_if_needed(output, (len + reslen + 1), &out_len)))
-			{
-				CATERR("Out of memory\n"); goto fail_gen;
-			}
-
-			resit = res;
-			while (*resit)
-			{
-				output[len] = *resit++;
-				len++;
-			}
+		catcierge_output_segments_copy(segs, (char *)zframe_data(frame));
+		catcierge_publisher_send(grb->zmq_publisher, t->settings.topic, &frame, NULL, 0);
+	}
+	#endif // WITH_ZMQ
 
-			catcierge_xfree(&res);
+	if (!t->settings.nofile)
+	{
+		if (!(f = catcierge_output_open_template(t)))
+		{
+			return -1;
 		}
 
-		output[len] = '\0';
-
-	fail_gen:
-		if (var_it)
+		if (catcierge_output_segments_write_file(f, segs->segs, segs->count))
 		{
-			HASH_DEL(grb->output.vars, var_it);
-			catcierge_xfree(&var_it->value);
-			catcierge_xfree(&var_it);
+			CATERR("Failed to write template output file \"%s\"\n", t->generated_path);
+			ret = -1;
 		}
 
-		catcierge_xfree_list(&for_expr_vals, &for_expr_vals_count);
-		catcierge_xfree(&for_expr_var);
-		catcierge_xfree(&for_body);
-		catcierge_xfree(&res);
-
-		return output;
+		fclose(f);
 	}
 
-fail:
-	catcierge_xfree_list(&for_expr_vals, &for_expr_vals_count);
-	catcierge_xfree(&for_expr_var);
-	catcierge_xfree(&for_body);
-	return NULL;
+	return ret;
 }
 
-char *catcierge_parse_if(catcierge_grb_t *grb, char **template_str,
-		const char *ifexpr, size_t *linenum)
+static void catcierge_output_publish_cbor(catcierge_grb_t *grb, uint32_t event_bit)
 {
-	char *output = NULL;
-	const char *res = NULL;
-	const char *varval = NULL;
-	size_t start_linenum = *linenum;
-	char valstrs[2][128];
-	char *end = NULL;
-	long vals[2];
-	char operator[128];
-	int if_val = 0;
-	int i;
-	char buf[1024];
-
-	ifexpr += sizeof("if");
+	#ifdef WITH_ZMQ
+	int e;
+	char topic[128];
+	catcierge_cbor_t c;
+	zframe_t *frame = NULL;
 
-	if (sscanf(ifexpr, "%127s %127s %127s", valstrs[0], operator, valstrs[1]) != 3)
+	if (!grb->output.publish_cbor || !grb->zmq_publisher)
 	{
-		CATERR("Failed to parse if expression '%s' on line %d\n", ifexpr, *linenum);
-		return NULL;
+		return;
 	}
 
-	// TODO: Add string support.
-
-	for (i = 0; i < 2; i++)
+	// Not published for the "all" pseudo event.
+	for (e = 0; e < CATCIERGE_EVENT_COUNT; e++)
 	{
-		res = valstrs[i];
-
-		if ((varval = catcierge_output_translate(grb, buf, sizeof(buf), res)))
-		{
-			res = varval; 
-		}
+		if (CATCIERGE_EVENT_BIT(e) == event_bit)
+			break;
+	}
 
-		vals[i] = strtol(res, &end, 10);
-		if (end == res)
-		{
-			CATERR("Failed to parse '%s' as an integer\n", res);
-			goto fail;
-		}
+	if (e == CATCIERGE_EVENT_COUNT)
+	{
+		return;
 	}
 
-	if (!strcmp(operator, "==")) if_val = (vals[0] == vals[1]);
-	else if (!strcmp(operator, ">=")) if_val = (vals[0] >= vals[1]);
-	else if (!strcmp(operator, "<=")) if_val = (vals[0] <= vals[1]);
-	else if (!strcmp(operator, "!=")) if_val = (vals[0] != vals[1]);
-	else if (!strcmp(operator, ">")) if_val = (vals[0] > vals[1]);
-	else if (!strcmp(operator, "<")) if_val = (vals[0] < vals[1]);
+	catcierge_cbor_init(&c);
 
-	if (!(output = catcierge_parse_body(ifexpr, template_str,
-						start_linenum, linenum, "if", "endif", 0)))
+	if (catcierge_output_encode_cbor(grb, (catcierge_event_t)e, &c))
 	{
+		CATERR("Failed to encode %s event\n", catcierge_event_name(e));
 		goto fail;
 	}
 
-	if (!if_val)
+	if (!(frame = zframe_new(c.buf, c.len)))
 	{
-		output[0] = '\0';
+		CATERR("Out of memory\n"); goto fail;
 	}
 
-	return output;
+	snprintf(topic, sizeof(topic), "%s%s",
+		CATCIERGE_OUTPUT_CBOR_TOPIC, catcierge_event_name(e));
+
+	catcierge_publisher_send(grb->zmq_publisher, topic, &frame, NULL, 0);
+
 fail:
-	return NULL;
+	catcierge_cbor_destroy(&c);
+	#endif // WITH_ZMQ
 }
 
-char *catcierge_output_generate(catcierge_output_t *ctx,
-		catcierge_grb_t *grb, const char *template_str)
+#ifdef WITH_ZMQ
+static void catcierge_output_cbor_index(catcierge_cbor_t *c, int idx)
 {
-	char buf[4096];
-	char *var;
-	char *it;
-	char *output = NULL;
-	char *tmp = NULL;
-	size_t orig_len = 0;
-	size_t out_len = 0;
-	size_t len;
-	size_t linenum;
-	size_t reslen;
-	assert(ctx);
-	assert(grb);
+	if (idx >= 0)
+		catcierge_cbor_int(c, idx);
+	else
+		catcierge_cbor_null(c);
+}
 
-	if (!template_str)
-		return NULL;
+static void catcierge_output_cbor_image(catcierge_cbor_t *c, const char *type,
+		int match, int step, catcierge_path_t *path, catcierge_encoded_image_t *img)
+{
+	catcierge_cbor_map(c, 5);
+	catcierge_cbor_text(c, "type");
+	catcierge_cbor_text(c, type);
+	catcierge_cbor_text(c, "match");
+	catcierge_output_cbor_index(c, match);
+	catcierge_cbor_text(c, "step");
+	catcierge_output_cbor_index(c, step);
+	catcierge_cbor_text(c, "filename");
+	catcierge_cbor_text(c, path->filename);
+	catcierge_cbor_text(c, "size");
+	catcierge_cbor_uint(c, img->size);
+}
+#endif // WITH_ZMQ
 
-	if (ctx->recursion >= CATCIERGE_OUTPUT_MAX_RECURSION)
+//
+// Publishes the images saved for a match group as a multipart message:
+//
+//   CATCIERGE_OUTPUT_IMAGES_TOPIC<event>
+//   CBOR index: { "schema": 1, "match_group_id": <20 byte SHA1>,
+//                 "images": [ { "type": "obstruct"|"match"|"step",
+//                               "match": idx or null, "step": idx or null,
+//                               "filename": "..", "size": bytes }, .. ] }
+//   One frame per image in the same order as the index.
+//
+static void catcierge_output_publish_images(catcierge_grb_t *grb, uint32_t event_bit)
+{
+	#ifdef WITH_ZMQ
+	size_t i;
+	size_t j;
+	size_t n = 0;
+	size_t count = 0;
+	zframe_t *frame = NULL;
+	catcierge_cbor_t c;
+	match_group_t *mg = &grb->match_group;
+	match_state_t *m = NULL;
+	match_step_t *step = NULL;
+	catcierge_encoded_image_t *imgs[1 + MATCH_MAX_COUNT_LIMIT * (1 + MAX_STEPS)];
+
+	if (!grb->output.publish_images || !grb->zmq_publisher
+	 || (event_bit != CATCIERGE_EVENT_BIT(CATCIERGE_MATCH_GROUP_DONE)))
 	{
-		CATERR("Max output template recursion level reached (%d)!\n",
-			CATCIERGE_OUTPUT_MAX_RECURSION);
-		ctx->recursion_error = 1;
-		return NULL;
+		return;
 	}
 
-	orig_len = strlen(template_str);
-	out_len = 2 * orig_len + 1;
+	catcierge_cbor_init(&c);
+
+	if (mg->obstruct_encoded)
+		count++;
 
-	if (!(output = malloc(out_len)))
+	for (i = 0; mg->matches && (i < mg->match_count); i++)
 	{
-		return NULL;
+		m = &mg->matches[i];
+		count += (m->encoded != NULL);
+
+		for (j = 0; j < m->result.step_img_count; j++)
+			count += (m->result.steps[j].encoded != NULL);
 	}
 
-	if (!(tmp = strdup(template_str)))
+	if (count == 0)
 	{
-		free(output);
-		return NULL;
+		goto fail;
 	}
 
-	len = 0;
-	linenum = 0;
-	it = tmp;
+	catcierge_cbor_map(&c, 3);
+	catcierge_cbor_text(&c, "schema");
+	catcierge_cbor_uint(&c, CATCIERGE_OUTPUT_CBOR_SCHEMA);
+	catcierge_cbor_text(&c, "match_group_id");
+	catcierge_output_cbor_sha(&c, &mg->sha);
+	catcierge_cbor_text(&c, "images");
+	catcierge_cbor_array(&c, count);
 
-	while (*it)
+	if (mg->obstruct_encoded)
 	{
-		if (*it == '\n')
+		catcierge_output_cbor_image(&c, "obstruct", -1, -1,
+			&mg->obstruct_path, mg->obstruct_encoded);
+		imgs[n++] = mg->obstruct_encoded;
+	}
+
+	for (i = 0; mg->matches && (i < mg->match_count); i++)
+	{
+		m = &mg->matches[i];
+
+		if (m->encoded)
 		{
-			linenum++;
+			catcierge_output_cbor_image(&c, "match", (int)i, -1, &m->path, m->encoded);
+			imgs[n++] = m->encoded;
 		}
 
-		// Replace any variables signified by %varname%
-		if (*it == '%')
+		for (j = 0; j < m->result.step_img_count; j++)
 		{
-			const char *res = NULL; // TODO: Cannot be const for all cases, refactor this.
-			const char *resit = NULL;
-			int res_is_alloc = 0;
-			it++;
-
-			// %% means a literal %
-			if (*it && (*it == '%'))
-			{
-				output[len] = *it++;
-				len++;
-				continue;
-			}
+			step = &m->result.steps[j];
 
-			// Save position at beginning of var name.
-			var = it;
-
-			// Look for the ending %
-			while (*it && (*it != '%') && (*it != '\n'))
-			{
-				it++;
-			}
-
-			// Either we found it or the end of string.
-			if (*it != '%')
+			if (step->encoded)
 			{
-				*it = '\0';
-				CATERR("Variable \"%s\" not terminated in output template line %d\n",
-					var, (int)linenum);
-				catcierge_xfree(&output);
-				goto fail;
+				catcierge_output_cbor_image(&c, "step", (int)i, (int)j, &step->path, step->encoded);
+				imgs[n++] = step->encoded;
 			}
+		}
+	}
 
-			// Terminate so we get the var name in a nice comparable string.
-			*it++ = '\0';
-
-			// Some variables can nest other variables, make sure
-			// we don't end up in an infinite recursion.
-			ctx->recursion++;
-
-			// TODO: Refactor
-			if (!strncmp(var, "for", 3))
-			{
-				res_is_alloc = 1;
+	if (c.failed || !(frame = zframe_new(c.buf, c.len)))
+	{
+		CATERR("Failed to create image index\n"); goto fail;
+	}
 
-				if (!(var = catcierge_translate_inner_vars(grb, var)))
-				{
-					catcierge_xfree(&output);
-					goto fail;
-				}
+	CATLOG("ZMQ Publish %d images\n", (int)n);
 
-				if (!(res = catcierge_parse_for_loop(grb, &it, var, &linenum)))
-				{
-					catcierge_xfree(&var);
-					catcierge_xfree(&output);
-					goto fail;
-				}
+	catcierge_publisher_send(grb->zmq_publisher,
+		CATCIERGE_OUTPUT_IMAGES_TOPIC "match_group_done", &frame, imgs, n);
 
-				catcierge_xfree(&var);
-			}
-			else if (!strncmp(var, "if", 2))
-			{
-				res_is_alloc = 1;
+fail:
+	catcierge_cbor_destroy(&c);
+	#endif // WITH_ZMQ
+}
 
-				if (!(var = catcierge_translate_inner_vars(grb, var)))
-				{
-					catcierge_xfree(&output);
-					goto fail;
-				}
+static int catcierge_output_generate_event_templates(catcierge_output_t *ctx,
+	catcierge_grb_t *grb, uint32_t event_bit)
+{
+	catcierge_output_template_t *t = NULL;
+	catcierge_args_t *args = &grb->args;
+	catcierge_output_segments_t segs;
+	FILE *f = NULL;
+	size_t i;
+	int ret = 0;
+	catcierge_arena_mark_t mark;
+	catcierge_arena_mark_t sink_mark;
+	assert(ctx);
+	assert(grb);
 
-				if (!(res = catcierge_parse_if(grb, &it, var, &linenum)))
-				{
-					catcierge_xfree(&var);
-					catcierge_xfree(&output);
-					goto fail;
-				}
+	if (catcierge_output_default_template_path(args))
+	{
+		return -1;
+	}
 
-				catcierge_xfree(&var);				
-			}
-			// Find the value of the variable and append it to the output.
-			else if (!(res = catcierge_output_translate(grb, buf, sizeof(buf), var)))
-			{
-				if (ctx->recursion_error)
-				{
-					CATERR(" %*s\"%s\"\n", (CATCIERGE_OUTPUT_MAX_RECURSION - ctx->recursion), "", var);
-					ctx->recursion--;
+	catcierge_output_free_generated_paths(ctx);
 
-					if (ctx->recursion == 0)
-						ctx->recursion_error = 0;
-				}
-				else
-				{
-					CATERR("Unknown template variable \"%s\"\n", var);
-				}
+	for (i = 0; i < ctx->template_count; i++)
+	{
+		ctx->template_idx = i;
+		t = &ctx->templates[i];
 
-				catcierge_xfree(&output);
-				goto fail;
-			}
+		// Filter out any events that don't have the current "event" in their list.
+		if (!catcierge_output_template_registered_to_event(t, event_bit))
+		{
+			//CATLOG("  Skip template %s because event %s not registered for it\n", t->name, event);
+			continue;
+		}
 
-			ctx->recursion--;
+		// First generate the target path
+		// (It is important this comes first, since we might refer to the generated
+		// path later, either inside the template itself, but most importantly we
+		// want to be able to pass the path to an external program).
+		if (args->template_output_path
+		 && catcierge_output_generate_template_path(ctx, grb, t))
+		{
+			ret = -1; continue;
+		}
 
-			reslen = strlen(res);
+		// Output that only goes to a file is streamed straight into it.
+		if (!t->settings.nofile && !catcierge_output_publishes_template(grb, t)
+		 && !(f = catcierge_output_open_template(t)))
+		{
+			ret = -1; continue;
+		}
 
-			// Make sure we have enough room.
-			if (!(output = catcierge_output_realloc_if_needed(output, (len + reslen + 1), &out_len)))
-			{
-				goto fail;
-			}
+		mark = catcierge_arena_mark(&ctx->arena);
+		sink_mark = catcierge_arena_mark(&ctx->sink_arena);
 
-			// Append the variable to the output.
-			resit = res;
-			while (*resit)
-			{
-				output[len] = *resit++;
-				len++;
-			}
+		// And then generate the template contents.
+		if (catcierge_output_segments_init(&segs, &ctx->sink_arena, f)
+		 || catcierge_output_render_to(ctx, grb, &t->prog, &segs.sink)
+		 || catcierge_output_segments_flush(&segs))
+		{
+			CATERR("Failed to generate output for template \"%s\"\n", t->settings.filename);
+			ret = -1;
 
-			if (res_is_alloc)
+			// Don't leave a half written file behind.
+			if (f)
 			{
-				catcierge_xfree(&res);
+				fclose(f);
+				f = NULL;
+				remove(t->generated_path);
 			}
 		}
-		else
+		else if (!f && catcierge_output_write_template(grb, t, &segs))
 		{
-			// Make sure we have enough room.
-			if (!(output = catcierge_output_realloc_if_needed(output, (len + 1), &out_len)))
-			{
-				goto fail;
-			}
+			ret = -1;
+		}
 
-			output[len] = *it++;
-			len++;
+		catcierge_arena_release(&ctx->sink_arena, sink_mark);
+		catcierge_arena_release(&ctx->arena, mark);
+
+		if (f)
+		{
+			fclose(f);
+			f = NULL;
 		}
 	}
 
-	output[len] = '\0';
+	ctx->template_idx = -1;
 
-fail:
-	if (tmp)
-		free(tmp);
+	return ret;
+}
 
-	return output;
+int catcierge_output_generate_templates(catcierge_output_t *ctx,
+	catcierge_grb_t *grb, const char *event)
+{
+	assert(event);
+
+	return catcierge_output_generate_event_templates(ctx, grb,
+			catcierge_output_event_bit(event));
 }
 
-int catcierge_output_validate(catcierge_output_t *ctx,
-	catcierge_grb_t *grb, const char *template_str)
+#ifdef CATCIERGE_HAVE_PTHREADS
+//
+// With --output_threads the FSM only takes a snapshot of the state when an
+// event happens and queues it. A single thread takes the events in order,
+// generates the template paths, renders the template contents in parallel on
+// the render threads and then writes them and runs the commands in order.
+// The variables of the templates are resolved once after the paths have been
+// generated, and the render threads share those values.
+//
+
+typedef struct catcierge_output_event_s
 {
-	int is_valid = 0;
-	char *output = catcierge_output_generate(ctx, grb, template_str);
-	is_valid = (output != NULL);
+	catcierge_grb_t grb;		// Snapshot of the state when the event happened.
+	char *event;
+	uint32_t event_bit;
+	char **commands;			// Owned by the args.
+	size_t command_count;
+	catcierge_workers_t *renderers;
+} catcierge_output_event_t;
+
+typedef struct catcierge_output_render_task_s
+{
+	catcierge_grb_t grb;		// Each render thread needs its own output context.
+	catcierge_output_template_t *t;
+	size_t idx;
+	catcierge_output_segments_t segs; // The output, written by the event thread.
+	int failed;
+} catcierge_output_render_task_t;
+
+// Sets up the parts of a copied output context that can't be shared.
+// The cache is kept, a render task looks up the values of the event in it
+// and adds whatever is missing to the front of its own copy of the slots.
+static void catcierge_output_context_copy_init(catcierge_output_t *o)
+{
+	o->template_idx = -1;
+	o->recursion = 0;
+	o->recursion_error = 0;
+	o->no_relative_path = 0;
+	o->loop_vars = NULL;
+	o->snapshot = 1;
+	catcierge_arena_init(&o->event_arena, 0);
+	catcierge_arena_init(&o->arena, 0);
+	catcierge_arena_init(&o->sink_arena, 0);
+	o->events = NULL;
+	o->renderers = NULL;
+}
+
+static void catcierge_output_event_destroy(catcierge_output_event_t *ev)
+{
+	catcierge_output_t *o = NULL;
+
+	if (!ev)
+		return;
 
-	if (output)
-		free(output);
+	o = &ev->grb.output;
 
-	return is_valid;
+	if (o->templates)
+	{
+		catcierge_output_free_generated_paths(o);
+		free(o->templates);
+	}
+
+	catcierge_arena_destroy(&o->event_arena);
+	catcierge_arena_destroy(&o->arena);
+	catcierge_arena_destroy(&o->sink_arena);
+
+	catcierge_encoded_images_release(&ev->grb.match_group);
+	catcierge_xfree(&ev->grb.match_group.matches);
+	catcierge_xfree(&ev->event);
+	free(ev);
 }
 
-static char *catcierge_replace_whitespace(char *path, char *extra_chars)
+static catcierge_output_event_t *catcierge_output_event_create(catcierge_grb_t *grb,
+		const char *event, uint32_t event_bit, char **commands, size_t command_count)
 {
-	char *p = path;
-	char *e = NULL;
+	size_t i;
+	catcierge_output_t *ctx = &grb->output;
+	catcierge_output_t *o = NULL;
+	match_group_t *mg = NULL;
+	catcierge_output_event_t *ev = NULL;
 
-	while (*p)
+	if (!(ev = calloc(1, sizeof(catcierge_output_event_t))))
 	{
-		if ((*p == ' ') || (*p == '\t') || (*p == '\n'))
+		CATERR("Out of memory\n"); return NULL;
+	}
+
+	ev->grb = *grb;
+	ev->event_bit = event_bit;
+	ev->commands = commands;
+	ev->command_count = command_count;
+	ev->renderers = ctx->renderers;
+
+	// The values cached by the FSM live in its event arena.
+	o = &ev->grb.output;
+	o->cache_count = 0;
+	memset(o->cache, 0, sizeof(o->cache));
+	catcierge_output_context_copy_init(o);
+	catcierge_clock_gettimeofday(&o->event_tv);
+	o->templates = NULL;
+
+	// The images are never part of the output.
+	ev->grb.img = NULL;
+	mg = &ev->grb.match_group;
+	mg->obstruct_img = NULL;
+	mg->obstruct_encoded = NULL;
+	mg->matches = NULL;
+
+	if (!(ev->event = strdup(event)))
+	{
+		CATERR("Out of memory\n"); goto fail;
+	}
+
+	// The FSM reuses the matches for the next match group, so they are copied.
+	// (The step images are only checked for NULL, never used).
+	if (grb->match_group.max_count)
+	{
+		if (!(mg->matches = calloc(mg->max_count, sizeof(match_state_t))))
 		{
-			*p = '_';
+			CATERR("Out of memory\n"); goto fail;
 		}
 
-		if (extra_chars)
-		{
-			e = extra_chars;
-			while (*e)
-			{
-				if (*p == *e)
-				{
-					*p = '_';
-				}
+		memcpy(mg->matches, grb->match_group.matches,
+			mg->max_count * sizeof(match_state_t));
 
-				e++;
-			}
+		for (i = 0; i < mg->max_count; i++)
+		{
+			mg->matches[i].img = NULL;
 		}
+	}
 
-		p++;
+	// The encoded images are shared.
+	catcierge_encoded_images_ref(mg);
+	mg->obstruct_encoded = catcierge_encoded_image_ref(grb->match_group.obstruct_encoded);
+
+	// The compiled templates are shared, but each event has its own generated paths.
+	if (!(o->templates = calloc(ctx->template_count ? ctx->template_count : 1,
+		sizeof(catcierge_output_template_t))))
+	{
+		CATERR("Out of memory\n"); goto fail;
 	}
 
-	return 0;
+	memcpy(o->templates, ctx->templates,
+		ctx->template_count * sizeof(catcierge_output_template_t));
+	o->template_max_count = ctx->template_count;
+
+	for (i = 0; i < o->template_count; i++)
+	{
+		o->templates[i].generated_path = NULL;
+	}
+
+	return ev;
+fail:
+	catcierge_output_event_destroy(ev);
+	return NULL;
 }
 
-static void catcierge_output_free_generated_paths(catcierge_output_t *ctx)
+static void catcierge_output_render_task_main(void *arg)
 {
-	size_t i;
-	catcierge_output_template_t *t = NULL;
-	assert(ctx);
+	catcierge_output_render_task_t *task = (catcierge_output_render_task_t *)arg;
+	catcierge_output_t *o = &task->grb.output;
 
-	for (i = 0; i < ctx->template_count; i++)
-	{
-		t = &ctx->templates[i];
+	o->template_idx = task->idx;
 
-		if (t->generated_path)
-		{
-			free(t->generated_path);
-			t->generated_path = NULL;
-		}
+	if (catcierge_output_segments_init(&task->segs, &o->sink_arena, NULL)
+	 || catcierge_output_render_to(o, &task->grb, &task->t->prog, &task->segs.sink))
+	{
+		CATERR("Failed to generate output for template \"%s\"\n", task->t->settings.filename);
+		task->failed = 1;
 	}
+
+	o->template_idx = -1;
 }
 
-int catcierge_output_template_registered_to_event(catcierge_output_template_t *t, const char *event)
+// Resolves the variables used by the render tasks once, so that they can share
+// the values without locking. Only the top level of each template is resolved,
+// since a for or if body might never be rendered.
+static void catcierge_output_event_fill_cache(catcierge_grb_t *grb,
+		catcierge_output_render_task_t *tasks, size_t count)
 {
 	size_t i;
-	assert(t);
-	assert(event);
+	size_t j;
+	char buf[4096];
+	catcierge_output_t *o = &grb->output;
+	catcierge_output_program_t *prog = NULL;
+	catcierge_output_node_t *node = NULL;
 
-	for (i = 0; i < t->settings.event_filter_count; i++)
+	for (i = 0; i < count; i++)
 	{
-		if (!strcmp(t->settings.event_filter[i], "all")
-		 || !strcmp(t->settings.event_filter[i], "*"))
-		{
-			return 1;
-		}
+		o->template_idx = tasks[i].idx;
+		prog = &tasks[i].t->prog;
 
-		if (!strcmp(t->settings.event_filter[i], event))
+		for (j = 0; j < prog->count; j++)
 		{
-			return 1;
+			node = &prog->nodes[j];
+
+			if ((node->type == CATCIERGE_OUTPUT_NODE_VAR) && !node->inner_vars
+			 && (node->ref.id != CATCIERGE_VAR_UNKNOWN)
+			 && !(node->ref.flags & CATCIERGE_VAR_VOLATILE))
+			{
+				catcierge_output_translate_cached(grb, &node->ref, buf, sizeof(buf));
+			}
 		}
 	}
 
-	return 0;
+	o->template_idx = -1;
 }
 
-int catcierge_output_generate_templates(catcierge_output_t *ctx,
-	catcierge_grb_t *grb, const char *event)
+static void catcierge_output_event_main(void *arg)
 {
-	catcierge_output_template_t *t = NULL;
-	catcierge_args_t *args = &grb->args;
-	char *output = NULL;
-	char *path = NULL;
-	char full_path[4096];
-	char *dir = NULL;
-	char *gen_output_path = NULL;
 	size_t i;
+	size_t count = 0;
 	int ret = 0;
-	FILE *f = NULL;
-	assert(ctx);
-	assert(grb);
+	catcierge_output_event_t *ev = (catcierge_output_event_t *)arg;
+	catcierge_grb_t *grb = &ev->grb;
+	catcierge_output_t *o = &grb->output;
+	catcierge_output_template_t *t = NULL;
+	catcierge_output_render_task_t *tasks = NULL;
+	catcierge_output_render_task_t *task = NULL;
+	catcierge_workers_group_t group;
 
-	if (!args->template_output_path && args->output_path)
+	catcierge_output_publish_cbor(grb, ev->event_bit);
+	catcierge_output_publish_images(grb, ev->event_bit);
+
+	if (!(tasks = calloc(o->template_count ? o->template_count : 1,
+		sizeof(catcierge_output_render_task_t))))
 	{
-		if (!(args->template_output_path = strdup(args->output_path)))
-		{
-			CATERR("Out of memory");
-			return -1;
-		}
+		CATERR("Out of memory\n"); ret = -1; goto fail;
 	}
 
-	catcierge_output_free_generated_paths(ctx);
-
-	for (i = 0; i < ctx->template_count; i++)
+	// All the paths are generated before any contents,
+	// since the templates can refer to each others paths.
+	for (i = 0; i < o->template_count; i++)
 	{
-		ctx->template_idx = i;
-		t = &ctx->templates[i];
+		o->template_idx = i;
+		t = &o->templates[i];
 
-		// Filter out any events that don't have the current "event" in their list.
-		if (!catcierge_output_template_registered_to_event(t, event))
+		if (!catcierge_output_template_registered_to_event(t, ev->event_bit))
 		{
-			//CATLOG("  Skip template %s because event %s not registered for it\n", t->name, event);
 			continue;
 		}
 
-		// First generate the target path
-		// (It is important this comes first, since we might refer to the generated
-		// path later, either inside the template itself, but most importantly we
-		// want to be able to pass the path to an external program).
-		if (args->template_output_path)
+		if (grb->args.template_output_path
+		 && catcierge_output_generate_template_path(o, grb, t))
 		{
-			// Generate the output path.
-			if (!(gen_output_path = catcierge_output_generate(&grb->output,
-					grb, args->template_output_path)))
-			{
-				CATERR("Failed to generate output path from: \"%s\"\n", args->template_output_path);
-				ret = -1; goto fail_template;
-			}
-
-			if (catcierge_make_path(gen_output_path))
-			{
-				CATERR("Failed to create directory %s\n", gen_output_path);
-			}
+			ret = -1; continue;
+		}
 
-			// Generate the filename.
-			if (!(path = catcierge_output_generate(ctx, grb, t->settings.filename)))
-			{
-				CATERR("Failed to generate output path for template \"%s\"\n", t->settings.filename);
-				ret = -1; goto fail_template;
-			}
+		task = &tasks[count++];
+		task->t = t;
+		task->idx = i;
+	}
 
-			// Replace whitespace with underscore.
-			catcierge_replace_whitespace(path, ":");
+	o->template_idx = -1;
 
-			// Assemble the full output path.
-			snprintf(full_path, sizeof(full_path), "%s%s%s",
-				gen_output_path, catcierge_path_sep(), path);
+	// After the paths, since a rootpath can refer to the generated paths.
+	catcierge_output_event_fill_cache(grb, tasks, count);
 
-			// We make a copy so that we can use the generated
-			// path as a variable in the templates contents, or
-			// when passed to catcierge_execute. 
-			if (!(t->generated_path = strdup(full_path)))
-			{
-				CATERR("Out of memory!\n"); ret = -1; goto fail_template;
-			}
-		}
+	catcierge_workers_group_init(&group);
 
-		// And then generate the template contents.
-		if (!(output = catcierge_output_generate(ctx, grb, t->tmpl)))
-		{
-			CATERR("Failed to generate output for template \"%s\"\n", t->settings.filename);
-			ret = -1; goto fail_template;
-		}
+	for (i = 0; i < count; i++)
+	{
+		task = &tasks[i];
+		task->grb = *grb;
+		catcierge_output_context_copy_init(&task->grb.output);
 
-		#ifdef WITH_ZMQ
-		if (grb->args.zmq && grb->zmq_pub && !t->settings.nozmq)
+		if (catcierge_workers_group_add(ev->renderers, &group,
+				catcierge_output_render_task_main, task))
 		{
-			CATLOG("ZMQ Publish topic %s, %d bytes\n", t->settings.topic, strlen(output));
-			zstr_sendm(grb->zmq_pub, t->settings.topic);
-			zstr_send(grb->zmq_pub, output);
+			catcierge_output_render_task_main(task);
 		}
-		#endif // WITH_ZMQ
+	}
 
-		if (!t->settings.nofile)
-		{
-			CATLOG("Generate template: %s\n", full_path);
+	catcierge_workers_group_wait(ev->renderers, &group);
 
-			if (!(f = fopen(full_path, "w")))
-			{
-				CATERR("Failed to open template output file \"%s\" for writing\n", full_path);
-				ret = -1; goto fail_template;
-			}
-			else
-			{
-				size_t len = strlen(output);
-				size_t written = fwrite(output, sizeof(char), len, f);
-				fclose(f);
-			}
-		}
+	// Written in the same order as the templates were loaded.
+	for (i = 0; i < count; i++)
+	{
+		task = &tasks[i];
 
-fail_template:
-		if (output)
+		if (task->failed || catcierge_output_write_template(grb, task->t, &task->segs))
 		{
-			free(output);
-			output = NULL;
+			ret = -1;
 		}
 
-		if (path)
-		{
-			free(path);
-			path = NULL;
-		}
+		catcierge_arena_destroy(&task->grb.output.event_arena);
+		catcierge_arena_destroy(&task->grb.output.arena);
+		catcierge_arena_destroy(&task->grb.output.sink_arena);
+	}
 
-		if (gen_output_path)
-		{
-			free(gen_output_path);
-			gen_output_path = NULL;
-		}
+	if (ret)
+	{
+		CATERR("Failed to generate templates on execute!\n");
+		goto fail;
 	}
 
-	ctx->template_idx = -1;
+	for (i = 0; i < ev->command_count; i++)
+	{
+		catcierge_output_execute(grb, ev->event, ev->commands[i]);
+	}
 
-	return ret;
+fail:
+	catcierge_xfree(&tasks);
+	catcierge_output_event_destroy(ev);
+}
+
+static int catcierge_output_has_event_output(catcierge_output_t *ctx,
+		uint32_t event_bit, size_t command_count)
+{
+	return (command_count > 0) || (ctx->event_mask & event_bit) || ctx->publish_cbor
+		|| (ctx->publish_images && (event_bit == CATCIERGE_EVENT_BIT(CATCIERGE_MATCH_GROUP_DONE)));
+}
+
+#endif // CATCIERGE_HAVE_PTHREADS
+
+void catcierge_output_flush(catcierge_output_t *ctx)
+{
+	assert(ctx);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (ctx->events)
+	{
+		catcierge_workers_wait(ctx->events);
+	}
+	#endif
 }
 
 int catcierge_output_load_template(catcierge_output_t *ctx, char *path)
@@ -2435,21 +3773,72 @@ int catcierge_output_load_templates(catcierge_output_t *ctx,
 	return ret;
 }
 
-void catcierge_output_execute_list(catcierge_grb_t *grb,
-		const char *event, char **commands, size_t command_count)
+static void catcierge_output_execute_event_bit(catcierge_grb_t *grb,
+		const char *event, uint32_t event_bit, char **commands, size_t command_count)
 {
 	size_t i;
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	catcierge_output_event_t *ev = NULL;
 
-	if (catcierge_output_generate_templates(&grb->output, grb, event))
+	if (grb->output.events)
 	{
-		CATERR("Failed to generate templates on execute!\n");
+		if (!catcierge_output_has_event_output(&grb->output, event_bit, command_count))
+		{
+			return;
+		}
+
+		// Paths that are defaulted when generating are set up before the snapshot.
+		if (catcierge_output_default_template_path(&grb->args))
+		{
+			return;
+		}
+
+		if (!(ev = catcierge_output_event_create(grb, event, event_bit, commands, command_count))
+		 || catcierge_workers_add(grb->output.events, catcierge_output_event_main, ev))
+		{
+			CATERR("Failed to queue output for event %s\n", event);
+			catcierge_output_event_destroy(ev);
+		}
+
 		return;
 	}
+	#endif // CATCIERGE_HAVE_PTHREADS
+
+	// Variables are only resolved once for all templates and commands.
+	catcierge_output_snapshot_begin(&grb->output);
+
+	catcierge_output_publish_cbor(grb, event_bit);
+	catcierge_output_publish_images(grb, event_bit);
+
+	if (catcierge_output_generate_event_templates(&grb->output, grb, event_bit))
+	{
+		CATERR("Failed to generate templates on execute!\n");
+		goto fail;
+	}
 
 	for (i = 0; i < command_count; i++)
 	{
 		catcierge_output_execute(grb, event, commands[i]);
 	}
+
+fail:
+	catcierge_output_snapshot_end(&grb->output);
+}
+
+void catcierge_output_execute_list(catcierge_grb_t *grb,
+		const char *event, char **commands, size_t command_count)
+{
+	assert(event);
+
+	catcierge_output_execute_event_bit(grb, event,
+		catcierge_output_event_bit(event), commands, command_count);
+}
+
+void catcierge_output_execute_event(catcierge_grb_t *grb,
+		catcierge_event_t e, char **commands, size_t command_count)
+{
+	catcierge_output_execute_event_bit(grb, catcierge_event_name(e),
+		CATCIERGE_EVENT_BIT(e), commands, command_count);
 }
 
 void catcierge_output_execute(catcierge_grb_t *grb,
@@ -2468,7 +3857,16 @@ void catcierge_output_execute(catcierge_grb_t *grb,
 		return;
 	}
 
-	catcierge_run(generated_cmd);
+	#ifndef _WIN32
+	if (grb->output.exec)
+	{
+		catcierge_exec_run(grb->output.exec, generated_cmd);
+	}
+	else
+	#endif
+	{
+		catcierge_run(generated_cmd);
+	}
 
 	free(generated_cmd);
 }
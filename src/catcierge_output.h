@@ -31,15 +31,53 @@ void catcierge_output_print_usage();
 int catcierge_output_init(catcierge_grb_t *grb, catcierge_output_t *ctx);
 void catcierge_output_destroy(catcierge_output_t *ctx);
 
+// While a snapshot is active variable values are cached on first use,
+// so that all templates and commands for an event see the same values.
+void catcierge_output_snapshot_begin(catcierge_output_t *ctx);
+void catcierge_output_snapshot_end(catcierge_output_t *ctx);
+
 int catcierge_output_add_template(catcierge_output_t *ctx,
 		const char *template_str, const char *filename);
 
 char *catcierge_output_generate(catcierge_output_t *ctx, catcierge_grb_t *grb,
 		const char *template_str);
 
+// Compiles a template once so that it can be rendered
+// many times without being parsed again.
+int catcierge_output_compile(catcierge_output_program_t *prog,
+		const char *template_str);
+
+void catcierge_output_program_destroy(catcierge_output_program_t *prog);
+
+char *catcierge_output_render(catcierge_output_t *ctx, catcierge_grb_t *grb,
+		catcierge_output_program_t *prog);
+
+// Renders into a sink piece by piece instead of returning a string.
+int catcierge_output_render_to(catcierge_output_t *ctx, catcierge_grb_t *grb,
+		catcierge_output_program_t *prog, catcierge_output_sink_t *sink);
+
 int catcierge_output_generate_templates(catcierge_output_t *ctx,
 		catcierge_grb_t *grb, const char *event);
 
+#define CATCIERGE_OUTPUT_CBOR_SCHEMA 1
+#define CATCIERGE_OUTPUT_CBOR_TOPIC "cbor/"
+#define CATCIERGE_OUTPUT_IMAGES_TOPIC "images/"
+
+struct catcierge_cbor_s;
+
+// Encodes the event and the current match group as CBOR, this is published
+// on the topic CATCIERGE_OUTPUT_CBOR_TOPIC<event> when --zmq_cbor is used.
+// See catcierge_output_cbor.c for the layout.
+int catcierge_output_encode_cbor(catcierge_grb_t *grb,
+		catcierge_event_t e, struct catcierge_cbor_s *c);
+
+// IDs are written as the 20 byte SHA1 digest.
+void catcierge_output_cbor_sha(struct catcierge_cbor_s *c, SHA1Context *sha);
+
+// Waits until the output for all events so far has been generated,
+// when it is generated in the background (--output_threads).
+void catcierge_output_flush(catcierge_output_t *ctx);
+
 int catcierge_output_load_template(catcierge_output_t *ctx, char *path);
 
 int catcierge_output_load_templates(catcierge_output_t *ctx,
@@ -48,9 +86,24 @@ int catcierge_output_load_templates(catcierge_output_t *ctx,
 const char *catcierge_output_translate(catcierge_grb_t *grb,
 	char *buf, size_t bufsize, const char *var);
 
+// Builds the table used to resolve variable names, done by catcierge_output_init.
+int catcierge_output_vars_init();
+
+// Resolves a variable name into an ID. Returns -1 and leaves the ID as
+// CATCIERGE_VAR_UNKNOWN for names that aren't built in (user variables).
+// The reference points into name, so it must outlive it.
+int catcierge_output_var_parse(catcierge_output_var_ref_t *ref, const char *name);
+
+const char *catcierge_output_translate_ref(catcierge_grb_t *grb,
+	char *buf, size_t bufsize, const catcierge_output_var_ref_t *ref);
+
 void catcierge_output_execute_list(catcierge_grb_t *grb,
 		const char *event, char **commands, size_t command_count);
 
+// Generates the templates registered to the event and runs its commands.
+void catcierge_output_execute_event(catcierge_grb_t *grb,
+		catcierge_event_t e, char **commands, size_t command_count);
+
 void catcierge_output_execute(catcierge_grb_t *grb,
 		const char *event, const char *command);
 
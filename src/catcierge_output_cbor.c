@@ -0,0 +1,183 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "catcierge_config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "catcierge_output.h"
+#include "catcierge_fsm.h"
+#include "catcierge_bus.h"
+#include "catcierge_clock.h"
+#include "catcierge_cbor.h"
+
+//
+// Binary version of the event data, encoded straight from the match group
+// so that subscribers don't need to parse rendered JSON templates.
+// Any change to the layout below must bump CATCIERGE_OUTPUT_CBOR_SCHEMA.
+//
+// {
+//   "schema": 1,
+//   "event": "match_group_done",
+//   "time": <seconds since epoch>,
+//   "state": "Waiting", "prev_state": "Matching",
+//   "match_group": {
+//     "id": <20 byte SHA1>, "start_time": .., "end_time": ..,
+//     "success": true, "success_count": 3, "final_decision": false,
+//     "early_decision": false, "direction": 0, "description": "..",
+//     "obstruct_path": ".." or null,
+//     "matches": [
+//       {
+//         "id": <20 byte SHA1>, "time": .., "success": true, "result": 0.9,
+//         "direction": 0, "description": "..", "path": ".." or null,
+//         "steps": [ { "name": "..", "description": "..", "path": ".." or null } ]
+//       }
+//     ]
+//   }
+// }
+//
+
+static double catcierge_cbor_tv_seconds(const struct timeval *tv)
+{
+	return (double)tv->tv_sec + ((double)tv->tv_usec / 1000000.0);
+}
+
+void catcierge_output_cbor_sha(catcierge_cbor_t *c, SHA1Context *sha)
+{
+	int i;
+	uint8_t digest[20];
+
+	for (i = 0; i < 5; i++)
+	{
+		digest[i * 4 + 0] = (uint8_t)(sha->Message_Digest[i] >> 24);
+		digest[i * 4 + 1] = (uint8_t)(sha->Message_Digest[i] >> 16);
+		digest[i * 4 + 2] = (uint8_t)(sha->Message_Digest[i] >> 8);
+		digest[i * 4 + 3] = (uint8_t)(sha->Message_Digest[i]);
+	}
+
+	catcierge_cbor_bytes(c, digest, sizeof(digest));
+}
+
+// Paths are only set when the images are saved.
+static void catcierge_cbor_path(catcierge_cbor_t *c, catcierge_path_t *path)
+{
+	catcierge_cbor_text(c, *path->full ? path->full : NULL);
+}
+
+static void catcierge_output_cbor_match(catcierge_cbor_t *c, match_state_t *m)
+{
+	size_t i;
+	match_step_t *step = NULL;
+	match_result_t *res = &m->result;
+
+	catcierge_cbor_map(c, 8);
+	catcierge_cbor_text(c, "id");
+	catcierge_output_cbor_sha(c, &m->sha);
+	catcierge_cbor_text(c, "time");
+	catcierge_cbor_double(c, catcierge_cbor_tv_seconds(&m->tv));
+	catcierge_cbor_text(c, "success");
+	catcierge_cbor_bool(c, res->success);
+	catcierge_cbor_text(c, "result");
+	catcierge_cbor_double(c, res->result);
+	catcierge_cbor_text(c, "direction");
+	catcierge_cbor_int(c, res->direction);
+	catcierge_cbor_text(c, "description");
+	catcierge_cbor_text(c, res->description);
+	catcierge_cbor_text(c, "path");
+	catcierge_cbor_path(c, &m->path);
+
+	catcierge_cbor_text(c, "steps");
+	catcierge_cbor_array(c, res->step_img_count);
+
+	for (i = 0; i < res->step_img_count; i++)
+	{
+		step = &res->steps[i];
+		catcierge_cbor_map(c, 3);
+		catcierge_cbor_text(c, "name");
+		catcierge_cbor_text(c, step->name);
+		catcierge_cbor_text(c, "description");
+		catcierge_cbor_text(c, step->description);
+		catcierge_cbor_text(c, "path");
+		catcierge_cbor_path(c, &step->path);
+	}
+}
+
+int catcierge_output_encode_cbor(catcierge_grb_t *grb,
+		catcierge_event_t e, catcierge_cbor_t *c)
+{
+	size_t i;
+	size_t match_count;
+	struct timeval tv;
+	match_group_t *mg = NULL;
+	assert(grb);
+	assert(c);
+
+	mg = &grb->match_group;
+	match_count = mg->matches ? mg->match_count : 0;
+
+	// Output generated in the background uses the time of the event.
+	if (grb->output.event_tv.tv_sec)
+		tv = grb->output.event_tv;
+	else
+		catcierge_clock_gettimeofday(&tv);
+
+	catcierge_cbor_map(c, 6);
+	catcierge_cbor_text(c, "schema");
+	catcierge_cbor_uint(c, CATCIERGE_OUTPUT_CBOR_SCHEMA);
+	catcierge_cbor_text(c, "event");
+	catcierge_cbor_text(c, catcierge_event_name(e));
+	catcierge_cbor_text(c, "time");
+	catcierge_cbor_double(c, catcierge_cbor_tv_seconds(&tv));
+	catcierge_cbor_text(c, "state");
+	catcierge_cbor_text(c, catcierge_get_state_string(grb->state));
+	catcierge_cbor_text(c, "prev_state");
+	catcierge_cbor_text(c, catcierge_get_state_string(grb->prev_state));
+
+	catcierge_cbor_text(c, "match_group");
+	catcierge_cbor_map(c, 11);
+	catcierge_cbor_text(c, "id");
+	catcierge_output_cbor_sha(c, &mg->sha);
+	catcierge_cbor_text(c, "start_time");
+	catcierge_cbor_double(c, catcierge_cbor_tv_seconds(&mg->start_tv));
+	catcierge_cbor_text(c, "end_time");
+	catcierge_cbor_double(c, catcierge_cbor_tv_seconds(&mg->end_tv));
+	catcierge_cbor_text(c, "success");
+	catcierge_cbor_bool(c, mg->success);
+	catcierge_cbor_text(c, "success_count");
+	catcierge_cbor_int(c, mg->success_count);
+	catcierge_cbor_text(c, "final_decision");
+	catcierge_cbor_bool(c, mg->final_decision);
+	catcierge_cbor_text(c, "early_decision");
+	catcierge_cbor_bool(c, mg->early_decision);
+	catcierge_cbor_text(c, "direction");
+	catcierge_cbor_int(c, mg->direction);
+	catcierge_cbor_text(c, "description");
+	catcierge_cbor_text(c, mg->description);
+	catcierge_cbor_text(c, "obstruct_path");
+	catcierge_cbor_path(c, &mg->obstruct_path);
+
+	catcierge_cbor_text(c, "matches");
+	catcierge_cbor_array(c, match_count);
+
+	for (i = 0; i < match_count; i++)
+	{
+		catcierge_output_cbor_match(c, &mg->matches[i]);
+	}
+
+	return c->failed ? -1 : 0;
+}
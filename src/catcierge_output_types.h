@@ -20,7 +20,9 @@
 #define __CATCIERGE_OUTPUT_TYPES_H__
 
 #include <stdio.h>
+#include <stdint.h>
 #include "catcierge_types.h"
+#include "catcierge_arena.h"
 #include "uthash.h"
 
 #define CATCIERGE_OUTPUT_MAX_RECURSION 20
@@ -31,6 +33,7 @@ typedef struct catcierge_output_settings_s
 	char *name;
 	char **event_filter;
 	size_t event_filter_count;
+	uint32_t event_mask; // The event filter as CATCIERGE_EVENT_BIT's.
 	int nofile;
 	char *filename;
 	char *rootpath; // Path all templates are relative to. Default is cwd.
@@ -42,12 +45,87 @@ typedef struct catcierge_output_settings_s
 	#endif
 } catcierge_output_settings_t;
 
+// The variable can be followed by :<arg> or |<path operations>.
+#define CATCIERGE_VAR_SUFFIX (1 << 0)
+// The value depends on the template being generated (relative paths).
+#define CATCIERGE_VAR_PATH (1 << 1)
+// The value can change between the templates of the same event.
+#define CATCIERGE_VAR_VOLATILE (1 << 2)
+
+#define CATCIERGE_DEFINE_VAR(var_id, var_name, var_flags) \
+	var_id,
+
+typedef enum catcierge_output_var_id_e
+{
+	CATCIERGE_VAR_UNKNOWN = 0, // User defined variables, loop variables.
+	#include "catcierge_output_vars.h"
+	CATCIERGE_VAR_COUNT
+} catcierge_output_var_id_t;
+
+// A variable name resolved into an ID and its indices, so that it
+// doesn't have to be looked up by name every time it is rendered.
+typedef struct catcierge_output_var_ref_s
+{
+	catcierge_output_var_id_t id;
+	int flags;
+	const char *name;	// The full variable name.
+	const char *suffix;	// Whatever follows the name, ":<arg>" or "|<path ops>".
+	int idx;			// 0-based # in match#_ and snout#.
+	int step_idx;		// 0-based # in step#_.
+	int current;		// matchcur_ instead of match#_.
+} catcierge_output_var_ref_t;
+
+typedef enum catcierge_output_node_type_e
+{
+	CATCIERGE_OUTPUT_NODE_TEXT,	// Literal text.
+	CATCIERGE_OUTPUT_NODE_VAR,	// %var%
+	CATCIERGE_OUTPUT_NODE_FOR,	// %for i in 1..4% ... %endfor%
+	CATCIERGE_OUTPUT_NODE_IF	// %if a != b% ... %endif%
+} catcierge_output_node_type_t;
+
+// A compiled template.
+typedef struct catcierge_output_program_s
+{
+	struct catcierge_output_node_s *nodes;
+	size_t count;
+	size_t max_count;
+	catcierge_arena_t *arena; // If set all nodes are allocated from this.
+} catcierge_output_program_t;
+
+typedef struct catcierge_output_node_s
+{
+	catcierge_output_node_type_t type;
+	char *str;			// Text, variable name or the for/if expression.
+	size_t len;
+	int inner_vars;		// str contains $var$ that are expanded when rendering.
+	catcierge_output_var_ref_t ref; // Resolved variable, unless inner_vars is set.
+	size_t linenum;
+	catcierge_output_program_t body; // Loop or if body.
+} catcierge_output_node_t;
+
+// Receives the rendered output piece by piece, so that it can be written
+// somewhere without first being joined into one string.
+typedef struct catcierge_output_sink_s catcierge_output_sink_t;
+
+// Literal pieces point into the compiled template and stay valid for as
+// long as it does, other pieces are only valid during the call.
+typedef int (*catcierge_output_sink_write_f)(catcierge_output_sink_t *sink,
+		const char *str, size_t len, int literal);
+
+struct catcierge_output_sink_s
+{
+	catcierge_output_sink_write_f write;
+	size_t len; // Bytes written so far.
+};
+
 typedef struct catcierge_output_template_s
 {
 	char *tmpl;
 	char *generated_path;	// The last generated path.
 	char *name;
 	catcierge_output_settings_t settings;
+	catcierge_output_program_t prog;			// Compiled tmpl.
+	catcierge_output_program_t filename_prog;	// Compiled settings.filename.
 } catcierge_output_template_t;
 
 typedef struct catcierge_output_invar_s
@@ -57,12 +135,31 @@ typedef struct catcierge_output_invar_s
 	UT_hash_handle hh;
 } catcierge_output_invar_t;
 
+// A for loop variable, only valid while the loop body is rendered.
+typedef struct catcierge_output_loop_var_s
+{
+	const char *name;
+	const char *value;
+	struct catcierge_output_loop_var_s *next;
+} catcierge_output_loop_var_t;
+
+// A variable value saved for the rest of the event.
+typedef struct catcierge_output_cached_var_s
+{
+	char *key;
+	char *value;
+	struct catcierge_output_cached_var_s *next;
+} catcierge_output_cached_var_t;
+
+#define CATCIERGE_OUTPUT_CACHE_SIZE 256
+
 typedef struct catcierge_output_s
 {
 	char *input_path;
 	catcierge_output_template_t *templates;
 	size_t template_count;
 	size_t template_max_count;
+	uint32_t event_mask; // Events that any template is registered to.
 	int template_idx; // Index of template currently being parsed.
 	int recursion;
 	int recursion_error;
@@ -70,6 +167,19 @@ typedef struct catcierge_output_s
 						  // running catcierge_output_generate when generating
 						  // relative paths :)
 	catcierge_output_invar_t *vars; // Hash table.
+	catcierge_output_loop_var_t *loop_vars; // Innermost loop first.
+	int snapshot; // Cache variable values while generating an event.
+	size_t cache_count;
+	catcierge_output_cached_var_t *cache[CATCIERGE_OUTPUT_CACHE_SIZE];
+	catcierge_arena_t event_arena; // Cached values, reset after each event.
+	catcierge_arena_t arena; // Temporary memory used while rendering.
+	catcierge_arena_t sink_arena; // Variable values in output that is written piece by piece.
+	struct timeval event_tv; // When the event happened, if generated in the background.
+	struct catcierge_workers_s *events;		// Generates one event at a time (--output_threads).
+	struct catcierge_workers_s *renderers;	// Renders the templates of an event in parallel.
+	struct catcierge_exec_s *exec;			// Runs the commands, if not set each command is forked.
+	int publish_cbor;						// Publish every event as CBOR (--zmq_cbor).
+	int publish_images;						// Publish the saved images (--zmq_images).
 } catcierge_output_t;
 
 #endif // __CATCIERGE_OUTPUT_TYPES_H__
@@ -0,0 +1,117 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Note this file should only include calls to CATCIERGE_DEFINE_VAR
+// since it is meant to be included in multiple files.
+//
+// The names are the variable names used in the templates, with any
+// index such as match2_step3_path written as #. Variables flagged with
+// CATCIERGE_VAR_SUFFIX can be followed by :<arg> or |<path operations>.
+// CATCIERGE_VAR_PATH variables depend on the template being generated
+// and CATCIERGE_VAR_VOLATILE ones can change while an event is generated.
+//
+
+#ifndef CATCIERGE_DEFINE_VAR
+#error "CATCIERGE_DEFINE_VAR must be defined when " __file__ " is included"
+#endif
+
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TEMPLATE_PATH, "template_path", CATCIERGE_VAR_SUFFIX | CATCIERGE_VAR_PATH | CATCIERGE_VAR_VOLATILE)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TIME, "time", CATCIERGE_VAR_SUFFIX)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STATE, "state", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_PREV_STATE, "prev_state", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_GIT_COMMIT, "git_commit", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_GIT_HASH, "git_hash", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_GIT_COMMIT_SHORT, "git_commit_short", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_GIT_HASH_SHORT, "git_hash_short", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_GIT_TAINTED, "git_tainted", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_VERSION, "version", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_CWD, "cwd", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_OUTPUT_PATH, "output_path", CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_OUTPUT_PATH, "match_output_path", CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPS_OUTPUT_PATH, "steps_output_path", CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_OBSTRUCT_OUTPUT_PATH, "obstruct_output_path", CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TEMPLATE_OUTPUT_PATH, "template_output_path", CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHER, "matcher", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_OK_MATCHES_NEEDED, "ok_matches_needed", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_NO_FINAL_DECISION, "no_final_decision", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MAX_MATCHES, "max_matches", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_EARLY_DECISION, "early_decision", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHTIME, "matchtime", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_LOCKOUT_METHOD, "lockout_method", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_LOCKOUT_ERROR, "lockout_error", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_LOCKOUT_ERROR_DELAY, "lockout_error_delay", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_LOCKOUT_TIME, "lockout_time", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_ID, "match_group_id", CATCIERGE_VAR_SUFFIX)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_START_TIME, "match_group_start_time", CATCIERGE_VAR_SUFFIX)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_END_TIME, "match_group_end_time", CATCIERGE_VAR_SUFFIX)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_SUCCESS, "match_group_success", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_SUCCESS, "match_success", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_SUCCESS_COUNT, "match_group_success_count", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_FINAL_DECISION, "match_group_final_decision", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_EARLY_DECISION, "match_group_early_decision", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_DIRECTION, "match_group_direction", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_DESCRIPTION, "match_group_description", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_DESC, "match_group_desc", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_COUNT, "match_group_count", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_COUNT, "match_count", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCH_GROUP_MAX_COUNT, "match_group_max_count", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_OBSTRUCT_FILENAME, "obstruct_filename", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_OBSTRUCT_PATH, "obstruct_path", CATCIERGE_VAR_SUFFIX | CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_OBSTRUCT_TIME, "obstruct_time", CATCIERGE_VAR_SUFFIX)
+
+// matchN_* (or matchcur_* for the current match).
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_PATH, "match#_path", CATCIERGE_VAR_SUFFIX | CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_FILENAME, "match#_filename", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_IDX, "match#_idx", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_ID, "match#_id", CATCIERGE_VAR_SUFFIX)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_SUCCESS, "match#_success", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_SUCCESS_STR, "match#_success_str", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_DIRECTION, "match#_direction", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_DESC, "match#_desc", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_DESCRIPTION, "match#_description", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_RESULT, "match#_result", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_TIME, "match#_time", CATCIERGE_VAR_SUFFIX)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_MATCHN_STEP_COUNT, "match#_step_count", 0)
+
+// matchN_stepN_*
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPN_PATH, "match#_step#_path", CATCIERGE_VAR_SUFFIX | CATCIERGE_VAR_PATH)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPN_FILENAME, "match#_step#_filename", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPN_NAME, "match#_step#_name", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPN_DESC, "match#_step#_desc", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPN_DESCRIPTION, "match#_step#_description", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_STEPN_ACTIVE, "match#_step#_active", 0)
+
+// Haar matcher.
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_CASCADE, "cascade", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_IN_DIRECTION, "in_direction", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_MIN_SIZE, "min_size", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_MIN_SIZE_WIDTH, "min_size_width", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_MIN_SIZE_HEIGHT, "min_size_height", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_NO_MATCH_IS_FAIL, "no_match_is_fail", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_EQ_HISTOGRAM, "eq_histogram", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_PREY_METHOD, "prey_method", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_HAAR_PREY_STEPS, "prey_steps", 0)
+
+// Template matcher.
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TEMPLATE_SNOUT_COUNT, "snout_count", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TEMPLATE_SNOUTN, "snout#", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TEMPLATE_THRESHOLD, "threshold", 0)
+CATCIERGE_DEFINE_VAR(CATCIERGE_VAR_TEMPLATE_MATCH_FLIPPED, "match_flipped", 0)
+
+// We undefine this so that it must be redefine each time the file is included.
+#undef CATCIERGE_DEFINE_VAR
@@ -45,6 +45,30 @@ typedef int mode_t;
 #include "win32/gettimeofday.h"
 #endif // _WIN32
 
+// Atomic reference counts, both return the new value.
+#ifdef _WIN32
+#define catcierge_atomic_inc(p) InterlockedIncrement((volatile LONG *)(p))
+#define catcierge_atomic_dec(p) InterlockedDecrement((volatile LONG *)(p))
+#else
+#define catcierge_atomic_inc(p) __sync_add_and_fetch((p), 1)
+#define catcierge_atomic_dec(p) __sync_sub_and_fetch((p), 1)
+#endif
+
+// Used by lock-free code on pointer sized values (size_t or pointers).
+// Loads acquire, stores release and the compare and swap is a full barrier.
+#ifdef _WIN32
+#define catcierge_atomic_load(p) (MemoryBarrier(), *(p))
+#define catcierge_atomic_store(p, v) do { MemoryBarrier(); *(p) = (v); } while (0)
+#define catcierge_atomic_cas(p, o, n) \
+	(InterlockedCompareExchangePointer((PVOID volatile *)(p), (PVOID)(n), (PVOID)(o)) == (PVOID)(o))
+#define catcierge_atomic_fence() MemoryBarrier()
+#else
+#define catcierge_atomic_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define catcierge_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define catcierge_atomic_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define catcierge_atomic_fence() __sync_synchronize()
+#endif
+
 #if (!defined (va_copy))
 	#define va_copy(dest, src) (dest) = (src)
 #endif
@@ -0,0 +1,108 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_PLUGIN_H__
+#define __CATCIERGE_PLUGIN_H__
+
+//
+// The interface for handler plugins loaded with --plugin.
+//
+// A plugin is a shared object that exports catcierge_plugin_init.
+// It is called once when the plugin is loaded, and fills in the
+// handler and the events it wants. The handler is then called on a
+// worker thread for every one of those events, so it doesn't have to
+// be fast but must not block forever.
+//
+// This header doesn't depend on any other catcierge headers, so that
+// plugins can be built on their own:
+//
+//   #include "catcierge_plugin.h"
+//
+//   static void handle(catcierge_plugin_t *p, const catcierge_plugin_event_t *ev)
+//   {
+//       ...
+//   }
+//
+//   int catcierge_plugin_init(catcierge_plugin_t *p)
+//   {
+//       if (p->api_version != CATCIERGE_PLUGIN_API_VERSION) return -1;
+//       p->name = "example";
+//       p->events = "match_group_done, do_lockout";
+//       p->handle = handle;
+//       return 0;
+//   }
+//
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <WinSock2.h> // struct timeval
+#else
+#include <sys/time.h>
+#endif
+
+#define CATCIERGE_PLUGIN_API_VERSION 1
+#define CATCIERGE_PLUGIN_INIT_SYMBOL "catcierge_plugin_init"
+
+typedef struct catcierge_plugin_match_s
+{
+	int success;
+	double result;
+	int direction;				// -1 unknown, 0 in, 1 out.
+	const char *description;
+	const char *path;			// Where the image is saved (if --save is used).
+	struct timeval tv;
+} catcierge_plugin_match_t;
+
+// The strings and matches are only valid during the call to the handler.
+typedef struct catcierge_plugin_event_s
+{
+	int type;					// The catcierge_event_t.
+	const char *name;			// Event name, same as used for the template event filter.
+	struct timeval tv;
+
+	const char *state;
+	const char *prev_state;
+
+	// The current match group.
+	int match_group_success;
+	int match_group_success_count;
+	int match_group_direction;	// -1 unknown, 0 in, 1 out.
+	const char *match_group_description;
+	size_t match_count;
+	const catcierge_plugin_match_t *matches;
+	const char *obstruct_path;
+} catcierge_plugin_event_t;
+
+typedef struct catcierge_plugin_s
+{
+	// Set by catcierge.
+	int api_version;
+	const char *arg;			// Anything after the path given to --plugin.
+
+	// Set by the plugin.
+	const char *name;
+	const char *events;			// Event filter like for templates, default "all".
+	void (*handle)(struct catcierge_plugin_s *p, const catcierge_plugin_event_t *ev);
+	void (*destroy)(struct catcierge_plugin_s *p);
+	void *user;					// Plugin state. The struct itself is copied after init.
+} catcierge_plugin_t;
+
+typedef int (*catcierge_plugin_init_f)(catcierge_plugin_t *p);
+
+#endif // __CATCIERGE_PLUGIN_H__
@@ -0,0 +1,398 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "catcierge_plugins.h"
+#include "catcierge_fsm.h"
+#include "catcierge_bus.h"
+#include "catcierge_arena.h"
+#include "catcierge_clock.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+
+// A snapshot of an event, owned by the worker until the plugins are done.
+typedef struct catcierge_plugins_job_s
+{
+	catcierge_plugins_t *ps;
+	catcierge_arena_t arena;
+	catcierge_plugin_event_t ev;
+} catcierge_plugins_job_t;
+
+int catcierge_plugins_init(catcierge_plugins_t *ps)
+{
+	assert(ps);
+	memset(ps, 0, sizeof(catcierge_plugins_t));
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_init(&ps->lock, NULL);
+	#endif
+
+	return 0;
+}
+
+void catcierge_plugins_destroy(catcierge_plugins_t *ps)
+{
+	size_t i;
+	catcierge_loaded_plugin_t *pl = NULL;
+	assert(ps);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (ps->started)
+	{
+		catcierge_workers_destroy(&ps->worker);
+		ps->started = 0;
+	}
+
+	pthread_mutex_destroy(&ps->lock);
+	#endif
+
+	for (i = 0; i < ps->count; i++)
+	{
+		pl = &ps->plugins[i];
+
+		if (pl->p.destroy)
+		{
+			pl->p.destroy(&pl->p);
+		}
+
+		dlclose(pl->lib);
+		catcierge_xfree(&pl->path);
+	}
+
+	catcierge_xfree(&ps->plugins);
+	ps->count = 0;
+}
+
+static uint32_t catcierge_plugins_event_mask(const char *events)
+{
+	size_t i;
+	size_t count = 0;
+	uint32_t mask = 0;
+	char **filters = NULL;
+
+	if (!events)
+	{
+		return CATCIERGE_EVENT_MASK_ALL;
+	}
+
+	if (!(filters = catcierge_parse_list(events, &count, 1)))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		mask |= catcierge_event_filter_mask(filters[i]);
+	}
+
+	catcierge_xfree_list(&filters, &count);
+
+	return mask;
+}
+
+int catcierge_plugins_load(catcierge_plugins_t *ps, const char *spec)
+{
+	char *arg = NULL;
+	catcierge_plugin_init_f init = NULL;
+	catcierge_loaded_plugin_t *plugins = NULL;
+	catcierge_loaded_plugin_t pl;
+	assert(ps);
+	assert(spec);
+
+	memset(&pl, 0, sizeof(pl));
+
+	if (!(pl.path = strdup(spec)))
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	// Everything after the path is passed to the plugin.
+	if ((arg = strchr(pl.path, ' ')))
+	{
+		*arg++ = '\0';
+
+		while (*arg == ' ')
+			arg++;
+	}
+
+	if (!(pl.lib = dlopen(pl.path, RTLD_NOW | RTLD_LOCAL)))
+	{
+		CATERR("Failed to load plugin \"%s\": %s\n", pl.path, dlerror());
+		goto fail;
+	}
+
+	if (!(*(void **)&init = dlsym(pl.lib, CATCIERGE_PLUGIN_INIT_SYMBOL)))
+	{
+		CATERR("Plugin \"%s\" has no %s function\n", pl.path, CATCIERGE_PLUGIN_INIT_SYMBOL);
+		goto fail;
+	}
+
+	pl.p.api_version = CATCIERGE_PLUGIN_API_VERSION;
+	pl.p.arg = arg ? arg : "";
+
+	if (init(&pl.p) || !pl.p.handle)
+	{
+		CATERR("Failed to init plugin \"%s\"\n", pl.path);
+		goto fail;
+	}
+
+	if (!pl.p.name)
+	{
+		pl.p.name = pl.path;
+	}
+
+	pl.events = catcierge_plugins_event_mask(pl.p.events);
+
+	if (!(plugins = realloc(ps->plugins, (ps->count + 1) * sizeof(catcierge_loaded_plugin_t))))
+	{
+		CATERR("Out of memory\n");
+
+		if (pl.p.destroy)
+		{
+			pl.p.destroy(&pl.p);
+		}
+
+		goto fail;
+	}
+
+	ps->plugins = plugins;
+	ps->plugins[ps->count++] = pl;
+	ps->events |= pl.events;
+
+	CATLOG(" %s (%s)\n", pl.p.name, pl.path);
+
+	return 0;
+fail:
+	if (pl.lib)
+	{
+		dlclose(pl.lib);
+	}
+
+	free(pl.path);
+
+	return -1;
+}
+
+static void catcierge_plugins_job_destroy(catcierge_plugins_job_t *job)
+{
+	if (!job)
+		return;
+
+	catcierge_arena_destroy(&job->arena);
+	free(job);
+}
+
+static const char *catcierge_plugins_strdup(catcierge_arena_t *a, const char *s)
+{
+	return *s ? catcierge_arena_strdup(a, s) : NULL;
+}
+
+static catcierge_plugins_job_t *catcierge_plugins_job_create(catcierge_plugins_t *ps,
+		const catcierge_event_data_t *data)
+{
+	size_t i;
+	catcierge_grb_t *grb = ps->grb;
+	match_group_t *mg = &grb->match_group;
+	match_state_t *m = NULL;
+	catcierge_plugin_match_t *matches = NULL;
+	catcierge_plugin_event_t *ev = NULL;
+	catcierge_plugins_job_t *job = NULL;
+
+	if (!(job = calloc(1, sizeof(catcierge_plugins_job_t))))
+	{
+		CATERR("Out of memory\n"); return NULL;
+	}
+
+	job->ps = ps;
+	catcierge_arena_init(&job->arena, 0);
+
+	ev = &job->ev;
+	ev->type = data->type;
+	ev->name = catcierge_event_name(data->type);
+	ev->tv = data->tv;
+	ev->state = catcierge_get_state_string(grb->state);
+	ev->prev_state = catcierge_get_state_string(grb->prev_state);
+
+	ev->match_group_success = mg->success;
+	ev->match_group_success_count = mg->success_count;
+	ev->match_group_direction = mg->direction;
+	ev->match_group_description = catcierge_plugins_strdup(&job->arena, mg->description);
+	ev->obstruct_path = catcierge_plugins_strdup(&job->arena, mg->obstruct_path.full);
+
+	if (!mg->matches || !mg->match_count)
+	{
+		return job;
+	}
+
+	if (!(matches = catcierge_arena_alloc(&job->arena,
+		mg->match_count * sizeof(catcierge_plugin_match_t))))
+	{
+		catcierge_plugins_job_destroy(job);
+		return NULL;
+	}
+
+	for (i = 0; i < mg->match_count; i++)
+	{
+		m = &mg->matches[i];
+		matches[i].success = m->result.success;
+		matches[i].result = m->result.result;
+		matches[i].direction = m->result.direction;
+		matches[i].description = catcierge_plugins_strdup(&job->arena, m->result.description);
+		matches[i].path = catcierge_plugins_strdup(&job->arena, m->path.full);
+		matches[i].tv = m->tv;
+	}
+
+	ev->matches = matches;
+	ev->match_count = mg->match_count;
+
+	return job;
+}
+
+static void catcierge_plugins_run(void *arg)
+{
+	size_t i;
+	double start;
+	double elapsed;
+	catcierge_plugins_job_t *job = (catcierge_plugins_job_t *)arg;
+	catcierge_plugins_t *ps = job->ps;
+	catcierge_loaded_plugin_t *pl = NULL;
+	uint32_t bit = CATCIERGE_EVENT_BIT(job->ev.type);
+
+	for (i = 0; i < ps->count; i++)
+	{
+		pl = &ps->plugins[i];
+
+		if (!(pl->events & bit))
+		{
+			continue;
+		}
+
+		start = catcierge_clock_monotonic();
+		pl->p.handle(&pl->p, &job->ev);
+		elapsed = catcierge_clock_monotonic() - start;
+
+		pl->calls++;
+		pl->total_time += elapsed;
+
+		if (elapsed > pl->max_time)
+		{
+			pl->max_time = elapsed;
+		}
+	}
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_lock(&ps->lock);
+	ps->pending--;
+	pthread_mutex_unlock(&ps->lock);
+	#endif
+
+	catcierge_plugins_job_destroy(job);
+}
+
+static void catcierge_plugins_event_handler(const catcierge_event_data_t *data, void *user)
+{
+	catcierge_plugins_t *ps = (catcierge_plugins_t *)user;
+	catcierge_plugins_job_t *job = NULL;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_lock(&ps->lock);
+
+	if (ps->pending >= CATCIERGE_PLUGINS_MAX_PENDING)
+	{
+		ps->dropped++;
+		pthread_mutex_unlock(&ps->lock);
+		CATERR("Plugins are too slow, dropping %s event\n", catcierge_event_name(data->type));
+		return;
+	}
+
+	ps->pending++;
+	pthread_mutex_unlock(&ps->lock);
+
+	if (!(job = catcierge_plugins_job_create(ps, data))
+	 || catcierge_workers_add(&ps->worker, catcierge_plugins_run, job))
+	{
+		CATERR("Failed to pass %s event to the plugins\n", catcierge_event_name(data->type));
+		catcierge_plugins_job_destroy(job);
+
+		pthread_mutex_lock(&ps->lock);
+		ps->pending--;
+		pthread_mutex_unlock(&ps->lock);
+	}
+	#else
+	if ((job = catcierge_plugins_job_create(ps, data)))
+	{
+		catcierge_plugins_run(job);
+	}
+	#endif
+}
+
+int catcierge_plugins_start(catcierge_plugins_t *ps, catcierge_grb_t *grb)
+{
+	assert(ps);
+	assert(grb);
+
+	if (ps->count == 0)
+	{
+		return 0;
+	}
+
+	ps->grb = grb;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (catcierge_workers_init(&ps->worker, 1))
+	{
+		CATERR("Failed to start plugin thread\n");
+		return -1;
+	}
+
+	ps->started = 1;
+	#endif
+
+	if (catcierge_bus_subscribe(&grb->bus, "plugins", CATCIERGE_SUBSCRIBER_PLUGIN,
+		ps->events, catcierge_plugins_event_handler, ps, 0, CATCIERGE_BUS_DROP_NEWEST) < 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+void catcierge_plugins_print_stats(catcierge_plugins_t *ps)
+{
+	size_t i;
+	catcierge_loaded_plugin_t *pl = NULL;
+	assert(ps);
+
+	for (i = 0; i < ps->count; i++)
+	{
+		pl = &ps->plugins[i];
+		CATLOG("Plugin %s: %lu calls, %0.1f us on average, %0.1f us max\n",
+			pl->p.name, (unsigned long)pl->calls,
+			pl->calls ? (pl->total_time * 1e6 / pl->calls) : 0.0,
+			pl->max_time * 1e6);
+	}
+
+	if (ps->dropped)
+	{
+		CATLOG("Plugins: %lu events dropped\n", (unsigned long)ps->dropped);
+	}
+}
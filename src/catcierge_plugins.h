@@ -0,0 +1,87 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_PLUGINS_H__
+#define __CATCIERGE_PLUGINS_H__
+
+//
+// Loads the handler plugins (--plugin) and passes events to them.
+//
+// The plugins subscribe to the event bus. For each event a snapshot of
+// the match group is taken on the publishing thread, and the plugins
+// are then called with it on a worker thread, one event at a time in
+// order. When the plugins fall behind by too many events new ones are
+// dropped. See catcierge_plugin.h for the plugin interface.
+//
+
+#include <catcierge_config.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "catcierge_plugin.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include "catcierge_workers.h"
+#endif
+
+#define CATCIERGE_PLUGINS_MAX_PENDING 64
+
+struct catcierge_grb_s;
+
+typedef struct catcierge_loaded_plugin_s
+{
+	catcierge_plugin_t p;
+	void *lib;
+	char *path;
+	uint32_t events;		// The plugin event filter as CATCIERGE_EVENT_BIT's.
+
+	// Timing, only updated by the worker thread.
+	size_t calls;
+	double total_time;
+	double max_time;
+} catcierge_loaded_plugin_t;
+
+typedef struct catcierge_plugins_s
+{
+	catcierge_loaded_plugin_t *plugins;
+	size_t count;
+	uint32_t events;		// Events that any plugin wants.
+	struct catcierge_grb_s *grb;
+
+	size_t pending;			// Events waiting for the worker.
+	size_t dropped;
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	catcierge_workers_t worker;
+	int started;
+	pthread_mutex_t lock;
+	#endif
+} catcierge_plugins_t;
+
+int catcierge_plugins_init(catcierge_plugins_t *ps);
+
+// Waits for the pending events before the plugins are unloaded.
+void catcierge_plugins_destroy(catcierge_plugins_t *ps);
+
+// Loads a plugin given as "path [argument]".
+int catcierge_plugins_load(catcierge_plugins_t *ps, const char *spec);
+
+// Subscribes the plugins to the events of the grabber.
+int catcierge_plugins_start(catcierge_plugins_t *ps, struct catcierge_grb_s *grb);
+
+void catcierge_plugins_print_stats(catcierge_plugins_t *ps);
+
+#endif // __CATCIERGE_PLUGINS_H__
@@ -0,0 +1,314 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "catcierge_config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_preview.h"
+#include "catcierge_encoded_image.h"
+#include "catcierge_platform.h"
+#include "catcierge_clock.h"
+#include "catcierge_log.h"
+
+#if (ZMQ_VERSION >= ZMQ_MAKE_VERSION (4, 0, 0))
+
+// XPUB passes on subscriptions as a frame starting with 1 (subscribe)
+// or 0 (unsubscribe) followed by the prefix. Only the first subscription
+// and the last unsubscription of each prefix are passed on, so this
+// counts the distinct prefixes that match the topic.
+static void catcierge_preview_handle_subscription(catcierge_preview_t *p)
+{
+	zframe_t *frame = NULL;
+	unsigned char *data = NULL;
+	size_t size;
+
+	if (!(frame = zframe_recv(p->xpub)))
+	{
+		return;
+	}
+
+	data = zframe_data(frame);
+	size = zframe_size(frame);
+
+	if ((size >= 1)
+	 && ((size - 1) <= strlen(CATCIERGE_PREVIEW_TOPIC))
+	 && !memcmp(data + 1, CATCIERGE_PREVIEW_TOPIC, size - 1))
+	{
+		if (data[0] == 1)
+		{
+			if (catcierge_atomic_inc(&p->subscribers) == 1)
+				CATLOG("Preview subscriber connected\n");
+		}
+		else if (data[0] == 0)
+		{
+			if (catcierge_atomic_dec(&p->subscribers) == 0)
+				CATLOG("No preview subscribers left\n");
+		}
+	}
+
+	zframe_destroy(&frame);
+}
+
+static void catcierge_preview_send_frame(catcierge_preview_t *p)
+{
+	IplImage *tmp = NULL;
+	catcierge_encoded_image_t *e = NULL;
+
+	pthread_mutex_lock(&p->lock);
+
+	if (!p->pending)
+	{
+		pthread_mutex_unlock(&p->lock);
+		return;
+	}
+
+	// Swap so that the FSM can fill in the next frame while this is encoded.
+	tmp = p->work;
+	p->work = p->frame;
+	p->frame = tmp;
+	p->pending = 0;
+
+	pthread_mutex_unlock(&p->lock);
+
+	if (!(e = catcierge_encoded_image_create(p->work, ".jpg", p->params)))
+	{
+		return;
+	}
+
+	zstr_sendm(p->xpub, CATCIERGE_PREVIEW_TOPIC);
+
+	if (catcierge_encoded_image_send(e, zsock_resolve(p->xpub), 0))
+	{
+		CATERR("Failed to publish preview frame\n");
+	}
+	else
+	{
+		p->sent++;
+	}
+
+	catcierge_encoded_image_unref(&e);
+}
+
+static void *catcierge_preview_thread(void *arg)
+{
+	catcierge_preview_t *p = (catcierge_preview_t *)arg;
+	zpoller_t *poller = NULL;
+	void *which = NULL;
+	int stop = 0;
+
+	if (!(poller = zpoller_new(p->xpub, p->pipe_backend, NULL)))
+	{
+		CATERR("Failed to create preview poller\n");
+		return NULL;
+	}
+
+	while (!stop)
+	{
+		if (!(which = zpoller_wait(poller, -1)))
+		{
+			// Interrupted.
+			if (zpoller_terminated(poller))
+				break;
+			continue;
+		}
+
+		if (which == p->xpub)
+		{
+			catcierge_preview_handle_subscription(p);
+		}
+		else
+		{
+			zsock_wait(p->pipe_backend);
+
+			pthread_mutex_lock(&p->lock);
+			stop = p->stop;
+			pthread_mutex_unlock(&p->lock);
+
+			if (!stop)
+			{
+				catcierge_preview_send_frame(p);
+			}
+		}
+	}
+
+	zpoller_destroy(&poller);
+
+	return NULL;
+}
+
+int catcierge_preview_init(catcierge_preview_t *p, const char *endpoint,
+		double fps, int quality)
+{
+	assert(p);
+	assert(endpoint);
+	memset(p, 0, sizeof(catcierge_preview_t));
+
+	pthread_mutex_init(&p->lock, NULL);
+
+	p->interval = (fps > 0.0) ? (1.0 / fps) : 0.0;
+	p->last_push = -p->interval;
+	p->params[0] = CV_IMWRITE_JPEG_QUALITY;
+	p->params[1] = quality;
+	p->params[2] = 0;
+
+	if (!(p->xpub = zsock_new_xpub(endpoint)))
+	{
+		CATERR("Failed to create preview publisher on %s\n", endpoint);
+		goto fail;
+	}
+
+	if (!(p->pipe = zsys_create_pipe((zsock_t **)&p->pipe_backend)))
+	{
+		CATERR("Failed to create preview pipe\n");
+		goto fail;
+	}
+
+	if (pthread_create(&p->thread, NULL, catcierge_preview_thread, p))
+	{
+		CATERR("Failed to start preview thread\n");
+		goto fail;
+	}
+
+	p->started = 1;
+
+	CATLOG("Preview published on %s (%0.1f fps)\n", endpoint, fps);
+
+	return 0;
+fail:
+	catcierge_preview_destroy(p);
+	return -1;
+}
+
+void catcierge_preview_destroy(catcierge_preview_t *p)
+{
+	assert(p);
+
+	if (p->started)
+	{
+		pthread_mutex_lock(&p->lock);
+		p->stop = 1;
+		pthread_mutex_unlock(&p->lock);
+
+		zsock_signal(p->pipe, 0);
+		pthread_join(p->thread, NULL);
+		p->started = 0;
+	}
+
+	if (p->pipe)
+		zsock_destroy((zsock_t **)&p->pipe);
+
+	if (p->pipe_backend)
+		zsock_destroy((zsock_t **)&p->pipe_backend);
+
+	if (p->xpub)
+		zsock_destroy((zsock_t **)&p->xpub);
+
+	if (p->frame)
+		cvReleaseImage(&p->frame);
+
+	if (p->work)
+		cvReleaseImage(&p->work);
+
+	pthread_mutex_destroy(&p->lock);
+}
+
+void catcierge_preview_push(catcierge_preview_t *p, IplImage *img)
+{
+	double now;
+	int signal = 0;
+	assert(p);
+	assert(img);
+
+	if (!p->started || (p->subscribers <= 0))
+	{
+		return;
+	}
+
+	now = catcierge_clock_monotonic();
+
+	if ((now - p->last_push) < p->interval)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&p->lock);
+
+	if (p->pending)
+	{
+		// Still encoding the last one.
+		p->dropped++;
+		goto done;
+	}
+
+	if (p->frame
+	 && ((p->frame->width != img->width)
+	  || (p->frame->height != img->height)
+	  || (p->frame->depth != img->depth)
+	  || (p->frame->nChannels != img->nChannels)))
+	{
+		cvReleaseImage(&p->frame);
+	}
+
+	if (!p->frame && !(p->frame = cvCreateImage(cvGetSize(img), img->depth, img->nChannels)))
+	{
+		goto done;
+	}
+
+	cvCopy(img, p->frame, NULL);
+	p->pending = 1;
+	p->last_push = now;
+	signal = 1;
+
+done:
+	pthread_mutex_unlock(&p->lock);
+
+	if (signal)
+	{
+		zsock_signal(p->pipe, 0);
+	}
+}
+
+#else // ZMQ_VERSION < 4.0.0
+
+int catcierge_preview_init(catcierge_preview_t *p, const char *endpoint,
+		double fps, int quality)
+{
+	assert(p);
+	memset(p, 0, sizeof(catcierge_preview_t));
+	CATERR("The preview needs CZMQ 3.0 or later\n");
+	return -1;
+}
+
+void catcierge_preview_destroy(catcierge_preview_t *p)
+{
+}
+
+void catcierge_preview_push(catcierge_preview_t *p, IplImage *img)
+{
+}
+
+#endif // ZMQ_VERSION < 4.0.0
+
+void catcierge_preview_print_stats(catcierge_preview_t *p)
+{
+	assert(p);
+
+	CATLOG("Preview: %lu frames sent, %lu dropped\n",
+		(unsigned long)p->sent, (unsigned long)p->dropped);
+}
@@ -0,0 +1,75 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_PREVIEW_H__
+#define __CATCIERGE_PREVIEW_H__
+
+//
+// Live JPEG preview of the camera published over ZMQ (--preview).
+//
+// Frames are published on their own XPUB socket, so that the
+// subscriptions can be tracked. As long as nobody is subscribed to
+// CATCIERGE_PREVIEW_TOPIC the FSM only checks a counter for each frame.
+//
+// The FSM copies the latest frame into a single slot, and the preview
+// thread encodes and sends it. If the thread is still busy with the
+// previous frame the new one is dropped, frames are never queued.
+//
+
+#include <catcierge_config.h>
+#include <pthread.h>
+#include <czmq.h>
+#include "catcierge_types.h"
+
+#define CATCIERGE_PREVIEW_TOPIC "preview"
+
+typedef struct catcierge_preview_s
+{
+	void *xpub;					// Only used by the preview thread.
+	void *pipe;					// Wakes up the preview thread.
+	void *pipe_backend;
+	pthread_t thread;
+	int started;
+
+	pthread_mutex_t lock;
+	IplImage *frame;			// The latest frame, waiting to be encoded.
+	int pending;
+	int stop;
+
+	IplImage *work;				// The frame being encoded.
+	volatile long subscribers;	// Subscriptions matching the topic.
+
+	double interval;
+	double last_push;
+	int params[3];				// JPEG quality for cvEncodeImage.
+
+	// Statistics.
+	size_t sent;
+	size_t dropped;
+} catcierge_preview_t;
+
+int catcierge_preview_init(catcierge_preview_t *p, const char *endpoint,
+		double fps, int quality);
+void catcierge_preview_destroy(catcierge_preview_t *p);
+
+// Called by the FSM for every frame.
+void catcierge_preview_push(catcierge_preview_t *p, IplImage *img);
+
+void catcierge_preview_print_stats(catcierge_preview_t *p);
+
+#endif // __CATCIERGE_PREVIEW_H__
@@ -0,0 +1,336 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_publisher.h"
+#include "catcierge_platform.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+
+static void catcierge_publisher_msg_destroy(catcierge_publisher_msg_t **msg)
+{
+	size_t i;
+	catcierge_publisher_msg_t *m = NULL;
+
+	if (!msg || !*msg)
+		return;
+
+	m = *msg;
+
+	for (i = 0; i < m->image_count; i++)
+	{
+		catcierge_encoded_image_unref(&m->images[i]);
+	}
+
+	zframe_destroy(&m->frame);
+	free(m->images);
+	free(m->topic);
+	free(m);
+	*msg = NULL;
+}
+
+static int catcierge_publisher_send_now(catcierge_publisher_t *p,
+		catcierge_publisher_msg_t *m)
+{
+	size_t i;
+	void *sock = p->sock;
+	int more = (m->frame || m->image_count) ? ZFRAME_MORE : 0;
+
+	#if (ZMQ_VERSION >= ZMQ_MAKE_VERSION (4, 0, 0))
+	sock = zsock_resolve(p->sock);
+	#endif
+
+	if (more)
+	{
+		if (zstr_sendm(p->sock, m->topic))
+			goto fail;
+	}
+	else if (zstr_send(p->sock, m->topic))
+	{
+		goto fail;
+	}
+
+	if (m->frame)
+	{
+		if (zframe_send(&m->frame, p->sock, m->image_count ? ZFRAME_MORE : 0))
+			goto fail;
+	}
+
+	for (i = 0; i < m->image_count; i++)
+	{
+		if (catcierge_encoded_image_send(m->images[i], sock, (i + 1) < m->image_count))
+			goto fail;
+	}
+
+	p->sent++;
+	return 0;
+
+fail:
+	CATERR("Failed to publish \"%s\"\n", m->topic);
+	p->failed++;
+	return -1;
+}
+
+static int catcierge_publisher_conflates(catcierge_publisher_t *p, const char *topic)
+{
+	size_t i;
+
+	for (i = 0; i < p->conflate_count; i++)
+	{
+		if (!strncmp(topic, p->conflate[i], strlen(p->conflate[i])))
+			return 1;
+	}
+
+	return 0;
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+static void catcierge_publisher_send_batch(catcierge_publisher_t *p,
+		catcierge_publisher_msg_t **msgs, size_t count)
+{
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < count; i++)
+	{
+		if (catcierge_publisher_conflates(p, msgs[i]->topic))
+		{
+			// Skip it if there's a newer one.
+			for (j = i + 1; j < count; j++)
+			{
+				if (!strcmp(msgs[i]->topic, msgs[j]->topic))
+					break;
+			}
+
+			if (j < count)
+			{
+				p->conflated++;
+				catcierge_publisher_msg_destroy(&msgs[i]);
+				continue;
+			}
+		}
+
+		catcierge_publisher_send_now(p, msgs[i]);
+		catcierge_publisher_msg_destroy(&msgs[i]);
+	}
+}
+
+static void *catcierge_publisher_thread(void *arg)
+{
+	int stop = 0;
+	size_t count;
+	catcierge_publisher_t *p = (catcierge_publisher_t *)arg;
+	catcierge_publisher_msg_t *msgs[CATCIERGE_PUBLISHER_BATCH];
+
+	while (1)
+	{
+		count = 0;
+
+		while ((count < CATCIERGE_PUBLISHER_BATCH)
+			&& (msgs[count] = catcierge_queue_pop(&p->queue)))
+		{
+			count++;
+		}
+
+		if (count > 0)
+		{
+			catcierge_publisher_send_batch(p, msgs, count);
+			continue;
+		}
+
+		if (stop)
+			break;
+
+		pthread_mutex_lock(&p->lock);
+
+		// Pairs with the fence in catcierge_publisher_send, either we
+		// see the new message or the producer sees that we are sleeping.
+		catcierge_atomic_store(&p->sleeping, 1);
+		catcierge_atomic_fence();
+
+		while (!p->stop && !catcierge_queue_count(&p->queue))
+		{
+			pthread_cond_wait(&p->cond, &p->lock);
+		}
+
+		catcierge_atomic_store(&p->sleeping, 0);
+		stop = p->stop;
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int catcierge_publisher_init(catcierge_publisher_t *p, void *sock,
+		size_t queue_size, char **conflate, size_t conflate_count)
+{
+	size_t i;
+	assert(p);
+	assert(sock);
+	memset(p, 0, sizeof(catcierge_publisher_t));
+
+	p->sock = sock;
+
+	if (conflate_count > 0)
+	{
+		if (!(p->conflate = calloc(conflate_count, sizeof(char *))))
+		{
+			CATERR("Out of memory\n"); goto fail;
+		}
+
+		p->conflate_count = conflate_count;
+
+		for (i = 0; i < conflate_count; i++)
+		{
+			if (!(p->conflate[i] = strdup(conflate[i])))
+			{
+				CATERR("Out of memory\n"); goto fail;
+			}
+		}
+	}
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (catcierge_queue_init(&p->queue,
+		queue_size ? queue_size : CATCIERGE_PUBLISHER_DEFAULT_QUEUE_SIZE))
+	{
+		goto fail;
+	}
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	if (pthread_create(&p->thread, NULL, catcierge_publisher_thread, p))
+	{
+		CATERR("Failed to start ZMQ publisher thread\n");
+		goto fail;
+	}
+
+	p->started = 1;
+	#endif // CATCIERGE_HAVE_PTHREADS
+
+	return 0;
+
+fail:
+	catcierge_publisher_destroy(p);
+	return -1;
+}
+
+void catcierge_publisher_destroy(catcierge_publisher_t *p)
+{
+	assert(p);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (p->started)
+	{
+		pthread_mutex_lock(&p->lock);
+		p->stop = 1;
+		pthread_cond_signal(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+
+		pthread_join(p->thread, NULL);
+		p->started = 0;
+	}
+
+	if (p->queue.cells)
+	{
+		pthread_cond_destroy(&p->cond);
+		pthread_mutex_destroy(&p->lock);
+		catcierge_queue_destroy(&p->queue);
+	}
+	#endif // CATCIERGE_HAVE_PTHREADS
+
+	catcierge_xfree_list(&p->conflate, &p->conflate_count);
+	p->sock = NULL;
+}
+
+int catcierge_publisher_send(catcierge_publisher_t *p, const char *topic,
+		zframe_t **frame, catcierge_encoded_image_t **images, size_t image_count)
+{
+	size_t i;
+	catcierge_publisher_msg_t *m = NULL;
+	assert(p);
+	assert(topic);
+
+	if (!(m = calloc(1, sizeof(catcierge_publisher_msg_t)))
+	 || !(m->topic = strdup(topic))
+	 || (image_count
+	  && !(m->images = calloc(image_count, sizeof(catcierge_encoded_image_t *)))))
+	{
+		CATERR("Out of memory\n");
+		goto fail;
+	}
+
+	if (frame)
+	{
+		m->frame = *frame;
+		*frame = NULL;
+	}
+
+	for (i = 0; i < image_count; i++)
+	{
+		m->images[i] = catcierge_encoded_image_ref(images[i]);
+	}
+
+	m->image_count = image_count;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (catcierge_queue_push(&p->queue, m))
+	{
+		catcierge_atomic_inc(&p->dropped);
+		catcierge_publisher_msg_destroy(&m);
+		return -1;
+	}
+
+	catcierge_atomic_inc(&p->queued);
+	catcierge_atomic_fence();
+
+	if (catcierge_atomic_load(&p->sleeping))
+	{
+		pthread_mutex_lock(&p->lock);
+		pthread_cond_signal(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return 0;
+	#else
+	catcierge_atomic_inc(&p->queued);
+	i = catcierge_publisher_send_now(p, m);
+	catcierge_publisher_msg_destroy(&m);
+	return (i ? -1 : 0);
+	#endif // CATCIERGE_HAVE_PTHREADS
+
+fail:
+	if (frame)
+		zframe_destroy(frame);
+	catcierge_publisher_msg_destroy(&m);
+	catcierge_atomic_inc(&p->dropped);
+	return -1;
+}
+
+void catcierge_publisher_print_stats(catcierge_publisher_t *p)
+{
+	assert(p);
+
+	CATLOG("ZMQ publisher: %ld queued, %lu sent, %ld dropped, %lu conflated, %lu failed\n",
+		(long)p->queued, (unsigned long)p->sent, (long)p->dropped,
+		(unsigned long)p->conflated, (unsigned long)p->failed);
+}
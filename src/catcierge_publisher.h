@@ -0,0 +1,98 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_PUBLISHER_H__
+#define __CATCIERGE_PUBLISHER_H__
+
+//
+// Publishes ZMQ messages from an I/O thread of its own.
+//
+// Messages are handed over through a lock-free queue, so publishing
+// from the FSM never waits on the socket. If the queue is full the
+// message is dropped and counted instead.
+//
+// Topics set to be conflated only keep the newest message when the
+// I/O thread falls behind, since older state is of no use to anyone.
+//
+// Without threads the messages are sent directly.
+//
+
+#include <catcierge_config.h>
+#include <czmq.h>
+#include "catcierge_queue.h"
+#include "catcierge_encoded_image.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define CATCIERGE_PUBLISHER_DEFAULT_QUEUE_SIZE 256
+
+// Messages sent by the I/O thread at a time, conflation
+// is done within such a batch.
+#define CATCIERGE_PUBLISHER_BATCH 32
+
+typedef struct catcierge_publisher_msg_s
+{
+	char *topic;
+	zframe_t *frame;						// Can be NULL.
+	catcierge_encoded_image_t **images;		// Sent after the frame.
+	size_t image_count;
+} catcierge_publisher_msg_t;
+
+typedef struct catcierge_publisher_s
+{
+	void *sock;						// Only used by the I/O thread.
+	catcierge_queue_t queue;
+	char **conflate;				// Topic prefixes to conflate.
+	size_t conflate_count;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// A message was queued, or stopping.
+	volatile size_t sleeping;		// The I/O thread is waiting on cond.
+	int started;
+	int stop;
+	#endif
+
+	// Statistics.
+	volatile long queued;
+	volatile long dropped;			// The queue was full.
+	size_t conflated;
+	size_t sent;
+	size_t failed;
+} catcierge_publisher_t;
+
+// The publisher does not own the socket, but nothing else may use
+// it until catcierge_publisher_destroy.
+int catcierge_publisher_init(catcierge_publisher_t *p, void *sock,
+		size_t queue_size, char **conflate, size_t conflate_count);
+
+// Sends everything that is still queued before stopping.
+void catcierge_publisher_destroy(catcierge_publisher_t *p);
+
+// Publishes the topic, followed by the frame and the images. The frame
+// is taken over, and the images get a reference of their own. Never
+// blocks, returns -1 if the message was dropped.
+int catcierge_publisher_send(catcierge_publisher_t *p, const char *topic,
+		zframe_t **frame, catcierge_encoded_image_t **images, size_t image_count);
+
+void catcierge_publisher_print_stats(catcierge_publisher_t *p);
+
+#endif // __CATCIERGE_PUBLISHER_H__
@@ -0,0 +1,156 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_queue.h"
+#include "catcierge_platform.h"
+#include "catcierge_log.h"
+
+int catcierge_queue_init(catcierge_queue_t *q, size_t size)
+{
+	size_t i;
+	size_t n = 2;
+	assert(q);
+	memset(q, 0, sizeof(catcierge_queue_t));
+
+	while (n < size)
+		n <<= 1;
+
+	if (!(q->cells = calloc(n, sizeof(catcierge_queue_cell_t))))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		q->cells[i].seq = i;
+	}
+
+	q->mask = n - 1;
+
+	return 0;
+}
+
+void catcierge_queue_destroy(catcierge_queue_t *q)
+{
+	assert(q);
+
+	free(q->cells);
+	q->cells = NULL;
+	q->mask = 0;
+}
+
+int catcierge_queue_push(catcierge_queue_t *q, void *data)
+{
+	size_t pos;
+	ptrdiff_t diff;
+	catcierge_queue_cell_t *cell = NULL;
+	assert(q);
+	assert(q->cells);
+
+	pos = catcierge_atomic_load(&q->head);
+
+	while (1)
+	{
+		// The difference is used so that the positions can wrap around.
+		cell = &q->cells[pos & q->mask];
+		diff = (ptrdiff_t)(catcierge_atomic_load(&cell->seq) - pos);
+
+		if (diff == 0)
+		{
+			// The cell is free, try to claim it.
+			if (catcierge_atomic_cas(&q->head, pos, pos + 1))
+				break;
+
+			pos = catcierge_atomic_load(&q->head);
+		}
+		else if (diff < 0)
+		{
+			// The consumer has not popped this cell since the last lap.
+			return -1;
+		}
+		else
+		{
+			// Another producer got here first.
+			pos = catcierge_atomic_load(&q->head);
+		}
+	}
+
+	cell->data = data;
+	catcierge_atomic_store(&cell->seq, pos + 1);
+
+	return 0;
+}
+
+void *catcierge_queue_pop(catcierge_queue_t *q)
+{
+	size_t pos;
+	ptrdiff_t diff;
+	void *data = NULL;
+	catcierge_queue_cell_t *cell = NULL;
+	assert(q);
+	assert(q->cells);
+
+	pos = catcierge_atomic_load(&q->tail);
+
+	while (1)
+	{
+		cell = &q->cells[pos & q->mask];
+		diff = (ptrdiff_t)(catcierge_atomic_load(&cell->seq) - (pos + 1));
+
+		if (diff == 0)
+		{
+			if (catcierge_atomic_cas(&q->tail, pos, pos + 1))
+				break;
+
+			pos = catcierge_atomic_load(&q->tail);
+		}
+		else if (diff < 0)
+		{
+			// Empty.
+			return NULL;
+		}
+		else
+		{
+			pos = catcierge_atomic_load(&q->tail);
+		}
+	}
+
+	data = cell->data;
+
+	// Free the cell for the producer on the next lap.
+	catcierge_atomic_store(&cell->seq, pos + q->mask + 1);
+
+	return data;
+}
+
+size_t catcierge_queue_size(catcierge_queue_t *q)
+{
+	assert(q);
+	return q->mask + 1;
+}
+
+size_t catcierge_queue_count(catcierge_queue_t *q)
+{
+	assert(q);
+	return catcierge_atomic_load(&q->head) - catcierge_atomic_load(&q->tail);
+}
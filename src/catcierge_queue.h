@@ -0,0 +1,71 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_QUEUE_H__
+#define __CATCIERGE_QUEUE_H__
+
+//
+// Bounded lock-free queue of pointers.
+//
+// Any number of threads can push and pop at the same time without
+// taking a lock, so a producer is never held up by a slow consumer.
+// When the queue is full push fails right away, and it is up to the
+// caller to drop or retry.
+//
+// Each cell has a sequence number telling whether it is free for the
+// producer or holds data for the consumer at the current position.
+//
+
+#include <stddef.h>
+
+typedef struct catcierge_queue_cell_s
+{
+	volatile size_t seq;
+	void *data;
+} catcierge_queue_cell_t;
+
+typedef struct catcierge_queue_s
+{
+	catcierge_queue_cell_t *cells;
+	size_t mask;
+
+	// The producers and consumers update different positions,
+	// keep them on separate cache lines.
+	char pad0[64];
+	volatile size_t head;		// Next position to push.
+	char pad1[64];
+	volatile size_t tail;		// Next position to pop.
+	char pad2[64];
+} catcierge_queue_t;
+
+// The size is rounded up to a power of 2.
+int catcierge_queue_init(catcierge_queue_t *q, size_t size);
+void catcierge_queue_destroy(catcierge_queue_t *q);
+
+// Returns -1 if the queue is full.
+int catcierge_queue_push(catcierge_queue_t *q, void *data);
+
+// Returns NULL if the queue is empty.
+void *catcierge_queue_pop(catcierge_queue_t *q);
+
+size_t catcierge_queue_size(catcierge_queue_t *q);
+
+// Only exact while no other thread is using the queue.
+size_t catcierge_queue_count(catcierge_queue_t *q);
+
+#endif // __CATCIERGE_QUEUE_H__
@@ -0,0 +1,405 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include "catcierge_reactor.h"
+#include "catcierge_log.h"
+
+#define CATCIERGE_REACTOR_MAX_EVENTS 16
+
+int catcierge_reactor_init(catcierge_reactor_t *r)
+{
+	assert(r);
+	memset(r, 0, sizeof(catcierge_reactor_t));
+	sigemptyset(&r->sigmask);
+
+	if ((r->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		CATERR("Failed to create epoll instance: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void catcierge_reactor_free_handler(catcierge_reactor_handler_t *h)
+{
+	if ((h->fd >= 0) && (h->type != CATCIERGE_REACTOR_FD))
+	{
+		// Timers, events and signal fds are created by us.
+		close(h->fd);
+	}
+
+	free(h);
+}
+
+static void catcierge_reactor_purge(catcierge_reactor_t *r)
+{
+	catcierge_reactor_handler_t **it = &r->handlers;
+	catcierge_reactor_handler_t *h;
+
+	// Handlers are only unlinked here, so that a callback can
+	// remove another handler that is also part of the current batch.
+	while (*it)
+	{
+		h = *it;
+
+		if (h->fd < 0)
+		{
+			*it = h->next;
+			free(h);
+		}
+		else
+		{
+			it = &h->next;
+		}
+	}
+}
+
+void catcierge_reactor_destroy(catcierge_reactor_t *r)
+{
+	catcierge_reactor_handler_t *h;
+	catcierge_reactor_handler_t *next;
+	assert(r);
+
+	for (h = r->handlers; h; h = next)
+	{
+		next = h->next;
+		catcierge_reactor_free_handler(h);
+	}
+
+	r->handlers = NULL;
+
+	if (r->epfd > 0)
+	{
+		close(r->epfd);
+		r->epfd = -1;
+	}
+
+	// Unblocking an empty set is a no-op.
+	sigprocmask(SIG_UNBLOCK, &r->sigmask, NULL);
+	sigemptyset(&r->sigmask);
+}
+
+static catcierge_reactor_handler_t *catcierge_reactor_add_handler(
+			catcierge_reactor_t *r, int fd, uint32_t events,
+			catcierge_reactor_handler_type_t type,
+			catcierge_reactor_cb_f cb, void *user)
+{
+	struct epoll_event ev;
+	catcierge_reactor_handler_t *h = NULL;
+
+	if (!(h = calloc(1, sizeof(catcierge_reactor_handler_t))))
+	{
+		CATERR("Out of memory\n");
+		return NULL;
+	}
+
+	h->fd = fd;
+	h->type = type;
+	h->cb = cb;
+	h->user = user;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = h;
+
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		CATERR("Failed to add fd %d to epoll: %s\n", fd, strerror(errno));
+		free(h);
+		return NULL;
+	}
+
+	h->next = r->handlers;
+	r->handlers = h;
+
+	return h;
+}
+
+int catcierge_reactor_add_fd(catcierge_reactor_t *r, int fd, uint32_t events,
+			catcierge_reactor_cb_f cb, void *user)
+{
+	assert(r);
+	assert(cb);
+
+	if (!catcierge_reactor_add_handler(r, fd, events,
+		CATCIERGE_REACTOR_FD, cb, user))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+int catcierge_reactor_remove_fd(catcierge_reactor_t *r, int fd)
+{
+	catcierge_reactor_handler_t *h;
+	assert(r);
+
+	for (h = r->handlers; h; h = h->next)
+	{
+		if (h->fd == fd)
+		{
+			epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+
+			if (h->type != CATCIERGE_REACTOR_FD)
+			{
+				close(h->fd);
+			}
+
+			// Freed in catcierge_reactor_purge.
+			h->fd = -1;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int catcierge_reactor_add_event(catcierge_reactor_t *r,
+			catcierge_reactor_cb_f cb, void *user)
+{
+	int fd;
+	assert(r);
+	assert(cb);
+
+	if ((fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		CATERR("Failed to create eventfd: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (!catcierge_reactor_add_handler(r, fd, EPOLLIN,
+		CATCIERGE_REACTOR_EVENT, cb, user))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int catcierge_reactor_notify(int event_fd)
+{
+	uint64_t one = 1;
+
+	if (write(event_fd, &one, sizeof(one)) != sizeof(one))
+	{
+		// EAGAIN means the counter is saturated,
+		// the loop will wake up anyway.
+		if (errno != EAGAIN)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int catcierge_reactor_add_signals(catcierge_reactor_t *r,
+			const int *signals, size_t count,
+			catcierge_reactor_signal_cb_f cb, void *user)
+{
+	size_t i;
+	int fd;
+	sigset_t mask;
+	catcierge_reactor_handler_t *h;
+	assert(r);
+	assert(signals);
+	assert(cb);
+
+	sigemptyset(&mask);
+
+	for (i = 0; i < count; i++)
+	{
+		sigaddset(&mask, signals[i]);
+	}
+
+	// The signals must be blocked for signalfd to see them.
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+	{
+		CATERR("Failed to block signals: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if ((fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+	{
+		CATERR("Failed to create signalfd: %s\n", strerror(errno));
+		sigprocmask(SIG_UNBLOCK, &mask, NULL);
+		return -1;
+	}
+
+	if (!(h = catcierge_reactor_add_handler(r, fd, EPOLLIN,
+		CATCIERGE_REACTOR_SIGNAL, NULL, user)))
+	{
+		close(fd);
+		sigprocmask(SIG_UNBLOCK, &mask, NULL);
+		return -1;
+	}
+
+	h->signal_cb = cb;
+
+	for (i = 0; i < count; i++)
+	{
+		sigaddset(&r->sigmask, signals[i]);
+	}
+
+	return 0;
+}
+
+static void catcierge_reactor_dispatch(catcierge_reactor_t *r,
+			catcierge_reactor_handler_t *h, uint32_t events)
+{
+	uint64_t count;
+	struct signalfd_siginfo si;
+
+	switch (h->type)
+	{
+		case CATCIERGE_REACTOR_EVENT:
+		{
+			// Drain the counter so we're not woken up again.
+			if (read(h->fd, &count, sizeof(count)) != sizeof(count))
+			{
+				// Spurious wakeup (someone already drained it).
+				return;
+			}
+
+			h->cb(r, h->fd, events, h->user);
+			break;
+		}
+		case CATCIERGE_REACTOR_SIGNAL:
+		{
+			while ((h->fd >= 0)
+				&& (read(h->fd, &si, sizeof(si)) == sizeof(si)))
+			{
+				h->signal_cb(r, (int)si.ssi_signo, h->user);
+			}
+			break;
+		}
+		case CATCIERGE_REACTOR_FD:
+		default:
+		{
+			h->cb(r, h->fd, events, h->user);
+			break;
+		}
+	}
+}
+
+void catcierge_reactor_set_timer_wheel(catcierge_reactor_t *r,
+			catcierge_timer_wheel_t *wheel)
+{
+	assert(r);
+	r->wheel = wheel;
+}
+
+static int catcierge_reactor_wheel_timeout(catcierge_reactor_t *r, int timeout_ms)
+{
+	int wheel_ms;
+	double deadline;
+
+	if (!r->wheel
+		|| ((deadline = catcierge_timer_wheel_next_deadline(r->wheel)) < 0.0))
+	{
+		return timeout_ms;
+	}
+
+	// Round up so we don't wake up just before the deadline.
+	wheel_ms = (int)ceil(deadline * 1000.0);
+
+	if ((timeout_ms < 0) || (wheel_ms < timeout_ms))
+	{
+		return wheel_ms;
+	}
+
+	return timeout_ms;
+}
+
+int catcierge_reactor_run_once(catcierge_reactor_t *r, int timeout_ms)
+{
+	int i;
+	int n;
+	catcierge_reactor_handler_t *h;
+	struct epoll_event events[CATCIERGE_REACTOR_MAX_EVENTS];
+	assert(r);
+
+	timeout_ms = catcierge_reactor_wheel_timeout(r, timeout_ms);
+
+	if ((n = epoll_wait(r->epfd, events,
+		CATCIERGE_REACTOR_MAX_EVENTS, timeout_ms)) < 0)
+	{
+		if (errno == EINTR)
+		{
+			return 0;
+		}
+
+		CATERR("epoll_wait failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		h = (catcierge_reactor_handler_t *)events[i].data.ptr;
+
+		// Removed by an earlier callback in this batch.
+		if (h->fd < 0)
+			continue;
+
+		catcierge_reactor_dispatch(r, h, events[i].events);
+	}
+
+	catcierge_reactor_purge(r);
+
+	if (r->wheel)
+	{
+		n += catcierge_timer_wheel_advance(r->wheel);
+	}
+
+	return n;
+}
+
+int catcierge_reactor_run(catcierge_reactor_t *r)
+{
+	assert(r);
+	r->running = 1;
+
+	while (r->running)
+	{
+		if (catcierge_reactor_run_once(r, -1) < 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void catcierge_reactor_stop(catcierge_reactor_t *r)
+{
+	assert(r);
+	r->running = 0;
+}
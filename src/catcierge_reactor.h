@@ -0,0 +1,103 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_REACTOR_H__
+#define __CATCIERGE_REACTOR_H__
+
+//
+// A small epoll based event loop. Everything the grabber waits for
+// (frames from the capture thread, RFID serial ports and signals)
+// is turned into a file descriptor so the main loop can sleep in a single
+// epoll_wait instead of spinning. Timers live in a timer wheel, whose next
+// deadline bounds how long the loop sleeps.
+//
+
+#include <stdint.h>
+#include <signal.h>
+#include "catcierge_timer_wheel.h"
+
+typedef struct catcierge_reactor_s catcierge_reactor_t;
+
+// Called when a registered fd becomes ready. events is the epoll event mask.
+typedef void (*catcierge_reactor_cb_f)(catcierge_reactor_t *r, int fd, uint32_t events, void *user);
+
+// Called for each signal received via the signalfd.
+typedef void (*catcierge_reactor_signal_cb_f)(catcierge_reactor_t *r, int signo, void *user);
+
+typedef enum catcierge_reactor_handler_type_e
+{
+	CATCIERGE_REACTOR_FD,
+	CATCIERGE_REACTOR_EVENT,
+	CATCIERGE_REACTOR_SIGNAL
+} catcierge_reactor_handler_type_t;
+
+typedef struct catcierge_reactor_handler_s
+{
+	int fd;
+	catcierge_reactor_handler_type_t type;
+	catcierge_reactor_cb_f cb;
+	catcierge_reactor_signal_cb_f signal_cb;
+	void *user;
+	struct catcierge_reactor_handler_s *next;
+} catcierge_reactor_handler_t;
+
+struct catcierge_reactor_s
+{
+	int epfd;
+	int running;
+	sigset_t sigmask;
+	catcierge_reactor_handler_t *handlers;
+	catcierge_timer_wheel_t *wheel;
+};
+
+int catcierge_reactor_init(catcierge_reactor_t *r);
+void catcierge_reactor_destroy(catcierge_reactor_t *r);
+
+// Watch an fd owned by the caller. It is not closed on removal.
+int catcierge_reactor_add_fd(catcierge_reactor_t *r, int fd, uint32_t events,
+			catcierge_reactor_cb_f cb, void *user);
+int catcierge_reactor_remove_fd(catcierge_reactor_t *r, int fd);
+
+// Creates an eventfd that other threads can wake the loop with
+// using catcierge_reactor_notify. Returns the fd or -1.
+int catcierge_reactor_add_event(catcierge_reactor_t *r,
+			catcierge_reactor_cb_f cb, void *user);
+int catcierge_reactor_notify(int event_fd);
+
+// Blocks the given signals and delivers them via a signalfd instead.
+// This must be called before any other threads are started, so that
+// they inherit the blocked signal mask.
+int catcierge_reactor_add_signals(catcierge_reactor_t *r,
+			const int *signals, size_t count,
+			catcierge_reactor_signal_cb_f cb, void *user);
+
+// Wheel timers are run by the loop, and it never sleeps
+// past the next wheel deadline.
+void catcierge_reactor_set_timer_wheel(catcierge_reactor_t *r,
+			catcierge_timer_wheel_t *wheel);
+
+// Waits at most timeout_ms (-1 for forever) and dispatches ready handlers.
+// Returns the number of handlers dispatched (including wheel timers)
+// or -1 on error.
+int catcierge_reactor_run_once(catcierge_reactor_t *r, int timeout_ms);
+
+// Runs until catcierge_reactor_stop is called.
+int catcierge_reactor_run(catcierge_reactor_t *r);
+void catcierge_reactor_stop(catcierge_reactor_t *r);
+
+#endif // __CATCIERGE_REACTOR_H__
@@ -16,6 +16,7 @@
 //    You should have received a copy of the GNU General Public License
 //    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
 //
+#include <catcierge_config.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,7 +28,10 @@
 #include <errno.h>
 #include <sys/types.h> 
 #include <sys/socket.h>
+#include <poll.h>
 #include "catcierge_rfid.h"
+#include "catcierge_clock.h"
+#include "catcierge_platform.h"
 #include "catcierge_log.h"
 
 #define _POSIX_SOURCE 1 // POSIX compliant source.
@@ -54,9 +58,10 @@ int catcierge_rfid_init(const char *name, catcierge_rfid_t *rfid,
 	rfid->fd = -1;
 	rfid->cb = read_cb;
 	rfid->user = user;
-	rfid->bytes_read = 0;
 	rfid->offset = 0;
+	rfid->discard = 0;
 	rfid->state = CAT_DISCONNECTED;
+	rfid->ctx = NULL;
 
 	return 0;
 }
@@ -76,46 +81,64 @@ void catcierge_rfid_destroy(catcierge_rfid_t *rfid)
 	rfid->state = CAT_DISCONNECTED;
 }
 
-static int catcierge_rfid_read(catcierge_rfid_t *rfid)
+static void catcierge_rfid_tag_received(catcierge_rfid_t *rfid, int complete,
+			const char *data, size_t data_len, const struct timeval *time)
 {
-	int ret = 0;
-	int is_error = 0;
-	int errorcode;
-	const char *error_msg = NULL;
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	catcierge_rfid_tag_t *tag = NULL;
+	catcierge_rfid_context_t *ctx = rfid->ctx;
 
-	if ((rfid->bytes_read = read(rfid->fd, rfid->buf, 
-								sizeof(rfid->buf) - 1)) < 0)
+	// On the reader thread, leave it to the FSM to call the callback.
+	if (ctx && ctx->started)
 	{
-		if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+		if (!(tag = malloc(sizeof(catcierge_rfid_tag_t) + data_len + 1)))
 		{
-			CATERR("%s RFID Reader: Read error %d, %s\n", rfid->name, errno, strerror(errno));
-			ret = -1;
-			goto fail;
+			CATERR("Out of memory\n");
+			return;
 		}
 
-		CATERR("%s RFID Reader: Need more\n");
-		// TODO: Add CAT_NEED_MORE state here and handle that.
-		return -1;
-	}
+		tag->rfid = rfid;
+		tag->complete = complete;
+		tag->time = *time;
+		tag->data_len = data_len;
+		memcpy(tag->data, data, data_len);
+		tag->data[data_len] = '\0';
 
-	// Get rid of any trailing CRLF.
-	if (rfid->buf[rfid->bytes_read - 1] == '\n') rfid->bytes_read--;
-	if (rfid->buf[rfid->bytes_read - 1] == '\r') rfid->bytes_read--;
+		if (catcierge_queue_push(&ctx->tags, tag))
+		{
+			CATERR("%s RFID Reader: Queue full, dropped tag %s\n", rfid->name, tag->data);
+			catcierge_atomic_inc(&ctx->dropped);
+			free(tag);
+			return;
+		}
 
-	rfid->buf[rfid->bytes_read] = '\0';
-	CATLOG("%s RFID Reader: %ld bytes: %s\n", rfid->name, rfid->bytes_read, rfid->buf);
+		if (ctx->notify)
+		{
+			ctx->notify(ctx, ctx->notify_user);
+		}
 
-	if (rfid->bytes_read == 0)
-	{
-		// TODO: EOF, do something special here?
-		return 0;
+		return;
 	}
+	#endif // CATCIERGE_HAVE_PTHREADS
+
+	rfid->time = *time;
+	rfid->cb(rfid, complete, data, data_len, rfid->user);
+}
+
+static void catcierge_rfid_handle_line(catcierge_rfid_t *rfid,
+			const char *line, size_t len, const struct timeval *time)
+{
+	int is_error = 0;
+	int errorcode;
+	const char *error_msg = NULL;
+
+	CATLOG("%s RFID Reader: %d bytes: %s\n", rfid->name, (int)len, line);
 
 	// Check for error.
-	if (rfid->buf[0] == '?')
+	if (line[0] == '?')
 	{
 		is_error = 1;
-		errorcode = atoi(&rfid->buf[1]);
+		errorcode = atoi(&line[1]);
 		error_msg = catcierge_rfid_error_str(errorcode);
 
 		CATERR("%s RFID reader: error %d on read, %s\n", 
@@ -132,8 +155,8 @@ static int catcierge_rfid_read(catcierge_rfid_t *rfid)
 	{
 		if (!is_error)
 		{
-			int complete = (rfid->bytes_read >= 15);
-			rfid->cb(rfid, complete, rfid->buf, rfid->bytes_read, rfid->user);
+			int complete = (len >= 15);
+			catcierge_rfid_tag_received(rfid, complete, line, len, time);
 		}
 		else
 		{
@@ -144,21 +167,106 @@ static int catcierge_rfid_read(catcierge_rfid_t *rfid)
 	{
 		CATERR("%s RFID Reader: Invalid state on read, %d\n", rfid->name, rfid->state);
 	}
+}
+
+void catcierge_rfid_parse(catcierge_rfid_t *rfid, const char *data, size_t len,
+			const struct timeval *time)
+{
+	size_t i;
+	assert(rfid);
+	assert(data || !len);
+	assert(time);
+
+	// The reader ends each line with CR (and sometimes LF), but a read
+	// can return anything from part of a line to several lines at once.
+	for (i = 0; i < len; i++)
+	{
+		if ((data[i] == '\r') || (data[i] == '\n'))
+		{
+			// Empty lines are the second half of a CRLF.
+			if ((rfid->offset > 0) && !rfid->discard)
+			{
+				rfid->buf[rfid->offset] = '\0';
+				catcierge_rfid_handle_line(rfid, rfid->buf, rfid->offset, time);
+			}
+
+			rfid->offset = 0;
+			rfid->discard = 0;
+			continue;
+		}
+
+		if (rfid->discard)
+		{
+			continue;
+		}
+
+		if (rfid->offset >= (ssize_t)(sizeof(rfid->buf) - 1))
+		{
+			CATERR("%s RFID Reader: Line too long, discarding it\n", rfid->name);
+			rfid->offset = 0;
+			rfid->discard = 1;
+			continue;
+		}
+
+		rfid->buf[rfid->offset++] = data[i];
+	}
+}
+
+static void catcierge_rfid_lost(catcierge_rfid_t *rfid)
+{
+	CATERR("%s RFID Reader: Serial port closed, no longer listening\n", rfid->name);
+
+	if (rfid->fd > 0)
+	{
+		close(rfid->fd);
+		rfid->fd = -1;
+	}
 
-fail:
-	rfid->bytes_read = 0;
 	rfid->offset = 0;
-	return ret;
+	rfid->discard = 0;
+	rfid->state = CAT_DISCONNECTED;
+}
+
+static int catcierge_rfid_read(catcierge_rfid_t *rfid)
+{
+	char data[256];
+	ssize_t bytes_read;
+	struct timeval time;
+
+	if ((bytes_read = read(rfid->fd, data, sizeof(data))) < 0)
+	{
+		if ((errno == EWOULDBLOCK) || (errno == EAGAIN) || (errno == EINTR))
+		{
+			// Nothing to read after all, the rest of the line will come later.
+			return 0;
+		}
+
+		CATERR("%s RFID Reader: Read error %d, %s\n", rfid->name, errno, strerror(errno));
+		catcierge_rfid_lost(rfid);
+		return -1;
+	}
+
+	if (bytes_read == 0)
+	{
+		catcierge_rfid_lost(rfid);
+		return -1;
+	}
+
+	// Timestamp the tag when it arrives and not when the FSM gets to it.
+	catcierge_clock_gettimeofday(&time);
+	catcierge_rfid_parse(rfid, data, bytes_read, &time);
+
+	return 0;
 }
 
 static void _set_maxfd(catcierge_rfid_context_t *ctx)
 {
-	int i;
+	size_t i;
 	int max_fd = 0;
 
-	for (i = 0; i < RFID_COUNT; i++)
+	for (i = 0; i < ctx->count; i++)
 	{
-		if (ctx->rfids[i] && (ctx->rfids[i]->fd > max_fd))
+		if (ctx->rfids[i]->fd > max_fd)
 		{
 			max_fd = ctx->rfids[i]->fd;
 		}
@@ -175,28 +283,208 @@ int catcierge_rfid_ctx_init(catcierge_rfid_context_t *ctx)
 
 int catcierge_rfid_ctx_destroy(catcierge_rfid_context_t *ctx)
 {
+	catcierge_rfid_ctx_stop(ctx);
+	free(ctx->rfids);
 	memset(ctx, 0, sizeof(catcierge_rfid_context_t));
 	return 0;
 }
 
+#ifdef CATCIERGE_HAVE_PTHREADS
+static void *catcierge_rfid_thread(void *arg)
+{
+	size_t i;
+	size_t count;
+	catcierge_rfid_context_t *ctx = (catcierge_rfid_context_t *)arg;
+	catcierge_rfid_t **rfids = NULL;
+	struct pollfd *fds = NULL;
+
+	// The first slot is for the wake up pipe.
+	if (!(rfids = calloc(ctx->count + 1, sizeof(catcierge_rfid_t *)))
+	 || !(fds = calloc(ctx->count + 1, sizeof(struct pollfd))))
+	{
+		CATERR("Out of memory\n");
+		goto fail;
+	}
+
+	while (1)
+	{
+		memset(fds, 0, (ctx->count + 1) * sizeof(struct pollfd));
+		fds[0].fd = ctx->wake[0];
+		fds[0].events = POLLIN;
+		count = 1;
+
+		for (i = 0; i < ctx->count; i++)
+		{
+			catcierge_rfid_t *rfid = ctx->rfids[i];
+
+			if ((rfid->fd > 0) && (rfid->state != CAT_DISCONNECTED))
+			{
+				fds[count].fd = rfid->fd;
+				fds[count].events = POLLIN;
+				rfids[count] = rfid;
+				count++;
+			}
+		}
+
+		// Sleeps until a reader has something to say.
+		if (poll(fds, count, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			CATERR("RFID poll error %d, %s\n", errno, strerror(errno));
+			break;
+		}
+
+		if (fds[0].revents)
+		{
+			break;
+		}
+
+		for (i = 1; i < count; i++)
+		{
+			// A failed read has already dropped the reader.
+			if ((fds[i].revents & POLLIN) && catcierge_rfid_read(rfids[i]))
+			{
+				continue;
+			}
+
+			// Whatever was still buffered has been read above, on a hang up
+			// the reader has to go or poll will keep returning right away.
+			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				catcierge_rfid_lost(rfids[i]);
+			}
+		}
+	}
+
+fail:
+	free(rfids);
+	free(fds);
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int catcierge_rfid_ctx_start(catcierge_rfid_context_t *ctx)
+{
+	assert(ctx);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (ctx->started)
+		return 0;
+
+	if (catcierge_queue_init(&ctx->tags, CATCIERGE_RFID_QUEUE_SIZE))
+		return -1;
+
+	if (pipe(ctx->wake))
+	{
+		CATERR("Failed to create RFID pipe %d, %s\n", errno, strerror(errno));
+		goto fail;
+	}
+
+	// Set before the thread runs so that it queues the tags.
+	ctx->started = 1;
+
+	if (pthread_create(&ctx->thread, NULL, catcierge_rfid_thread, ctx))
+	{
+		CATERR("Failed to start RFID thread\n");
+		ctx->started = 0;
+		close(ctx->wake[0]);
+		close(ctx->wake[1]);
+		goto fail;
+	}
+
+	CATLOG("Started RFID thread\n");
+
+	return 0;
+
+fail:
+	catcierge_queue_destroy(&ctx->tags);
+	return -1;
+	#else
+	return -1;
+	#endif // CATCIERGE_HAVE_PTHREADS
+}
+
+void catcierge_rfid_ctx_stop(catcierge_rfid_context_t *ctx)
+{
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	catcierge_rfid_tag_t *tag = NULL;
+	assert(ctx);
+
+	if (!ctx->started)
+		return;
+
+	if (write(ctx->wake[1], "", 1) < 0)
+	{
+		CATERR("Failed to stop RFID thread %d, %s\n", errno, strerror(errno));
+	}
+
+	pthread_join(ctx->thread, NULL);
+	close(ctx->wake[0]);
+	close(ctx->wake[1]);
+	ctx->started = 0;
+
+	while ((tag = catcierge_queue_pop(&ctx->tags)))
+	{
+		free(tag);
+	}
+
+	catcierge_queue_destroy(&ctx->tags);
+
+	if (ctx->dropped)
+	{
+		CATLOG("RFID: %ld tags dropped\n", (long)ctx->dropped);
+	}
+	#endif // CATCIERGE_HAVE_PTHREADS
+}
+
+void catcierge_rfid_ctx_set_notify(catcierge_rfid_context_t *ctx,
+			catcierge_rfid_notify_f notify, void *user)
+{
+	assert(ctx);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	ctx->notify = notify;
+	ctx->notify_user = user;
+	#endif
+}
+
 int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
 {
-	int i;
+	size_t i;
 	int res = 0;
 	struct timeval tv = {0, 0};
 
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	if (ctx->started)
+	{
+		catcierge_rfid_tag_t *tag = NULL;
+
+		while ((tag = catcierge_queue_pop(&ctx->tags)))
+		{
+			catcierge_rfid_t *rfid = tag->rfid;
+			rfid->time = tag->time;
+			rfid->cb(rfid, tag->complete, tag->data, tag->data_len, rfid->user);
+			free(tag);
+		}
+
+		return 0;
+	}
+	#endif // CATCIERGE_HAVE_PTHREADS
+
 	_set_maxfd(ctx);
 
-	if (!ctx->rfids[RFID_IN] && !ctx->rfids[RFID_OUT])
+	if (ctx->count == 0)
 	{
 		return -1;
 	}
 
 	FD_ZERO(&ctx->readfs);
 
-	for (i = 0; i < RFID_COUNT; i++)
+	for (i = 0; i < ctx->count; i++)
 	{
-		if (ctx->rfids[i] && (ctx->rfids[i]->fd > 0))
+		if (ctx->rfids[i]->fd > 0)
 		{
 			FD_SET(ctx->rfids[i]->fd, &ctx->readfs);
 		}
@@ -207,9 +495,9 @@ int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
 		return 0; // No input available.
 	}
 
-	for (i = 0; i < RFID_COUNT; i++)
+	for (i = 0; i < ctx->count; i++)
 	{
-		if (ctx->rfids[i] && FD_ISSET(ctx->rfids[i]->fd, &ctx->readfs))
+		if ((ctx->rfids[i]->fd > 0) && FD_ISSET(ctx->rfids[i]->fd, &ctx->readfs))
 		{
 			if (catcierge_rfid_read(ctx->rfids[i]) < 0)
 			{
@@ -221,18 +509,42 @@ int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx)
 	return 0;
 }
 
-void catcierge_rfid_ctx_set_inner(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid)
+int catcierge_rfid_service(catcierge_rfid_t *rfid)
 {
-	assert(ctx);
-	ctx->rfids[RFID_IN] = rfid;
-	_set_maxfd(ctx);
+	assert(rfid);
+
+	// Used when the fd is already known to be readable,
+	// for instance when it is watched by the grabber event loop.
+	if (rfid->fd <= 0)
+	{
+		return -1;
+	}
+
+	return catcierge_rfid_read(rfid);
 }
 
-void catcierge_rfid_ctx_set_outer(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid)
+int catcierge_rfid_ctx_add(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid)
 {
+	catcierge_rfid_t **rfids = NULL;
 	assert(ctx);
-	ctx->rfids[RFID_OUT] = rfid;
+	assert(rfid);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	assert(!ctx->started);
+	#endif
+
+	if (!(rfids = realloc(ctx->rfids, (ctx->count + 1) * sizeof(catcierge_rfid_t *))))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	ctx->rfids = rfids;
+	ctx->rfids[ctx->count++] = rfid;
+	rfid->ctx = ctx;
 	_set_maxfd(ctx);
+
+	return 0;
 }
 
 int catcierge_rfid_write_rat(catcierge_rfid_t *rfid)
@@ -28,13 +28,21 @@
 #ifndef __CATCIERGE_RFID_H__
 #define __CATCIERGE_RFID_H__
 
+#include <catcierge_config.h>
 #include <termios.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include "catcierge_queue.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #define EXAMPLE_RFID_STR "999_000000001007" //_1_0_AEC4_000000"
 
 typedef struct catcierge_rfid_s catcierge_rfid_t;
+typedef struct catcierge_rfid_context_s catcierge_rfid_context_t;
 
 typedef void (*catcierge_rfid_read_f)(catcierge_rfid_t *rfid, int complete, const char *data, size_t data_len, void *user);
 
@@ -54,32 +62,75 @@ struct catcierge_rfid_s
 	char name[256];
 	const char *serial_path;
 	int fd;
-	ssize_t bytes_read;
-	ssize_t offset;
+	ssize_t offset;			// Length of the partial line in buf.
+	int discard;			// The line did not fit in buf, skip the rest of it.
 	char buf[1024];
 	catcierge_rfid_read_f cb;
 	void *user;
 	catcierge_rfid_state_t state;
+	struct timeval time;	// When the tag passed to cb was received.
+	catcierge_rfid_context_t *ctx;
 };
 
-#define RFID_IN 0
-#define RFID_OUT 1
-#define RFID_COUNT 2
+#define CATCIERGE_RFID_QUEUE_SIZE 64
+
+// Called from the reader thread when a tag has been queued.
+typedef void (*catcierge_rfid_notify_f)(catcierge_rfid_context_t *ctx, void *user);
 
-typedef struct catcierge_rfid_context_s
+typedef struct catcierge_rfid_tag_s
+{
+	catcierge_rfid_t *rfid;
+	int complete;
+	struct timeval time;
+	size_t data_len;
+	char data[];
+} catcierge_rfid_tag_t;
+
+struct catcierge_rfid_context_s
 {
 	fd_set readfs;
 	int maxfd;
-	catcierge_rfid_t *rfids[RFID_COUNT];
-} catcierge_rfid_context_t;
+	catcierge_rfid_t **rfids;		// Ordered from the inside of the door to the outside.
+	size_t count;
+
+	// Reader thread, see catcierge_rfid_ctx_start.
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_t thread;
+	int started;
+	int wake[2];					// Written to stop the thread.
+	catcierge_queue_t tags;			// Tags waiting for catcierge_rfid_ctx_service.
+	catcierge_rfid_notify_f notify;
+	void *notify_user;
+	volatile long dropped;
+	#endif
+};
 
 int catcierge_rfid_init(const char *name, catcierge_rfid_t *rfid, 
 			const char *serial_path, catcierge_rfid_read_f read_cb, void *user);
 
 void catcierge_rfid_destroy(catcierge_rfid_t *rfid);
+
+// Calls the read callbacks for any tags that have been received.
+// Without the reader thread this polls the serial ports instead.
 int catcierge_rfid_ctx_service(catcierge_rfid_context_t *ctx);
-void catcierge_rfid_ctx_set_inner(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid);
-void catcierge_rfid_ctx_set_outer(catcierge_rfid_context_t * ctx, catcierge_rfid_t *rfid);
+int catcierge_rfid_service(catcierge_rfid_t *rfid);
+
+// Feeds data received from the reader to the line parser. Lines can be
+// split over several calls and one call can contain several lines.
+void catcierge_rfid_parse(catcierge_rfid_t *rfid, const char *data, size_t len,
+			const struct timeval *time);
+
+// Reads the serial ports on a thread of its own, so tags are picked
+// up (and timestamped) right away even when matching is slow. The tags
+// are handed to the read callbacks by catcierge_rfid_ctx_service.
+// Add and open the readers and set the notify callback before starting.
+int catcierge_rfid_ctx_start(catcierge_rfid_context_t *ctx);
+void catcierge_rfid_ctx_stop(catcierge_rfid_context_t *ctx);
+void catcierge_rfid_ctx_set_notify(catcierge_rfid_context_t *ctx,
+			catcierge_rfid_notify_f notify, void *user);
+
+// Readers are added in order from the inside of the door to the outside.
+int catcierge_rfid_ctx_add(catcierge_rfid_context_t *ctx, catcierge_rfid_t *rfid);
 int catcierge_rfid_open(catcierge_rfid_t *rfid);
 int catcierge_rfid_write_rat(catcierge_rfid_t *rfid);
 int catcierge_rfid_ctx_init(catcierge_rfid_context_t *ctx);
@@ -0,0 +1,166 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_rfid_allowed.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+
+int catcierge_rfid_allowed_init(catcierge_rfid_allowed_t *allowed)
+{
+	assert(allowed);
+	memset(allowed, 0, sizeof(catcierge_rfid_allowed_t));
+	return 0;
+}
+
+void catcierge_rfid_allowed_destroy(catcierge_rfid_allowed_t *allowed)
+{
+	catcierge_rfid_allowed_tag_t *it = NULL;
+	catcierge_rfid_allowed_tag_t *tmp = NULL;
+	assert(allowed);
+
+	HASH_ITER(hh, allowed->tags, it, tmp)
+	{
+		HASH_DEL(allowed->tags, it);
+		free(it);
+	}
+
+	allowed->tags = NULL;
+	allowed->count = 0;
+}
+
+int catcierge_rfid_allowed_add(catcierge_rfid_allowed_t *allowed, const char *tag)
+{
+	size_t len;
+	catcierge_rfid_allowed_tag_t *it = NULL;
+	assert(allowed);
+	assert(tag);
+
+	HASH_FIND_STR(allowed->tags, tag, it);
+
+	if (it)
+	{
+		return 0;
+	}
+
+	len = strlen(tag);
+
+	if (!(it = calloc(1, sizeof(catcierge_rfid_allowed_tag_t) + len + 1)))
+	{
+		CATERR("Out of memory\n");
+		return -1;
+	}
+
+	memcpy(it->tag, tag, len + 1);
+	HASH_ADD_KEYPTR(hh, allowed->tags, it->tag, len, it);
+	allowed->count++;
+
+	return 0;
+}
+
+int catcierge_rfid_allowed_contains(catcierge_rfid_allowed_t *allowed, const char *tag)
+{
+	catcierge_rfid_allowed_tag_t *it = NULL;
+	assert(allowed);
+
+	if (!tag)
+		return 0;
+
+	HASH_FIND_STR(allowed->tags, tag, it);
+
+	return (it != NULL);
+}
+
+int catcierge_rfid_allowed_add_file(catcierge_rfid_allowed_t *allowed, const char *path)
+{
+	int ret = 0;
+	char *contents = NULL;
+	char *line = NULL;
+	char *next = NULL;
+	char *tag = NULL;
+	char *save = NULL;
+	char *comment = NULL;
+	assert(allowed);
+	assert(path);
+
+	if (!(contents = catcierge_read_file(path)))
+	{
+		return -1;
+	}
+
+	for (line = contents; line; line = next)
+	{
+		if ((next = strchr(line, '\n')))
+		{
+			*next++ = '\0';
+		}
+
+		if ((comment = strchr(line, '#')))
+		{
+			*comment = '\0';
+		}
+
+		for (tag = strtok_r(line, " \t\r,", &save); tag;
+			 tag = strtok_r(NULL, " \t\r,", &save))
+		{
+			if (catcierge_rfid_allowed_add(allowed, tag))
+			{
+				ret = -1;
+				goto fail;
+			}
+		}
+	}
+
+fail:
+	free(contents);
+	return ret;
+}
+
+int catcierge_rfid_allowed_load(catcierge_rfid_allowed_t *allowed,
+		char **tags, size_t count, const char *path)
+{
+	size_t i;
+	catcierge_rfid_allowed_t tmp;
+	assert(allowed);
+
+	catcierge_rfid_allowed_init(&tmp);
+
+	for (i = 0; i < count; i++)
+	{
+		if (catcierge_rfid_allowed_add(&tmp, tags[i]))
+			goto fail;
+	}
+
+	if (path && catcierge_rfid_allowed_add_file(&tmp, path))
+	{
+		CATERR("Failed to load allowed RFID tags from %s\n", path);
+		goto fail;
+	}
+
+	catcierge_rfid_allowed_destroy(allowed);
+	*allowed = tmp;
+
+	return 0;
+
+fail:
+	catcierge_rfid_allowed_destroy(&tmp);
+	return -1;
+}
@@ -0,0 +1,61 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_RFID_ALLOWED_H__
+#define __CATCIERGE_RFID_ALLOWED_H__
+
+//
+// Set of the RFID tags that are allowed through the door.
+//
+// Lookups are done in a hash table so a shelter with hundreds of
+// chips does not have to compare every tag. The set can be reloaded
+// while running, if that fails the old set is kept.
+//
+
+#include <stddef.h>
+#include "uthash.h"
+
+typedef struct catcierge_rfid_allowed_tag_s
+{
+	UT_hash_handle hh;
+	char tag[];
+} catcierge_rfid_allowed_tag_t;
+
+typedef struct catcierge_rfid_allowed_s
+{
+	catcierge_rfid_allowed_tag_t *tags;
+	size_t count;
+} catcierge_rfid_allowed_t;
+
+int catcierge_rfid_allowed_init(catcierge_rfid_allowed_t *allowed);
+void catcierge_rfid_allowed_destroy(catcierge_rfid_allowed_t *allowed);
+
+// Adding a tag that is already in the set does nothing.
+int catcierge_rfid_allowed_add(catcierge_rfid_allowed_t *allowed, const char *tag);
+int catcierge_rfid_allowed_contains(catcierge_rfid_allowed_t *allowed, const char *tag);
+
+// Adds the tags listed in a file. Tags are separated by whitespace or
+// commas, and # starts a comment that runs to the end of the line.
+int catcierge_rfid_allowed_add_file(catcierge_rfid_allowed_t *allowed, const char *path);
+
+// Replaces the set with the given tags and the ones in the file (can be NULL).
+// The set is left untouched on failure.
+int catcierge_rfid_allowed_load(catcierge_rfid_allowed_t *allowed,
+		char **tags, size_t count, const char *path);
+
+#endif // __CATCIERGE_RFID_ALLOWED_H__
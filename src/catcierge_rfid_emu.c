@@ -0,0 +1,558 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include "catcierge_rfid_emu.h"
+#include "catcierge_clock.h"
+#include "catcierge_util.h"
+#include "catcierge_log.h"
+
+#ifdef CATCIERGE_HAVE_PTY_H
+#include <pty.h>
+#endif
+
+#ifdef CATCIERGE_HAVE_UTIL_H
+#include <util.h>
+#endif
+
+#define IS_RUNNING(running) (!(running) || *(running))
+
+// How long to wait for catcierge to read the data before giving up.
+#define RFID_EMU_WRITE_TIMEOUT_MS 1000
+
+int catcierge_rfid_emu_init(catcierge_rfid_emu_t *emu, const char *name)
+{
+	int flags;
+	char *slave_path = NULL;
+	struct termios options;
+	assert(emu);
+	assert(name);
+
+	memset(emu, 0, sizeof(catcierge_rfid_emu_t));
+	snprintf(emu->name, sizeof(emu->name), "%s", name);
+	emu->master = -1;
+	emu->slave = -1;
+
+	if (openpty(&emu->master, &emu->slave, NULL, NULL, NULL))
+	{
+		CATERR("%s RFID emulator: Failed to create pseudo terminal %d, %s\n",
+				emu->name, errno, strerror(errno));
+		goto fail;
+	}
+
+	if (!(slave_path = ttyname(emu->slave)))
+	{
+		CATERR("%s RFID emulator: Failed to get pseudo terminal name\n", emu->name);
+		goto fail;
+	}
+
+	snprintf(emu->slave_path, sizeof(emu->slave_path), "%s", slave_path);
+
+	// The slave is kept open so that the master stays usable when catcierge
+	// closes the port. Raw mode so nothing is echoed back before it is opened.
+	if (!tcgetattr(emu->slave, &options))
+	{
+		cfmakeraw(&options);
+		tcsetattr(emu->slave, TCSANOW, &options);
+	}
+
+	if (((flags = fcntl(emu->master, F_GETFL)) < 0)
+	 || (fcntl(emu->master, F_SETFL, flags | O_NONBLOCK) < 0))
+	{
+		CATERR("%s RFID emulator: fcntl error %d, %s\n", emu->name, errno, strerror(errno));
+		goto fail;
+	}
+
+	CATLOG("%s RFID emulator: Listening on %s\n", emu->name, emu->slave_path);
+
+	return 0;
+fail:
+	catcierge_rfid_emu_destroy(emu);
+	return -1;
+}
+
+void catcierge_rfid_emu_destroy(catcierge_rfid_emu_t *emu)
+{
+	assert(emu);
+
+	if (emu->master >= 0)
+	{
+		close(emu->master);
+		emu->master = -1;
+	}
+
+	if (emu->slave >= 0)
+	{
+		close(emu->slave);
+		emu->slave = -1;
+	}
+}
+
+static int catcierge_rfid_emu_write(catcierge_rfid_emu_t *emu, const char *buf, size_t len)
+{
+	ssize_t bytes;
+	struct pollfd fd;
+
+	while (len > 0)
+	{
+		if ((bytes = write(emu->master, buf, len)) < 0)
+		{
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+			{
+				CATERR("%s RFID emulator: Write error %d, %s\n", emu->name, errno, strerror(errno));
+				return -1;
+			}
+
+			// The pty buffer is full, wait for catcierge to read it.
+			fd.fd = emu->master;
+			fd.events = POLLOUT;
+			fd.revents = 0;
+
+			if (poll(&fd, 1, RFID_EMU_WRITE_TIMEOUT_MS) == 0)
+			{
+				CATERR("%s RFID emulator: Write timed out, is %s open?\n",
+						emu->name, emu->slave_path);
+				return -1;
+			}
+
+			continue;
+		}
+
+		buf += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+static int catcierge_rfid_emu_write_line(catcierge_rfid_emu_t *emu,
+			catcierge_rfid_emu_settings_t *settings, const char *data)
+{
+	int len;
+	size_t offset;
+	size_t chunk;
+	char line[CATCIERGE_RFID_EMU_MAX_DATA + 2];
+
+	len = snprintf(line, sizeof(line), "%.*s%s",
+			CATCIERGE_RFID_EMU_MAX_DATA - 1, data,
+			(settings && settings->crlf) ? "\r\n" : "\r");
+
+	if (!settings || (settings->fragment == 0))
+	{
+		return catcierge_rfid_emu_write(emu, line, len);
+	}
+
+	// Split the line up like a slow serial port would.
+	for (offset = 0; offset < (size_t)len; offset += chunk)
+	{
+		chunk = 1 + (rand_r(&settings->seed) % settings->fragment);
+
+		if (chunk > (len - offset))
+		{
+			chunk = len - offset;
+		}
+
+		if (catcierge_rfid_emu_write(emu, &line[offset], chunk))
+		{
+			return -1;
+		}
+
+		if (((offset + chunk) < (size_t)len) && (settings->fragment_delay > 0.0))
+		{
+			catcierge_clock_sleep(settings->fragment_delay);
+		}
+	}
+
+	return 0;
+}
+
+static void catcierge_rfid_emu_handle_command(catcierge_rfid_emu_t *emu, const char *cmd)
+{
+	CATLOG("%s RFID emulator: Received %s\n", emu->name, cmd);
+
+	if (!strcasecmp(cmd, "RAT"))
+	{
+		emu->rat = 1;
+		catcierge_rfid_emu_write_line(emu, NULL, "OK");
+	}
+	else
+	{
+		// Command not understood.
+		catcierge_rfid_emu_write_line(emu, NULL, "?0");
+	}
+}
+
+int catcierge_rfid_emu_service(catcierge_rfid_emu_t *emu)
+{
+	char data[64];
+	ssize_t bytes;
+	ssize_t i;
+	assert(emu);
+
+	while ((bytes = read(emu->master, data, sizeof(data))) > 0)
+	{
+		for (i = 0; i < bytes; i++)
+		{
+			if ((data[i] == '\r') || (data[i] == '\n'))
+			{
+				if (emu->offset > 0)
+				{
+					emu->buf[emu->offset] = '\0';
+					catcierge_rfid_emu_handle_command(emu, emu->buf);
+				}
+
+				emu->offset = 0;
+				continue;
+			}
+
+			// catcierge sends the NUL terminator after RAT.
+			if (data[i] == '\0')
+				continue;
+
+			if (emu->offset < (sizeof(emu->buf) - 1))
+			{
+				emu->buf[emu->offset++] = data[i];
+			}
+		}
+	}
+
+	if ((bytes < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+	{
+		CATERR("%s RFID emulator: Read error %d, %s\n", emu->name, errno, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int catcierge_rfid_emu_wait_until(catcierge_rfid_emu_t *emus, size_t count,
+		double until, volatile int *running)
+{
+	size_t i;
+	double left;
+	struct pollfd fds[CATCIERGE_RFID_EMU_MAX_READERS];
+	assert(emus);
+	assert(count <= CATCIERGE_RFID_EMU_MAX_READERS);
+
+	for (i = 0; i < count; i++)
+	{
+		fds[i].fd = emus[i].master;
+		fds[i].events = POLLIN;
+	}
+
+	do
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (catcierge_rfid_emu_service(&emus[i]))
+			{
+				return -1;
+			}
+
+			fds[i].revents = 0;
+		}
+
+		if ((left = until - catcierge_clock_monotonic()) <= 0.0)
+		{
+			break;
+		}
+
+		// Wake up now and then to check if we should stop.
+		if ((poll(fds, count, (left < 0.1) ? (int)(left * 1000.0) : 100) < 0)
+			&& (errno != EINTR))
+		{
+			CATERR("RFID emulator: Poll error %d, %s\n", errno, strerror(errno));
+			return -1;
+		}
+	} while (IS_RUNNING(running));
+
+	return 0;
+}
+
+int catcierge_rfid_emu_wait_rat(catcierge_rfid_emu_t *emus, size_t count,
+		volatile int *running)
+{
+	size_t i;
+	size_t rat_count = 0;
+	assert(emus);
+
+	while (IS_RUNNING(running))
+	{
+		for (i = 0, rat_count = 0; i < count; i++)
+		{
+			rat_count += emus[i].rat ? 1 : 0;
+		}
+
+		if (rat_count == count)
+		{
+			return 0;
+		}
+
+		if (catcierge_rfid_emu_wait_until(emus, count,
+				catcierge_clock_monotonic() + 0.1, running))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int catcierge_rfid_emu_send(catcierge_rfid_emu_t *emu,
+		catcierge_rfid_emu_settings_t *settings, const char *data)
+{
+	char noise[CATCIERGE_RFID_EMU_MAX_DATA];
+	size_t len;
+	assert(emu);
+	assert(settings);
+	assert(data);
+
+	// Things the real readers send now and then.
+	if ((settings->noise > 0.0)
+		&& (((double)rand_r(&settings->seed) / RAND_MAX) < settings->noise))
+	{
+		len = strlen(data);
+
+		switch (rand_r(&settings->seed) % 3)
+		{
+			case 0: snprintf(noise, sizeof(noise), "?1"); break; // Tag not present.
+			case 1: noise[0] = '\0'; break;
+			default:
+			{
+				// Partial read of the tag, short enough to not look complete.
+				snprintf(noise, sizeof(noise), "%.*s",
+					(int)(1 + (rand_r(&settings->seed) % (len / 2 + 1))), data);
+				break;
+			}
+		}
+
+		if (catcierge_rfid_emu_write_line(emu, settings, noise))
+		{
+			return -1;
+		}
+	}
+
+	if (catcierge_rfid_emu_write_line(emu, settings, data))
+	{
+		return -1;
+	}
+
+	emu->sent++;
+
+	return 0;
+}
+
+void catcierge_rfid_emu_settings_init(catcierge_rfid_emu_settings_t *settings)
+{
+	assert(settings);
+	memset(settings, 0, sizeof(catcierge_rfid_emu_settings_t));
+	settings->rate = 1.0;
+}
+
+int catcierge_rfid_emu_timeline_init(catcierge_rfid_emu_timeline_t *timeline)
+{
+	assert(timeline);
+	memset(timeline, 0, sizeof(catcierge_rfid_emu_timeline_t));
+	return 0;
+}
+
+void catcierge_rfid_emu_timeline_destroy(catcierge_rfid_emu_timeline_t *timeline)
+{
+	assert(timeline);
+	catcierge_xfree(&timeline->events);
+	timeline->count = 0;
+	timeline->alloc_count = 0;
+}
+
+int catcierge_rfid_emu_timeline_add(catcierge_rfid_emu_timeline_t *timeline,
+		double time, size_t reader, const char *data)
+{
+	size_t alloc_count;
+	catcierge_rfid_emu_event_t *events = NULL;
+	catcierge_rfid_emu_event_t *ev = NULL;
+	assert(timeline);
+	assert(data);
+
+	if (timeline->count >= timeline->alloc_count)
+	{
+		alloc_count = timeline->alloc_count ? (timeline->alloc_count * 2) : 16;
+
+		if (!(events = realloc(timeline->events,
+				alloc_count * sizeof(catcierge_rfid_emu_event_t))))
+		{
+			CATERR("Out of memory\n");
+			return -1;
+		}
+
+		timeline->events = events;
+		timeline->alloc_count = alloc_count;
+	}
+
+	ev = &timeline->events[timeline->count++];
+	memset(ev, 0, sizeof(catcierge_rfid_emu_event_t));
+	ev->time = time;
+	ev->reader = reader;
+	snprintf(ev->data, sizeof(ev->data), "%s", data);
+
+	return 0;
+}
+
+static int compare_events(const void *a, const void *b)
+{
+	const catcierge_rfid_emu_event_t *ea = (const catcierge_rfid_emu_event_t *)a;
+	const catcierge_rfid_emu_event_t *eb = (const catcierge_rfid_emu_event_t *)b;
+
+	if (ea->time != eb->time)
+		return (ea->time < eb->time) ? -1 : 1;
+
+	return (ea->reader < eb->reader) ? -1 : (ea->reader > eb->reader);
+}
+
+int catcierge_rfid_emu_timeline_load(catcierge_rfid_emu_timeline_t *timeline,
+		const char *path)
+{
+	int ret = 0;
+	int n;
+	int line_num = 0;
+	char *contents = NULL;
+	char *line = NULL;
+	char *next = NULL;
+	char *comment = NULL;
+	double time;
+	unsigned long reader;
+	char data[CATCIERGE_RFID_EMU_MAX_DATA];
+	assert(timeline);
+	assert(path);
+
+	if (!(contents = catcierge_read_file(path)))
+	{
+		return -1;
+	}
+
+	for (line = contents; line; line = next)
+	{
+		line_num++;
+
+		if ((next = strchr(line, '\n')))
+		{
+			*next++ = '\0';
+		}
+
+		if ((comment = strchr(line, '#')))
+		{
+			*comment = '\0';
+		}
+
+		if ((n = sscanf(line, "%lf %lu %63s", &time, &reader, data)) <= 0)
+		{
+			continue;
+		}
+
+		if ((n != 3) || (time < 0.0))
+		{
+			CATERR("%s:%d: Expected \"<seconds> <reader> <data>\"\n", path, line_num);
+			ret = -1; goto fail;
+		}
+
+		if (catcierge_rfid_emu_timeline_add(timeline, time, (size_t)reader, data))
+		{
+			ret = -1; goto fail;
+		}
+	}
+
+	qsort(timeline->events, timeline->count,
+		sizeof(catcierge_rfid_emu_event_t), compare_events);
+
+fail:
+	free(contents);
+	return ret;
+}
+
+int catcierge_rfid_emu_play(catcierge_rfid_emu_t *emus, size_t count,
+		catcierge_rfid_emu_timeline_t *timeline,
+		catcierge_rfid_emu_settings_t *settings, volatile int *running)
+{
+	size_t i;
+	double start;
+	double at;
+	double rate;
+	catcierge_rfid_emu_event_t *ev = NULL;
+	assert(emus);
+	assert(timeline);
+	assert(settings);
+
+	rate = (settings->rate > 0.0) ? settings->rate : 1.0;
+
+	if (!settings->no_wait)
+	{
+		CATLOG("RFID emulator: Waiting for RAT on all readers\n");
+
+		if (catcierge_rfid_emu_wait_rat(emus, count, running))
+		{
+			return -1;
+		}
+	}
+
+	start = catcierge_clock_monotonic();
+
+	for (i = 0; (i < timeline->count) && IS_RUNNING(running); i++)
+	{
+		ev = &timeline->events[i];
+
+		if (ev->reader >= count)
+		{
+			CATERR("RFID emulator: Event %d is for reader %d, only %d readers emulated\n",
+					(int)i, (int)ev->reader, (int)count);
+			continue;
+		}
+
+		at = start + (ev->time / rate);
+
+		if (catcierge_rfid_emu_wait_until(emus, count, at, running))
+		{
+			return -1;
+		}
+
+		if (!IS_RUNNING(running))
+			break;
+
+		if (catcierge_rfid_emu_send(&emus[ev->reader], settings, ev->data))
+		{
+			return -1;
+		}
+
+		// Compare with the time catcierge logs for the tag to get the latency.
+		catcierge_clock_gettimeofday(&ev->sent);
+
+		CATLOG("%s RFID emulator: Sent %s (%0.1f ms late)\n",
+				emus[ev->reader].name, ev->data,
+				(catcierge_clock_monotonic() - at) * 1000.0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_RFID_EMU_H__
+#define __CATCIERGE_RFID_EMU_H__
+
+//
+// Emulates the Priority 1 Design RFID readers on pseudo terminals.
+//
+// Each emulated reader creates a pty that catcierge can open as if it
+// was the serial port of a real reader. The reader answers the RAT
+// command and then sends tag lines, optionally split up in several
+// writes and mixed with noise, to stress the RFID parser and to
+// measure how long it takes from a tag being read until a decision.
+//
+
+#include <stddef.h>
+#include <sys/time.h>
+
+#define CATCIERGE_RFID_EMU_MAX_READERS 16
+#define CATCIERGE_RFID_EMU_MAX_DATA 64
+
+typedef struct catcierge_rfid_emu_s
+{
+	char name[128];
+	int master;
+	int slave;
+	char slave_path[256];
+	char buf[64];		// Command currently being received.
+	size_t offset;
+	int rat;			// RAT command received, tags can be sent.
+	unsigned int sent;
+} catcierge_rfid_emu_t;
+
+typedef struct catcierge_rfid_emu_settings_s
+{
+	double rate;			// Speed up the timeline, 2.0 plays it twice as fast.
+	size_t fragment;		// Max bytes per write, 0 writes whole lines.
+	double fragment_delay;	// Seconds between the writes of a line.
+	double noise;			// Chance of a noise line before each tag (0.0-1.0).
+	int crlf;				// End lines with CRLF instead of only CR.
+	int no_wait;			// Don't wait for RAT before playing.
+	unsigned int seed;
+} catcierge_rfid_emu_settings_t;
+
+typedef struct catcierge_rfid_emu_event_s
+{
+	double time;			// Seconds from the start of the timeline.
+	size_t reader;
+	char data[CATCIERGE_RFID_EMU_MAX_DATA];
+	struct timeval sent;	// When the last byte of the tag was written.
+} catcierge_rfid_emu_event_t;
+
+typedef struct catcierge_rfid_emu_timeline_s
+{
+	catcierge_rfid_emu_event_t *events;
+	size_t count;
+	size_t alloc_count;
+} catcierge_rfid_emu_timeline_t;
+
+int catcierge_rfid_emu_init(catcierge_rfid_emu_t *emu, const char *name);
+void catcierge_rfid_emu_destroy(catcierge_rfid_emu_t *emu);
+
+// Reads and answers any commands sent to the reader.
+int catcierge_rfid_emu_service(catcierge_rfid_emu_t *emu);
+
+// Services the readers until the given monotonic time (catcierge_clock_monotonic).
+int catcierge_rfid_emu_wait_until(catcierge_rfid_emu_t *emus, size_t count,
+		double until, volatile int *running);
+
+// Waits until all readers have been put in RAT mode.
+int catcierge_rfid_emu_wait_rat(catcierge_rfid_emu_t *emus, size_t count,
+		volatile int *running);
+
+// Sends a line such as a tag or an error (?1), with noise and fragmentation.
+int catcierge_rfid_emu_send(catcierge_rfid_emu_t *emu,
+		catcierge_rfid_emu_settings_t *settings, const char *data);
+
+void catcierge_rfid_emu_settings_init(catcierge_rfid_emu_settings_t *settings);
+
+int catcierge_rfid_emu_timeline_init(catcierge_rfid_emu_timeline_t *timeline);
+void catcierge_rfid_emu_timeline_destroy(catcierge_rfid_emu_timeline_t *timeline);
+int catcierge_rfid_emu_timeline_add(catcierge_rfid_emu_timeline_t *timeline,
+		double time, size_t reader, const char *data);
+
+// Loads a recorded timeline. Each line is "<seconds> <reader index> <data>"
+// and # starts a comment. The events are sorted by time.
+int catcierge_rfid_emu_timeline_load(catcierge_rfid_emu_timeline_t *timeline,
+		const char *path);
+
+// Plays the timeline on the readers, blocks until done or *running is 0.
+int catcierge_rfid_emu_play(catcierge_rfid_emu_t *emus, size_t count,
+		catcierge_rfid_emu_timeline_t *timeline,
+		catcierge_rfid_emu_settings_t *settings, volatile int *running);
+
+#endif // __CATCIERGE_RFID_EMU_H__
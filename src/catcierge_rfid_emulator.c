@@ -0,0 +1,313 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include "catcierge_config.h"
+#include "catcierge_rfid.h"
+#include "catcierge_rfid_emu.h"
+#include "catcierge_clock.h"
+#include "catcierge_log.h"
+#include "cargo.h"
+
+#define DEFAULT_EMU_READERS 2
+#define DEFAULT_EMU_GAP 0.2
+#define DEFAULT_EMU_INTERVAL 5.0
+#define EMU_DRAIN_TIME 1.0
+
+typedef struct rfid_emulator_ctx_s
+{
+	int readers;
+	char *timeline_path;
+	char *tag;
+	int out;
+	double gap;
+	double interval;
+	int repeat;
+	double rate;
+	int fragment;
+	double fragment_delay;
+	double noise;
+	int crlf;
+	int no_wait;
+	int seed;
+} rfid_emulator_ctx_t;
+
+rfid_emulator_ctx_t ctx;
+volatile int running = 1;
+
+static int add_rfid_emulator_args(cargo_t cargo)
+{
+	int ret = 0;
+
+	ret |= cargo_add_group(cargo, 0,
+			"emu", "RFID emulator settings",
+			"Creates pseudo terminals that act like the Priority 1 Design RFID "
+			"readers. Pass the printed paths to catcierge instead of the "
+			"real serial ports.\n");
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --readers",
+			NULL,
+			"i", &ctx.readers);
+	ret |= cargo_set_option_description(cargo, "--readers",
+			"Number of readers to emulate, the first one is the innermost. "
+			"Default %d.", DEFAULT_EMU_READERS);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --timeline",
+			"Recorded timeline to replay. Each line is "
+			"\"<seconds> <reader> <tag>\" where reader is the index of the "
+			"reader starting at 0, # starts a comment. If not given the "
+			"--tag passes all readers in order.",
+			"s", &ctx.timeline_path);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --tag",
+			NULL,
+			"s", &ctx.tag);
+	ret |= cargo_set_option_description(cargo, "--tag",
+			"Tag sent when no --timeline is given. Default %s.", EXAMPLE_RFID_STR);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --out",
+			"Pass the readers from the inside to the outside instead.",
+			"b", &ctx.out);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --gap",
+			NULL,
+			"d", &ctx.gap);
+	ret |= cargo_set_option_description(cargo, "--gap",
+			"Seconds between each reader seeing the --tag. Default %0.1f.",
+			DEFAULT_EMU_GAP);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --repeat",
+			"Number of times to play the timeline, 0 repeats until "
+			"Ctrl+C. Default 1.",
+			"i", &ctx.repeat);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --interval",
+			NULL,
+			"d", &ctx.interval);
+	ret |= cargo_set_option_description(cargo, "--interval",
+			"Seconds between each --repeat. Default %0.1f.",
+			DEFAULT_EMU_INTERVAL);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --rate",
+			"Speed up the timeline, 2.0 plays it twice as fast. Default 1.0.",
+			"d", &ctx.rate);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --fragment",
+			"Split each line into random writes of at most this many bytes, "
+			"like a slow serial port would. Default 0 (whole lines).",
+			"i", &ctx.fragment);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --fragment_delay",
+			"Seconds between the writes of a --fragment line.",
+			"d", &ctx.fragment_delay);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --noise",
+			"Chance (0.0-1.0) of sending a read error, empty line or partial "
+			"tag before each tag.",
+			"d", &ctx.noise);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --crlf",
+			"End lines with CRLF instead of only CR.",
+			"b", &ctx.crlf);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --no_wait",
+			"Start playing without waiting for catcierge to send RAT "
+			"to all readers.",
+			"b", &ctx.no_wait);
+
+	ret |= cargo_add_option(cargo, 0,
+			"<emu> --seed",
+			"Random seed for --fragment and --noise, so that a run can be repeated.",
+			"i", &ctx.seed);
+
+	return ret;
+}
+
+static void sig_handler(int signo)
+{
+	fprintf(stderr, "Received SIGINT...\n");
+	running = 0;
+}
+
+static int create_timeline(catcierge_rfid_emu_timeline_t *timeline)
+{
+	int i;
+
+	if (ctx.timeline_path)
+	{
+		if (catcierge_rfid_emu_timeline_load(timeline, ctx.timeline_path))
+		{
+			fprintf(stderr, "Failed to load timeline %s\n", ctx.timeline_path);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	for (i = 0; i < ctx.readers; i++)
+	{
+		if (catcierge_rfid_emu_timeline_add(timeline, i * ctx.gap,
+				ctx.out ? i : (ctx.readers - 1 - i), ctx.tag))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+	int i;
+	int emu_count = 0;
+	cargo_t cargo;
+	catcierge_rfid_emu_t emus[CATCIERGE_RFID_EMU_MAX_READERS];
+	catcierge_rfid_emu_timeline_t timeline;
+	catcierge_rfid_emu_settings_t settings;
+	char name[64];
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.readers = DEFAULT_EMU_READERS;
+	ctx.gap = DEFAULT_EMU_GAP;
+	ctx.interval = DEFAULT_EMU_INTERVAL;
+	ctx.repeat = 1;
+	ctx.rate = 1.0;
+
+	catcierge_rfid_emu_timeline_init(&timeline);
+
+	if (cargo_init(&cargo, 0, "%s", argv[0]))
+	{
+		fprintf(stderr, "Failed to init command line parsing\n");
+		return -1;
+	}
+
+	if (add_rfid_emulator_args(cargo))
+	{
+		fprintf(stderr, "Failed to add emulator args\n");
+		ret = -1; goto fail;
+	}
+
+	if (cargo_parse(cargo, 0, 1, argc, argv))
+	{
+		ret = -1; goto fail;
+	}
+
+	if ((ctx.readers <= 0) || (ctx.readers > CATCIERGE_RFID_EMU_MAX_READERS))
+	{
+		fprintf(stderr, "--readers must be between 1 and %d\n", CATCIERGE_RFID_EMU_MAX_READERS);
+		ret = -1; goto fail;
+	}
+
+	if (!ctx.tag && !(ctx.tag = strdup(EXAMPLE_RFID_STR)))
+	{
+		fprintf(stderr, "Out of memory\n");
+		ret = -1; goto fail;
+	}
+
+	if (create_timeline(&timeline))
+	{
+		ret = -1; goto fail;
+	}
+
+	catcierge_rfid_emu_settings_init(&settings);
+	settings.rate = ctx.rate;
+	settings.fragment = (ctx.fragment > 0) ? (size_t)ctx.fragment : 0;
+	settings.fragment_delay = ctx.fragment_delay;
+	settings.noise = ctx.noise;
+	settings.crlf = ctx.crlf;
+	settings.no_wait = ctx.no_wait;
+	settings.seed = (unsigned int)ctx.seed;
+
+	for (emu_count = 0; emu_count < ctx.readers; emu_count++)
+	{
+		snprintf(name, sizeof(name), "Reader%d", emu_count);
+
+		if (catcierge_rfid_emu_init(&emus[emu_count], name))
+		{
+			ret = -1; goto fail;
+		}
+	}
+
+	printf("Emulating %d RFID readers, from the inside to the outside:\n --rfid", emu_count);
+
+	for (i = 0; i < emu_count; i++)
+	{
+		printf(" %s=%s", emus[i].name, emus[i].slave_path);
+	}
+
+	printf("\n");
+	fflush(stdout);
+
+	signal(SIGINT, sig_handler);
+
+	for (i = 0; running && ((ctx.repeat <= 0) || (i < ctx.repeat)); i++)
+	{
+		if ((i > 0) && catcierge_rfid_emu_wait_until(emus, emu_count,
+				catcierge_clock_monotonic() + (ctx.interval / settings.rate), &running))
+		{
+			ret = -1; break;
+		}
+
+		if (catcierge_rfid_emu_play(emus, emu_count, &timeline, &settings, &running))
+		{
+			ret = -1; break;
+		}
+
+		// Only wait for RAT the first time.
+		settings.no_wait = 1;
+	}
+
+	// Closing the pseudo terminals throws away anything not read yet.
+	catcierge_rfid_emu_wait_until(emus, emu_count,
+		catcierge_clock_monotonic() + EMU_DRAIN_TIME, &running);
+
+	for (i = 0; i < emu_count; i++)
+	{
+		printf("%s: Sent %u tags\n", emus[i].name, emus[i].sent);
+	}
+
+fail:
+	for (i = 0; i < emu_count; i++)
+	{
+		catcierge_rfid_emu_destroy(&emus[i]);
+	}
+
+	catcierge_rfid_emu_timeline_destroy(&timeline);
+	free(ctx.timeline_path);
+	free(ctx.tag);
+	cargo_destroy(&cargo);
+
+	return ret;
+}
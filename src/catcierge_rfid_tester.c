@@ -34,10 +34,10 @@ int main(int argc, char **argv)
 	catcierge_rfid_ctx_init(&ctx);
 
 	catcierge_rfid_init("Inner", &rfidin, "/dev/ttyUSB0", rfid_read_cb, NULL);
-	catcierge_rfid_ctx_set_inner(&ctx, &rfidin);
+	catcierge_rfid_ctx_add(&ctx, &rfidin);
 	catcierge_rfid_open(&rfidin);
 	catcierge_rfid_init("Outer", &rfidout, "/dev/ttyUSB1", rfid_read_cb, NULL);
-	catcierge_rfid_ctx_set_outer(&ctx, &rfidout);
+	catcierge_rfid_ctx_add(&ctx, &rfidout);
 	catcierge_rfid_open(&rfidout);
 
 	while (1)
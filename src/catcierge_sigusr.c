@@ -51,7 +51,15 @@ static void catcierge_sigusr_attention(catcierge_grb_t *grb)
 	catcierge_set_state(grb, catcierge_state_waiting);
 }
 
-void catcierge_handle_sigusr(catcierge_grb_t *grb, const char *behavior)
+#ifdef WITH_RFID
+static void catcierge_sigusr_reload_rfid(catcierge_grb_t *grb)
+{
+	CATLOG("  Reloading allowed RFID tags...\n");
+	catcierge_reload_rfid_allowed(grb);
+}
+#endif
+
+int catcierge_handle_sigusr(catcierge_grb_t *grb, const char *behavior)
 {
 	#define CATCIERGE_SIGUSR_BEHAVIOR(sigusr_name, sigusr_description) \
 		if (!strcasecmp(behavior, #sigusr_name)) \
@@ -63,6 +71,9 @@ void catcierge_handle_sigusr(catcierge_grb_t *grb, const char *behavior)
 
 	#include "catcierge_sigusr_types.h"
 	{
-		CATERR("Error, unknown sigusr behavior (this is probably a bug)...\n");
+		CATERR("Error, unknown sigusr behavior \"%s\"\n", behavior);
+		return -1;
 	}
+
+	return 0;
 }
@@ -18,4 +18,6 @@
 //
 
 
-void catcierge_handle_sigusr(catcierge_grb_t *grb, const char *behavior);
+// Also used by the control channel (--control) to run the
+// same behaviors. Returns -1 for unknown behaviors.
+int catcierge_handle_sigusr(catcierge_grb_t *grb, const char *behavior);
@@ -29,5 +29,8 @@ CATCIERGE_SIGUSR_BEHAVIOR(lock, "Lock the cat door for lockout time")
 CATCIERGE_SIGUSR_BEHAVIOR(unlock, "Unlock the cat door")
 CATCIERGE_SIGUSR_BEHAVIOR(ignore, "Ignores any events, until 'attention'")
 CATCIERGE_SIGUSR_BEHAVIOR(attention, "Stops ignoring events")
+#ifdef WITH_RFID
+CATCIERGE_SIGUSR_BEHAVIOR(reload_rfid, "Reload the allowed RFID tags")
+#endif
 
 #undef CATCIERGE_SIGUSR_BEHAVIOR
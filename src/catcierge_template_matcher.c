@@ -468,51 +468,34 @@ void catcierge_template_output_print_usage()
 	}
 }
 
-const char *catcierge_template_matcher_translate(catcierge_matcher_t *octx, const char *var,
-	char *buf, size_t bufsize)
+const char *catcierge_template_matcher_translate(catcierge_matcher_t *octx,
+	const catcierge_output_var_ref_t *var, char *buf, size_t bufsize)
 {
 	catcierge_template_matcher_t *ctx = (catcierge_template_matcher_t *)octx;
 	assert(ctx);
+	assert(var);
 
-	if (!strcmp(var, "snout_count"))
+	switch (var->id)
 	{
-		snprintf(buf, bufsize - 1, "%d", (int)ctx->args->snout_count);
-		return buf;
-	}
-
-	if (!strncmp(var, "snout", 5))
-	{
-		int idx = 0;
-		var += 5;
-
-		if (sscanf(var, "%d", &idx) == EOF)
-		{
-			return NULL;
-		}
-
-		idx--; // Convert to 0-based index.
+		case CATCIERGE_VAR_TEMPLATE_SNOUT_COUNT:
+			snprintf(buf, bufsize - 1, "%d", (int)ctx->args->snout_count);
+			return buf;
+		case CATCIERGE_VAR_TEMPLATE_SNOUTN:
+			if ((var->idx < 0) || (var->idx >= (int)ctx->args->snout_count))
+			{
+				return NULL;
+			}
 
-		if ((idx < 0) || (idx > (int)ctx->args->snout_count))
-		{
+			return ctx->args->snout_paths[var->idx];
+		case CATCIERGE_VAR_TEMPLATE_THRESHOLD:
+			snprintf(buf, bufsize - 1, "%f", ctx->args->match_threshold);
+			return buf;
+		case CATCIERGE_VAR_TEMPLATE_MATCH_FLIPPED:
+			snprintf(buf, bufsize - 1, "%d", ctx->args->match_flipped);
+			return buf;
+		default:
 			return NULL;
-		}
-
-		return ctx->args->snout_paths[idx];
-	}
-
-	if (!strcmp(var, "threshold"))
-	{
-		snprintf(buf, bufsize - 1, "%f", ctx->args->match_threshold);
-		return buf;
 	}
-
-	if (!strcmp(var, "match_flipped"))
-	{
-		snprintf(buf, bufsize - 1, "%d", ctx->args->match_flipped);
-		return buf;
-	}
-
-	return NULL;
 }
 
 int catcierge_template_matcher_parse_args(catcierge_template_matcher_args_t *args, const char *key, char **values, size_t value_count)
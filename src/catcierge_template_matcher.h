@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include "catcierge_types.h"
 #include "catcierge_matcher.h"
+#include "catcierge_output_types.h"
 #include "cargo.h"
 
 #define CATCIERGE_LOW_BINARY_THRESH_DEFAULT 90
@@ -86,8 +87,8 @@ void catcierge_template_matcher_args_destroy(catcierge_template_matcher_args_t *
 void catcierge_template_matcher_print_settings(catcierge_template_matcher_args_t * args);
 void catcierge_template_matcher_args_init(catcierge_template_matcher_args_t *args);
 
-const char *catcierge_template_matcher_translate(catcierge_matcher_t *octx, const char *var,
-	char *buf, size_t bufsize);
+const char *catcierge_template_matcher_translate(catcierge_matcher_t *octx,
+	const catcierge_output_var_ref_t *var, char *buf, size_t bufsize);
 void catcierge_template_output_print_usage();
 
 #endif // __CATCIERGE_TEMPLATE_MATCHER_H__
@@ -19,43 +19,40 @@
 #include <catcierge_config.h>
 #include <assert.h>
 #include "catcierge_timer.h"
+#include "catcierge_clock.h"
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
 #include <math.h>
 
-// TODO: Replace this with a monotonic timer version instead!
 void catcierge_timer_reset(catcierge_timer_t *t)
 {
 	assert(t);
-	memset(&t->start, 0, sizeof(struct timeval));
-	memset(&t->end, 0, sizeof(struct timeval));
+	t->start = 0.0;
+	t->active = 0;
 }
 
 int catcierge_timer_isactive(catcierge_timer_t *t)
 {
 	assert(t);
-	return (t->start.tv_sec != 0);
+	return t->active;
 }
 
 void catcierge_timer_start(catcierge_timer_t *t)
 {
 	assert(t);
 
-	gettimeofday(&t->start, NULL);
-	gettimeofday(&t->end, NULL);
+	t->start = catcierge_clock_monotonic();
+	t->active = 1;
 }
 
 double catcierge_timer_get(catcierge_timer_t *t)
 {
 	assert(t);
-	if (t->start.tv_sec == 0)
+	if (!t->active)
 		return 0.0;
 
-	gettimeofday(&t->end, NULL);
-
-	return (double)(t->end.tv_sec - t->start.tv_sec) +
-			((t->end.tv_usec - t->start.tv_usec) / 1000000.0);
+	return catcierge_clock_monotonic() - t->start;
 }
 
 void catcierge_timer_set(catcierge_timer_t *t, double timeout)
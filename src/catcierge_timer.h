@@ -29,10 +29,14 @@
 #include <sys/time.h>
 #endif
 
+//
+// Simple polled timer. This is a thin layer on top of the monotonic clock,
+// see catcierge_timer_wheel.h for timers with callbacks.
+//
 typedef struct catcierge_timer_s
 {
-	struct timeval start;
-	struct timeval end;
+	double start;
+	int active;
 	double timeout;
 } catcierge_timer_t;
 
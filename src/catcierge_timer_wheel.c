@@ -0,0 +1,421 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "catcierge_timer_wheel.h"
+#include "catcierge_clock.h"
+
+#define LEVEL_SHIFT(level) ((level) * CATCIERGE_TIMER_WHEEL_BITS)
+#define LEVEL_INDEX(w, level) \
+	(((w)->now >> LEVEL_SHIFT(level)) & CATCIERGE_TIMER_WHEEL_MASK)
+
+// Timers further away than this are parked in the last slot
+// of the top level and re-added when it is cascaded.
+#define MAX_DELTA ((1ULL << LEVEL_SHIFT(CATCIERGE_TIMER_WHEEL_LEVELS)) - 1)
+
+static uint64_t catcierge_timer_wheel_clock_tick(catcierge_timer_wheel_t *w)
+{
+	double elapsed = catcierge_clock_monotonic() - w->start;
+
+	if (elapsed <= 0.0)
+	{
+		return 0;
+	}
+
+	return (uint64_t)(elapsed * CATCIERGE_TIMER_WHEEL_HZ);
+}
+
+static uint64_t catcierge_timer_wheel_to_ticks(double seconds)
+{
+	if (seconds <= 0.0)
+	{
+		return 0;
+	}
+
+	return (uint64_t)ceil(seconds * CATCIERGE_TIMER_WHEEL_HZ);
+}
+
+int catcierge_timer_wheel_init(catcierge_timer_wheel_t *w)
+{
+	assert(w);
+	memset(w, 0, sizeof(catcierge_timer_wheel_t));
+	w->start = catcierge_clock_monotonic();
+
+	return 0;
+}
+
+void catcierge_timer_wheel_destroy(catcierge_timer_wheel_t *w)
+{
+	int level;
+	int i;
+	catcierge_wheel_timer_t *t;
+	assert(w);
+
+	// The timers are owned by the caller, just detach them.
+	for (level = 0; level < CATCIERGE_TIMER_WHEEL_LEVELS; level++)
+	{
+		for (i = 0; i < CATCIERGE_TIMER_WHEEL_SLOTS; i++)
+		{
+			while ((t = w->slots[level][i]))
+			{
+				w->slots[level][i] = t->next;
+				t->next = t->prev = NULL;
+				t->slot = NULL;
+				t->pending = 0;
+			}
+		}
+	}
+
+	w->count = 0;
+}
+
+void catcierge_wheel_timer_init(catcierge_wheel_timer_t *t,
+			catcierge_wheel_timer_cb_f cb, void *user)
+{
+	assert(t);
+	memset(t, 0, sizeof(catcierge_wheel_timer_t));
+	t->cb = cb;
+	t->user = user;
+}
+
+int catcierge_wheel_timer_pending(catcierge_wheel_timer_t *t)
+{
+	assert(t);
+	return t->pending;
+}
+
+static catcierge_wheel_timer_t **catcierge_timer_wheel_slot(
+			catcierge_timer_wheel_t *w, uint64_t expires)
+{
+	int level;
+	uint64_t delta = (expires > w->now) ? (expires - w->now) : 0;
+
+	if (delta > MAX_DELTA)
+	{
+		expires = w->now + MAX_DELTA;
+		delta = MAX_DELTA;
+	}
+
+	for (level = 0; level < (CATCIERGE_TIMER_WHEEL_LEVELS - 1); level++)
+	{
+		if (delta < (1ULL << LEVEL_SHIFT(level + 1)))
+			break;
+	}
+
+	if (expires < w->now)
+	{
+		expires = w->now;
+	}
+
+	return &w->slots[level][(expires >> LEVEL_SHIFT(level)) & CATCIERGE_TIMER_WHEEL_MASK];
+}
+
+static void catcierge_timer_wheel_link(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t)
+{
+	catcierge_wheel_timer_t **slot = catcierge_timer_wheel_slot(w, t->expires);
+
+	t->prev = NULL;
+	t->next = *slot;
+
+	if (*slot)
+	{
+		(*slot)->prev = t;
+	}
+
+	*slot = t;
+	t->slot = slot;
+	t->pending = 1;
+	w->count++;
+}
+
+static void catcierge_timer_wheel_unlink(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t)
+{
+	if (t->prev)
+	{
+		t->prev->next = t->next;
+	}
+	else
+	{
+		*t->slot = t->next;
+	}
+
+	if (t->next)
+	{
+		t->next->prev = t->prev;
+	}
+
+	t->next = t->prev = NULL;
+	t->slot = NULL;
+	t->pending = 0;
+	w->count--;
+}
+
+int catcierge_timer_wheel_add(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t, double timeout, double interval)
+{
+	double elapsed;
+	assert(w);
+	assert(t);
+	assert(t->cb);
+
+	if (t->pending)
+	{
+		catcierge_timer_wheel_cancel(w, t);
+	}
+
+	// A timer runs once the clock has reached its tick, so the deadline
+	// is rounded up to the tick after it to never expire early. Ticks
+	// that have already been processed can't be used again.
+	elapsed = catcierge_clock_monotonic() - w->start;
+	t->expires = catcierge_timer_wheel_to_ticks(elapsed
+			+ ((timeout > 0.0) ? timeout : 0.0));
+
+	if (t->expires < w->now)
+	{
+		t->expires = w->now;
+	}
+
+	t->interval = catcierge_timer_wheel_to_ticks(interval);
+
+	// Make sure repeating timers make progress.
+	if ((interval > 0.0) && (t->interval == 0))
+	{
+		t->interval = 1;
+	}
+
+	catcierge_timer_wheel_link(w, t);
+
+	return 0;
+}
+
+void catcierge_timer_wheel_cancel(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t)
+{
+	assert(w);
+	assert(t);
+
+	if (t->pending)
+	{
+		catcierge_timer_wheel_unlink(w, t);
+	}
+}
+
+static int catcierge_timer_wheel_cascade(catcierge_timer_wheel_t *w, int level)
+{
+	int index = LEVEL_INDEX(w, level);
+	catcierge_wheel_timer_t *t = w->slots[level][index];
+	catcierge_wheel_timer_t *next;
+
+	w->slots[level][index] = NULL;
+
+	// Spread the timers out over the lower levels.
+	while (t)
+	{
+		next = t->next;
+		w->count--;
+		catcierge_timer_wheel_link(w, t);
+		t = next;
+	}
+
+	return index;
+}
+
+static int catcierge_timer_wheel_run_tick(catcierge_timer_wheel_t *w)
+{
+	int level;
+	int fired = 0;
+	int index = (int)(w->now & CATCIERGE_TIMER_WHEEL_MASK);
+	catcierge_wheel_timer_t **slot = &w->slots[0][index];
+	catcierge_wheel_timer_t *t;
+
+	if (index == 0)
+	{
+		for (level = 1; level < CATCIERGE_TIMER_WHEEL_LEVELS; level++)
+		{
+			if (catcierge_timer_wheel_cascade(w, level) != 0)
+				break;
+		}
+	}
+
+	// Timers added by the callbacks end up in a later slot.
+	w->now++;
+
+	while ((t = *slot))
+	{
+		catcierge_timer_wheel_unlink(w, t);
+
+		if (t->interval)
+		{
+			// Don't try to catch up on missed expiries.
+			t->expires += t->interval;
+
+			if (t->expires < w->now)
+				t->expires = w->now;
+
+			catcierge_timer_wheel_link(w, t);
+		}
+
+		t->cb(w, t, t->user);
+		fired++;
+	}
+
+	return fired;
+}
+
+static uint64_t catcierge_timer_wheel_slot_min(catcierge_wheel_timer_t *t)
+{
+	uint64_t min = UINT64_MAX;
+
+	for (; t; t = t->next)
+	{
+		if (t->expires < min)
+			min = t->expires;
+	}
+
+	return min;
+}
+
+static uint64_t catcierge_timer_wheel_next_tick(catcierge_timer_wheel_t *w)
+{
+	int level;
+	int i;
+	int index;
+	uint64_t slot_min;
+	uint64_t min = UINT64_MAX;
+
+	for (level = 0; level < CATCIERGE_TIMER_WHEEL_LEVELS; level++)
+	{
+		// The current slot is cascaded when the lower bits of now wrap
+		// around. Until then it is the next one, after that it can
+		// only hold timers a full lap away.
+		index = LEVEL_INDEX(w, level);
+
+		if (w->now & ((1ULL << LEVEL_SHIFT(level)) - 1))
+			index++;
+
+		for (i = 0; i < CATCIERGE_TIMER_WHEEL_SLOTS; i++)
+		{
+			catcierge_wheel_timer_t *t =
+				w->slots[level][(index + i) & CATCIERGE_TIMER_WHEEL_MASK];
+
+			if (t)
+			{
+				slot_min = catcierge_timer_wheel_slot_min(t);
+
+				if (slot_min < min)
+					min = slot_min;
+				break;
+			}
+		}
+	}
+
+	return min;
+}
+
+static void catcierge_timer_wheel_rebase(catcierge_timer_wheel_t *w, uint64_t now)
+{
+	int level;
+	int i;
+	catcierge_wheel_timer_t *all = NULL;
+	catcierge_wheel_timer_t *t;
+
+	// Jumps over a stretch of time with no expiring timers
+	// instead of stepping through it one tick at a time.
+	for (level = 0; level < CATCIERGE_TIMER_WHEEL_LEVELS; level++)
+	{
+		for (i = 0; i < CATCIERGE_TIMER_WHEEL_SLOTS; i++)
+		{
+			while ((t = w->slots[level][i]))
+			{
+				catcierge_timer_wheel_unlink(w, t);
+				t->next = all;
+				all = t;
+			}
+		}
+	}
+
+	w->now = now;
+
+	while ((t = all))
+	{
+		all = t->next;
+		catcierge_timer_wheel_link(w, t);
+	}
+}
+
+int catcierge_timer_wheel_advance(catcierge_timer_wheel_t *w)
+{
+	int fired = 0;
+	uint64_t next;
+	uint64_t target;
+	assert(w);
+
+	target = catcierge_timer_wheel_clock_tick(w);
+
+	while (w->now <= target)
+	{
+		if (!w->count)
+		{
+			w->now = target + 1;
+			break;
+		}
+
+		if ((target - w->now) > CATCIERGE_TIMER_WHEEL_SLOTS)
+		{
+			next = catcierge_timer_wheel_next_tick(w);
+
+			if (next > (w->now + CATCIERGE_TIMER_WHEEL_SLOTS))
+			{
+				catcierge_timer_wheel_rebase(w, (next <= target) ? next : (target + 1));
+				continue;
+			}
+		}
+
+		fired += catcierge_timer_wheel_run_tick(w);
+	}
+
+	return fired;
+}
+
+double catcierge_timer_wheel_next_deadline(catcierge_timer_wheel_t *w)
+{
+	uint64_t next;
+	uint64_t tick;
+	assert(w);
+
+	if (!w->count)
+	{
+		return -1.0;
+	}
+
+	next = catcierge_timer_wheel_next_tick(w);
+	tick = catcierge_timer_wheel_clock_tick(w);
+
+	if (next <= tick)
+	{
+		return 0.0;
+	}
+
+	// A timer expires when the clock passes its tick.
+	return (double)(next - tick) / CATCIERGE_TIMER_WHEEL_HZ;
+}
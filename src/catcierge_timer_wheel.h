@@ -0,0 +1,92 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_TIMER_WHEEL_H__
+#define __CATCIERGE_TIMER_WHEEL_H__
+
+//
+// Hierarchical timer wheel driven by the monotonic clock.
+//
+// Each level has 64 slots. Level 0 slots are 1 ms apart, level 1 slots
+// 64 ms and so on. Timers far in the future sit in the higher levels and
+// are cascaded down as time passes, so adding, cancelling and expiring
+// a timer is O(1).
+//
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CATCIERGE_TIMER_WHEEL_BITS 6
+#define CATCIERGE_TIMER_WHEEL_SLOTS (1 << CATCIERGE_TIMER_WHEEL_BITS)
+#define CATCIERGE_TIMER_WHEEL_MASK (CATCIERGE_TIMER_WHEEL_SLOTS - 1)
+#define CATCIERGE_TIMER_WHEEL_LEVELS 5
+
+// Ticks per second.
+#define CATCIERGE_TIMER_WHEEL_HZ 1000
+
+typedef struct catcierge_timer_wheel_s catcierge_timer_wheel_t;
+typedef struct catcierge_wheel_timer_s catcierge_wheel_timer_t;
+
+typedef void (*catcierge_wheel_timer_cb_f)(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t, void *user);
+
+struct catcierge_wheel_timer_s
+{
+	uint64_t expires;	// Absolute tick.
+	uint64_t interval;	// Ticks between repeats, 0 for one-shot.
+	int pending;
+	catcierge_wheel_timer_cb_f cb;
+	void *user;
+	struct catcierge_wheel_timer_s **slot;
+	struct catcierge_wheel_timer_s *next;
+	struct catcierge_wheel_timer_s *prev;
+};
+
+struct catcierge_timer_wheel_s
+{
+	uint64_t now;		// All ticks before this have been processed.
+	double start;		// Monotonic time of tick 0.
+	size_t count;
+	catcierge_wheel_timer_t *slots[CATCIERGE_TIMER_WHEEL_LEVELS][CATCIERGE_TIMER_WHEEL_SLOTS];
+};
+
+int catcierge_timer_wheel_init(catcierge_timer_wheel_t *w);
+void catcierge_timer_wheel_destroy(catcierge_timer_wheel_t *w);
+
+void catcierge_wheel_timer_init(catcierge_wheel_timer_t *t,
+			catcierge_wheel_timer_cb_f cb, void *user);
+
+// Schedules the timer timeout seconds from now, repeating every
+// interval seconds if interval > 0. Re-adding a pending timer reschedules it.
+int catcierge_timer_wheel_add(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t, double timeout, double interval);
+
+void catcierge_timer_wheel_cancel(catcierge_timer_wheel_t *w,
+			catcierge_wheel_timer_t *t);
+
+int catcierge_wheel_timer_pending(catcierge_wheel_timer_t *t);
+
+// Runs the callbacks of all timers that have expired according to the
+// monotonic clock. Returns the number of callbacks run.
+int catcierge_timer_wheel_advance(catcierge_timer_wheel_t *w);
+
+// Seconds until the next timer expires, 0 if one already has,
+// or -1 if there are no pending timers.
+double catcierge_timer_wheel_next_deadline(catcierge_timer_wheel_t *w);
+
+#endif // __CATCIERGE_TIMER_WHEEL_H__
@@ -27,7 +27,8 @@
 #include "catcierge_platform.h"
 #include "sha1.h"
 
-#define MATCH_MAX_COUNT 4 // The number of matches to perform before deciding the lock state.
+#define MATCH_MAX_COUNT 4 // The default number of matches to perform before deciding the lock state.
+#define MATCH_MAX_COUNT_LIMIT 32 // Upper limit for --max_matches.
 
 #define CATCIERGE_DEFINE_EVENT(ev_enum_name, ev_name, ev_description)	\
 	ev_enum_name,
@@ -35,6 +36,7 @@
 typedef enum catcierge_event_e
 {
 	#include "catcierge_events.h"
+	CATCIERGE_EVENT_COUNT
 } catcierge_event_t;
 
 typedef struct catcierge_output_var_s
@@ -72,6 +74,8 @@ typedef enum catcierge_lockout_method_s
 #define MAX_STEPS 24
 #define MAX_MATCH_RECTS 24
 
+struct catcierge_encoded_image_s;
+
 typedef struct catcierge_path_s
 {
 	char full[2048];		// Directory + filename.
@@ -82,6 +86,7 @@ typedef struct catcierge_path_s
 typedef struct match_step_s
 {
 	IplImage *img;
+	struct catcierge_encoded_image_s *encoded; // Set once the image has been saved.
 	catcierge_path_t path;
 	const char *name;
 	const char *description;
@@ -106,6 +111,7 @@ typedef struct match_state_s
 {
 	catcierge_path_t path;			// Path info where to save the image.
 	IplImage *img;					// A cached image of the match frame.
+	struct catcierge_encoded_image_s *encoded; // The saved image, kept until the match group is done.
 	struct timeval tv;
 	time_t time;					// We need this on Windows. 
 									// Since tv_sec in struct timeval is a long (32-bit) and time_t
@@ -118,8 +124,10 @@ typedef struct match_state_s
 typedef struct match_group_s
 {
 	SHA1Context sha;				// Used to generate match group ID.
-	match_state_t matches[MATCH_MAX_COUNT];
-	size_t match_count;				// The current match count, will go up to MATCH_MAX_COUNT.
+	match_state_t *matches;
+	size_t max_count;				// The number of allocated matches (--max_matches).
+	size_t match_count;				// The current match count, will go up to max_count.
+	int early_decision;				// Was the decision made before max_count matches?
 	int success;
 	int success_count;
 	int final_decision;				// Was the match decision overriden by the matcher?
@@ -132,6 +140,7 @@ typedef struct match_group_s
 	time_t end_time;
 
 	IplImage *obstruct_img;
+	struct catcierge_encoded_image_s *obstruct_encoded;
 	catcierge_path_t obstruct_path;
 	struct timeval obstruct_tv;
 	time_t obstruct_time;
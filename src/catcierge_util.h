@@ -34,6 +34,7 @@ const char *catcierge_get_left_right_str(direction_t dir);
 
 const char *catcierge_skip_whitespace(const char *it);
 char *catcierge_skip_whitespace_alt(char *it);
+void catcierge_end_trim_whitespace(char *s);
 char **catcierge_parse_list(const char *input, size_t *list_count, int end_trim);
 
 void catcierge_run(char *command);
@@ -0,0 +1,238 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <catcierge_config.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catcierge_workers.h"
+#include "catcierge_log.h"
+
+static void *catcierge_workers_main(void *arg)
+{
+	catcierge_workers_t *w = (catcierge_workers_t *)arg;
+	catcierge_workers_task_t *task = NULL;
+
+	pthread_mutex_lock(&w->lock);
+
+	while (1)
+	{
+		while (!w->head && !w->stop)
+		{
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+
+		// The queue is drained before stopping.
+		if (!w->head)
+		{
+			break;
+		}
+
+		task = w->head;
+		w->head = task->next;
+
+		if (!w->head)
+		{
+			w->tail = NULL;
+		}
+
+		pthread_mutex_unlock(&w->lock);
+
+		task->func(task->arg);
+
+		pthread_mutex_lock(&w->lock);
+
+		if (task->group)
+		{
+			task->group->pending--;
+		}
+
+		w->pending--;
+		pthread_cond_broadcast(&w->done_cond);
+
+		free(task);
+	}
+
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+static void catcierge_workers_join(catcierge_workers_t *w, size_t count)
+{
+	size_t i;
+
+	pthread_mutex_lock(&w->lock);
+	w->stop = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	for (i = 0; i < count; i++)
+	{
+		pthread_join(w->threads[i], NULL);
+	}
+}
+
+int catcierge_workers_init(catcierge_workers_t *w, size_t thread_count)
+{
+	size_t i;
+	assert(w);
+	assert(thread_count > 0);
+
+	memset(w, 0, sizeof(catcierge_workers_t));
+
+	if (!(w->threads = calloc(thread_count, sizeof(pthread_t))))
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	pthread_cond_init(&w->done_cond, NULL);
+
+	for (i = 0; i < thread_count; i++)
+	{
+		if (pthread_create(&w->threads[i], NULL, catcierge_workers_main, w))
+		{
+			CATERR("Failed to create worker thread\n");
+			goto fail;
+		}
+	}
+
+	w->thread_count = thread_count;
+
+	return 0;
+fail:
+	catcierge_workers_join(w, i);
+	pthread_cond_destroy(&w->done_cond);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w->threads);
+	w->threads = NULL;
+	return -1;
+}
+
+void catcierge_workers_destroy(catcierge_workers_t *w)
+{
+	assert(w);
+
+	if (!w->threads)
+	{
+		return;
+	}
+
+	catcierge_workers_join(w, w->thread_count);
+
+	pthread_cond_destroy(&w->done_cond);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+
+	free(w->threads);
+	w->threads = NULL;
+	w->thread_count = 0;
+}
+
+static int catcierge_workers_push(catcierge_workers_t *w,
+		catcierge_workers_group_t *g, catcierge_workers_func_t func, void *arg)
+{
+	catcierge_workers_task_t *task = NULL;
+	assert(w);
+	assert(func);
+
+	if (!(task = calloc(1, sizeof(catcierge_workers_task_t))))
+	{
+		CATERR("Out of memory\n"); return -1;
+	}
+
+	task->func = func;
+	task->arg = arg;
+	task->group = g;
+
+	pthread_mutex_lock(&w->lock);
+
+	if (w->tail)
+	{
+		w->tail->next = task;
+	}
+	else
+	{
+		w->head = task;
+	}
+
+	w->tail = task;
+	w->pending++;
+
+	if (g)
+	{
+		g->pending++;
+	}
+
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	return 0;
+}
+
+int catcierge_workers_add(catcierge_workers_t *w,
+		catcierge_workers_func_t func, void *arg)
+{
+	return catcierge_workers_push(w, NULL, func, arg);
+}
+
+void catcierge_workers_wait(catcierge_workers_t *w)
+{
+	assert(w);
+
+	pthread_mutex_lock(&w->lock);
+
+	while (w->pending)
+	{
+		pthread_cond_wait(&w->done_cond, &w->lock);
+	}
+
+	pthread_mutex_unlock(&w->lock);
+}
+
+void catcierge_workers_group_init(catcierge_workers_group_t *g)
+{
+	assert(g);
+	memset(g, 0, sizeof(catcierge_workers_group_t));
+}
+
+int catcierge_workers_group_add(catcierge_workers_t *w,
+		catcierge_workers_group_t *g, catcierge_workers_func_t func, void *arg)
+{
+	assert(g);
+	return catcierge_workers_push(w, g, func, arg);
+}
+
+void catcierge_workers_group_wait(catcierge_workers_t *w,
+		catcierge_workers_group_t *g)
+{
+	assert(w);
+	assert(g);
+
+	pthread_mutex_lock(&w->lock);
+
+	while (g->pending)
+	{
+		pthread_cond_wait(&w->done_cond, &w->lock);
+	}
+
+	pthread_mutex_unlock(&w->lock);
+}
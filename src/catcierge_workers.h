@@ -0,0 +1,82 @@
+//
+// This file is part of the Catcierge project.
+//
+// Copyright (c) Joakim Soderberg 2013-2017
+//
+//    Catcierge is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    Catcierge is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with Catcierge.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef __CATCIERGE_WORKERS_H__
+#define __CATCIERGE_WORKERS_H__
+
+//
+// A pool of worker threads running tasks from a shared FIFO queue.
+//
+// With a single thread the tasks run one at a time in the order they
+// were added, which is used to keep work in order while still moving
+// it off the calling thread. Tasks added to a group can be waited on
+// together, to fan work out over the threads and collect the results.
+//
+
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*catcierge_workers_func_t)(void *arg);
+
+typedef struct catcierge_workers_group_s
+{
+	size_t pending;	// Tasks in the group that have not finished.
+} catcierge_workers_group_t;
+
+typedef struct catcierge_workers_task_s
+{
+	catcierge_workers_func_t func;
+	void *arg;
+	catcierge_workers_group_t *group;
+	struct catcierge_workers_task_s *next;
+} catcierge_workers_task_t;
+
+typedef struct catcierge_workers_s
+{
+	pthread_t *threads;
+	size_t thread_count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		// A task was added, or the pool is stopping.
+	pthread_cond_t done_cond;	// A task has finished.
+	catcierge_workers_task_t *head;
+	catcierge_workers_task_t *tail;
+	size_t pending;				// Queued and running tasks.
+	int stop;
+} catcierge_workers_t;
+
+int catcierge_workers_init(catcierge_workers_t *w, size_t thread_count);
+
+// Runs everything still in the queue before the threads are joined.
+void catcierge_workers_destroy(catcierge_workers_t *w);
+
+int catcierge_workers_add(catcierge_workers_t *w,
+		catcierge_workers_func_t func, void *arg);
+
+// Blocks until all tasks added so far have finished.
+void catcierge_workers_wait(catcierge_workers_t *w);
+
+void catcierge_workers_group_init(catcierge_workers_group_t *g);
+
+int catcierge_workers_group_add(catcierge_workers_t *w,
+		catcierge_workers_group_t *g, catcierge_workers_func_t func, void *arg);
+
+// Blocks until all tasks in the group have finished.
+void catcierge_workers_group_wait(catcierge_workers_t *w,
+		catcierge_workers_group_t *g);
+
+#endif // __CATCIERGE_WORKERS_H__
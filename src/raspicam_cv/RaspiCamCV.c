@@ -582,6 +582,26 @@ void raspiCamCvSetCaptureProperty(RaspiCamCvCapture * capture, int property_id,
 			//state->width = (int)value;
 			break;
 		}
+		case CV_CAP_PROP_FPS:
+		{
+			// The frame rate can be changed while capturing.
+			MMAL_PORT_T *video_port = state->camera_component->output[MMAL_CAMERA_VIDEO_PORT];
+			MMAL_PARAMETER_FPS_RANGE_T fps_range =
+			{
+				{ MMAL_PARAMETER_FPS_RANGE, sizeof(fps_range) },
+				{ (int32_t)(value * 256), 256 },
+				{ (int32_t)(value * 256), 256 }
+			};
+
+			if (mmal_port_parameter_set(video_port, &fps_range.hdr) != MMAL_SUCCESS)
+			{
+				vcos_log_error("Failed to set frame rate %f", value);
+				break;
+			}
+
+			state->settings.framerate = (int)value;
+			break;
+		}
 	}
 }
 
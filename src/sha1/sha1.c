@@ -36,10 +36,35 @@
  *      implementation only works with messages with a length that is a
  *      multiple of the size of an 8-bit character.
  *
+ *  Performance:
+ *      Catcierge hashes every camera frame it matches, so instead of
+ *      copying the message a byte at a time into Message_Block, whole
+ *      blocks are processed directly from the input. The blocks are
+ *      processed using the SHA instructions on x86 (SHA-NI) and ARMv8
+ *      if the CPU has them, otherwise an unrolled C version is used.
+ *
  */
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include "sha1.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_HAVE_SHANI 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define SHA1_HAVE_ARMV8 1
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA1
+#define HWCAP_SHA1 (1 << 5)
+#endif
+#endif
+
 /*
  *  Define the circular shift macro
  */
@@ -47,10 +72,26 @@
                 ((((word) << (bits)) & 0xFFFFFFFF) | \
                 ((word) >> (32-(bits))))
 
+/*
+ *  Processes a number of consecutive 64 byte blocks.
+ */
+typedef void (*SHA1BlocksFunc)(unsigned *digest,
+                               const unsigned char *data,
+                               size_t blocks);
+
 /* Function prototypes */
 void SHA1ProcessMessageBlock(SHA1Context *);
 void SHA1PadMessage(SHA1Context *);
 
+static void SHA1ProcessBlocksScalar(unsigned *, const unsigned char *, size_t);
+
+/*
+ *  Selected by SHA1Reset the first time. If two threads do that at
+ *  the same time they pick the same one, so that is harmless.
+ */
+static SHA1BlocksFunc SHA1ProcessBlocks = NULL;
+static SHA1Implementation SHA1Selected = SHA1_IMPL_AUTO;
+
 /*  
  *  SHA1Reset
  *
@@ -70,6 +111,11 @@ void SHA1PadMessage(SHA1Context *);
  */
 void SHA1Reset(SHA1Context *context)
 {
+    if (!SHA1ProcessBlocks)
+    {
+        SHA1SetImplementation(SHA1_IMPL_AUTO);
+    }
+
     context->Length_Low             = 0;
     context->Length_High            = 0;
     context->Message_Block_Index    = 0;
@@ -138,12 +184,18 @@ int SHA1Result(SHA1Context *context)
  *      Nothing.
  *
  *  Comments:
+ *      Only a partial block at the start or the end of the input is
+ *      copied to Message_Block, the whole blocks in between are
+ *      processed where they are.
  *
  */
 void SHA1Input(     SHA1Context         *context,
                     const unsigned char *message_array,
                     unsigned            length)
 {
+    uint64_t bits;
+    size_t n;
+
     if (!length)
     {
         return;
@@ -155,32 +207,53 @@ void SHA1Input(     SHA1Context         *context,
         return;
     }
 
-    while(length-- && !context->Corrupted)
+    bits = ((uint64_t)context->Length_High << 32) | context->Length_Low;
+
+    if ((bits + (uint64_t)length * 8) < bits)
+    {
+        /* Message is too long */
+        context->Corrupted = 1;
+        return;
+    }
+
+    bits += (uint64_t)length * 8;
+    context->Length_High = (unsigned)(bits >> 32);
+    context->Length_Low = (unsigned)(bits & 0xFFFFFFFF);
+
+    if (context->Message_Block_Index > 0)
     {
-        context->Message_Block[context->Message_Block_Index++] =
-                                                (*message_array & 0xFF);
+        n = 64 - context->Message_Block_Index;
 
-        context->Length_Low += 8;
-        /* Force it to 32 bits */
-        context->Length_Low &= 0xFFFFFFFF;
-        if (context->Length_Low == 0)
+        if (n > length)
         {
-            context->Length_High++;
-            /* Force it to 32 bits */
-            context->Length_High &= 0xFFFFFFFF;
-            if (context->Length_High == 0)
-            {
-                /* Message is too long */
-                context->Corrupted = 1;
-            }
+            n = length;
         }
 
-        if (context->Message_Block_Index == 64)
+        memcpy(&context->Message_Block[context->Message_Block_Index],
+               message_array, n);
+        context->Message_Block_Index += (int)n;
+        message_array += n;
+        length -= (unsigned)n;
+
+        if (context->Message_Block_Index < 64)
         {
-            SHA1ProcessMessageBlock(context);
+            return;
         }
 
-        message_array++;
+        SHA1ProcessMessageBlock(context);
+    }
+
+    if (length >= 64)
+    {
+        SHA1ProcessBlocks(context->Message_Digest, message_array, length / 64);
+        message_array += length & ~63u;
+        length &= 63;
+    }
+
+    if (length > 0)
+    {
+        memcpy(context->Message_Block, message_array, length);
+        context->Message_Block_Index = (int)length;
     }
 }
 
@@ -198,106 +271,393 @@ void SHA1Input(     SHA1Context         *context,
  *      Nothing.
  *
  *  Comments:
- *      Many of the variable names in the SHAContext, especially the
- *      single character names, were used because those were the names
- *      used in the publication.
- *         
  *
  */
 void SHA1ProcessMessageBlock(SHA1Context *context)
 {
-    const unsigned K[] =            /* Constants defined in SHA-1   */      
-    {
-        0x5A827999,
-        0x6ED9EBA1,
-        0x8F1BBCDC,
-        0xCA62C1D6
-    };
-    int         t;                  /* Loop counter                 */
-    unsigned    temp;               /* Temporary word value         */
-    unsigned    W[80];              /* Word sequence                */
-    unsigned    A, B, C, D, E;      /* Word buffers                 */
+    SHA1ProcessBlocks(context->Message_Digest, context->Message_Block, 1);
+    context->Message_Block_Index = 0;
+}
 
-    /*
-     *  Initialize the first 16 words in the array W
-     */
-    for(t = 0; t < 16; t++)
+/*
+ *  SHA1ProcessBlocksScalar
+ *
+ *  Description:
+ *      The rounds of FIPS PUB 180-1 unrolled, with the word sequence
+ *      kept in a 16 word circular buffer instead of all 80 words.
+ *
+ *  Comments:
+ *      Many of the variable names are the names used in the publication.
+ *
+ */
+#define SHA1Load(p) \
+                (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | \
+                 ((uint32_t)(p)[2] << 8) | ((uint32_t)(p)[3]))
+
+#define SHA1W(t) \
+                (W[(t) & 15] = SHA1CircularShift(1, W[((t) + 13) & 15] ^ \
+                    W[((t) + 8) & 15] ^ W[((t) + 2) & 15] ^ W[(t) & 15]))
+
+#define SHA1Round(a, b, c, d, e, f, k, w) \
+                e += SHA1CircularShift(5, a) + (f) + (k) + (w); \
+                b = SHA1CircularShift(30, b)
+
+#define R0(a, b, c, d, e, t) \
+    SHA1Round(a, b, c, d, e, ((b & (c ^ d)) ^ d), 0x5A827999, \
+              (W[t] = SHA1Load(data + (t) * 4)))
+#define R1(a, b, c, d, e, t) \
+    SHA1Round(a, b, c, d, e, ((b & (c ^ d)) ^ d), 0x5A827999, SHA1W(t))
+#define R2(a, b, c, d, e, t) \
+    SHA1Round(a, b, c, d, e, (b ^ c ^ d), 0x6ED9EBA1, SHA1W(t))
+#define R3(a, b, c, d, e, t) \
+    SHA1Round(a, b, c, d, e, ((b & c) | ((b | c) & d)), 0x8F1BBCDC, SHA1W(t))
+#define R4(a, b, c, d, e, t) \
+    SHA1Round(a, b, c, d, e, (b ^ c ^ d), 0xCA62C1D6, SHA1W(t))
+
+static void SHA1ProcessBlocksScalar(unsigned *digest,
+                                    const unsigned char *data,
+                                    size_t blocks)
+{
+    uint32_t W[16];
+    uint32_t a, b, c, d, e;
+
+    for (; blocks > 0; blocks--, data += 64)
     {
-        W[t] = ((unsigned) context->Message_Block[t * 4]) << 24;
-        W[t] |= ((unsigned) context->Message_Block[t * 4 + 1]) << 16;
-        W[t] |= ((unsigned) context->Message_Block[t * 4 + 2]) << 8;
-        W[t] |= ((unsigned) context->Message_Block[t * 4 + 3]);
+        a = digest[0];
+        b = digest[1];
+        c = digest[2];
+        d = digest[3];
+        e = digest[4];
+
+        R0(a, b, c, d, e,  0); R0(e, a, b, c, d,  1); R0(d, e, a, b, c,  2); R0(c, d, e, a, b,  3); R0(b, c, d, e, a,  4);
+        R0(a, b, c, d, e,  5); R0(e, a, b, c, d,  6); R0(d, e, a, b, c,  7); R0(c, d, e, a, b,  8); R0(b, c, d, e, a,  9);
+        R0(a, b, c, d, e, 10); R0(e, a, b, c, d, 11); R0(d, e, a, b, c, 12); R0(c, d, e, a, b, 13); R0(b, c, d, e, a, 14);
+        R0(a, b, c, d, e, 15); R1(e, a, b, c, d, 16); R1(d, e, a, b, c, 17); R1(c, d, e, a, b, 18); R1(b, c, d, e, a, 19);
+        R2(a, b, c, d, e, 20); R2(e, a, b, c, d, 21); R2(d, e, a, b, c, 22); R2(c, d, e, a, b, 23); R2(b, c, d, e, a, 24);
+        R2(a, b, c, d, e, 25); R2(e, a, b, c, d, 26); R2(d, e, a, b, c, 27); R2(c, d, e, a, b, 28); R2(b, c, d, e, a, 29);
+        R2(a, b, c, d, e, 30); R2(e, a, b, c, d, 31); R2(d, e, a, b, c, 32); R2(c, d, e, a, b, 33); R2(b, c, d, e, a, 34);
+        R2(a, b, c, d, e, 35); R2(e, a, b, c, d, 36); R2(d, e, a, b, c, 37); R2(c, d, e, a, b, 38); R2(b, c, d, e, a, 39);
+        R3(a, b, c, d, e, 40); R3(e, a, b, c, d, 41); R3(d, e, a, b, c, 42); R3(c, d, e, a, b, 43); R3(b, c, d, e, a, 44);
+        R3(a, b, c, d, e, 45); R3(e, a, b, c, d, 46); R3(d, e, a, b, c, 47); R3(c, d, e, a, b, 48); R3(b, c, d, e, a, 49);
+        R3(a, b, c, d, e, 50); R3(e, a, b, c, d, 51); R3(d, e, a, b, c, 52); R3(c, d, e, a, b, 53); R3(b, c, d, e, a, 54);
+        R3(a, b, c, d, e, 55); R3(e, a, b, c, d, 56); R3(d, e, a, b, c, 57); R3(c, d, e, a, b, 58); R3(b, c, d, e, a, 59);
+        R4(a, b, c, d, e, 60); R4(e, a, b, c, d, 61); R4(d, e, a, b, c, 62); R4(c, d, e, a, b, 63); R4(b, c, d, e, a, 64);
+        R4(a, b, c, d, e, 65); R4(e, a, b, c, d, 66); R4(d, e, a, b, c, 67); R4(c, d, e, a, b, 68); R4(b, c, d, e, a, 69);
+        R4(a, b, c, d, e, 70); R4(e, a, b, c, d, 71); R4(d, e, a, b, c, 72); R4(c, d, e, a, b, 73); R4(b, c, d, e, a, 74);
+        R4(a, b, c, d, e, 75); R4(e, a, b, c, d, 76); R4(d, e, a, b, c, 77); R4(c, d, e, a, b, 78); R4(b, c, d, e, a, 79);
+
+        digest[0] += a;
+        digest[1] += b;
+        digest[2] += c;
+        digest[3] += d;
+        digest[4] += e;
     }
+}
 
-    for(t = 16; t < 80; t++)
+#ifdef SHA1_HAVE_SHANI
+/*
+ *  SHA1ProcessBlocksSHANI
+ *
+ *  Description:
+ *      Uses the x86 SHA extensions. Each sha1rnds4 does 4 rounds, and
+ *      sha1msg1/sha1msg2 calculate the word sequence 4 words at a time.
+ *
+ */
+#define SHA1ShaniLoad(msg, offset) \
+    msg = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + (offset))), mask)
+
+#define SHA1ShaniRounds(e, e_next, msg, func) \
+    e = _mm_sha1nexte_epu32(e, msg); \
+    e_next = abcd; \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, func)
+
+__attribute__((target("sha,sse4.1")))
+static void SHA1ProcessBlocksSHANI(unsigned *digest,
+                                   const unsigned char *data,
+                                   size_t blocks)
+{
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i msg0, msg1, msg2, msg3;
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)digest), 0x1B);
+    e0 = _mm_set_epi32((int)digest[4], 0, 0, 0);
+
+    for (; blocks > 0; blocks--, data += 64)
     {
-       W[t] = SHA1CircularShift(1,W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]);
+        abcd_save = abcd;
+        e0_save = e0;
+
+        /* Rounds 0-15 */
+        SHA1ShaniLoad(msg0, 0);
+        e0 = _mm_add_epi32(e0, msg0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        SHA1ShaniLoad(msg1, 16);
+        SHA1ShaniRounds(e1, e0, msg1, 0);
+        msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+        SHA1ShaniLoad(msg2, 32);
+        SHA1ShaniRounds(e0, e1, msg2, 0);
+        msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+        msg0 = _mm_xor_si128(msg0, msg2);
+
+        SHA1ShaniLoad(msg3, 48);
+        SHA1ShaniRounds(e1, e0, msg3, 0);
+        msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+        msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+        msg1 = _mm_xor_si128(msg1, msg3);
+
+        /* Rounds 16-67, the word sequence follows the same pattern. */
+        #define SHA1ShaniSchedule(e, e_next, m0, m1, m2, m3, func) \
+            SHA1ShaniRounds(e, e_next, m0, func); \
+            m1 = _mm_sha1msg2_epu32(m1, m0); \
+            m3 = _mm_sha1msg1_epu32(m3, m0); \
+            m2 = _mm_xor_si128(m2, m0)
+
+        SHA1ShaniSchedule(e0, e1, msg0, msg1, msg2, msg3, 0);
+        SHA1ShaniSchedule(e1, e0, msg1, msg2, msg3, msg0, 1);
+        SHA1ShaniSchedule(e0, e1, msg2, msg3, msg0, msg1, 1);
+        SHA1ShaniSchedule(e1, e0, msg3, msg0, msg1, msg2, 1);
+        SHA1ShaniSchedule(e0, e1, msg0, msg1, msg2, msg3, 1);
+        SHA1ShaniSchedule(e1, e0, msg1, msg2, msg3, msg0, 1);
+        SHA1ShaniSchedule(e0, e1, msg2, msg3, msg0, msg1, 2);
+        SHA1ShaniSchedule(e1, e0, msg3, msg0, msg1, msg2, 2);
+        SHA1ShaniSchedule(e0, e1, msg0, msg1, msg2, msg3, 2);
+        SHA1ShaniSchedule(e1, e0, msg1, msg2, msg3, msg0, 2);
+        SHA1ShaniSchedule(e0, e1, msg2, msg3, msg0, msg1, 2);
+        SHA1ShaniSchedule(e1, e0, msg3, msg0, msg1, msg2, 3);
+        SHA1ShaniSchedule(e0, e1, msg0, msg1, msg2, msg3, 3);
+
+        #undef SHA1ShaniSchedule
+
+        /* Rounds 68-79 */
+        SHA1ShaniRounds(e1, e0, msg1, 3);
+        msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+        msg3 = _mm_xor_si128(msg3, msg1);
+
+        SHA1ShaniRounds(e0, e1, msg2, 3);
+        msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+
+        SHA1ShaniRounds(e1, e0, msg3, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
     }
 
-    A = context->Message_Digest[0];
-    B = context->Message_Digest[1];
-    C = context->Message_Digest[2];
-    D = context->Message_Digest[3];
-    E = context->Message_Digest[4];
+    _mm_storeu_si128((__m128i *)digest, _mm_shuffle_epi32(abcd, 0x1B));
+    digest[4] = (unsigned)_mm_extract_epi32(e0, 3);
+}
+
+static int SHA1HaveSHANI(void)
+{
+    unsigned eax, ebx, ecx, edx;
 
-    for(t = 0; t < 20; t++)
+    /* SSSE3 and SSE4.1 are needed as well. */
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+        || !(ecx & (1 << 9)) || !(ecx & (1 << 19)))
     {
-        temp =  SHA1CircularShift(5,A) +
-                ((B & C) | ((~B) & D)) + E + W[t] + K[0];
-        temp &= 0xFFFFFFFF;
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+        return 0;
     }
 
-    for(t = 20; t < 40; t++)
+    if (__get_cpuid_max(0, NULL) < 7)
+    {
+        return 0;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+    return (ebx & (1 << 29)) != 0;
+}
+#endif /* SHA1_HAVE_SHANI */
+
+#ifdef SHA1_HAVE_ARMV8
+/*
+ *  SHA1ProcessBlocksARMv8
+ *
+ *  Description:
+ *      Uses the ARMv8 crypto extensions. Each vsha1[cpm]q does 4 rounds
+ *      and vsha1su0q/vsha1su1q calculate the word sequence.
+ *
+ */
+#if defined(__clang__)
+#define SHA1_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+#define SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+
+SHA1_ARMV8_TARGET
+static void SHA1ProcessBlocksARMv8(unsigned *digest,
+                                   const unsigned char *data,
+                                   size_t blocks)
+{
+    uint32x4_t abcd, abcd_save;
+    uint32x4_t tmp0, tmp1;
+    uint32x4_t msg0, msg1, msg2, msg3;
+    uint32_t e0, e0_save, e1;
+    const uint32x4_t k0 = vdupq_n_u32(0x5A827999);
+    const uint32x4_t k1 = vdupq_n_u32(0x6ED9EBA1);
+    const uint32x4_t k2 = vdupq_n_u32(0x8F1BBCDC);
+    const uint32x4_t k3 = vdupq_n_u32(0xCA62C1D6);
+
+    abcd = vld1q_u32((const uint32_t *)digest);
+    e0 = digest[4];
+
+    for (; blocks > 0; blocks--, data += 64)
     {
-        temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[1];
-        temp &= 0xFFFFFFFF;
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+        abcd_save = abcd;
+        e0_save = e0;
+
+        msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+        msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+        msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+        msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+        tmp0 = vaddq_u32(msg0, k0);
+        tmp1 = vaddq_u32(msg1, k0);
+
+        /*
+         *  4 rounds using e, the other e is calculated for the next 4.
+         *  tmp is the word sequence + K for 2 rounds ahead, m0 is the
+         *  oldest words and is updated with the words for 16 rounds ahead.
+         */
+        #define SHA1Armv8Rounds(op, e, e_next, tmp) \
+            e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+            abcd = op(abcd, e, tmp)
+
+        #define SHA1Armv8Schedule(op, e, e_next, tmp, k, m0, m1, m2, m3) \
+            SHA1Armv8Rounds(op, e, e_next, tmp); \
+            tmp = vaddq_u32(m2, k); \
+            m3 = vsha1su1q_u32(m3, m2); \
+            m0 = vsha1su0q_u32(m0, m1, m2)
+
+        /* Rounds 0-3 */
+        SHA1Armv8Rounds(vsha1cq_u32, e0, e1, tmp0);
+        tmp0 = vaddq_u32(msg2, k0);
+        msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+        /* Rounds 4-63 */
+        SHA1Armv8Schedule(vsha1cq_u32, e1, e0, tmp1, k0, msg1, msg2, msg3, msg0);
+        SHA1Armv8Schedule(vsha1cq_u32, e0, e1, tmp0, k0, msg2, msg3, msg0, msg1);
+        SHA1Armv8Schedule(vsha1cq_u32, e1, e0, tmp1, k1, msg3, msg0, msg1, msg2);
+        SHA1Armv8Schedule(vsha1cq_u32, e0, e1, tmp0, k1, msg0, msg1, msg2, msg3);
+        SHA1Armv8Schedule(vsha1pq_u32, e1, e0, tmp1, k1, msg1, msg2, msg3, msg0);
+        SHA1Armv8Schedule(vsha1pq_u32, e0, e1, tmp0, k1, msg2, msg3, msg0, msg1);
+        SHA1Armv8Schedule(vsha1pq_u32, e1, e0, tmp1, k1, msg3, msg0, msg1, msg2);
+        SHA1Armv8Schedule(vsha1pq_u32, e0, e1, tmp0, k2, msg0, msg1, msg2, msg3);
+        SHA1Armv8Schedule(vsha1pq_u32, e1, e0, tmp1, k2, msg1, msg2, msg3, msg0);
+        SHA1Armv8Schedule(vsha1mq_u32, e0, e1, tmp0, k2, msg2, msg3, msg0, msg1);
+        SHA1Armv8Schedule(vsha1mq_u32, e1, e0, tmp1, k2, msg3, msg0, msg1, msg2);
+        SHA1Armv8Schedule(vsha1mq_u32, e0, e1, tmp0, k2, msg0, msg1, msg2, msg3);
+        SHA1Armv8Schedule(vsha1mq_u32, e1, e0, tmp1, k3, msg1, msg2, msg3, msg0);
+        SHA1Armv8Schedule(vsha1mq_u32, e0, e1, tmp0, k3, msg2, msg3, msg0, msg1);
+        SHA1Armv8Schedule(vsha1pq_u32, e1, e0, tmp1, k3, msg3, msg0, msg1, msg2);
+
+        /* Rounds 64-79 */
+        SHA1Armv8Rounds(vsha1pq_u32, e0, e1, tmp0);
+        tmp0 = vaddq_u32(msg2, k3);
+        msg3 = vsha1su1q_u32(msg3, msg2);
+
+        SHA1Armv8Rounds(vsha1pq_u32, e1, e0, tmp1);
+        tmp1 = vaddq_u32(msg3, k3);
+
+        SHA1Armv8Rounds(vsha1pq_u32, e0, e1, tmp0);
+        SHA1Armv8Rounds(vsha1pq_u32, e1, e0, tmp1);
+
+        #undef SHA1Armv8Schedule
+        #undef SHA1Armv8Rounds
+
+        e0 += e0_save;
+        abcd = vaddq_u32(abcd, abcd_save);
     }
 
-    for(t = 40; t < 60; t++)
+    vst1q_u32((uint32_t *)digest, abcd);
+    digest[4] = e0;
+}
+
+static int SHA1HaveARMv8(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+}
+#endif /* SHA1_HAVE_ARMV8 */
+
+/*
+ *  SHA1SetImplementation
+ *
+ *  Description:
+ *      Selects how the message blocks are processed. The other
+ *      implementations are mostly useful for testing and benchmarks.
+ *
+ *  Returns:
+ *      0 on success, -1 if it is not supported.
+ *
+ */
+int SHA1SetImplementation(SHA1Implementation impl)
+{
+    switch (impl)
     {
-        temp = SHA1CircularShift(5,A) +
-               ((B & C) | (B & D) | (C & D)) + E + W[t] + K[2];
-        temp &= 0xFFFFFFFF;
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+        case SHA1_IMPL_AUTO:
+            if (!SHA1SetImplementation(SHA1_IMPL_SHANI)
+                || !SHA1SetImplementation(SHA1_IMPL_ARMV8))
+            {
+                return 0;
+            }
+
+            return SHA1SetImplementation(SHA1_IMPL_SCALAR);
+        case SHA1_IMPL_SCALAR:
+            SHA1ProcessBlocks = SHA1ProcessBlocksScalar;
+            break;
+        #ifdef SHA1_HAVE_SHANI
+        case SHA1_IMPL_SHANI:
+            if (!SHA1HaveSHANI())
+            {
+                return -1;
+            }
+
+            SHA1ProcessBlocks = SHA1ProcessBlocksSHANI;
+            break;
+        #endif
+        #ifdef SHA1_HAVE_ARMV8
+        case SHA1_IMPL_ARMV8:
+            if (!SHA1HaveARMv8())
+            {
+                return -1;
+            }
+
+            SHA1ProcessBlocks = SHA1ProcessBlocksARMv8;
+            break;
+        #endif
+        default:
+            return -1;
     }
 
-    for(t = 60; t < 80; t++)
+    SHA1Selected = impl;
+
+    return 0;
+}
+
+SHA1Implementation SHA1GetImplementation(void)
+{
+    if (!SHA1ProcessBlocks)
     {
-        temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[3];
-        temp &= 0xFFFFFFFF;
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+        SHA1SetImplementation(SHA1_IMPL_AUTO);
     }
 
-    context->Message_Digest[0] =
-                        (context->Message_Digest[0] + A) & 0xFFFFFFFF;
-    context->Message_Digest[1] =
-                        (context->Message_Digest[1] + B) & 0xFFFFFFFF;
-    context->Message_Digest[2] =
-                        (context->Message_Digest[2] + C) & 0xFFFFFFFF;
-    context->Message_Digest[3] =
-                        (context->Message_Digest[3] + D) & 0xFFFFFFFF;
-    context->Message_Digest[4] =
-                        (context->Message_Digest[4] + E) & 0xFFFFFFFF;
+    return SHA1Selected;
+}
 
-    context->Message_Block_Index = 0;
+const char *SHA1ImplementationName(SHA1Implementation impl)
+{
+    switch (impl)
+    {
+        case SHA1_IMPL_AUTO: return "auto";
+        case SHA1_IMPL_SCALAR: return "scalar";
+        case SHA1_IMPL_SHANI: return "sha-ni";
+        case SHA1_IMPL_ARMV8: return "armv8";
+    }
+
+    return "unknown";
 }
 
 /*  
@@ -19,6 +19,9 @@
  *
  *      Please read the file sha1.c for more information.
  *
+ *      Modified for Catcierge to process whole blocks at a time, using
+ *      the SHA instructions of the CPU when they are available.
+ *
  */
 
 #ifndef _SHA1_H_
@@ -42,6 +45,18 @@ typedef struct SHA1Context
     int Corrupted;              /* Is the message digest corruped?  */
 } SHA1Context;
 
+/*
+ *  The ways the message blocks can be processed. SHA1_IMPL_AUTO picks
+ *  the fastest one the CPU supports.
+ */
+typedef enum SHA1Implementation
+{
+    SHA1_IMPL_AUTO,
+    SHA1_IMPL_SCALAR,
+    SHA1_IMPL_SHANI,            /* x86 SHA extensions               */
+    SHA1_IMPL_ARMV8             /* ARMv8 crypto extensions          */
+} SHA1Implementation;
+
 /*
  *  Function Prototypes
  */
@@ -51,4 +66,12 @@ void SHA1Input( SHA1Context *,
                 const unsigned char *,
                 unsigned);
 
+/*
+ *  Returns 0 on success and -1 if the implementation isn't supported
+ *  by the compiler or the CPU. Don't change it while hashing.
+ */
+int SHA1SetImplementation(SHA1Implementation);
+SHA1Implementation SHA1GetImplementation(void);
+const char *SHA1ImplementationName(SHA1Implementation);
+
 #endif
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_arena.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+static char *run_alloc_tests()
+{
+	catcierge_arena_t a;
+	char *s = NULL;
+	char *t = NULL;
+	char *p = NULL;
+
+	catcierge_arena_init(&a, 64);
+
+	mu_assert("Expected strdup", (s = catcierge_arena_strdup(&a, "hello")));
+	mu_assert("Expected hello", !strcmp(s, "hello"));
+
+	mu_assert("Expected strndup", (t = catcierge_arena_strndup(&a, "world!", 5)));
+	mu_assert("Expected world", !strcmp(t, "world"));
+	mu_assert("Expected aligned allocation", ((size_t)t % 8) == 0);
+
+	catcierge_test_STATUS("Grow the last allocation in place");
+	p = catcierge_arena_realloc(&a, t, 6, 12);
+	mu_assert("Expected realloc in place", p == t);
+	mu_assert("Expected contents kept", !strncmp(p, "world", 5));
+
+	catcierge_test_STATUS("Grow an older allocation");
+	p = catcierge_arena_realloc(&a, s, 6, 32);
+	mu_assert("Expected a copy", p && (p != s));
+	mu_assert("Expected contents copied", !strcmp(p, "hello"));
+
+	catcierge_test_STATUS("Allocate more than a chunk");
+	mu_assert("Expected big allocation", (p = catcierge_arena_alloc(&a, 1000)));
+	memset(p, 'a', 1000);
+
+	catcierge_arena_destroy(&a);
+
+	return NULL;
+}
+
+static char *run_mark_tests()
+{
+	size_t i;
+	size_t capacity;
+	catcierge_arena_t a;
+	catcierge_arena_mark_t mark;
+	char *s = NULL;
+	char *p = NULL;
+
+	catcierge_arena_init(&a, 128);
+
+	s = catcierge_arena_strdup(&a, "keep");
+	mark = catcierge_arena_mark(&a);
+
+	for (i = 0; i < 100; i++)
+	{
+		mu_assert("Expected allocation", catcierge_arena_alloc(&a, 50));
+	}
+
+	capacity = catcierge_arena_capacity(&a);
+	catcierge_test_STATUS("Capacity after 100 allocations %d", (int)capacity);
+
+	catcierge_arena_release(&a, mark);
+	mu_assert("Expected allocation before mark to be kept", !strcmp(s, "keep"));
+
+	p = catcierge_arena_alloc(&a, 16);
+	mu_assert("Expected the memory after the mark to be reused",
+		p == (s + 16));
+
+	catcierge_test_STATUS("Released chunks are reused");
+
+	for (i = 0; i < 100; i++)
+	{
+		catcierge_arena_alloc(&a, 50);
+	}
+
+	mu_assert("Expected no new chunks", catcierge_arena_capacity(&a) == capacity);
+
+	catcierge_arena_reset(&a);
+	mu_assert("Expected memory to be kept", catcierge_arena_capacity(&a) == capacity);
+
+	catcierge_arena_destroy(&a);
+	mu_assert("Expected memory to be freed", catcierge_arena_capacity(&a) == 0);
+
+	return NULL;
+}
+
+int TEST_catcierge_arena(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	CATCIERGE_RUN_TEST((e = run_alloc_tests()),
+		"Arena allocations",
+		"Arena allocations", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_mark_tests()),
+		"Arena marks",
+		"Arena marks", &ret);
+
+	return ret;
+}
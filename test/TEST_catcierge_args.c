@@ -178,6 +178,23 @@ static char *run_catcierge_parse_test()
 		PARSE_ARGV_END();
 	}
 
+	{
+		PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--max_matches", "8", "--ok_matches_needed", "6");
+		mu_assert("max_matches != 8", args.max_matches == 8);
+		mu_assert("ok_matches_needed != 6", args.ok_matches_needed == 6);
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--max_matches", "0");
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--max_matches", "2", "--ok_matches_needed", "3");
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--early_decision", "--early_decision_confidence", "0.9");
+		mu_assert("Expected early_decision == 1", args.early_decision == 1);
+		mu_assert("Expected early_decision_confidence == 0.9", args.early_decision_confidence == 0.9);
+		PARSE_ARGV_END();
+		PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--early_decision_confidence", "2.0");
+		PARSE_ARGV_END();
+	}
+
 	PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--no_final_decision");
 	mu_assert("Expected no_final_decision == 1", args.no_final_decision == 1);
 	PARSE_ARGV_END();
@@ -323,6 +340,24 @@ static char *run_catcierge_parse_test()
 		(args.rfid_allowed_count == 3));
 	PARSE_ARGV_END();
 
+	PARSE_ARGV_START(0, &args, "catcierge", "--haar",
+		"--rfid", "inner=/dev/ttyUSB0", "mid=/dev/ttyUSB1");
+	mu_assert("Unexpected rfid_readers values",
+		(args.rfid_reader_count == 2) &&
+		!strcmp(args.rfid_readers[0], "inner=/dev/ttyUSB0") &&
+		!strcmp(args.rfid_readers[1], "mid=/dev/ttyUSB1"));
+	PARSE_ARGV_END();
+
+	PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--rfid", "/dev/ttyUSB0"); PARSE_ARGV_END();
+	PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--rfid", "=/dev/ttyUSB0"); PARSE_ARGV_END();
+	PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--rfid", "inner="); PARSE_ARGV_END();
+
+	PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--rfid_allowed_file", "/some/allowed.txt");
+	mu_assert("Expected rfid_allowed_file == /some/allowed.txt",
+		args.rfid_allowed_file
+		&& !strcmp(args.rfid_allowed_file, "/some/allowed.txt"));
+	PARSE_ARGV_END();
+
 	PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--rfid_time", "3.5");
 	mu_assert("Expected rfid_lock_time == 3.5",
 		(args.rfid_lock_time == 3.5));
@@ -348,6 +383,18 @@ static char *run_catcierge_parse_test()
 	mu_assert("Expected nocolor == 1", (args.nocolor == 1));
 	PARSE_ARGV_END();
 
+	PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--log_queue", "0");
+	mu_assert("Expected log_queue == 0", (args.log_queue == 0));
+	PARSE_ARGV_END();
+	PARSE_ARGV_START(-1, &args, "catcierge", "--haar", "--log_queue", "-1"); PARSE_ARGV_END();
+
+	#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+	PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--journal", "catcierge.journal");
+	mu_assert("Expected journal_path", args.journal_path
+		&& !strcmp(args.journal_path, "catcierge.journal"));
+	PARSE_ARGV_END();
+	#endif
+
 	PARSE_ARGV_START(0, &args, "catcierge", "--haar", "--noanim");
 	mu_assert("Expected noanim == 1", (args.noanim == 1));
 	PARSE_ARGV_END();
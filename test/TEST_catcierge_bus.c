@@ -0,0 +1,227 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_bus.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+typedef struct bus_test_s
+{
+	int count;
+	int idx[16];
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_t gate;	// Held by the test to stall the subscriber.
+	#endif
+} bus_test_t;
+
+static void on_event(const catcierge_event_data_t *ev, void *user)
+{
+	bus_test_t *t = (bus_test_t *)user;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_lock(&t->gate);
+	#endif
+
+	if (t->count < 16)
+	{
+		t->idx[t->count] = ev->u.match.idx;
+	}
+
+	t->count++;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_unlock(&t->gate);
+	#endif
+}
+
+static void publish(catcierge_bus_t *bus, catcierge_event_t type, int idx)
+{
+	catcierge_event_data_t ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.u.match.idx = idx;
+	catcierge_bus_publish(bus, &ev);
+}
+
+static char *run_event_names_test()
+{
+	mu_assert("Expected match_done",
+		!strcmp(catcierge_event_name(CATCIERGE_MATCH_DONE), "match_done"));
+	mu_assert("Expected state_change to be parsed",
+		catcierge_event_from_name("state_change") == CATCIERGE_STATE_CHANGE);
+	mu_assert("Expected unknown event", catcierge_event_from_name("nop") == -1);
+
+	mu_assert("Expected all events for \"all\"",
+		catcierge_event_filter_mask("all") == CATCIERGE_EVENT_MASK_ALL);
+	mu_assert("Expected all events for \"*\"",
+		catcierge_event_filter_mask("*") == CATCIERGE_EVENT_MASK_ALL);
+	mu_assert("Expected a single event",
+		catcierge_event_filter_mask("do_lockout") == CATCIERGE_EVENT_BIT(CATCIERGE_DO_LOCKOUT));
+	mu_assert("Expected no events", catcierge_event_filter_mask("nop") == 0);
+
+	return NULL;
+}
+
+static char *run_dispatch_test()
+{
+	int id;
+	catcierge_bus_t bus;
+	bus_test_t all;
+	bus_test_t match;
+
+	memset(&all, 0, sizeof(all));
+	memset(&match, 0, sizeof(match));
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	pthread_mutex_init(&all.gate, NULL);
+	pthread_mutex_init(&match.gate, NULL);
+	#endif
+
+	catcierge_bus_init(&bus);
+
+	mu_assert("Expected subscriber", catcierge_bus_subscribe(&bus, "all",
+		CATCIERGE_SUBSCRIBER_METRICS, CATCIERGE_EVENT_MASK_ALL,
+		on_event, &all, 0, CATCIERGE_BUS_BLOCK) == 0);
+
+	mu_assert("Expected subscriber", (id = catcierge_bus_subscribe(&bus, "match",
+		CATCIERGE_SUBSCRIBER_TEMPLATES, CATCIERGE_EVENT_BIT(CATCIERGE_MATCH_DONE),
+		on_event, &match, 0, CATCIERGE_BUS_BLOCK)) == 1);
+
+	publish(&bus, CATCIERGE_MATCH_DONE, 0);
+	publish(&bus, CATCIERGE_STATE_CHANGE, 1);
+	publish(&bus, CATCIERGE_MATCH_DONE, 2);
+
+	mu_assert("Expected all events", all.count == 3);
+	mu_assert("Expected only match_done", (match.count == 2) && (match.idx[1] == 2));
+
+	catcierge_test_STATUS("Change the subscription");
+	mu_assert("Expected events to be set", !catcierge_bus_set_events(&bus, id,
+		CATCIERGE_EVENT_BIT(CATCIERGE_STATE_CHANGE)));
+
+	publish(&bus, CATCIERGE_MATCH_DONE, 3);
+	publish(&bus, CATCIERGE_STATE_CHANGE, 4);
+
+	mu_assert("Expected only state_change", (match.count == 3) && (match.idx[2] == 4));
+	mu_assert("Expected published count", bus.published[CATCIERGE_MATCH_DONE] == 3);
+	mu_assert("Expected invalid subscriber", catcierge_bus_set_events(&bus, 5, 0) == -1);
+
+	catcierge_bus_destroy(&bus);
+
+	return NULL;
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+static void wait_busy(catcierge_bus_subscriber_t *sub)
+{
+	int busy = 0;
+
+	while (!busy)
+	{
+		pthread_mutex_lock(&sub->lock);
+		busy = sub->busy;
+		pthread_mutex_unlock(&sub->lock);
+	}
+}
+
+static char *run_queue_test(catcierge_bus_policy_t policy)
+{
+	int i;
+	catcierge_bus_t bus;
+	bus_test_t t;
+	catcierge_bus_subscriber_t *sub = NULL;
+
+	memset(&t, 0, sizeof(t));
+	pthread_mutex_init(&t.gate, NULL);
+
+	catcierge_bus_init(&bus);
+
+	mu_assert("Expected queued subscriber", catcierge_bus_subscribe(&bus, "queued",
+		CATCIERGE_SUBSCRIBER_PLUGIN, CATCIERGE_EVENT_MASK_ALL,
+		on_event, &t, 2, policy) == 0);
+
+	sub = &bus.subscribers[0];
+
+	if (policy == CATCIERGE_BUS_BLOCK)
+	{
+		for (i = 0; i < 10; i++)
+		{
+			publish(&bus, CATCIERGE_MATCH_DONE, i);
+		}
+
+		catcierge_bus_flush(&bus);
+		mu_assert("Expected all events", (t.count == 10) && (sub->dropped == 0));
+
+		for (i = 0; i < 10; i++)
+		{
+			mu_assert("Expected events in order", t.idx[i] == i);
+		}
+
+		goto done;
+	}
+
+	// Stall the subscriber on the first event so the queue fills up.
+	pthread_mutex_lock(&t.gate);
+	publish(&bus, CATCIERGE_MATCH_DONE, 0);
+	wait_busy(sub);
+
+	for (i = 1; i < 5; i++)
+	{
+		publish(&bus, CATCIERGE_MATCH_DONE, i);
+	}
+
+	pthread_mutex_unlock(&t.gate);
+	catcierge_bus_flush(&bus);
+
+	catcierge_test_STATUS("Got %d events %d %d %d, dropped %d",
+		t.count, t.idx[0], t.idx[1], t.idx[2], (int)sub->dropped);
+
+	mu_assert("Expected 3 events and 2 dropped", (t.count == 3) && (sub->dropped == 2));
+
+	if (policy == CATCIERGE_BUS_DROP_NEWEST)
+	{
+		mu_assert("Expected the oldest events", (t.idx[1] == 1) && (t.idx[2] == 2));
+	}
+	else
+	{
+		mu_assert("Expected the newest events", (t.idx[1] == 3) && (t.idx[2] == 4));
+	}
+
+done:
+	catcierge_bus_destroy(&bus);
+	pthread_mutex_destroy(&t.gate);
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int TEST_catcierge_bus(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	CATCIERGE_RUN_TEST((e = run_event_names_test()),
+		"Event names",
+		"Event names", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_dispatch_test()),
+		"Event dispatch",
+		"Event dispatch", &ret);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	CATCIERGE_RUN_TEST((e = run_queue_test(CATCIERGE_BUS_BLOCK)),
+		"Queued subscriber blocking",
+		"Queued subscriber blocking", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_queue_test(CATCIERGE_BUS_DROP_NEWEST)),
+		"Queued subscriber dropping newest",
+		"Queued subscriber dropping newest", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_queue_test(CATCIERGE_BUS_DROP_OLDEST)),
+		"Queued subscriber dropping oldest",
+		"Queued subscriber dropping oldest", &ret);
+	#else
+	catcierge_test_SKIPPED("Queued subscribers, no thread support");
+	#endif
+
+	return ret;
+}
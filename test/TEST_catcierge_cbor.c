@@ -0,0 +1,162 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_cbor.h"
+#include "catcierge_fsm.h"
+#include "catcierge_output.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#define CBOR_EXPECT(c, ...)											\
+	do																\
+	{																\
+		static const uint8_t exp[] = { __VA_ARGS__ };				\
+		mu_assert("Unexpected length", (c)->len == sizeof(exp));	\
+		mu_assert("Unexpected encoding", !memcmp((c)->buf, exp, sizeof(exp))); \
+		catcierge_cbor_reset(c);									\
+	} while (0)
+
+// Examples from RFC 7049 appendix A.
+static char *run_encode_tests()
+{
+	catcierge_cbor_t c;
+	catcierge_cbor_init(&c);
+
+	catcierge_cbor_uint(&c, 0);
+	CBOR_EXPECT(&c, 0x00);
+	catcierge_cbor_uint(&c, 23);
+	CBOR_EXPECT(&c, 0x17);
+	catcierge_cbor_uint(&c, 24);
+	CBOR_EXPECT(&c, 0x18, 0x18);
+	catcierge_cbor_uint(&c, 1000);
+	CBOR_EXPECT(&c, 0x19, 0x03, 0xe8);
+	catcierge_cbor_uint(&c, 1000000);
+	CBOR_EXPECT(&c, 0x1a, 0x00, 0x0f, 0x42, 0x40);
+	catcierge_cbor_uint(&c, 1000000000000ULL);
+	CBOR_EXPECT(&c, 0x1b, 0x00, 0x00, 0x00, 0xe8, 0xd4, 0xa5, 0x10, 0x00);
+
+	catcierge_cbor_int(&c, -1);
+	CBOR_EXPECT(&c, 0x20);
+	catcierge_cbor_int(&c, -1000);
+	CBOR_EXPECT(&c, 0x39, 0x03, 0xe7);
+
+	catcierge_cbor_double(&c, 100000.0);
+	CBOR_EXPECT(&c, 0xfa, 0x47, 0xc3, 0x50, 0x00);
+	catcierge_cbor_double(&c, 1.1);
+	CBOR_EXPECT(&c, 0xfb, 0x3f, 0xf1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a);
+
+	catcierge_cbor_bool(&c, 0);
+	CBOR_EXPECT(&c, 0xf4);
+	catcierge_cbor_bool(&c, 1);
+	CBOR_EXPECT(&c, 0xf5);
+	catcierge_cbor_null(&c);
+	CBOR_EXPECT(&c, 0xf6);
+	catcierge_cbor_text(&c, NULL);
+	CBOR_EXPECT(&c, 0xf6);
+
+	catcierge_cbor_text(&c, "IETF");
+	CBOR_EXPECT(&c, 0x64, 0x49, 0x45, 0x54, 0x46);
+	catcierge_cbor_bytes(&c, "\x01\x02\x03\x04", 4);
+	CBOR_EXPECT(&c, 0x44, 0x01, 0x02, 0x03, 0x04);
+
+	// {"a": 1, "b": [2, 3]}
+	catcierge_cbor_map(&c, 2);
+	catcierge_cbor_text(&c, "a");
+	catcierge_cbor_uint(&c, 1);
+	catcierge_cbor_text(&c, "b");
+	catcierge_cbor_array(&c, 2);
+	catcierge_cbor_uint(&c, 2);
+	catcierge_cbor_uint(&c, 3);
+	CBOR_EXPECT(&c, 0xa2, 0x61, 0x61, 0x01, 0x61, 0x62, 0x82, 0x02, 0x03);
+
+	catcierge_cbor_destroy(&c);
+
+	return NULL;
+}
+
+static char *run_grow_test()
+{
+	size_t i;
+	catcierge_cbor_t c;
+	char str[100];
+
+	catcierge_cbor_init(&c);
+	memset(str, 'a', sizeof(str) - 1);
+	str[sizeof(str) - 1] = '\0';
+
+	catcierge_test_STATUS("Outgrow the inline buffer");
+	catcierge_cbor_array(&c, 100);
+
+	for (i = 0; i < 100; i++)
+	{
+		catcierge_cbor_text(&c, str);
+	}
+
+	mu_assert("Expected no failure", !c.failed);
+	mu_assert("Expected buffer on the heap", c.buf != c.inline_buf);
+	mu_assert("Unexpected length", c.len == (2 + 100 * (2 + 99)));
+	mu_assert("Expected array head", (c.buf[0] == 0x98) && (c.buf[1] == 100));
+	mu_assert("Expected last string", !memcmp(&c.buf[c.len - 99], str, 99));
+
+	catcierge_cbor_destroy(&c);
+
+	return NULL;
+}
+
+static char *run_event_test()
+{
+	catcierge_grb_t grb;
+	catcierge_cbor_t c;
+	static const uint8_t head[] =
+	{
+		0xa6,
+		0x66, 's', 'c', 'h', 'e', 'm', 'a',
+		CATCIERGE_OUTPUT_CBOR_SCHEMA,
+		0x65, 'e', 'v', 'e', 'n', 't',
+		0x70, 'm', 'a', 't', 'c', 'h', '_', 'g', 'r', 'o', 'u', 'p', '_', 'd', 'o', 'n', 'e'
+	};
+
+	catcierge_grabber_init(&grb);
+	catcierge_cbor_init(&c);
+
+	grb.match_group.match_count = 2;
+	grb.match_group.success = 1;
+	strcpy(grb.match_group.description, "cat");
+	strcpy(grb.match_group.matches[1].result.description, "prey found");
+
+	mu_assert("Expected event to be encoded",
+		!catcierge_output_encode_cbor(&grb, CATCIERGE_MATCH_GROUP_DONE, &c));
+	catcierge_test_STATUS("Encoded match group in %d bytes", (int)c.len);
+
+	mu_assert("Unexpected header", (c.len > sizeof(head))
+		&& !memcmp(c.buf, head, sizeof(head)));
+
+	catcierge_test_STATUS("Ends with the last match with no steps");
+	mu_assert("Expected empty steps array", c.buf[c.len - 1] == 0x80);
+
+	catcierge_cbor_destroy(&c);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+int TEST_catcierge_cbor(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	CATCIERGE_RUN_TEST((e = run_encode_tests()),
+		"CBOR encoding",
+		"CBOR encoding", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_grow_test()),
+		"CBOR buffer growth",
+		"CBOR buffer growth", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_event_test()),
+		"CBOR event encoding",
+		"CBOR event encoding", &ret);
+
+	return ret;
+}
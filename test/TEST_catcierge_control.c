@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_config.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_args.h"
+#include "catcierge_fsm.h"
+
+#ifdef WITH_ZMQ
+#include <czmq.h>
+#include "catcierge_control.h"
+
+#if (ZMQ_VERSION >= ZMQ_MAKE_VERSION (4, 0, 0))
+#define CONTROL_TEST_ENABLED
+#define CONTROL_TEST_ENDPOINT "inproc://catcierge_control_test"
+
+static catcierge_grb_t grb;
+static catcierge_control_t ctrl;
+
+// Sends a command and runs the control channel until it has been handled.
+static void send_command(zsock_t *req, const char *cmd)
+{
+	zpoller_t *poller = zpoller_new(ctrl.router, NULL);
+
+	zstr_send(req, cmd);
+	zpoller_wait(poller, 1000);
+	zpoller_destroy(&poller);
+
+	catcierge_control_service(&ctrl);
+}
+
+static char *command(zsock_t *req, const char *cmd)
+{
+	send_command(req, cmd);
+	return zstr_recv(req);
+}
+
+static char *run_commands_test()
+{
+	zsock_t *req = NULL;
+	char *reply = NULL;
+
+	mu_assert("Expected grabber init", !catcierge_grabber_init(&grb));
+	mu_assert("Expected args init", !catcierge_args_init(&grb.args, "catcierge"));
+	catcierge_update_event_subscriptions(&grb);
+	catcierge_set_state(&grb, catcierge_state_waiting);
+
+	mu_assert("Expected control init",
+		!catcierge_control_init(&ctrl, &grb, CONTROL_TEST_ENDPOINT));
+	mu_assert("Expected REQ socket", (req = zsock_new_req(">" CONTROL_TEST_ENDPOINT)));
+
+	catcierge_test_STATUS("ping");
+	mu_assert("Expected reply", (reply = command(req, "ping")));
+	catcierge_test_STATUS("%s", reply);
+	mu_assert("Expected ok", strstr(reply, "\"ok\":true"));
+	zstr_free(&reply);
+
+	catcierge_test_STATUS("ignore");
+	mu_assert("Expected reply", (reply = command(req, "ignore")));
+	catcierge_test_STATUS("%s", reply);
+	mu_assert("Expected ignoring", strstr(reply, "\"state\":\"Ignoring\""));
+	mu_assert("Expected ignoring state", grb.state == catcierge_state_ignoring);
+	zstr_free(&reply);
+
+	catcierge_test_STATUS("attention");
+	mu_assert("Expected reply", (reply = command(req, "attention")));
+	mu_assert("Expected waiting state", grb.state == catcierge_state_waiting);
+	zstr_free(&reply);
+
+	catcierge_test_STATUS("stats");
+	mu_assert("Expected reply", (reply = command(req, "stats")));
+	catcierge_test_STATUS("%s", reply);
+	mu_assert("Expected event counts", strstr(reply, "\"state_change\":"));
+	zstr_free(&reply);
+
+	catcierge_test_STATUS("Unknown command");
+	mu_assert("Expected reply", (reply = command(req, "open_the_pod_bay_doors")));
+	catcierge_test_STATUS("%s", reply);
+	mu_assert("Expected error", strstr(reply, "\"ok\":false"));
+	zstr_free(&reply);
+
+	zsock_destroy(&req);
+	catcierge_control_destroy(&ctrl);
+	catcierge_args_destroy(&grb.args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_history_test()
+{
+	zsock_t *req = NULL;
+	char *reply = NULL;
+
+	mu_assert("Expected grabber init", !catcierge_grabber_init(&grb));
+	mu_assert("Expected args init", !catcierge_args_init(&grb.args, "catcierge"));
+	catcierge_update_event_subscriptions(&grb);
+
+	mu_assert("Expected control init",
+		!catcierge_control_init(&ctrl, &grb, CONTROL_TEST_ENDPOINT));
+	mu_assert("Expected REQ socket", (req = zsock_new_req(">" CONTROL_TEST_ENDPOINT)));
+
+	strcpy(grb.match_group.description, "First \"cat\"");
+	catcierge_trigger_event(&grb, CATCIERGE_MATCH_GROUP_DONE, 0);
+
+	strcpy(grb.match_group.description, "Second cat");
+	grb.match_group.success = 1;
+	catcierge_trigger_event(&grb, CATCIERGE_MATCH_GROUP_DONE, 0);
+
+	catcierge_test_STATUS("Full history");
+	mu_assert("Expected reply", (reply = command(req, "history")));
+	catcierge_test_STATUS("%s", reply);
+	mu_assert("Expected total", strstr(reply, "\"total\":2"));
+	mu_assert("Expected escaped description", strstr(reply, "First \\\"cat\\\""));
+	mu_assert("Expected newest first",
+		strstr(reply, "Second cat") < strstr(reply, "First"));
+	zstr_free(&reply);
+
+	catcierge_test_STATUS("Last match group");
+	mu_assert("Expected reply", (reply = command(req, "history 1")));
+	mu_assert("Expected newest", strstr(reply, "Second cat"));
+	mu_assert("Expected only one", !strstr(reply, "First"));
+	zstr_free(&reply);
+
+	zsock_destroy(&req);
+	catcierge_control_destroy(&ctrl);
+	catcierge_args_destroy(&grb.args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_snapshot_test()
+{
+	zsock_t *req = NULL;
+	zmsg_t *msg = NULL;
+	char *reply = NULL;
+	zframe_t *img_frame = NULL;
+	IplImage *img = NULL;
+
+	mu_assert("Expected grabber init", !catcierge_grabber_init(&grb));
+	mu_assert("Expected args init", !catcierge_args_init(&grb.args, "catcierge"));
+	catcierge_update_event_subscriptions(&grb);
+
+	mu_assert("Expected control init",
+		!catcierge_control_init(&ctrl, &grb, CONTROL_TEST_ENDPOINT));
+	mu_assert("Expected REQ socket", (req = zsock_new_req(">" CONTROL_TEST_ENDPOINT)));
+	mu_assert("Expected image", (img = cvLoadImage(CATCIERGE_SNOUT1_PATH, 0)));
+
+	send_command(req, "snapshot");
+	mu_assert("Expected the snapshot to wait for a frame", ctrl.snapshot_count == 1);
+
+	catcierge_test_STATUS("Reply on the next frame");
+	catcierge_control_frame(&ctrl, img);
+	mu_assert("Expected no waiting snapshots", ctrl.snapshot_count == 0);
+
+	mu_assert("Expected reply", (msg = zmsg_recv(req)));
+	mu_assert("Expected JSON and image", zmsg_size(msg) == 2);
+	reply = zmsg_popstr(msg);
+	catcierge_test_STATUS("%s", reply);
+	mu_assert("Expected ok", strstr(reply, "\"ok\":true"));
+	img_frame = zmsg_pop(msg);
+	mu_assert("Expected JPEG", (zframe_size(img_frame) > 2)
+		&& (zframe_data(img_frame)[0] == 0xFF)
+		&& (zframe_data(img_frame)[1] == 0xD8));
+
+	zframe_destroy(&img_frame);
+	zstr_free(&reply);
+	zmsg_destroy(&msg);
+	cvReleaseImage(&img);
+	zsock_destroy(&req);
+	catcierge_control_destroy(&ctrl);
+	catcierge_args_destroy(&grb.args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+#endif // ZMQ_VERSION >= 4.0.0
+#endif // WITH_ZMQ
+
+int TEST_catcierge_control(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	#ifdef CONTROL_TEST_ENABLED
+	CATCIERGE_RUN_TEST((e = run_commands_test()),
+		"Control commands",
+		"Control commands", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_history_test()),
+		"Control history",
+		"Control history", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_snapshot_test()),
+		"Control snapshot",
+		"Control snapshot", &ret);
+	#else
+	catcierge_test_SKIPPED("The control channel needs CZMQ 3.0 or later");
+	#endif
+
+	return ret;
+}
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_fsm.h"
+#include "catcierge_encoded_image.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+#include "catcierge_test_common.h"
+
+#define ENCODED_TEST_PATH "encoded_image_test.png"
+
+static char *run_encode_save_test()
+{
+	IplImage *img = NULL;
+	IplImage *loaded = NULL;
+	catcierge_encoded_image_t *e = NULL;
+	FILE *f = NULL;
+	long size = 0;
+
+	mu_assert("Expected image", (img = create_black_image()));
+	mu_assert("Expected image to be encoded", (e = catcierge_encoded_image_create(img, ".png", NULL)));
+	mu_assert("Expected data", e->data && (e->size > 0));
+	mu_assert("Expected PNG signature", !memcmp(e->data, "\x89PNG", 4));
+	catcierge_test_STATUS("Encoded 320x240 image in %d bytes", (int)e->size);
+
+	mu_assert("Expected image to be saved", !catcierge_encoded_image_save(e, ENCODED_TEST_PATH));
+
+	mu_assert("Expected saved file", (f = fopen(ENCODED_TEST_PATH, "rb")));
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fclose(f);
+	mu_assert("Expected the encoded data to be written as is", size == (long)e->size);
+
+	mu_assert("Expected the saved image to load", (loaded = cvLoadImage(ENCODED_TEST_PATH, 0)));
+	mu_assert("Expected same size", (loaded->width == 320) && (loaded->height == 240));
+
+	cvReleaseImage(&loaded);
+	cvReleaseImage(&img);
+	catcierge_encoded_image_unref(&e);
+	mu_assert("Expected unref to clear the pointer", e == NULL);
+	remove(ENCODED_TEST_PATH);
+
+	return NULL;
+}
+
+static char *run_refcount_test()
+{
+	IplImage *img = NULL;
+	match_group_t mg;
+	match_group_t snapshot;
+	catcierge_encoded_image_t *e = NULL;
+	catcierge_encoded_image_t *step = NULL;
+
+	memset(&mg, 0, sizeof(mg));
+	mu_assert("Expected match group", !catcierge_match_group_init(&mg, 2));
+
+	mu_assert("Expected image", (img = create_clear_image()));
+	mu_assert("Expected image to be encoded", (e = catcierge_encoded_image_create(img, ".png", NULL)));
+	mu_assert("Expected image to be encoded", (step = catcierge_encoded_image_create(img, ".png", NULL)));
+
+	mg.matches[1].encoded = e;
+	mg.matches[1].result.steps[3].encoded = step;
+	mg.obstruct_encoded = catcierge_encoded_image_ref(e);
+	mu_assert("Expected 2 references", e->refcount == 2);
+
+	catcierge_test_STATUS("A copy of the match group shares the images");
+	snapshot = mg;
+	mu_assert("Expected matches", (snapshot.matches = calloc(mg.max_count, sizeof(match_state_t))));
+	memcpy(snapshot.matches, mg.matches, mg.max_count * sizeof(match_state_t));
+	catcierge_encoded_images_ref(&snapshot);
+	mu_assert("Expected 4 references", e->refcount == 4);
+	mu_assert("Expected 2 step references", step->refcount == 2);
+
+	catcierge_encoded_images_release(&mg);
+	mu_assert("Expected images to be cleared", !mg.obstruct_encoded
+		&& !mg.matches[1].encoded && !mg.matches[1].result.steps[3].encoded);
+	mu_assert("Expected 2 references", e->refcount == 2);
+	mu_assert("Expected 1 step reference", step->refcount == 1);
+
+	catcierge_test_STATUS("The last reference frees the images");
+	catcierge_encoded_images_release(&snapshot);
+	mu_assert("Expected images to be cleared", !snapshot.obstruct_encoded
+		&& !snapshot.matches[1].encoded);
+
+	free(snapshot.matches);
+	cvReleaseImage(&img);
+	catcierge_match_group_destroy(&mg);
+
+	return NULL;
+}
+
+int TEST_catcierge_encoded_image(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	CATCIERGE_RUN_TEST((e = run_encode_save_test()),
+		"Encode and save image",
+		"Encode and save image", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_refcount_test()),
+		"Encoded image references",
+		"Encoded image references", &ret);
+
+	return ret;
+}
@@ -0,0 +1,145 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#include "catcierge_exec.h"
+#include "catcierge_clock.h"
+
+static void wait_for_commands(catcierge_exec_t *e, double timeout)
+{
+	double start = catcierge_clock_monotonic();
+
+	while (catcierge_exec_service(e)
+		&& ((catcierge_clock_monotonic() - start) < timeout))
+	{
+		catcierge_clock_sleep(0.01);
+	}
+}
+
+static char *run_exit_status_test()
+{
+	catcierge_exec_t e;
+
+	mu_assert("Expected init", !catcierge_exec_init(&e, 2, 4, 0.0));
+
+	mu_assert("Expected command to start", !catcierge_exec_run(&e, "exit 0"));
+	mu_assert("Expected command to start", !catcierge_exec_run(&e, "exit 3"));
+	mu_assert("Expected 2 running", e.running_count == 2);
+
+	wait_for_commands(&e, 5.0);
+
+	catcierge_exec_print_stats(&e);
+	mu_assert("Expected all commands to be reaped", e.running_count == 0);
+	mu_assert("Expected 1 success", e.stats.succeeded == 1);
+	mu_assert("Expected 1 failure", e.stats.failed == 1);
+
+	catcierge_exec_destroy(&e);
+
+	return NULL;
+}
+
+static char *run_limit_test()
+{
+	catcierge_exec_t e;
+
+	mu_assert("Expected init", !catcierge_exec_init(&e, 1, 2, 0.0));
+
+	catcierge_exec_run(&e, "sleep 0.1");
+	mu_assert("Expected first command to be queued", !catcierge_exec_run(&e, "true"));
+	mu_assert("Expected second command to be queued", !catcierge_exec_run(&e, "true"));
+	mu_assert("Expected command to be dropped", catcierge_exec_run(&e, "true") == -1);
+
+	mu_assert("Expected 1 running", e.running_count == 1);
+	mu_assert("Expected 2 queued", e.queued_count == 2);
+	mu_assert("Expected 1 dropped", e.stats.dropped == 1);
+
+	wait_for_commands(&e, 5.0);
+
+	catcierge_exec_print_stats(&e);
+	mu_assert("Expected 3 successful", e.stats.succeeded == 3);
+	mu_assert("Expected never more than 1 running", e.stats.max_running == 1);
+
+	catcierge_exec_destroy(&e);
+
+	return NULL;
+}
+
+static char *run_timeout_test()
+{
+	catcierge_exec_t e;
+
+	mu_assert("Expected init", !catcierge_exec_init(&e, 1, 1, 0.2));
+
+	catcierge_exec_run(&e, "sleep 10");
+
+	wait_for_commands(&e, 5.0);
+
+	catcierge_exec_print_stats(&e);
+	mu_assert("Expected command to be killed", e.running_count == 0);
+	mu_assert("Expected timeout", e.stats.timed_out == 1);
+	mu_assert("Expected failure", e.stats.failed == 1);
+
+	catcierge_exec_destroy(&e);
+
+	return NULL;
+}
+
+static char *run_lost_test()
+{
+	int status;
+	catcierge_exec_t e;
+
+	mu_assert("Expected init", !catcierge_exec_init(&e, 1, 1, 0.0));
+	mu_assert("Expected command to start", !catcierge_exec_run(&e, "exit 0"));
+
+	// Reap it behind the back of the executor.
+	mu_assert("Expected to reap the command",
+		waitpid(e.running[0].pid, &status, 0) == e.running[0].pid);
+
+	wait_for_commands(&e, 5.0);
+
+	catcierge_exec_print_stats(&e);
+	mu_assert("Expected the command to be removed", e.running_count == 0);
+	mu_assert("Expected 1 lost", e.stats.lost == 1);
+	mu_assert("Expected no success", e.stats.succeeded == 0);
+	mu_assert("Expected no failure", e.stats.failed == 0);
+
+	catcierge_exec_destroy(&e);
+
+	return NULL;
+}
+#endif // !_WIN32
+
+int TEST_catcierge_exec(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	#ifndef _WIN32
+	CATCIERGE_RUN_TEST((e = run_exit_status_test()),
+		"Command exit status",
+		"Command exit status", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_limit_test()),
+		"Command concurrency limit",
+		"Command concurrency limit", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_timeout_test()),
+		"Command timeout",
+		"Command timeout", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_lost_test()),
+		"Command reaped by someone else",
+		"Command reaped by someone else", &ret);
+	#else
+	catcierge_test_SKIPPED("Commands are not run by the executor on Windows");
+	#endif
+
+	return ret;
+}
@@ -10,6 +10,7 @@
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
 #include "catcierge_test_common.h"
+#include "catcierge_clock.h"
 
 static char *run_consecutive_lockout_abort_tests()
 {
@@ -77,7 +78,7 @@ static char *run_consecutive_lockout_abort_tests()
 		mu_assertf("Expected 2 consecutive lockout count", (grb.consecutive_lockout_count == 2));
 
 		// Here we expect the lockout count to be reset.
-		// Note that we must sleep at least args->consecutive_lockout_delay seconds
+		// Note that we must wait more than args->consecutive_lockout_delay seconds
 		// before causing another lockout, otherwise we will still count it as
 		// a consecutive lockout...
 		load_test_image_and_run(&grb, 1, 1); // Obstruct.
@@ -88,8 +89,8 @@ static char *run_consecutive_lockout_abort_tests()
 		load_test_image_and_run(&grb, 1, 5); // Clear frame.
 		catcierge_test_STATUS("Consecutive lockout reset");
 
-		catcierge_test_STATUS("Sleep %0.1f seconds so that the next lockout isn't counted as consecutive", args->consecutive_lockout_delay);
-		sleep(args->consecutive_lockout_delay);
+		catcierge_test_STATUS("Advance %0.1f seconds so that the next lockout isn't counted as consecutive", args->consecutive_lockout_delay + 1);
+		catcierge_clock_virtual_advance(args->consecutive_lockout_delay + 1);
 
 		load_test_image_and_run(&grb, 1, 2); // Obstruct.
 		load_test_image_and_run(&grb, 1, 2); // Pass 4 images (invalid).
@@ -196,6 +197,8 @@ int TEST_catcierge_fsm_consecutive_lockouts(int argc, char **argv)
 	char *e = NULL;
 	catcierge_test_HEADLINE("TEST_catcierge_fsm_consecutive_lockouts");
 
+	catcierge_test_virtual_clock_start();
+
 	// Trigger max consecutive lockout.
 	CATCIERGE_RUN_TEST((e = run_consecutive_lockout_tests()),
 		"Run consecutive lockout tests.",
@@ -206,5 +209,7 @@ int TEST_catcierge_fsm_consecutive_lockouts(int argc, char **argv)
 		"Run consecutive lockout test. Reset counter",
 		"Consecutive lockout test (with reset counter)", &ret);
 
+	catcierge_test_virtual_clock_stop();
+
 	return ret;
 }
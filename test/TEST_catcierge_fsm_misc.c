@@ -10,6 +10,7 @@
 #include <opencv2/highgui/highgui_c.h>
 #include "catcierge_fsm.h"
 #include "catcierge_test_common.h"
+#include "catcierge_clock.h"
 
 static char *run_tests()
 {
@@ -30,29 +31,32 @@ static char *run_tests()
 	catcierge_timer_set(&grb.frame_timer, 1.0);
 	catcierge_timer_start(&grb.frame_timer);
 
+	mu_assert("Expected the virtual clock to start at the test epoch",
+		catcierge_clock_realtime() == CATCIERGE_TEST_VIRTUAL_EPOCH);
+
 	catcierge_test_STATUS("Test spinner with waiting state");
 	grb.running = 1;
 	catcierge_set_state(&grb, catcierge_state_waiting);
 
-	sleep(1);
+	catcierge_clock_virtual_advance(1.0);
 	catcierge_print_spinner(&grb);
 
 	catcierge_test_STATUS("Test spinner with locked out state");
 	catcierge_set_state(&grb, catcierge_state_lockout);
 	catcierge_timer_start(&grb.frame_timer);
-	sleep(1);
+	catcierge_clock_virtual_advance(1.0);
 	catcierge_print_spinner(&grb);
 
 	catcierge_test_STATUS("Test spinner with keep open state");
 	catcierge_set_state(&grb, catcierge_state_keepopen);
 	catcierge_timer_start(&grb.frame_timer);
-	sleep(1);
+	catcierge_clock_virtual_advance(1.0);
 	catcierge_print_spinner(&grb);
 
 	catcierge_timer_start(&grb.frame_timer);
 	catcierge_timer_set(&grb.rematch_timer, 1.0);
 	catcierge_timer_start(&grb.rematch_timer);
-	sleep(1);
+	catcierge_clock_virtual_advance(1.0);
 	catcierge_print_spinner(&grb);
 
 	args->do_lockout_cmd = calloc(1, sizeof(char *));
@@ -72,7 +76,7 @@ static char *run_tests()
 
 	args->noanim = 1;
 	catcierge_timer_start(&grb.frame_timer);
-	sleep(1);
+	catcierge_clock_virtual_advance(1.0);
 	catcierge_print_spinner(&grb);
 
 	catcierge_destroy_camera(&grb);
@@ -92,9 +96,13 @@ int TEST_catcierge_fsm_misc(int argc, char **argv)
 
 	catcierge_test_HEADLINE("TEST_catcierge_fsm_misc");
 
+	catcierge_test_virtual_clock_start();
+
 	CATCIERGE_RUN_TEST((e = run_tests()),
 		"Misc tests",
 		"Misc tests", &ret);
 	
+	catcierge_test_virtual_clock_stop();
+
 	return ret;
 }
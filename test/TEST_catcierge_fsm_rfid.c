@@ -152,6 +152,7 @@ static char *run_rfid_pseudo_tests(rfid_pseudo_test_conf_t *conf)
 		{
 			catcierge_test_STATUS("Emulate outer tag: %s", conf->outer_tag);
 			write_rfid_master(out_master, conf->outer_tag);
+			write_rfid_master(out_master, "\r");
 			mu_assertf("Failed to service RFID", !catcierge_rfid_ctx_service(&grb.rfid_ctx));
 			//sleep(1);
 		}
@@ -172,6 +173,7 @@ static char *run_rfid_pseudo_tests(rfid_pseudo_test_conf_t *conf)
 		{
 			catcierge_test_STATUS("Emulate inner tag: %s", conf->inner_tag);
 			write_rfid_master(in_master, conf->inner_tag);
+			write_rfid_master(in_master, "\r");
 			mu_assertf("Failed to service RFID", !catcierge_rfid_ctx_service(&grb.rfid_ctx));
 		}
 
@@ -265,20 +267,33 @@ static char* run_rfid_tests(rfid_test_conf_t *conf)
 		mu_assert("Failed to parse command line", ret == 0);
 	}
 
-	grb.rfid_in_match.is_allowed = conf->inner_valid_rfid;
-	grb.rfid_out_match.is_allowed = conf->outer_valid_rfid;
-	grb.rfid_direction = conf->direction;
+	// Note! We don't want to open the RFID readers for real.
+	// Instead we simply set the result structs manually to test
+	// the lockout logic.
+	mu_assert("Failed to create RFID readers", !catcierge_create_rfid_readers(&grb));
+	mu_assert("Expected RFID reader count",
+		grb.rfid_count == (size_t)((conf->inner_path ? 1 : 0) + (conf->outer_path ? 1 : 0)));
 
-	if (conf->direction != MATCH_DIR_UNKNOWN)
+	if (grb.rfid_count > 0)
 	{
-		grb.rfid_in_match.triggered = 1;
-		grb.rfid_out_match.triggered = 1;
+		// The readers are ordered from the inside to the outside.
+		rfid_match_t *in_match = conf->inner_path ? &grb.rfid_matches[0] : NULL;
+		rfid_match_t *out_match = conf->outer_path ? &grb.rfid_matches[grb.rfid_count - 1] : NULL;
+
+		if (in_match)
+		{
+			in_match->is_allowed = conf->inner_valid_rfid;
+			in_match->triggered = (conf->direction != MATCH_DIR_UNKNOWN);
+		}
+
+		if (out_match)
+		{
+			out_match->is_allowed = conf->outer_valid_rfid;
+			out_match->triggered = (conf->direction != MATCH_DIR_UNKNOWN);
+		}
 	}
 
-	// Note! We don't want to init the RFID readers for real.
-	// Instead we simply set the result structs manually to test
-	// the lockout logic.
-	//catcierge_init_rfid_readers(&grb);
+	grb.rfid_direction = conf->direction;
 
 	if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->templ))
 	{
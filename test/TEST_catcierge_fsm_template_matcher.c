@@ -10,6 +10,7 @@
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
 #include "catcierge_test_common.h"
+#include "catcierge_clock.h"
 
 // This tests the different lockout strategies.
 static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
@@ -45,7 +46,7 @@ static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
 				mu_assert("Expected LOCKOUT state after obstruction",
 					(grb->state == catcierge_state_lockout));
 
-				sleep(args->lockout_time + 1);
+				catcierge_clock_virtual_advance(args->lockout_time + 1);
 				
 				//catcierge_run_state(grb);
 				load_test_image_and_run(grb, 1, 2);
@@ -58,7 +59,7 @@ static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
 					"No obstruction. Sleeping %d seconds should result in unlock",
 					args->lockout_time + 1);
 
-				sleep(args->lockout_time + 1);
+				catcierge_clock_virtual_advance(args->lockout_time + 1);
 
 				// Clear frame.
 				load_test_image_and_run(grb, 1, 5);
@@ -81,12 +82,12 @@ static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
 				mu_assert("Expected LOCKOUT state after clear frame",
 					(grb->state == catcierge_state_lockout));
 
-				sleep(1);
+				catcierge_clock_virtual_advance(1);
 
 				mu_assert("Expected LOCKOUT state after 1 second clear frame",
 					(grb->state == catcierge_state_lockout));
 
-				sleep(args->lockout_time);
+				catcierge_clock_virtual_advance(args->lockout_time);
 
 				load_test_image_and_run(grb, 1, 5); // Clear frame.
 				mu_assert("Expected WAITING state after clear frame and timeout",
@@ -104,7 +105,7 @@ static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
 				mu_assert("Expected LOCKOUT state after obstruction",
 					(grb->state == catcierge_state_lockout));
 				
-				sleep(args->lockout_time + 1);
+				catcierge_clock_virtual_advance(args->lockout_time + 1);
 				
 				load_test_image_and_run(grb, 1, 2); // Obstruct.
 				mu_assert("Expected LOCKOUT state after timeout and"
@@ -123,7 +124,7 @@ static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
 				mu_assert("Expected LOCKOUT state after clear frame",
 					(grb->state == catcierge_state_lockout));
 
-				sleep(args->lockout_time + 1);
+				catcierge_clock_virtual_advance(args->lockout_time + 1);
 
 				load_test_image_and_run(grb, 1, 5); // Clear frame.
 				mu_assert("Expected WAITING state after clear frame and timeout",
@@ -135,7 +136,7 @@ static char *run_lockout_tests(catcierge_grb_t *grb, int obstruct,
 			catcierge_test_STATUS("Lockout method: Timer only, sleep %d seconds",
 				args->lockout_time + 1);
 
-			sleep(args->lockout_time + 1);
+			catcierge_clock_virtual_advance(args->lockout_time + 1);
 
 			catcierge_run_state(grb);
 			mu_assert("Expected WAITING state after timeout",
@@ -312,6 +313,213 @@ static char *run_success_tests(int obstruct)
 	return NULL;
 }
 
+static char *run_match_count_tests(int early_decision)
+{
+	int i;
+	int ret = 0;
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	grb.running = 1;
+
+	{
+		char *argv[256] =
+		{
+			"catcierge",
+			"--templ",
+			"--match_flipped",
+			"--threshold", "0.8",
+			"--snout", CATCIERGE_SNOUT1_PATH, CATCIERGE_SNOUT2_PATH,
+			"--max_matches", "6",
+			early_decision ? "--early_decision" : NULL,
+			NULL
+		};
+		int argc = get_argc(argv);
+
+		ret = catcierge_args_parse(args, argc, argv);
+		mu_assert("Failed to parse command line", ret == 0);
+	}
+
+	if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->templ))
+	{
+		return "Failed to init catcierge lib!\n";
+	}
+
+	catcierge_set_state(&grb, catcierge_state_waiting);
+
+	// Obstruct the frame to begin matching.
+	load_test_image_and_run(&grb, 1, 1);
+	mu_assert("Expected MATCHING state", (grb.state == catcierge_state_matching));
+	mu_assert("Expected 6 matches to be allocated", (grb.match_group.max_count == 6));
+
+	// The first 2 images are OK matches, which is all that is needed.
+	load_test_image_and_run(&grb, 1, 1);
+	load_test_image_and_run(&grb, 1, 2);
+
+	if (early_decision)
+	{
+		mu_assert("Expected KEEP OPEN state", (grb.state == catcierge_state_keepopen));
+		mu_assert("Expected 2 matches", (grb.match_group.match_count == 2));
+		mu_assert("Expected early decision", grb.match_group.early_decision);
+	}
+	else
+	{
+		for (i = 0; i < 3; i++)
+		{
+			mu_assert("Expected MATCHING state", (grb.state == catcierge_state_matching));
+			load_test_image_and_run(&grb, 1, 1);
+		}
+
+		mu_assert("Expected MATCHING state", (grb.state == catcierge_state_matching));
+		load_test_image_and_run(&grb, 1, 2);
+
+		mu_assert("Expected KEEP OPEN state", (grb.state == catcierge_state_keepopen));
+		mu_assert("Expected 6 matches", (grb.match_group.match_count == 6));
+		mu_assert("Expected no early decision", !grb.match_group.early_decision);
+	}
+
+	catcierge_template_matcher_destroy(&grb.matcher);
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+//
+// 1 OK match followed by failures, where 4 OK matches of 8 are needed.
+// The chance of still reaching 4 is 11% after 4 matches and 2% after 5,
+// so the confidence decides how many matches are made before locking out.
+//
+static char *run_early_decision_confidence_tests(char *confidence, size_t expected_count)
+{
+	size_t i;
+	int ret = 0;
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	grb.running = 1;
+
+	{
+		char *argv[256] =
+		{
+			"catcierge",
+			"--templ",
+			"--match_flipped",
+			"--threshold", "0.8",
+			"--snout", CATCIERGE_SNOUT1_PATH, CATCIERGE_SNOUT2_PATH,
+			"--max_matches", "8",
+			"--ok_matches_needed", "4",
+			"--early_decision",
+			"--early_decision_confidence", confidence,
+			NULL
+		};
+		int argc = get_argc(argv);
+
+		ret = catcierge_args_parse(args, argc, argv);
+		mu_assert("Failed to parse command line", ret == 0);
+	}
+
+	if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->templ))
+	{
+		return "Failed to init catcierge lib!\n";
+	}
+
+	catcierge_set_state(&grb, catcierge_state_waiting);
+
+	// Obstruct the frame to begin matching.
+	load_test_image_and_run(&grb, 1, 1);
+
+	for (i = 1; i <= expected_count; i++)
+	{
+		mu_assert("Expected MATCHING state", (grb.state == catcierge_state_matching));
+		load_test_image_and_run(&grb, 1, (i == 1) ? 2 : 4);
+	}
+
+	catcierge_test_STATUS("Locked out after %d of 8 matches",
+		(int)grb.match_group.match_count);
+	mu_assert("Expected LOCKOUT state", (grb.state == catcierge_state_lockout));
+	mu_assert("Unexpected match count", (grb.match_group.match_count == expected_count));
+	mu_assert("Expected early decision", grb.match_group.early_decision);
+
+	catcierge_template_matcher_destroy(&grb.matcher);
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_idle_tests()
+{
+	int i;
+	int ret = 0;
+	catcierge_grb_t grb;
+	catcierge_args_t *args = &grb.args;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	grb.running = 1;
+
+	{
+		char *argv[256] =
+		{
+			"catcierge",
+			"--templ",
+			"--match_flipped",
+			"--threshold", "0.8",
+			"--snout", CATCIERGE_SNOUT1_PATH, CATCIERGE_SNOUT2_PATH,
+			"--idle_after", "5",
+			"--idle_fps", "2",
+			NULL
+		};
+		int argc = get_argc(argv);
+
+		ret = catcierge_args_parse(args, argc, argv);
+		mu_assert("Failed to parse command line", ret == 0);
+	}
+
+	if (catcierge_matcher_init(&grb.matcher, (catcierge_matcher_args_t *)&args->templ))
+	{
+		return "Failed to init catcierge lib!\n";
+	}
+
+	catcierge_set_state(&grb, catcierge_state_waiting);
+
+	// Clear frames for a while.
+	for (i = 0; i < 4; i++)
+	{
+		load_test_image_and_run(&grb, 1, 5);
+		mu_assert("Expected WAITING state", (grb.state == catcierge_state_waiting));
+		mu_assert("Expected to not be idle yet", !grb.idle);
+		mu_assert("Expected no frame interval", catcierge_get_frame_interval(&grb) == 0.0);
+		catcierge_clock_virtual_advance(1.0);
+	}
+
+	catcierge_clock_virtual_advance(2.0);
+	load_test_image_and_run(&grb, 1, 5);
+	mu_assert("Expected to be idle", grb.idle);
+	mu_assert("Expected 0.5 second frame interval", catcierge_get_frame_interval(&grb) == 0.5);
+
+	catcierge_clock_virtual_advance(0.5);
+	load_test_image_and_run(&grb, 1, 5);
+	mu_assert("Expected to still be idle", grb.idle);
+
+	// Something in front of the door wakes us up right away.
+	load_test_image_and_run(&grb, 1, 1);
+	mu_assert("Expected MATCHING state", (grb.state == catcierge_state_matching));
+	mu_assert("Expected to not be idle", !grb.idle);
+	mu_assert("Expected no frame interval", catcierge_get_frame_interval(&grb) == 0.0);
+
+	catcierge_template_matcher_destroy(&grb.matcher);
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
 void run_camera_test()
 {
 	catcierge_grb_t grb;
@@ -328,6 +536,8 @@ int TEST_catcierge_fsm_template_matcher(int argc, char **argv)
 
 	catcierge_test_HEADLINE("TEST_catcierge_fsm_template_matcher");
 
+	catcierge_test_virtual_clock_start();
+
 	// Test without anything obstructing the frame after
 	// the successful match.
 	CATCIERGE_RUN_TEST((e = run_success_tests(0)),
@@ -358,6 +568,26 @@ int TEST_catcierge_fsm_template_matcher(int argc, char **argv)
 		}
 	}
 
+	CATCIERGE_RUN_TEST((e = run_match_count_tests(0)),
+		"Run tests with 6 matches per match group.",
+		"6 matches per match group", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_match_count_tests(1)),
+		"Run early decision tests.",
+		"Early decision", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_early_decision_confidence_tests("0.85", 4)),
+		"Run early decision confidence lockout tests.",
+		"Early decision confidence lockout", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_early_decision_confidence_tests("0.95", 5)),
+		"Run early decision confidence tests that keep matching.",
+		"Early decision confidence keeps matching", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_idle_tests()),
+		"Run idle tests.",
+		"Idle tests", &ret);
+
 	// This fails on the Raspberry pi, the camera fails to init for some reason...
 	#ifndef RPI
 	run_camera_test();
@@ -368,5 +598,7 @@ int TEST_catcierge_fsm_template_matcher(int argc, char **argv)
 		catcierge_test_FAILURE("One of the tests failed!\n");
 	}
 
+	catcierge_test_virtual_clock_stop();
+
 	return ret;
 }
@@ -0,0 +1,210 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "catcierge_log.h"
+#include "catcierge_util.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define LOG_TEST_PATH "log_async_test.txt"
+#define LOG_TEST_THREADS 4
+#define LOG_TEST_LINES 500
+
+static int saved_stdout = -1;
+
+// Sends stdout to a file, so we can check what the log thread wrote.
+static int capture_stdout()
+{
+	int fd;
+	fflush(stdout);
+
+	if ((fd = open(LOG_TEST_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+
+	saved_stdout = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+
+	return 0;
+}
+
+static void restore_stdout()
+{
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	saved_stdout = -1;
+}
+
+static void *log_thread(void *arg)
+{
+	int i;
+	int id = (int)(intptr_t)arg;
+
+	for (i = 0; i < LOG_TEST_LINES; i++)
+	{
+		CATLOG("thread %d line %d\n", id, i);
+	}
+
+	return NULL;
+}
+
+static char *run_async_tests()
+{
+	int i;
+	int id;
+	int n;
+	int count = 0;
+	int next[LOG_TEST_THREADS];
+	int in_order = 1;
+	int direct = 0;
+	unsigned long dropped;
+	char *contents = NULL;
+	char *line = NULL;
+	char *save = NULL;
+	pthread_t threads[LOG_TEST_THREADS];
+	int nocolor = catcierge_nocolor;
+
+	memset(next, 0, sizeof(next));
+	catcierge_nocolor = 1;
+
+	mu_assert("Failed to capture stdout", !capture_stdout());
+
+	if (catcierge_log_async_start(64))
+	{
+		restore_stdout();
+		return "Failed to start async logging";
+	}
+
+	for (i = 0; i < LOG_TEST_THREADS; i++)
+	{
+		pthread_create(&threads[i], NULL, log_thread, (void *)(intptr_t)i);
+	}
+
+	for (i = 0; i < LOG_TEST_THREADS; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	dropped = catcierge_log_async_dropped();
+	catcierge_log_async_stop();
+
+	// Written directly once stopped.
+	CATLOG("thread %d line %d\n", LOG_TEST_THREADS, 0);
+
+	restore_stdout();
+	catcierge_nocolor = nocolor;
+
+	mu_assert("Failed to read log", (contents = catcierge_read_file(LOG_TEST_PATH)));
+
+	for (line = strtok_r(contents, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+	{
+		// [2017-01-01 10:00:00.123456]  thread 1 line 2
+		if ((strlen(line) < 31) || (line[0] != '[') || (line[27] != ']')
+			|| (sscanf(&line[30], "thread %d line %d", &id, &n) != 2)
+			|| (id < 0) || (id > LOG_TEST_THREADS))
+		{
+			catcierge_test_STATUS("Unexpected line: %s", line);
+			free(contents);
+			return "Unexpected log line";
+		}
+
+		if (id < LOG_TEST_THREADS)
+		{
+			// Each thread's lines are in order, with gaps for dropped ones.
+			if (n < next[id])
+				in_order = 0;
+
+			next[id] = n + 1;
+		}
+		else
+		{
+			direct++;
+		}
+
+		count++;
+	}
+
+	free(contents);
+	remove(LOG_TEST_PATH);
+
+	catcierge_test_STATUS("Wrote %d lines, dropped %lu", count, dropped);
+	mu_assert("Expected lines in order", in_order);
+	mu_assert("Expected the line logged after stopping", direct == 1);
+	mu_assert("Expected every line written or dropped",
+		((count - 1) + dropped) == (LOG_TEST_THREADS * LOG_TEST_LINES));
+
+	return NULL;
+}
+
+static char *run_long_line_tests()
+{
+	char longline[CATCIERGE_LOG_MAX_LINE * 2];
+	char *contents = NULL;
+	char *first = NULL;
+	char *second = NULL;
+	char *third = NULL;
+	int nocolor = catcierge_nocolor;
+
+	memset(longline, 'x', sizeof(longline) - 1);
+	longline[sizeof(longline) - 1] = '\0';
+	catcierge_nocolor = 1;
+
+	mu_assert("Failed to capture stdout", !capture_stdout());
+
+	if (catcierge_log_async_start(64))
+	{
+		restore_stdout();
+		return "Failed to start async logging";
+	}
+
+	CATLOG("first\n");
+	CATLOG("%s\n", longline);
+	CATLOG("third\n");
+
+	catcierge_log_async_stop();
+	restore_stdout();
+	catcierge_nocolor = nocolor;
+
+	mu_assert("Failed to read log", (contents = catcierge_read_file(LOG_TEST_PATH)));
+	remove(LOG_TEST_PATH);
+
+	first = strstr(contents, "]  first\n");
+	second = strstr(contents, longline);
+	third = strstr(contents, "]  third\n");
+
+	catcierge_test_STATUS("Long line %s", second ? "written in full" : "missing");
+	mu_assert("Expected the long line in full", second && (second[strlen(longline)] == '\n'));
+	mu_assert("Expected the lines in order", first && third && (first < second) && (second < third));
+	free(contents);
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int TEST_catcierge_log(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	CATCIERGE_RUN_TEST((e = run_async_tests()),
+		"Asynchronous logging",
+		"Asynchronous logging", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_long_line_tests()),
+		"Asynchronous logging of long lines",
+		"Asynchronous logging of long lines", &ret);
+	#else
+	catcierge_test_SKIPPED("No pthreads, asynchronous logging not supported\n");
+	#endif
+
+	return ret;
+}
@@ -0,0 +1,265 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+#include "catcierge_match_journal.h"
+
+#define JOURNAL_TEST_PATH "match_journal_test.bin"
+#define JOURNAL_TEST_INDEX_PATH JOURNAL_TEST_PATH ".idx"
+#define JOURNAL_TEST_COUNT 200
+#define JOURNAL_TEST_START 1500000000
+
+static void remove_journal()
+{
+	remove(JOURNAL_TEST_PATH);
+	remove(JOURNAL_TEST_INDEX_PATH);
+}
+
+// Match group i starts at JOURNAL_TEST_START + 10 * i seconds.
+static void init_match_group(match_group_t *mg, match_state_t *matches, int i)
+{
+	size_t k;
+
+	memset(mg, 0, sizeof(match_group_t));
+	memset(matches, 0, sizeof(match_state_t) * 2);
+	mg->matches = matches;
+	mg->max_count = 2;
+	mg->match_count = 2;
+	mg->success = i % 2;
+	mg->success_count = mg->success ? 2 : 1;
+	mg->direction = mg->success ? MATCH_DIR_IN : MATCH_DIR_OUT;
+	mg->start_tv.tv_sec = JOURNAL_TEST_START + 10 * i;
+	mg->end_tv.tv_sec = mg->start_tv.tv_sec + 2;
+	mg->sha.Message_Digest[0] = i;
+	snprintf(mg->description, sizeof(mg->description), "group %d", i);
+
+	for (k = 0; k < mg->match_count; k++)
+	{
+		match_state_t *m = &matches[k];
+		m->tv.tv_sec = mg->start_tv.tv_sec + k;
+		m->result.result = 0.5 + 0.1 * k;
+		m->result.success = (k == 1) || mg->success;
+		m->result.direction = mg->direction;
+		m->result.rect_count = 1;
+		m->result.match_rects[0] = cvRect(10, 20, 30 + k, 40);
+		strcpy(m->path.dir, "/tmp/catcierge");
+		snprintf(m->path.filename, sizeof(m->path.filename), "match_%d_%d.png", i, (int)k);
+		snprintf(m->path.full, sizeof(m->path.full), "%s/%s", m->path.dir, m->path.filename);
+	}
+}
+
+static int append_groups(int from, int to)
+{
+	int i;
+	catcierge_journal_t j;
+	catcierge_journal_record_t r;
+	match_group_t mg;
+	match_state_t matches[2];
+
+	if (catcierge_journal_open(&j, JOURNAL_TEST_PATH))
+		return -1;
+
+	for (i = from; i < to; i++)
+	{
+		init_match_group(&mg, matches, i);
+		catcierge_journal_record_init(&r, &mg);
+
+		if (catcierge_journal_append(&j, &r))
+			break;
+	}
+
+	catcierge_journal_close(&j);
+
+	return (i == to) ? 0 : -1;
+}
+
+static int count_callback(const catcierge_journal_record_t *r, void *user)
+{
+	(*(int *)user)++;
+	return 0;
+}
+
+static int query_count(catcierge_journal_reader_t *rd, int first, int last)
+{
+	int count = 0;
+
+	catcierge_journal_query(rd,
+		(int64_t)(JOURNAL_TEST_START + 10 * first) * 1000000,
+		(int64_t)(JOURNAL_TEST_START + 10 * last) * 1000000,
+		count_callback, &count);
+
+	return count;
+}
+
+static char *run_write_read_tests()
+{
+	catcierge_journal_reader_t rd;
+	const catcierge_journal_record_t *r = NULL;
+
+	remove_journal();
+
+	mu_assert("Failed to write journal", !append_groups(0, JOURNAL_TEST_COUNT / 2));
+
+	catcierge_test_STATUS("Reopen and append");
+	mu_assert("Failed to append to journal",
+		!append_groups(JOURNAL_TEST_COUNT / 2, JOURNAL_TEST_COUNT));
+
+	mu_assert("Failed to open journal", !catcierge_journal_reader_open(&rd, JOURNAL_TEST_PATH));
+	mu_assert("Expected all records", rd.count == JOURNAL_TEST_COUNT);
+	mu_assert("Expected an index entry per interval",
+		rd.index_count == ((JOURNAL_TEST_COUNT + CATCIERGE_JOURNAL_INDEX_INTERVAL - 1)
+							/ CATCIERGE_JOURNAL_INDEX_INTERVAL));
+
+	r = &rd.records[101];
+	mu_assert("Expected record fields",
+		(r->start_usec == (int64_t)(JOURNAL_TEST_START + 1010) * 1000000)
+		&& (r->success == 1) && (r->direction == MATCH_DIR_IN)
+		&& (r->match_count == 2) && (r->id[0] == 101)
+		&& !strcmp(r->description, "group 101")
+		&& !strcmp(r->dir, "/tmp/catcierge")
+		&& !(r->flags & CATCIERGE_JOURNAL_TRUNCATED));
+	mu_assert("Expected match fields",
+		(r->matches[1].rect_count == 1) && (r->matches[1].rects[0].width == 31)
+		&& (r->matches[1].result == 0.6)
+		&& !strcmp(r->matches[1].path, "match_101_1.png"));
+
+	catcierge_test_STATUS("Find records by time");
+	mu_assert("Expected first record", catcierge_journal_find(&rd, 0) == 0);
+	mu_assert("Expected exact match",
+		catcierge_journal_find(&rd, (int64_t)(JOURNAL_TEST_START + 640) * 1000000) == 64);
+	mu_assert("Expected next record",
+		catcierge_journal_find(&rd, (int64_t)(JOURNAL_TEST_START + 641) * 1000000) == 65);
+	mu_assert("Expected record count past the end",
+		catcierge_journal_find(&rd, INT64_MAX) == JOURNAL_TEST_COUNT);
+
+	catcierge_test_STATUS("Query time ranges");
+	mu_assert("Expected 10 records", query_count(&rd, 60, 70) == 10);
+	mu_assert("Expected 1 record", query_count(&rd, 127, 128) == 1);
+	mu_assert("Expected no records", query_count(&rd, 50, 50) == 0);
+	mu_assert("Expected all records", query_count(&rd, -10, 1000) == JOURNAL_TEST_COUNT);
+
+	catcierge_journal_reader_close(&rd);
+	remove_journal();
+
+	return NULL;
+}
+
+static char *run_recover_tests()
+{
+	FILE *f = NULL;
+	catcierge_journal_reader_t rd;
+
+	remove_journal();
+	mu_assert("Failed to write journal", !append_groups(0, 130));
+
+	catcierge_test_STATUS("Half written record and a missing index");
+	mu_assert("Failed to open journal", (f = fopen(JOURNAL_TEST_PATH, "ab")));
+	fwrite("garbage", 1, 7, f);
+	fclose(f);
+	remove(JOURNAL_TEST_INDEX_PATH);
+
+	catcierge_test_STATUS("Reading leaves out the partial record");
+	mu_assert("Failed to open journal", !catcierge_journal_reader_open(&rd, JOURNAL_TEST_PATH));
+	mu_assert("Expected whole records", rd.count == 130);
+	mu_assert("Expected no index", rd.index_count == 0);
+	mu_assert("Expected search without index", query_count(&rd, 100, 120) == 20);
+	catcierge_journal_reader_close(&rd);
+
+	mu_assert("Failed to append", !append_groups(130, 140));
+
+	mu_assert("Failed to open journal", !catcierge_journal_reader_open(&rd, JOURNAL_TEST_PATH));
+	mu_assert("Expected appended records", rd.count == 140);
+	mu_assert("Expected rebuilt index", rd.index_count == 3);
+	mu_assert("Expected indexed record", rd.index[2].record == 128);
+	mu_assert("Expected appended record after the partial one",
+		rd.records[130].id[0] == 130);
+	mu_assert("Expected 25 records", query_count(&rd, 115, 140) == 25);
+	catcierge_journal_reader_close(&rd);
+
+	catcierge_test_STATUS("Not a journal");
+	mu_assert("Failed to open file", (f = fopen(JOURNAL_TEST_PATH, "wb")));
+	fprintf(f, "This is not a journal, but long enough to have a header. "
+		"This is not a journal, but long enough to have a header.\n");
+	fclose(f);
+	mu_assert("Expected invalid journal", catcierge_journal_reader_open(&rd, JOURNAL_TEST_PATH));
+	mu_assert("Expected invalid journal", append_groups(0, 1));
+
+	remove_journal();
+
+	return NULL;
+}
+
+static char *run_truncate_tests()
+{
+	size_t i;
+	match_group_t mg;
+	match_state_t matches[CATCIERGE_JOURNAL_MAX_MATCHES + 2];
+	catcierge_journal_record_t r;
+
+	memset(&mg, 0, sizeof(mg));
+	memset(matches, 0, sizeof(matches));
+	mg.matches = matches;
+	mg.match_count = CATCIERGE_JOURNAL_MAX_MATCHES;
+
+	for (i = 0; i < mg.match_count; i++)
+	{
+		strcpy(matches[i].path.dir, "/tmp");
+		strcpy(matches[i].path.filename, "match.png");
+		strcpy(matches[i].path.full, "/tmp/match.png");
+	}
+
+	strcpy(matches[1].path.dir, "/elsewhere");
+	strcpy(matches[1].path.full, "/elsewhere/match.png");
+
+	catcierge_journal_record_init(&r, &mg);
+	mu_assert("Expected nothing truncated", !(r.flags & CATCIERGE_JOURNAL_TRUNCATED));
+	mu_assert("Expected relative path", !strcmp(r.matches[0].path, "match.png"));
+	mu_assert("Expected full path for another dir",
+		!strcmp(r.matches[1].path, "/elsewhere/match.png"));
+
+	catcierge_test_STATUS("Too many matches");
+	mg.match_count = CATCIERGE_JOURNAL_MAX_MATCHES + 2;
+	catcierge_journal_record_init(&r, &mg);
+	mu_assert("Expected truncated", r.flags & CATCIERGE_JOURNAL_TRUNCATED);
+	mu_assert("Expected real match count", r.match_count == mg.match_count);
+
+	catcierge_test_STATUS("Too long description");
+	mg.match_count = 1;
+	memset(mg.description, 'a', sizeof(mg.description) - 1);
+	catcierge_journal_record_init(&r, &mg);
+	mu_assert("Expected truncated", r.flags & CATCIERGE_JOURNAL_TRUNCATED);
+	mu_assert("Expected terminated description",
+		strlen(r.description) == (sizeof(r.description) - 1));
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_SYS_MMAN_H
+
+int TEST_catcierge_match_journal(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	#ifdef CATCIERGE_HAVE_SYS_MMAN_H
+	CATCIERGE_RUN_TEST((e = run_write_read_tests()),
+		"Write and query a journal",
+		"Write and query a journal", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_recover_tests()),
+		"Recover a journal",
+		"Recover a journal", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_truncate_tests()),
+		"Journal record truncation",
+		"Journal record truncation", &ret);
+	#else
+	catcierge_test_SKIPPED("No mmap, the match journal is not supported\n");
+	#endif
+
+	return ret;
+}
@@ -1219,6 +1219,384 @@ char *run_for_loop_test()
 	return NULL;
 }
 
+static char *run_var_parse_test()
+{
+	catcierge_output_var_ref_t ref;
+
+	mu_assert("Failed to init variable table", !catcierge_output_vars_init());
+
+	mu_assert("Failed to parse state", !catcierge_output_var_parse(&ref, "state"));
+	mu_assert("Expected state ID", ref.id == CATCIERGE_VAR_STATE);
+
+	mu_assert("Failed to parse time", !catcierge_output_var_parse(&ref, "time:@Y|abc"));
+	mu_assert("Expected time ID", ref.id == CATCIERGE_VAR_TIME);
+	mu_assert("Expected time suffix", !strcmp(ref.suffix, ":@Y|abc"));
+
+	mu_assert("Failed to parse step", !catcierge_output_var_parse(&ref, "match3_step12_path|dir"));
+	mu_assert("Expected step path ID", ref.id == CATCIERGE_VAR_STEPN_PATH);
+	mu_assert("Expected match index 2", ref.idx == 2);
+	mu_assert("Expected step index 11", ref.step_idx == 11);
+	mu_assert("Expected path suffix", !strcmp(ref.suffix, "|dir"));
+
+	mu_assert("Failed to parse matchcur", !catcierge_output_var_parse(&ref, "matchcur_idx"));
+	mu_assert("Expected match idx ID", ref.id == CATCIERGE_VAR_MATCHN_IDX);
+	mu_assert("Expected current match", ref.current);
+
+	mu_assert("Failed to parse matcher variable", !catcierge_output_var_parse(&ref, "match_flipped"));
+	mu_assert("Expected match_flipped ID", ref.id == CATCIERGE_VAR_TEMPLATE_MATCH_FLIPPED);
+
+	// Only some variables take arguments.
+	mu_assert("Expected state|dir to be unknown", catcierge_output_var_parse(&ref, "state|dir"));
+	mu_assert("Expected unknown ID", ref.id == CATCIERGE_VAR_UNKNOWN);
+
+	mu_assert("Expected user variable", catcierge_output_var_parse(&ref, "abc123"));
+	mu_assert("Expected user variable name", !strcmp(ref.name, "abc123"));
+
+	return NULL;
+}
+
+static char *run_compiled_template_test()
+{
+	char *p = NULL;
+	catcierge_grb_t grb;
+	catcierge_output_t *o = &grb.output;
+	catcierge_args_t *args = &grb.args;
+	catcierge_output_program_t prog;
+	catcierge_output_invar_t *count = NULL;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	{
+		if (catcierge_output_init(&grb, o))
+			return "Failed to init output context";
+
+		mu_assert("Failed to add variable",
+			(count = catcierge_output_add_user_variable(o, "count", "2")));
+
+		mu_assert("Expected compile to fail",
+			catcierge_output_compile(&prog, "%for i in 1..2%\n%i%\n"));
+
+		mu_assert("Failed to compile template", !catcierge_output_compile(&prog,
+			"count %count%%%\n"
+			"%for i in 1..$count$%\n"
+			"%i%%if i != count%,%endif%\n"
+			"%endfor%\n"
+			"%if count > 2%%count% > 2%endif%"));
+
+		catcierge_test_STATUS("Compiled into %d nodes", (int)prog.count);
+		mu_assert("Expected 5 nodes", prog.count == 5);
+
+		p = catcierge_output_render(o, &grb, &prog);
+		catcierge_test_STATUS("%s", p);
+		mu_assert("Unexpected output", p && !strcmp(p,
+			"count 2%\n"
+			"1,\n"
+			"2\n"));
+		catcierge_xfree(&p);
+
+		// Rendering again must pick up the new variable value.
+		catcierge_xfree(&count->value);
+		count->value = strdup("3");
+
+		p = catcierge_output_render(o, &grb, &prog);
+		catcierge_test_STATUS("%s", p);
+		mu_assert("Unexpected output", p && !strcmp(p,
+			"count 3%\n"
+			"1,\n"
+			"2,\n"
+			"3\n"
+			"3 > 2"));
+		catcierge_xfree(&p);
+
+		catcierge_output_program_destroy(&prog);
+		catcierge_output_destroy(o);
+	}
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+typedef struct test_sink_s
+{
+	catcierge_output_sink_t sink;
+	char str[256];
+	int literal_count;
+	int var_count;
+} test_sink_t;
+
+static int test_sink_write(catcierge_output_sink_t *sink,
+		const char *str, size_t len, int literal)
+{
+	test_sink_t *s = (test_sink_t *)sink;
+
+	if ((sink->len + len) >= sizeof(s->str))
+		return -1;
+
+	memcpy(&s->str[sink->len], str, len);
+	sink->len += len;
+	s->str[sink->len] = '\0';
+
+	if (literal) s->literal_count++;
+	else s->var_count++;
+
+	return 0;
+}
+
+static char *run_sink_test()
+{
+	catcierge_grb_t grb;
+	catcierge_output_t *o = &grb.output;
+	catcierge_args_t *args = &grb.args;
+	catcierge_output_program_t prog;
+	test_sink_t s;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	{
+		if (catcierge_output_init(&grb, o))
+			return "Failed to init output context";
+
+		mu_assert("Failed to compile template", !catcierge_output_compile(&prog,
+			"count: %match_count%\n"
+			"%for i in 1..2%\n"
+			"[%i%]%endfor%\n"
+			"end"));
+
+		grb.match_group.match_count = 2;
+
+		memset(&s, 0, sizeof(s));
+		s.sink.write = test_sink_write;
+
+		mu_assert("Failed to render", !catcierge_output_render_to(o, &grb, &prog, &s.sink));
+		catcierge_test_STATUS("%s", s.str);
+		mu_assert("Unexpected output", !strcmp(s.str, "count: 2\n[1][2]end"));
+		mu_assert("Unexpected length", s.sink.len == strlen(s.str));
+
+		catcierge_test_STATUS("%d literal pieces, %d variable pieces",
+			s.literal_count, s.var_count);
+		mu_assert("Expected the literal text as separate pieces", s.literal_count == 7);
+		mu_assert("Expected the variables as separate pieces", s.var_count == 3);
+
+		catcierge_output_program_destroy(&prog);
+		catcierge_output_destroy(o);
+	}
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_snapshot_test()
+{
+	char *p = NULL;
+	catcierge_grb_t grb;
+	catcierge_output_t *o = &grb.output;
+	catcierge_args_t *args = &grb.args;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	{
+		if (catcierge_output_init(&grb, o))
+			return "Failed to init output context";
+
+		grb.match_group.match_count = 2;
+		catcierge_output_snapshot_begin(o);
+
+		p = catcierge_output_generate(o, &grb, "%match_count%");
+		mu_assert("Unexpected output", p && !strcmp(p, "2"));
+		catcierge_xfree(&p);
+
+		// The value is cached for the rest of the event.
+		grb.match_group.match_count = 3;
+		p = catcierge_output_generate(o, &grb, "%match_count%");
+		catcierge_test_STATUS("%s", p);
+		mu_assert("Expected cached value", p && !strcmp(p, "2"));
+		catcierge_xfree(&p);
+
+		catcierge_output_snapshot_end(o);
+		mu_assert("Expected empty cache", !o->cache_count && !o->snapshot);
+
+		p = catcierge_output_generate(o, &grb, "%match_count%");
+		catcierge_test_STATUS("%s", p);
+		mu_assert("Expected new value", p && !strcmp(p, "3"));
+		catcierge_xfree(&p);
+
+		catcierge_output_destroy(o);
+	}
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+static char *run_async_test()
+{
+	int i;
+	FILE *f = NULL;
+	char path[256];
+	char expected[256];
+	char line[256];
+	catcierge_grb_t grb;
+	catcierge_output_t *o = &grb.output;
+	catcierge_args_t *args = &grb.args;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	{
+		args->output_threads = 2;
+		args->output_path = strdup("async_tests");
+		mu_assert("Out of memory", args->output_path);
+
+		if (catcierge_output_init(&grb, o))
+			return "Failed to init output context";
+
+		mu_assert("Expected output threads", o->events && o->renderers);
+
+		if (catcierge_output_add_template(o,
+			"%!event match_done\n"
+			"%!name first\n"
+			"%!filename first_%match_count%\n"
+			"%match_count% %template_path:second%",
+			"first"))
+		{
+			return "Failed to add template";
+		}
+
+		if (catcierge_output_add_template(o,
+			"%!event match_done\n"
+			"%!name second\n"
+			"%!filename second_%match_count%\n"
+			"%match1_path%",
+			"second"))
+		{
+			return "Failed to add template";
+		}
+
+		// Relative to the path of a template that is not written yet.
+		if (catcierge_output_add_template(o,
+			"%!event match_done\n"
+			"%!name third\n"
+			"%!rootpath %template_path:second|dir%\n"
+			"%!filename third_%match_count%\n"
+			"%template_path:second%",
+			"third"))
+		{
+			return "Failed to add template";
+		}
+
+		strcpy(grb.match_group.matches[0].path.dir, "async_tests");
+		strcpy(grb.match_group.matches[0].path.filename, "match.png");
+
+		for (i = 0; i < 10; i++)
+		{
+			grb.match_group.match_count = i;
+			catcierge_output_execute_list(&grb, "match_done", NULL, 0);
+		}
+
+		// Changed after the events, so it must not show up in the output.
+		strcpy(grb.match_group.matches[0].path.filename, "changed.png");
+
+		catcierge_output_flush(o);
+
+		for (i = 0; i < 10; i++)
+		{
+			snprintf(path, sizeof(path), "async_tests%sfirst_%d", catcierge_path_sep(), i);
+			snprintf(expected, sizeof(expected), "%d async_tests%ssecond_%d",
+				i, catcierge_path_sep(), i);
+			catcierge_test_STATUS("%s", path);
+
+			mu_assert("Expected template file", (f = fopen(path, "r")));
+			mu_assert("Expected contents", fgets(line, sizeof(line), f));
+			fclose(f);
+			mu_assert("Unexpected contents", !strcmp(line, expected));
+
+			snprintf(path, sizeof(path), "async_tests%ssecond_%d", catcierge_path_sep(), i);
+			mu_assert("Expected template file", (f = fopen(path, "r")));
+			mu_assert("Expected contents", fgets(line, sizeof(line), f));
+			fclose(f);
+			mu_assert("Expected the match path from the event", !strcmp(line, "async_tests/match.png"));
+
+			snprintf(path, sizeof(path), "async_tests%sthird_%d", catcierge_path_sep(), i);
+			snprintf(expected, sizeof(expected), "second_%d", i);
+			mu_assert("Expected template file", (f = fopen(path, "r")));
+			mu_assert("Expected contents", fgets(line, sizeof(line), f));
+			fclose(f);
+			mu_assert("Expected a path relative to the rootpath", !strcmp(line, expected));
+		}
+
+		catcierge_output_destroy(o);
+	}
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+
+static char *run_async_teardown_test()
+{
+	int i;
+	FILE *f = NULL;
+	char *e = NULL;
+	char path[256];
+	char line[1024];
+	catcierge_grb_t grb;
+	catcierge_output_t *o = &grb.output;
+	catcierge_args_t *args = &grb.args;
+
+	catcierge_grabber_init(&grb);
+	catcierge_args_init(args, "catcierge");
+	{
+		e = do_init_matcher(&grb, MATCHER_HAAR);
+		mu_assert(e, !e);
+
+		args->output_threads = 1;
+		args->output_path = strdup("async_teardown_tests");
+		mu_assert("Out of memory", args->output_path);
+
+		if (catcierge_output_init(&grb, o))
+			return "Failed to init output context";
+
+		// Refers to the matcher settings when it is rendered.
+		if (catcierge_output_add_template(o,
+			"%!event match_done\n"
+			"%!name cascade\n"
+			"%!filename cascade_%match_count%\n"
+			"%cascade%",
+			"cascade"))
+		{
+			return "Failed to add template";
+		}
+
+		for (i = 0; i < 10; i++)
+		{
+			grb.match_group.match_count = i;
+			catcierge_output_execute_list(&grb, "match_done", NULL, 0);
+		}
+
+		// Generates the queued events before the matcher is freed.
+		catcierge_destroy_output(&grb);
+		mu_assert("Expected the matcher to be destroyed", !grb.matcher);
+
+		for (i = 0; i < 10; i++)
+		{
+			snprintf(path, sizeof(path), "async_teardown_tests%scascade_%d", catcierge_path_sep(), i);
+			catcierge_test_STATUS("%s", path);
+
+			mu_assert("Expected template file", (f = fopen(path, "r")));
+			mu_assert("Expected contents", fgets(line, sizeof(line), f));
+			fclose(f);
+			mu_assert("Expected the cascade", !strcmp(line, CATCIERGE_CASCADE));
+		}
+	}
+	catcierge_args_destroy(args);
+	catcierge_grabber_destroy(&grb);
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
 char *run_uservars_test()
 {
 	char *p = NULL;
@@ -1316,10 +1694,36 @@ int TEST_catcierge_output(int argc, char **argv)
 		"Run for loop tests.",
 		"For loop tests", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_var_parse_test()),
+		"Run variable parse tests.",
+		"Variable parse tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_compiled_template_test()),
+		"Run compiled template tests.",
+		"Compiled template tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_sink_test()),
+		"Run output sink tests.",
+		"Output sink tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_snapshot_test()),
+		"Run variable snapshot tests.",
+		"Variable snapshot tests", &ret);
+
 	CATCIERGE_RUN_TEST((e = run_uservars_test()),
 		"Run uservars tests.",
 		"uservars tests", &ret);
 
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	CATCIERGE_RUN_TEST((e = run_async_test()),
+		"Run async output tests.",
+		"Async output tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_async_teardown_test()),
+		"Run async output teardown tests.",
+		"Async output teardown tests", &ret);
+	#endif
+
 	// TODO: Add a test for template paths in other directory.
 
 	if (ret)
@@ -0,0 +1,117 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_test_config.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifdef CATCIERGE_HAVE_DLFCN_H
+#include "catcierge_fsm.h"
+#include "catcierge_plugins.h"
+
+#define PLUGIN_OUTPUT "plugin_test_output.txt"
+
+static void publish(catcierge_grb_t *grb, catcierge_event_t type)
+{
+	catcierge_event_data_t ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	catcierge_bus_publish(&grb->bus, &ev);
+}
+
+static char *run_load_fail_test()
+{
+	catcierge_plugins_t ps;
+
+	catcierge_plugins_init(&ps);
+	mu_assert("Expected missing plugin to fail",
+		catcierge_plugins_load(&ps, "does_not_exist.so some arg") == -1);
+	mu_assert("Expected no plugins", ps.count == 0);
+	catcierge_plugins_destroy(&ps);
+
+	return NULL;
+}
+
+static char *run_events_test()
+{
+	catcierge_grb_t grb;
+	catcierge_plugins_t ps;
+	FILE *f = NULL;
+	char line[256];
+	int i;
+	const char *expected[] =
+	{
+		"match_done 1 0 -",
+		"match_done 2 0 -",
+		"match_group_done 2 1 cat",
+		"destroy"
+	};
+
+	catcierge_grabber_init(&grb);
+	catcierge_bus_set_events(&grb.bus, grb.output_subscriber, 0);
+
+	catcierge_plugins_init(&ps);
+	mu_assert("Expected plugin to load",
+		!catcierge_plugins_load(&ps, CATCIERGE_TEST_PLUGIN " " PLUGIN_OUTPUT));
+	mu_assert("Expected 1 plugin", ps.count == 1);
+	mu_assert("Expected plugin name", !strcmp(ps.plugins[0].p.name, "test"));
+	mu_assert("Expected plugin to start", !catcierge_plugins_start(&ps, &grb));
+
+	grb.match_group.match_count = 1;
+	publish(&grb, CATCIERGE_MATCH_DONE);
+	grb.match_group.match_count = 2;
+	publish(&grb, CATCIERGE_MATCH_DONE);
+
+	catcierge_test_STATUS("Events outside the filter are not passed on");
+	publish(&grb, CATCIERGE_DO_LOCKOUT);
+
+	grb.match_group.success = 1;
+	strcpy(grb.match_group.description, "cat");
+	publish(&grb, CATCIERGE_MATCH_GROUP_DONE);
+
+	// The events are passed on from a snapshot, so changing
+	// the match group now should not affect them.
+	grb.match_group.match_count = 0;
+
+	// Waits for the plugin and unloads it.
+	catcierge_plugins_destroy(&ps);
+	catcierge_grabber_destroy(&grb);
+
+	mu_assert("Expected plugin output", (f = fopen(PLUGIN_OUTPUT, "r")));
+
+	for (i = 0; i < (int)(sizeof(expected) / sizeof(expected[0])); i++)
+	{
+		mu_assert("Expected a line", fgets(line, sizeof(line), f));
+		line[strcspn(line, "\n")] = '\0';
+		catcierge_test_STATUS("%s", line);
+		mu_assert("Unexpected plugin output", !strcmp(line, expected[i]));
+	}
+
+	mu_assert("Expected no more output", !fgets(line, sizeof(line), f));
+	fclose(f);
+	remove(PLUGIN_OUTPUT);
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_DLFCN_H
+
+int TEST_catcierge_plugins(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	#ifdef CATCIERGE_HAVE_DLFCN_H
+	CATCIERGE_RUN_TEST((e = run_load_fail_test()),
+		"Load missing plugin",
+		"Load missing plugin", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_events_test()),
+		"Plugin events",
+		"Plugin events", &ret);
+	#else
+	catcierge_test_SKIPPED("Plugins are not supported on this platform");
+	#endif
+
+	return ret;
+}
@@ -0,0 +1,158 @@
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "catcierge_queue.h"
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static char *run_fifo_test()
+{
+	size_t i;
+	catcierge_queue_t q;
+	int items[8];
+
+	mu_assert("Expected init", !catcierge_queue_init(&q, 5));
+	mu_assert("Expected the size to be rounded up", catcierge_queue_size(&q) == 8);
+	mu_assert("Expected empty queue", !catcierge_queue_pop(&q));
+
+	catcierge_test_STATUS("Fill the queue");
+	for (i = 0; i < 8; i++)
+	{
+		mu_assert("Expected push", !catcierge_queue_push(&q, &items[i]));
+	}
+
+	mu_assert("Expected full queue", catcierge_queue_push(&q, &items[0]) == -1);
+	mu_assert("Expected 8 items", catcierge_queue_count(&q) == 8);
+
+	catcierge_test_STATUS("Items come out in order, also after wrapping around");
+	for (i = 0; i < 4; i++)
+	{
+		mu_assert("Expected item in order", catcierge_queue_pop(&q) == &items[i]);
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		mu_assert("Expected push", !catcierge_queue_push(&q, &items[i]));
+	}
+
+	for (i = 0; i < 8; i++)
+	{
+		mu_assert("Expected item in order",
+			catcierge_queue_pop(&q) == &items[(i + 4) % 8]);
+	}
+
+	mu_assert("Expected empty queue", !catcierge_queue_pop(&q));
+	mu_assert("Expected no items", catcierge_queue_count(&q) == 0);
+
+	catcierge_queue_destroy(&q);
+
+	return NULL;
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+#define QUEUE_TEST_PRODUCERS 4
+#define QUEUE_TEST_ITEMS 10000
+
+typedef struct queue_test_producer_s
+{
+	catcierge_queue_t *q;
+	size_t id;
+	pthread_t thread;
+} queue_test_producer_t;
+
+static void *producer_main(void *arg)
+{
+	size_t i;
+	queue_test_producer_t *p = (queue_test_producer_t *)arg;
+
+	for (i = 1; i <= QUEUE_TEST_ITEMS; i++)
+	{
+		// Encode the producer and a sequence number, the queue is
+		// kept small so that it is full most of the time.
+		while (catcierge_queue_push(p->q, (void *)(uintptr_t)((i << 4) | p->id)))
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+static char *run_threads_test()
+{
+	size_t i;
+	size_t id;
+	size_t seq;
+	size_t received = 0;
+	uintptr_t item;
+	catcierge_queue_t q;
+	queue_test_producer_t producers[QUEUE_TEST_PRODUCERS];
+	size_t last[QUEUE_TEST_PRODUCERS];
+
+	mu_assert("Expected init", !catcierge_queue_init(&q, 16));
+	memset(last, 0, sizeof(last));
+
+	for (i = 0; i < QUEUE_TEST_PRODUCERS; i++)
+	{
+		producers[i].q = &q;
+		producers[i].id = i;
+		mu_assert("Expected thread",
+			!pthread_create(&producers[i].thread, NULL, producer_main, &producers[i]));
+	}
+
+	catcierge_test_STATUS("%d producers pushing %d items each",
+		QUEUE_TEST_PRODUCERS, QUEUE_TEST_ITEMS);
+
+	while (received < (QUEUE_TEST_PRODUCERS * QUEUE_TEST_ITEMS))
+	{
+		if (!(item = (uintptr_t)catcierge_queue_pop(&q)))
+		{
+			sched_yield();
+			continue;
+		}
+
+		id = item & 0xf;
+		seq = item >> 4;
+
+		mu_assert("Expected a valid producer", id < QUEUE_TEST_PRODUCERS);
+		mu_assert("Expected the items of a producer in order", seq == (last[id] + 1));
+		last[id] = seq;
+		received++;
+	}
+
+	for (i = 0; i < QUEUE_TEST_PRODUCERS; i++)
+	{
+		pthread_join(producers[i].thread, NULL);
+	}
+
+	mu_assert("Expected empty queue", !catcierge_queue_pop(&q));
+	catcierge_queue_destroy(&q);
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+int TEST_catcierge_queue(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	CATCIERGE_RUN_TEST((e = run_fifo_test()),
+		"Queue order",
+		"Queue order", &ret);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	CATCIERGE_RUN_TEST((e = run_threads_test()),
+		"Queue with several producers",
+		"Queue with several producers", &ret);
+	#else
+	catcierge_test_SKIPPED("Threads are not supported on this platform");
+	#endif
+
+	return ret;
+}
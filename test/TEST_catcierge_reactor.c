@@ -0,0 +1,187 @@
+
+#include <catcierge_config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "minunit.h"
+#include "catcierge_test_helpers.h"
+
+#ifdef CATCIERGE_HAVE_EPOLL
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "catcierge_reactor.h"
+
+typedef struct reactor_test_s
+{
+	catcierge_reactor_t *r;
+	int event_count;
+	int timer_count;
+	int fd_count;
+	int signal_count;
+	char buf[32];
+} reactor_test_t;
+
+static void on_event(catcierge_reactor_t *r, int fd, uint32_t events, void *user)
+{
+	reactor_test_t *t = (reactor_test_t *)user;
+	t->event_count++;
+}
+
+static void on_timer(catcierge_timer_wheel_t *w, catcierge_wheel_timer_t *timer, void *user)
+{
+	reactor_test_t *t = (reactor_test_t *)user;
+	t->timer_count++;
+	catcierge_reactor_stop(t->r);
+}
+
+static void on_fd(catcierge_reactor_t *r, int fd, uint32_t events, void *user)
+{
+	reactor_test_t *t = (reactor_test_t *)user;
+	ssize_t n = read(fd, t->buf, sizeof(t->buf) - 1);
+
+	if (n > 0)
+	{
+		t->buf[n] = '\0';
+		t->fd_count++;
+	}
+}
+
+static void on_signal(catcierge_reactor_t *r, int signo, void *user)
+{
+	reactor_test_t *t = (reactor_test_t *)user;
+
+	if (signo == SIGUSR1)
+	{
+		t->signal_count++;
+	}
+}
+
+static char *run_event_tests()
+{
+	catcierge_reactor_t r;
+	reactor_test_t t;
+	int event_fd;
+	int i;
+
+	memset(&t, 0, sizeof(t));
+	mu_assert("Failed to init reactor", !catcierge_reactor_init(&r));
+
+	event_fd = catcierge_reactor_add_event(&r, on_event, &t);
+	mu_assert("Failed to add eventfd", event_fd >= 0);
+
+	mu_assert("Expected nothing to happen", catcierge_reactor_run_once(&r, 0) == 0);
+	mu_assert("Expected no events", t.event_count == 0);
+
+	// Several notifications before the loop runs are coalesced.
+	for (i = 0; i < 3; i++)
+	{
+		mu_assert("Failed to notify", !catcierge_reactor_notify(event_fd));
+	}
+
+	mu_assert("Expected 1 handler", catcierge_reactor_run_once(&r, 100) == 1);
+	mu_assert("Expected 1 event", t.event_count == 1);
+
+	mu_assert("Failed to remove eventfd", !catcierge_reactor_remove_fd(&r, event_fd));
+	mu_assert("Expected remove to fail", catcierge_reactor_remove_fd(&r, event_fd));
+
+	catcierge_reactor_destroy(&r);
+
+	return NULL;
+}
+
+static char *run_fd_and_timer_tests()
+{
+	catcierge_reactor_t r;
+	reactor_test_t t;
+	catcierge_timer_wheel_t w;
+	catcierge_wheel_timer_t timer;
+	int fds[2];
+
+	memset(&t, 0, sizeof(t));
+	t.r = &r;
+	mu_assert("Failed to init reactor", !catcierge_reactor_init(&r));
+	mu_assert("Failed to init timer wheel", !catcierge_timer_wheel_init(&w));
+	mu_assert("Failed to create pipe", !pipe(fds));
+
+	mu_assert("Failed to add pipe",
+		!catcierge_reactor_add_fd(&r, fds[0], EPOLLIN, on_fd, &t));
+
+	catcierge_reactor_set_timer_wheel(&r, &w);
+	catcierge_wheel_timer_init(&timer, on_timer, &t);
+	catcierge_timer_wheel_add(&w, &timer, 0.1, 0.0);
+
+	mu_assert("Failed to write to pipe", write(fds[1], "hello", 5) == 5);
+
+	// Runs until the timer stops the loop.
+	mu_assert("Failed to run reactor", !catcierge_reactor_run(&r));
+
+	mu_assert("Expected pipe to be read", t.fd_count == 1);
+	mu_assert("Expected pipe contents", !strcmp(t.buf, "hello"));
+	mu_assert("Expected timer to fire once", t.timer_count == 1);
+
+	// A cancelled timer should not fire.
+	catcierge_timer_wheel_add(&w, &timer, 0.05, 0.0);
+	catcierge_timer_wheel_cancel(&w, &timer);
+	mu_assert("Expected nothing to happen", catcierge_reactor_run_once(&r, 100) == 0);
+	mu_assert("Expected timer to not fire", t.timer_count == 1);
+
+	catcierge_timer_wheel_destroy(&w);
+	catcierge_reactor_destroy(&r);
+	close(fds[0]);
+	close(fds[1]);
+
+	return NULL;
+}
+
+static char *run_signal_tests()
+{
+	catcierge_reactor_t r;
+	reactor_test_t t;
+	int signals[] = { SIGUSR1 };
+
+	memset(&t, 0, sizeof(t));
+	mu_assert("Failed to init reactor", !catcierge_reactor_init(&r));
+
+	mu_assert("Failed to add signals",
+		!catcierge_reactor_add_signals(&r, signals, 1, on_signal, &t));
+
+	// The signal is blocked, so this won't kill us.
+	mu_assert("Failed to raise signal", !raise(SIGUSR1));
+
+	mu_assert("Expected 1 handler", catcierge_reactor_run_once(&r, 100) == 1);
+	mu_assert("Expected signal to be delivered", t.signal_count == 1);
+
+	catcierge_reactor_destroy(&r);
+
+	return NULL;
+}
+
+#endif // CATCIERGE_HAVE_EPOLL
+
+int TEST_catcierge_reactor(int argc, char **argv)
+{
+	int ret = 0;
+	char *e = NULL;
+
+	catcierge_test_HEADLINE("TEST_catcierge_reactor");
+
+	#ifdef CATCIERGE_HAVE_EPOLL
+
+	CATCIERGE_RUN_TEST((e = run_event_tests()),
+		"Run eventfd tests",
+		"eventfd tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_fd_and_timer_tests()),
+		"Run fd and timer tests",
+		"fd and timer tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_signal_tests()),
+		"Run signal tests",
+		"Signal tests", &ret);
+
+	#else
+	catcierge_test_SKIPPED("No epoll support!\n");
+	#endif // CATCIERGE_HAVE_EPOLL
+
+	return ret;
+}
@@ -10,6 +10,8 @@
 #include "catcierge_args.h"
 #include "catcierge_types.h"
 #include "catcierge_test_common.h"
+#include "catcierge_clock.h"
+#include "catcierge_rfid_emu.h"
 
 #ifdef CATCIERGE_HAVE_PTY_H
 #include <pty.h>
@@ -98,7 +100,7 @@ static int init_rfid_stuff(catcierge_rfid_context_t *ctx,
 	catcierge_rfid_ctx_init(ctx);
 
 	catcierge_rfid_init("Test inner", rfidin, slave_name, rfid_read_cb, NULL);
-	catcierge_rfid_ctx_set_inner(ctx, rfidin);
+	catcierge_rfid_ctx_add(ctx, rfidin);
 	catcierge_rfid_open(rfidin);
 
 	return 0;
@@ -220,11 +222,11 @@ char *run_double_tests()
 		catcierge_rfid_ctx_init(&ctx);
 
 		catcierge_rfid_init("Test inner", &rfidin, in_slave_name, rfid_read_cb, NULL); 
-		catcierge_rfid_ctx_set_inner(&ctx, &rfidin);
+		catcierge_rfid_ctx_add(&ctx, &rfidin);
 		catcierge_rfid_open(&rfidin);
 
 		catcierge_rfid_init("Test inner", &rfidout, out_slave_name, rfid_read_cb, NULL);
-		catcierge_rfid_ctx_set_outer(&ctx, &rfidout);
+		catcierge_rfid_ctx_add(&ctx, &rfidout);
 		catcierge_rfid_open(&rfidout);
 
 		// TODO: Do some more tests here.
@@ -247,6 +249,298 @@ cleanup:
 	return return_message;	
 }
 
+typedef struct rfid_test_tags_s
+{
+	int count;
+	int complete;
+	char data[8][64];
+} rfid_test_tags_t;
+
+static void rfid_store_cb(catcierge_rfid_t *rfid,
+				int complete, const char *data, size_t data_len, void *user)
+{
+	rfid_test_tags_t *tags = (rfid_test_tags_t *)user;
+
+	if (tags->count < 8)
+	{
+		snprintf(tags->data[tags->count], sizeof(tags->data[0]), "%s", data);
+	}
+
+	tags->complete += complete;
+	tags->count++;
+}
+
+char *run_parser_tests()
+{
+	catcierge_rfid_t rfid;
+	rfid_test_tags_t tags;
+	struct timeval now;
+	char longline[2048];
+
+	memset(&tags, 0, sizeof(tags));
+	catcierge_clock_gettimeofday(&now);
+	catcierge_rfid_init("Test parser", &rfid, "none", rfid_store_cb, &tags);
+	rfid.state = CAT_CONNECTED;
+
+	catcierge_test_STATUS("Reply split over several reads");
+	catcierge_rfid_parse(&rfid, "O", 1, &now);
+	catcierge_rfid_parse(&rfid, "K\r", 2, &now);
+	mu_assert("Expected CAT_AWAITING_TAG", rfid.state == CAT_AWAITING_TAG);
+
+	catcierge_test_STATUS("Tag split over several reads");
+	catcierge_rfid_parse(&rfid, "\n999_0000", 9, &now);
+	mu_assert("Expected no tag yet", tags.count == 0);
+	catcierge_rfid_parse(&rfid, "00001007\r\n", 10, &now);
+	mu_assert("Expected 1 tag", tags.count == 1);
+	mu_assert("Expected complete tag", tags.complete == 1);
+	mu_assert("Expected tag data", !strcmp(tags.data[0], EXAMPLE_RFID_STR));
+	mu_assert("Expected reception time", rfid.time.tv_sec == now.tv_sec);
+
+	catcierge_test_STATUS("Several tags in one read");
+	catcierge_rfid_parse(&rfid, "999_000000001008\r999_0001\r?1\r", 29, &now);
+	mu_assert("Expected 3 tags", tags.count == 3);
+	mu_assert("Expected tag data", !strcmp(tags.data[1], "999_000000001008"));
+	mu_assert("Expected incomplete tag", !strcmp(tags.data[2], "999_0001"));
+	mu_assert("Expected 2 complete tags", tags.complete == 2);
+
+	catcierge_test_STATUS("Too long line is discarded");
+	memset(longline, 'a', sizeof(longline));
+	catcierge_rfid_parse(&rfid, longline, sizeof(longline), &now);
+	catcierge_rfid_parse(&rfid, "\r999_000000001009\r", 18, &now);
+	mu_assert("Expected 4 tags", tags.count == 4);
+	mu_assert("Expected tag data", !strcmp(tags.data[3], "999_000000001009"));
+
+	return NULL;
+}
+
+#ifdef CATCIERGE_HAVE_PTHREADS
+char *run_thread_tests()
+{
+	int i;
+	int master;
+	int slave;
+	char *slave_name = NULL;
+	int ret;
+	char *e = NULL;
+	rfid_test_tags_t tags;
+	catcierge_rfid_context_t ctx;
+	catcierge_rfid_t rfidin;
+
+	memset(&tags, 0, sizeof(tags));
+
+	ret = openpty(&master, &slave, NULL, NULL, NULL);
+	mu_assert("Failed to create pseudo terminal", ret == 0);
+
+	slave_name = strdup(ttyname(slave));
+	mu_assert("Failed to get slave name", slave_name);
+
+	catcierge_rfid_ctx_init(&ctx);
+	catcierge_rfid_init("Test inner", &rfidin, slave_name, rfid_store_cb, &tags);
+	catcierge_rfid_ctx_add(&ctx, &rfidin);
+	catcierge_rfid_open(&rfidin);
+
+	if ((e = read_rfid_master(&ctx, master, "Expected RAT", "RAT\r\n")))
+		return e;
+
+	mu_assert("Failed to start RFID thread", !catcierge_rfid_ctx_start(&ctx));
+
+	write_rfid_master(master, "OK\r\n999_0000");
+	usleep(10000);
+	write_rfid_master(master, "00001007\r\n");
+
+	for (i = 0; (i < 100) && (tags.count == 0); i++)
+	{
+		usleep(10000);
+		mu_assert("Failed to service RFID", !catcierge_rfid_ctx_service(&ctx));
+	}
+
+	catcierge_test_STATUS("Got %d tags after %d ms", tags.count, i * 10);
+	mu_assert("Expected 1 tag", tags.count == 1);
+	mu_assert("Expected tag data", !strcmp(tags.data[0], EXAMPLE_RFID_STR));
+
+	catcierge_test_STATUS("Unplugging the reader");
+	close(master);
+	usleep(100000);
+
+	// Joins the thread, so it is safe to look at the reader afterwards.
+	catcierge_rfid_ctx_stop(&ctx);
+	mu_assert("Expected reader to be disconnected", rfidin.state == CAT_DISCONNECTED);
+	mu_assert("Expected reader fd to be closed", rfidin.fd == -1);
+
+	catcierge_rfid_destroy(&rfidin);
+	catcierge_rfid_ctx_destroy(&ctx);
+
+	close(slave);
+	free(slave_name);
+
+	return NULL;
+}
+
+#define EMU_TEST_TAGS 20
+
+typedef struct rfid_emu_test_tags_s
+{
+	int count;
+	int complete;
+	struct timeval time[EMU_TEST_TAGS];
+	char data[EMU_TEST_TAGS][64];
+} rfid_emu_test_tags_t;
+
+static void rfid_emu_store_cb(catcierge_rfid_t *rfid,
+				int complete, const char *data, size_t data_len, void *user)
+{
+	rfid_emu_test_tags_t *tags = (rfid_emu_test_tags_t *)user;
+	tags->count++;
+
+	// Noise is expected to show up as incomplete tags.
+	if (!complete || (tags->complete >= EMU_TEST_TAGS))
+		return;
+
+	tags->time[tags->complete] = rfid->time;
+	snprintf(tags->data[tags->complete], sizeof(tags->data[0]), "%s", data);
+	tags->complete++;
+}
+
+char *run_emulator_tests()
+{
+	int i;
+	double latency;
+	double max_latency = 0.0;
+	rfid_emu_test_tags_t tags;
+	catcierge_rfid_context_t ctx;
+	catcierge_rfid_t rfids[2];
+	catcierge_rfid_emu_t emus[2];
+	catcierge_rfid_emu_timeline_t timeline;
+	catcierge_rfid_emu_settings_t settings;
+	char tag[32];
+
+	memset(&tags, 0, sizeof(tags));
+	catcierge_rfid_ctx_init(&ctx);
+	catcierge_rfid_emu_timeline_init(&timeline);
+
+	mu_assert("Failed to init inner emulator", !catcierge_rfid_emu_init(&emus[0], "Inner"));
+	mu_assert("Failed to init outer emulator", !catcierge_rfid_emu_init(&emus[1], "Outer"));
+
+	for (i = 0; i < 2; i++)
+	{
+		catcierge_rfid_init(emus[i].name, &rfids[i], emus[i].slave_path, rfid_emu_store_cb, &tags);
+		catcierge_rfid_ctx_add(&ctx, &rfids[i]);
+		mu_assert("Failed to open emulated reader", !catcierge_rfid_open(&rfids[i]));
+	}
+
+	for (i = 0; (i < 100) && !(emus[0].rat && emus[1].rat); i++)
+	{
+		catcierge_rfid_emu_wait_until(emus, 2, catcierge_clock_monotonic() + 0.01, NULL);
+	}
+
+	mu_assert("Expected RAT on both readers", emus[0].rat && emus[1].rat);
+	mu_assert("Failed to start RFID thread", !catcierge_rfid_ctx_start(&ctx));
+
+	for (i = 0; i < EMU_TEST_TAGS; i++)
+	{
+		snprintf(tag, sizeof(tag), "999_0000000010%02d", i);
+		catcierge_rfid_emu_timeline_add(&timeline, i * 0.005, i % 2, tag);
+	}
+
+	catcierge_test_STATUS("Play %d tags with fragmentation and noise", EMU_TEST_TAGS);
+	catcierge_rfid_emu_settings_init(&settings);
+	settings.fragment = 4;
+	settings.fragment_delay = 0.0005;
+	settings.noise = 0.3;
+	settings.crlf = 1;
+	settings.no_wait = 1;
+	settings.seed = 1234;
+
+	mu_assert("Failed to play timeline",
+		!catcierge_rfid_emu_play(emus, 2, &timeline, &settings, NULL));
+
+	for (i = 0; (i < 200) && (tags.complete < EMU_TEST_TAGS); i++)
+	{
+		usleep(10000);
+		mu_assert("Failed to service RFID", !catcierge_rfid_ctx_service(&ctx));
+	}
+
+	catcierge_test_STATUS("Got %d lines, %d complete tags", tags.count, tags.complete);
+	mu_assert("Expected all tags", tags.complete == EMU_TEST_TAGS);
+
+	for (i = 0; i < EMU_TEST_TAGS; i++)
+	{
+		mu_assert("Unexpected tag data", !strcmp(tags.data[i], timeline.events[i].data));
+
+		latency = (tags.time[i].tv_sec + tags.time[i].tv_usec / 1000000.0)
+			- (timeline.events[i].sent.tv_sec + timeline.events[i].sent.tv_usec / 1000000.0);
+
+		if (latency > max_latency)
+			max_latency = latency;
+	}
+
+	catcierge_test_STATUS("Max tag latency %0.2f ms", max_latency * 1000.0);
+
+	catcierge_rfid_ctx_stop(&ctx);
+
+	for (i = 0; i < 2; i++)
+	{
+		catcierge_rfid_destroy(&rfids[i]);
+		catcierge_rfid_emu_destroy(&emus[i]);
+	}
+
+	catcierge_rfid_ctx_destroy(&ctx);
+	catcierge_rfid_emu_timeline_destroy(&timeline);
+
+	return NULL;
+}
+#endif // CATCIERGE_HAVE_PTHREADS
+
+#define RFID_ALLOWED_TEST_PATH "rfid_allowed_test.txt"
+
+static char *run_allowed_tests()
+{
+	FILE *f = NULL;
+	catcierge_rfid_allowed_t allowed;
+	char *tags[] = { "999_000000001007", "999_000000001008" };
+
+	catcierge_rfid_allowed_init(&allowed);
+
+	mu_assert("Expected add", !catcierge_rfid_allowed_add(&allowed, tags[0]));
+	mu_assert("Expected add", !catcierge_rfid_allowed_add(&allowed, tags[1]));
+	mu_assert("Expected duplicate add", !catcierge_rfid_allowed_add(&allowed, tags[0]));
+	mu_assert("Expected 2 tags", allowed.count == 2);
+	mu_assert("Expected allowed", catcierge_rfid_allowed_contains(&allowed, tags[1]));
+	mu_assert("Expected not allowed",
+		!catcierge_rfid_allowed_contains(&allowed, "999_000000001009"));
+	mu_assert("Expected NULL not allowed", !catcierge_rfid_allowed_contains(&allowed, NULL));
+
+	catcierge_test_STATUS("Load tags from a file");
+	mu_assert("Failed to open " RFID_ALLOWED_TEST_PATH,
+		(f = fopen(RFID_ALLOWED_TEST_PATH, "w")));
+	fprintf(f,
+		"# Our cats\n"
+		"999_000000002001 # Kitty\n"
+		"999_000000002002,999_000000002003\r\n"
+		"\n");
+	fclose(f);
+
+	mu_assert("Expected load", !catcierge_rfid_allowed_load(&allowed, tags, 1, RFID_ALLOWED_TEST_PATH));
+	mu_assert("Expected 4 tags", allowed.count == 4);
+	mu_assert("Expected allowed", catcierge_rfid_allowed_contains(&allowed, tags[0]));
+	mu_assert("Expected removed", !catcierge_rfid_allowed_contains(&allowed, tags[1]));
+	mu_assert("Expected allowed", catcierge_rfid_allowed_contains(&allowed, "999_000000002001"));
+	mu_assert("Expected allowed", catcierge_rfid_allowed_contains(&allowed, "999_000000002003"));
+	mu_assert("Expected comment ignored", !catcierge_rfid_allowed_contains(&allowed, "Kitty"));
+
+	catcierge_test_STATUS("A failed load keeps the old tags");
+	mu_assert("Expected load failure",
+		catcierge_rfid_allowed_load(&allowed, tags, 2, "non_existing_rfid_file.txt"));
+	mu_assert("Expected 4 tags", allowed.count == 4);
+	mu_assert("Expected allowed", catcierge_rfid_allowed_contains(&allowed, "999_000000002002"));
+
+	catcierge_rfid_allowed_destroy(&allowed);
+	mu_assert("Expected empty set", allowed.count == 0);
+	remove(RFID_ALLOWED_TEST_PATH);
+
+	return NULL;
+}
+
 #endif // WITH_RFID
 
 int TEST_catcierge_rfid(int argc, char **argv)
@@ -258,6 +552,10 @@ int TEST_catcierge_rfid(int argc, char **argv)
 
 	#ifdef WITH_RFID
 
+	CATCIERGE_RUN_TEST((e = run_allowed_tests()),
+		"Run RFID allowed tags tests",
+		"RFID allowed tags tests", &ret);
+
 	CATCIERGE_RUN_TEST((e = run_pseudo_console_tests()),
 		"Run pseudo console tests",
 		"Pseudo console tests", &ret);
@@ -276,6 +574,20 @@ int TEST_catcierge_rfid(int argc, char **argv)
 		"Run RFID double tests",
 		"RFID double tests", &ret);
 
+	CATCIERGE_RUN_TEST((e = run_parser_tests()),
+		"Run RFID parser tests",
+		"RFID parser tests", &ret);
+
+	#ifdef CATCIERGE_HAVE_PTHREADS
+	CATCIERGE_RUN_TEST((e = run_thread_tests()),
+		"Run RFID thread tests",
+		"RFID thread tests", &ret);
+
+	CATCIERGE_RUN_TEST((e = run_emulator_tests()),
+		"Run RFID emulator tests",
+		"RFID emulator tests", &ret);
+	#endif
+
 	#else
 	catcierge_test_SKIPPED("RFID support turned off!\n");
 	#endif // !WITH_RFID
@@ -1,10 +1,21 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include "catcierge_timer.h"
+#include "catcierge_timer_wheel.h"
+#include "catcierge_clock.h"
 #include "minunit.h"
 #include "catcierge_test_helpers.h"
 
-char *run_tests()
+static double fake_now = 1000.0;
+
+static double fake_clock(void *user)
+{
+	return fake_now;
+}
+
+static char *run_compat_tests()
 {
 	catcierge_timer_t t;
 	double val;
@@ -16,7 +27,7 @@ char *run_tests()
 	catcierge_test_STATUS("Wait 5 seconds for timer...");
 	mu_assert("Expected timer to be active", catcierge_timer_isactive(&t));
 
-	sleep(5);
+	fake_now += 5.0;
 	val = catcierge_timer_get(&t);
 	catcierge_test_STATUS("Waited %f seconds", val);
 
@@ -31,14 +42,133 @@ char *run_tests()
 	return NULL;
 }
 
+typedef struct wheel_test_s
+{
+	int count;
+	double fired_at;
+} wheel_test_t;
+
+static void on_timer(catcierge_timer_wheel_t *w, catcierge_wheel_timer_t *t, void *user)
+{
+	wheel_test_t *wt = (wheel_test_t *)user;
+	wt->count++;
+	wt->fired_at = fake_now;
+}
+
+static char *run_wheel_tests()
+{
+	catcierge_timer_wheel_t w;
+	catcierge_wheel_timer_t a;
+	catcierge_wheel_timer_t b;
+	catcierge_wheel_timer_t c;
+	wheel_test_t at;
+	wheel_test_t bt;
+	wheel_test_t ct;
+	double start;
+
+	memset(&at, 0, sizeof(at));
+	memset(&bt, 0, sizeof(bt));
+	memset(&ct, 0, sizeof(ct));
+
+	catcierge_timer_wheel_init(&w);
+	catcierge_wheel_timer_init(&a, on_timer, &at);
+	catcierge_wheel_timer_init(&b, on_timer, &bt);
+	catcierge_wheel_timer_init(&c, on_timer, &ct);
+	start = fake_now;
+
+	mu_assert("Expected no deadline", catcierge_timer_wheel_next_deadline(&w) < 0.0);
+
+	catcierge_test_STATUS("Add timers at 0.5, 30 and 3600 seconds");
+	catcierge_timer_wheel_add(&w, &a, 0.5, 0.0);
+	catcierge_timer_wheel_add(&w, &b, 30.0, 0.0);
+	catcierge_timer_wheel_add(&w, &c, 3600.0, 0.0);
+
+	mu_assert("Expected next deadline 0.5",
+		fabs(catcierge_timer_wheel_next_deadline(&w) - 0.5) < 0.002);
+
+	fake_now = start + 0.499;
+	mu_assert("Expected nothing to fire", catcierge_timer_wheel_advance(&w) == 0);
+
+	fake_now = start + 0.5;
+	mu_assert("Expected a to fire", catcierge_timer_wheel_advance(&w) == 1);
+	mu_assert("Expected a to fire once", at.count == 1);
+	mu_assert("Expected a to not be pending", !catcierge_wheel_timer_pending(&a));
+
+	mu_assert("Expected next deadline 29.5",
+		fabs(catcierge_timer_wheel_next_deadline(&w) - 29.5) < 0.002);
+
+	// Sleep exactly until the next deadline, like the main loop does.
+	fake_now += catcierge_timer_wheel_next_deadline(&w);
+	mu_assert("Expected b to fire", catcierge_timer_wheel_advance(&w) == 1);
+	mu_assert("Expected b to fire on time", fabs(bt.fired_at - (start + 30.0)) < 0.002);
+
+	catcierge_test_STATUS("Cancel the 3600 second timer");
+	catcierge_timer_wheel_cancel(&w, &c);
+	mu_assert("Expected no deadline", catcierge_timer_wheel_next_deadline(&w) < 0.0);
+	fake_now = start + 4000.0;
+	mu_assert("Expected nothing to fire", catcierge_timer_wheel_advance(&w) == 0);
+
+	catcierge_test_STATUS("Repeating timer every 2 seconds");
+	start = fake_now;
+	catcierge_timer_wheel_add(&w, &a, 2.0, 2.0);
+	at.count = 0;
+
+	for (fake_now = start; fake_now < (start + 10.5); fake_now += 0.1)
+	{
+		catcierge_timer_wheel_advance(&w);
+	}
+
+	mu_assert("Expected 5 repeats", at.count == 5);
+	catcierge_timer_wheel_cancel(&w, &a);
+
+	catcierge_test_STATUS("Timer far beyond the wheel range");
+	start = fake_now;
+	ct.count = 0;
+	catcierge_timer_wheel_add(&w, &c, 30 * 24 * 3600.0, 0.0);
+
+	fake_now = start + 29 * 24 * 3600.0;
+	mu_assert("Expected nothing to fire", catcierge_timer_wheel_advance(&w) == 0);
+
+	fake_now = start + 30 * 24 * 3600.0;
+	mu_assert("Expected c to fire", catcierge_timer_wheel_advance(&w) == 1);
+	mu_assert("Expected c to fire once", ct.count == 1);
+
+	catcierge_test_STATUS("Deadline between two ticks");
+	start = w.start + floor(fake_now - w.start) + 1.0006;
+	fake_now = start;
+	at.count = 0;
+	catcierge_timer_wheel_add(&w, &a, 0.001, 0.0);
+
+	// The clock has passed the tick the deadline was added in.
+	fake_now = start + 0.0008;
+	mu_assert("Expected nothing to fire", catcierge_timer_wheel_advance(&w) == 0);
+
+	fake_now = start + 0.0015;
+	mu_assert("Expected a to fire", catcierge_timer_wheel_advance(&w) == 1);
+	mu_assert("Expected a to not fire early", at.fired_at >= (start + 0.001));
+
+	catcierge_timer_wheel_destroy(&w);
+
+	return NULL;
+}
+
 int TEST_catcierge_timer(int argc, char **argv)
 {
 	int ret = 0;
 	char *e = NULL;
 
-	CATCIERGE_RUN_TEST((e = run_tests()),
+	// Don't wait for real time to pass.
+	catcierge_clock_set_monotonic(fake_clock, NULL);
+
+	CATCIERGE_RUN_TEST((e = run_compat_tests()),
 		"TEST_catcierge_timer",
 		"", &ret);
-	
+
+	CATCIERGE_RUN_TEST((e = run_wheel_tests()),
+		"Timer wheel",
+		"Timer wheel", &ret);
+
+	catcierge_clock_set_monotonic(NULL, NULL);
+
 	return ret;
 }
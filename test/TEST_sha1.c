@@ -19,8 +19,10 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "sha1.h"
+#include "catcierge_clock.h"
 #include "minunit.h"
 #include "catcierge_test_helpers.h"
 
@@ -134,14 +136,197 @@ static char *run_tests()
     return 0;
 }
 
+/*
+ *  Frame sizes of the grayscale images that are hashed for the match IDs.
+ */
+static const struct
+{
+    const char *name;
+    unsigned width;
+    unsigned height;
+} frame_sizes[] =
+{
+    { "320x240", 320, 240 },
+    { "640x480", 640, 480 },
+    { "1280x720", 1280, 720 },
+    { "1920x1080", 1920, 1080 }
+};
+
+#define FRAME_COUNT (sizeof(frame_sizes) / sizeof(frame_sizes[0]))
+#define MAX_FRAME_SIZE (1920 * 1080)
+#define BENCHMARK_BYTES (16 * 1024 * 1024)
+
+static void hash(SHA1Context *sha, const unsigned char *data,
+                 unsigned length, unsigned chunk)
+{
+    unsigned n;
+
+    SHA1Reset(sha);
+
+    for (; length > 0; length -= n, data += n)
+    {
+        n = (chunk && (chunk < length)) ? chunk : length;
+        SHA1Input(sha, data, n);
+    }
+
+    SHA1Result(sha);
+}
+
+/*
+ *  Compares the current implementation with the scalar one, for
+ *  lengths around the block size and inputs split at odd places.
+ */
+static char *run_compare_tests(SHA1Implementation impl)
+{
+    SHA1Context sha;
+    SHA1Context ref;
+    unsigned char *data = NULL;
+    unsigned length;
+    unsigned i;
+    const unsigned chunks[] = { 0, 1, 7, 63, 64, 65, 1000 };
+    size_t c;
+
+    if (!(data = malloc(MAX_FRAME_SIZE)))
+    {
+        return "Out of memory";
+    }
+
+    for (i = 0; i < MAX_FRAME_SIZE; i++)
+    {
+        data[i] = (unsigned char)((i * 2654435761u) >> 24);
+    }
+
+    for (length = 0; length <= 300; length++)
+    {
+        SHA1SetImplementation(SHA1_IMPL_SCALAR);
+        hash(&ref, data, length, 0);
+        SHA1SetImplementation(impl);
+
+        for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+        {
+            hash(&sha, data, length, chunks[c]);
+
+            if (memcmp(sha.Message_Digest, ref.Message_Digest, sizeof(ref.Message_Digest)))
+            {
+                free(data);
+                return "Digest differs from the scalar implementation";
+            }
+        }
+    }
+
+    catcierge_test_STATUS("Lengths 0-300 match the scalar implementation");
+
+    for (i = 0; i < FRAME_COUNT; i++)
+    {
+        length = frame_sizes[i].width * frame_sizes[i].height;
+
+        SHA1SetImplementation(SHA1_IMPL_SCALAR);
+        hash(&ref, data, length, 0);
+        SHA1SetImplementation(impl);
+        hash(&sha, data, length, 4099);
+
+        if (memcmp(sha.Message_Digest, ref.Message_Digest, sizeof(ref.Message_Digest)))
+        {
+            free(data);
+            return "Frame digest differs from the scalar implementation";
+        }
+    }
+
+    catcierge_test_STATUS("Frames match the scalar implementation");
+
+    free(data);
+
+    return NULL;
+}
+
+/*
+ *  Prints the time it takes to hash each frame size.
+ */
+static char *run_benchmark(SHA1Implementation impl)
+{
+    SHA1Context sha;
+    unsigned char *data = NULL;
+    unsigned length;
+    unsigned i;
+    unsigned j;
+    unsigned count;
+    double start;
+    double elapsed;
+
+    if (!(data = calloc(1, MAX_FRAME_SIZE)))
+    {
+        return "Out of memory";
+    }
+
+    SHA1SetImplementation(impl);
+
+    for (i = 0; i < FRAME_COUNT; i++)
+    {
+        length = frame_sizes[i].width * frame_sizes[i].height;
+        count = BENCHMARK_BYTES / length;
+
+        start = catcierge_clock_monotonic();
+
+        for (j = 0; j < count; j++)
+        {
+            hash(&sha, data, length, 0);
+        }
+
+        elapsed = catcierge_clock_monotonic() - start;
+
+        catcierge_test_STATUS("%-7s %-10s %8.3f ms/frame %8.1f MB/s",
+            SHA1ImplementationName(impl), frame_sizes[i].name,
+            (elapsed * 1000.0) / count,
+            elapsed > 0.0 ? (((double)length * count) / (1024.0 * 1024.0)) / elapsed : 0.0);
+    }
+
+    free(data);
+
+    return NULL;
+}
+
 int TEST_sha1(int argc, char **argv)
 {
     int ret = 0;
     char *e = NULL;
+    SHA1Implementation impl;
+    SHA1Implementation impls[] =
+    {
+        SHA1_IMPL_SCALAR,
+        SHA1_IMPL_SHANI,
+        SHA1_IMPL_ARMV8
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+    {
+        impl = impls[i];
+
+        if (SHA1SetImplementation(impl))
+        {
+            catcierge_test_SKIPPED("SHA1 %s is not supported by this CPU\n",
+                SHA1ImplementationName(impl));
+            continue;
+        }
+
+        catcierge_test_STATUS("SHA1 implementation: %s", SHA1ImplementationName(impl));
+
+        CATCIERGE_RUN_TEST((e = run_tests()),
+            "SHA1 tests",
+            "SHA1 tests", &ret);    
+
+        CATCIERGE_RUN_TEST((e = run_compare_tests(impl)),
+            "SHA1 compared to scalar",
+            "SHA1 compared to scalar", &ret);
+
+        CATCIERGE_RUN_TEST((e = run_benchmark(impl)),
+            "SHA1 frame benchmark",
+            "SHA1 frame benchmark", &ret);
+    }
 
-    CATCIERGE_RUN_TEST((e = run_tests()),
-        "SHA1 tests",
-        "SHA1 tests", &ret);    
+    SHA1SetImplementation(SHA1_IMPL_AUTO);
+    catcierge_test_STATUS("Using SHA1 implementation: %s",
+        SHA1ImplementationName(SHA1GetImplementation()));
 
     return ret;
 }
@@ -10,6 +10,7 @@
 #include <io.h>
 #endif
 #include "catcierge_test_helpers.h"
+#include "catcierge_clock.h"
 
 static int verbose;
 static int log_on;
@@ -264,4 +265,18 @@ void *catcierge_test_realloc(void *ptr, size_t sz)
 	return realloc(ptr, sz);
 }
 
+void catcierge_test_virtual_clock_start()
+{
+	// Time only moves when the test advances it, so lockout timers and
+	// the spinner don't make the test wait for real time to pass. The wall
+	// clock starts at a fixed date so the timestamps in the output are the
+	// same on every run.
+	catcierge_clock_virtual_start(CATCIERGE_TEST_VIRTUAL_EPOCH);
+}
+
+void catcierge_test_virtual_clock_stop()
+{
+	catcierge_clock_virtual_stop();
+}
+
 
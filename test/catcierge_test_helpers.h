@@ -34,6 +34,13 @@ void *catcierge_test_malloc(size_t sz);
 void catcierge_test_set_realloc_fail_count(int count);
 void *catcierge_test_realloc(void *ptr, size_t sz);
 
+// Runs the FSM on a virtual clock that is moved forward with
+// catcierge_clock_virtual_advance. The wall clock starts at
+// CATCIERGE_TEST_VIRTUAL_EPOCH, the monotonic clock where it was.
+#define CATCIERGE_TEST_VIRTUAL_EPOCH 1500000000.0
+void catcierge_test_virtual_clock_start();
+void catcierge_test_virtual_clock_stop();
+
 #define CATCIERGE_RUN_TEST(err, headline, success, ret) \
 	do \
 	{ \
@@ -0,0 +1,45 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "catcierge_plugin.h"
+
+//
+// Plugin used by TEST_catcierge_plugins. Appends a line for each event
+// to the file given as the plugin argument.
+//
+
+static void handle(catcierge_plugin_t *p, const catcierge_plugin_event_t *ev)
+{
+	FILE *f = (FILE *)p->user;
+
+	fprintf(f, "%s %d %d %s\n", ev->name, (int)ev->match_count,
+		ev->match_group_success,
+		ev->match_group_description ? ev->match_group_description : "-");
+}
+
+static void destroy(catcierge_plugin_t *p)
+{
+	FILE *f = (FILE *)p->user;
+
+	fprintf(f, "destroy\n");
+	fclose(f);
+}
+
+int catcierge_plugin_init(catcierge_plugin_t *p)
+{
+	FILE *f = NULL;
+
+	if (p->api_version != CATCIERGE_PLUGIN_API_VERSION)
+		return -1;
+
+	if (!(f = fopen(p->arg, "w")))
+		return -1;
+
+	p->name = "test";
+	p->events = "match_done, match_group_done";
+	p->handle = handle;
+	p->destroy = destroy;
+	p->user = f;
+
+	return 0;
+}